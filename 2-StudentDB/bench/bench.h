@@ -0,0 +1,55 @@
+#ifndef __BENCH_H__
+    #define __BENCH_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+//shared helpers for the sdbsc benchmarks.  Each benchmark is a small
+//program linked against the database code (built with -DSDBSC_NO_MAIN)
+//that calls the sdbsc functions in-process.
+
+//monotonic clock in nanoseconds
+static inline long long bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//the database functions always work on DB_FILE in the current directory,
+//so benchmarks run inside a scratch directory to leave ./student.db alone
+static inline void bench_enter_scratch_dir(void)
+{
+    char tmpl[] = "/tmp/sdbsc-bench.XXXXXX";
+    if (mkdtemp(tmpl) == NULL || chdir(tmpl) == -1) {
+        perror("bench scratch dir");
+        exit(1);
+    }
+}
+
+//the database functions report every operation on stdout, so results are
+//written to a dup of the original stdout while stdout goes to /dev/null
+static inline FILE *bench_mute_stdout(void)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (saved == -1 || devnull == -1 || dup2(devnull, STDOUT_FILENO) == -1) {
+        perror("bench stdout");
+        exit(1);
+    }
+    close(devnull);
+    return fdopen(saved, "w");
+}
+
+//report one timed phase as total ms and per-op ns
+static inline void bench_report(FILE *out, const char *name, long long ns, long ops)
+{
+    fprintf(out, "  %-28s %10.2f ms %10.1f ns/op\n", name, ns / 1e6,
+            ops > 0 ? (double)ns / ops : 0.0);
+}
+
+#endif
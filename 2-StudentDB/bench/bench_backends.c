@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_backends
+ *
+ *  Compares the storage backends (sdb_backend.c), the fd one (lseek +
+ *  read/write), mmap and mem, on a fully populated database of MAX_STD_ID
+ *  students.  Each runs the same sequence of operations through the public
+ *  sdbsc functions: populate every id, look every id up in random order,
+ *  count, print and finally delete every id.  mem shows what the logic
+ *  costs without the I/O, its write back is timed on its own.
+ */
+
+//fixed seed so both backends see the same lookup order
+static void shuffle_ids(int *ids, int n)
+{
+    unsigned int seed = 12345;
+    for (int i = n - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        int j = (seed >> 8) % (i + 1);
+        int tmp = ids[i];
+        ids[i] = ids[j];
+        ids[j] = tmp;
+    }
+}
+
+static void run_backend(FILE *out, const char *name, int *order)
+{
+    student_t student;
+    long long t;
+    int n = MAX_STD_ID;
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0 || backend_select(name) != NO_ERROR || backend_attach(fd) != NO_ERROR) {
+        fprintf(out, "%s: could not open database\n", name);
+        exit(1);
+    }
+
+    fprintf(out, "%s backend, %d students\n", name, n);
+
+    t = bench_now_ns();
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++)
+        add_student(fd, id, "bench", "student", id % (MAX_STD_GPA + 1));
+    bench_report(out, "add_student (sequential)", bench_now_ns() - t, n);
+
+    t = bench_now_ns();
+    for (int i = 0; i < n; i++) {
+        if (get_student(fd, order[i], &student) != NO_ERROR) {
+            fprintf(out, "%s: student %d missing\n", name, order[i]);
+            exit(1);
+        }
+    }
+    bench_report(out, "get_student (random)", bench_now_ns() - t, n);
+
+    t = bench_now_ns();
+    count_db_records(fd);
+    bench_report(out, "count_db_records", bench_now_ns() - t, n);
+
+    t = bench_now_ns();
+    print_db(fd);
+    fflush(stdout);
+    bench_report(out, "print_db", bench_now_ns() - t, n);
+
+    t = bench_now_ns();
+    for (int i = 0; i < n; i++)
+        del_student(fd, order[i]);
+    bench_report(out, "del_student (random)", bench_now_ns() - t, n);
+
+    t = bench_now_ns();
+    backend_detach();
+    bench_report(out, "detach (write back)", bench_now_ns() - t, 1);
+
+    close(fd);
+    unlink(DB_FILE);
+}
+
+int main(void)
+{
+    int *order = malloc(MAX_STD_ID * sizeof(int));
+    if (order == NULL)
+        return 1;
+    for (int i = 0; i < MAX_STD_ID; i++)
+        order[i] = i + MIN_STD_ID;
+    shuffle_ids(order, MAX_STD_ID);
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    run_backend(out, "fd", order);
+    run_backend(out, "mmap", order);
+    run_backend(out, "mem", order);
+
+    fclose(out);
+    free(order);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_bufpool
+ *
+ *  Runs the access patterns of a long lived process, such as the server,
+ *  with and without the buffer pool (sdb_bufpool.c): a verify pass that
+ *  looks up every id in order, an update pass that deletes and re-adds
+ *  every id in order, and lookups at random ids.  Random ids touch far
+ *  more pages than the pool holds, which shows what a miss costs.
+ */
+
+#define BENCH_N     50000
+
+static void run_pool(FILE *out, const char *name, bool use_cache)
+{
+    student_t student;
+    long long t;
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0) {
+        fprintf(out, "%s: could not open database\n", name);
+        exit(1);
+    }
+    for (int id = MIN_STD_ID; id <= BENCH_N; id++)
+        add_student(fd, id, "bench", "student", id % (MAX_STD_GPA + 1));
+
+    if (use_cache && bufpool_attach(fd) != NO_ERROR) {
+        fprintf(out, "%s: could not attach the pool\n", name);
+        exit(1);
+    }
+    fprintf(out, "%s, %d students\n", name, BENCH_N);
+
+    t = bench_now_ns();
+    for (int id = MIN_STD_ID; id <= BENCH_N; id++) {
+        if (get_student(fd, id, &student) != NO_ERROR) {
+            fprintf(out, "%s: student %d missing\n", name, id);
+            exit(1);
+        }
+    }
+    bench_report(out, "get_student (in order)", bench_now_ns() - t, BENCH_N);
+
+    t = bench_now_ns();
+    for (int id = MIN_STD_ID; id <= BENCH_N; id++) {
+        del_student(fd, id);
+        add_student(fd, id, "bench", "updated", (id + 1) % (MAX_STD_GPA + 1));
+    }
+    bench_report(out, "del + add (in order)", bench_now_ns() - t, BENCH_N);
+
+    unsigned int seed = 12345;
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_N; i++) {
+        seed = seed * 1103515245 + 12345;
+        get_student(fd, MIN_STD_ID + (seed >> 8) % BENCH_N, &student);
+    }
+    bench_report(out, "get_student (random)", bench_now_ns() - t, BENCH_N);
+
+    t = bench_now_ns();
+    bufpool_detach();
+    bench_report(out, "write back", bench_now_ns() - t, 1);
+
+    close(fd);
+    unlink(DB_FILE);
+}
+
+int main(void)
+{
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    run_pool(out, "no pool", false);
+    run_pool(out, "buffer pool", true);
+
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_colgpa
+ *
+ *  GPA aggregates on a dense database of MAX_STD_ID students: the record
+ *  at a time ways (get_student() per id and the scan iterator) against -A
+ *  on the GPA column, and each SIMD kernel set on its own over an in
+ *  memory column so the kernels can be compared to memory bandwidth.
+ */
+
+#define BENCH_REPEAT    200     //kernel calls per measurement
+#define NWORDS          ((MAX_STD_ID + 1 + 63) / 64)
+
+static int32_t gpa[NWORDS * 64];
+static uint64_t live[NWORDS];
+
+static void bench_kernels(FILE *out, const simd_kernels_t *k)
+{
+    char name[64];
+    uint32_t hist[DB_HDR_HIST_BUCKETS];
+    volatile int64_t sink = 0;
+    double bytes = sizeof(gpa) + sizeof(live);
+    long long t;
+
+    fprintf(out, "%s kernels, column of %d slots\n", k->name, NWORDS * 64);
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++)
+        sink += k->gpa_sum(gpa, live, NWORDS);
+    t = bench_now_ns() - t;
+    snprintf(name, sizeof(name), "avg   %6.1f GB/s", bytes * BENCH_REPEAT / t);
+    bench_report(out, name, t, BENCH_REPEAT);
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++)
+        sink += k->gpa_min(gpa, live, NWORDS);
+    t = bench_now_ns() - t;
+    snprintf(name, sizeof(name), "min   %6.1f GB/s", bytes * BENCH_REPEAT / t);
+    bench_report(out, name, t, BENCH_REPEAT);
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++)
+        sink += k->gpa_max(gpa, live, NWORDS);
+    t = bench_now_ns() - t;
+    snprintf(name, sizeof(name), "max   %6.1f GB/s", bytes * BENCH_REPEAT / t);
+    bench_report(out, name, t, BENCH_REPEAT);
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++) {
+        k->gpa_hist(gpa, live, NWORDS, hist);
+        sink += hist[0];
+    }
+    t = bench_now_ns() - t;
+    snprintf(name, sizeof(name), "hist  %6.1f GB/s", bytes * BENCH_REPEAT / t);
+    bench_report(out, name, t, BENCH_REPEAT);
+}
+
+int main(void)
+{
+    student_t s;
+    db_scan_t *sc = malloc(sizeof(db_scan_t));
+    int64_t sum = 0;
+    long long t;
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0 || sc == NULL) {
+        fprintf(out, "could not open database\n");
+        return 1;
+    }
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++) {
+        int g = (id * 7919) % (MAX_STD_GPA + 1);
+        add_student(fd, id, "bench", "student", g);
+        gpa[id] = g;
+        live[id / 64] |= 1ULL << (id % 64);
+    }
+
+    fprintf(out, "gpa average, %d students\n", MAX_STD_ID);
+
+    t = bench_now_ns();
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++)
+        if (get_student(fd, id, &s) == NO_ERROR)
+            sum += s.gpa;
+    bench_report(out, "get_student per id", bench_now_ns() - t, 1);
+
+    t = bench_now_ns();
+    scan_open(sc, fd);
+    while (scan_next(sc, &s))
+        sum += s.gpa;
+    bench_report(out, "scan iterator", bench_now_ns() - t, 1);
+
+    rebuild_colgpa(fd);
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++)
+        print_aggregate(fd, "avg");
+    bench_report(out, "-A avg (map + kernel)", bench_now_ns() - t, BENCH_REPEAT);
+
+    const char *sets[] = {"scalar", "sse2", "avx2"};
+    for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+        const simd_kernels_t *k = simd_kernels_named(sets[i]);
+        if (k != NULL)
+            bench_kernels(out, k);
+    }
+
+    close(fd);
+    unlink(COL_GPA_FILE);
+    unlink(DB_FILE);
+    free(sc);
+    fclose(out);
+    return sum == 0;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_format
+ *
+ *  Dumping 100k rows to /dev/null.  First formatting alone, from memory:
+ *  printf() of STUDENT_PRINT_FMT_STRING, as print_db() used to, against
+ *  fmt_row() into the output buffer in every format.  Then -p end to end
+ *  on a dense database in each format, and plain write() of the same
+ *  bytes as the floor set by I/O.
+ */
+
+#define BENCH_ROWS      100000
+#define BENCH_REPEAT    5
+
+static student_t rows[BENCH_ROWS];
+
+int main(void)
+{
+    const char *formats[] = {"table", "csv", "tsv", "jsonl"};
+    char name[64];
+    out_buf_t o;
+    long long t;
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        rows[i].id = i + 1;
+        snprintf(rows[i].fname, sizeof(rows[i].fname), "first%d", i);
+        snprintf(rows[i].lname, sizeof(rows[i].lname), "last%d", i * 7);
+        rows[i].gpa = (i * 7919) % (MAX_STD_GPA + 1);
+    }
+
+    fprintf(out, "formatting %d rows from memory\n", BENCH_ROWS);
+
+    t = bench_now_ns();
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        for (int i = 0; i < BENCH_ROWS; i++)
+            printf(STUDENT_PRINT_FMT_STRING, rows[i].id, rows[i].fname,
+                   rows[i].lname, rows[i].gpa / 100.0);
+        fflush(stdout);
+    }
+    bench_report(out, "printf", bench_now_ns() - t, (long)BENCH_REPEAT * BENCH_ROWS);
+
+    for (int f = 0; f < 4; f++) {
+        t = bench_now_ns();
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            out_begin(&o);
+            for (int i = 0; i < BENCH_ROWS; i++)
+                out_row(&o, &rows[i], f);
+            out_flush(&o);
+        }
+        snprintf(name, sizeof(name), "fmt_row %s", formats[f]);
+        bench_report(out, name, bench_now_ns() - t, (long)BENCH_REPEAT * BENCH_ROWS);
+    }
+
+    // the same table bytes written with no formatting at all
+    char *table = malloc((size_t)BENCH_ROWS * FMT_ROW_MAX);
+    size_t len = 0;
+    for (int i = 0; table != NULL && i < BENCH_ROWS; i++)
+        len += fmt_row(table + len, &rows[i], FMT_TABLE);
+    t = bench_now_ns();
+    for (int r = 0; table != NULL && r < BENCH_REPEAT; r++) {
+        out_begin(&o);
+        out_bytes(&o, table, len);
+        out_flush(&o);
+    }
+    bench_report(out, "write() only", bench_now_ns() - t, (long)BENCH_REPEAT * BENCH_ROWS);
+    free(table);
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0) {
+        fprintf(out, "could not open database\n");
+        return 1;
+    }
+    for (int i = 0; i < MAX_STD_ID; i++)
+        add_student(fd, rows[i].id, rows[i].fname, rows[i].lname, rows[i].gpa);
+
+    fprintf(out, "-p of %d students\n", MAX_STD_ID);
+    for (int f = 0; f < 4; f++) {
+        t = bench_now_ns();
+        for (int r = 0; r < BENCH_REPEAT; r++)
+            print_db_fmt(fd, f);
+        snprintf(name, sizeof(name), "-p --format %s", formats[f]);
+        bench_report(out, name, bench_now_ns() - t, (long)BENCH_REPEAT * MAX_STD_ID);
+    }
+
+    close(fd);
+    unlink(DB_FILE);
+    fclose(out);
+    return 0;
+}
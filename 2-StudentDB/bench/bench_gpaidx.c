@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_gpaidx
+ *
+ *  GPA range (-g) and top-K (-t) queries through the GPA index against
+ *  the full scan they replace, on a dense database of MAX_STD_ID students.
+ *  Every query prints its result (to /dev/null) in both versions, so the
+ *  difference is the cost of finding the students.
+ */
+
+#define BENCH_REPEAT    20      //queries per measurement
+
+//the scan version of -g lo hi
+static int scan_range(int fd, int lo, int hi)
+{
+    static db_scan_t sc;
+    student_t s;
+    int n = 0;
+
+    scan_open(&sc, fd);
+    while (scan_next(&sc, &s)) {
+        if (s.gpa >= lo && s.gpa <= hi) {
+            printf(STUDENT_PRINT_FMT_STRING, s.id, s.fname, s.lname, s.gpa / 100.0);
+            n++;
+        }
+    }
+    return n;
+}
+
+static int cmp_gpa_desc(const void *a, const void *b)
+{
+    const student_t *sa = a, *sb = b;
+    if (sa->gpa != sb->gpa)
+        return sb->gpa - sa->gpa;
+    return sa->id - sb->id;
+}
+
+//the scan version of -t k: read everything, sort, print the first k
+static int scan_top(int fd, int k)
+{
+    static db_scan_t sc;
+    static student_t all[MAX_STD_ID];
+    int n = 0;
+
+    scan_open(&sc, fd);
+    while (scan_next(&sc, &all[n]))
+        n++;
+    qsort(all, n, sizeof(student_t), cmp_gpa_desc);
+
+    for (int i = 0; i < k && i < n; i++)
+        printf(STUDENT_PRINT_FMT_STRING, all[i].id, all[i].fname,
+               all[i].lname, all[i].gpa / 100.0);
+    return n < k ? n : k;
+}
+
+static void compare_range(FILE *out, int fd, int lo, int hi)
+{
+    char name[64];
+    long long t;
+    int rows = 0;
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++)
+        rows = scan_range(fd, lo, hi);
+    fflush(stdout);
+    snprintf(name, sizeof(name), "scan  -g %d %d", lo, hi);
+    bench_report(out, name, bench_now_ns() - t, BENCH_REPEAT);
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++)
+        find_by_gpa_range(fd, lo, hi);
+    fflush(stdout);
+    snprintf(name, sizeof(name), "index -g %d %d (%d rows)", lo, hi, rows);
+    bench_report(out, name, bench_now_ns() - t, BENCH_REPEAT);
+}
+
+static void compare_top(FILE *out, int fd, int k)
+{
+    char name[64];
+    long long t;
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++)
+        scan_top(fd, k);
+    fflush(stdout);
+    snprintf(name, sizeof(name), "scan  -t %d", k);
+    bench_report(out, name, bench_now_ns() - t, BENCH_REPEAT);
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_REPEAT; i++)
+        find_top_gpa(fd, k);
+    fflush(stdout);
+    snprintf(name, sizeof(name), "index -t %d", k);
+    bench_report(out, name, bench_now_ns() - t, BENCH_REPEAT);
+}
+
+int main(void)
+{
+    long long t;
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0) {
+        fprintf(out, "could not open database\n");
+        return 1;
+    }
+
+    // gpas spread over the whole range in a scrambled order
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++)
+        add_student(fd, id, "bench", "student", (id * 7919) % (MAX_STD_GPA + 1));
+
+    fprintf(out, "gpa index, %d students, %d queries per line\n",
+            MAX_STD_ID, BENCH_REPEAT);
+
+    t = bench_now_ns();
+    rebuild_gpa_idx(fd);
+    bench_report(out, "rebuild_gpa_idx", bench_now_ns() - t, 1);
+
+    compare_range(out, fd, 350, 350);
+    compare_range(out, fd, 350, 400);
+    compare_top(out, fd, 10);
+    compare_top(out, fd, 100);
+
+    // keeping the index current on every add and delete
+    t = bench_now_ns();
+    for (int id = MIN_STD_ID; id <= 10000; id++)
+        del_student(fd, id);
+    for (int id = MIN_STD_ID; id <= 10000; id++)
+        add_student(fd, id, "bench", "student", id % (MAX_STD_GPA + 1));
+    bench_report(out, "del+add with index", bench_now_ns() - t, 20000);
+
+    close(fd);
+    unlink(GPA_IDX_FILE);
+    unlink(DB_FILE);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/wait.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_locks
+ *
+ *  Several writer processes, each with its own open of the database, doing
+ *  add_student() / del_student() pairs at once.  With disjoint ids the
+ *  record locks never conflict and only the header lock is shared, with
+ *  overlapping ids every writer fights over the same 64 slots.  After each
+ *  run the header count is checked against a recount of the records, which
+ *  a lost update or a doubly added id would break.
+ */
+
+#define BENCH_OPS       4000    //add + delete pairs per writer
+#define HOT_IDS         64      //ids shared by the overlapping writers
+
+static void writer(int w, bool overlap)
+{
+    int fd = open_db(DB_FILE, false);
+    if (fd < 0)
+        _exit(1);
+
+    srand(w + 1);
+    for (int i = 0; i < BENCH_OPS; i++) {
+        int id = overlap ? MIN_STD_ID + rand() % HOT_IDS
+                         : MIN_STD_ID + w * BENCH_OPS + i;
+        add_student(fd, id, "bench", "student", 300);
+        del_student(fd, id);
+    }
+    close(fd);
+    _exit(0);
+}
+
+static int run(FILE *out, int writers, bool overlap)
+{
+    char name[64];
+    db_header_t h;
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0)
+        return 1;
+
+    long long t = bench_now_ns();
+    for (int w = 0; w < writers; w++)
+        if (fork() == 0)
+            writer(w, overlap);
+
+    int status, failed = 0;
+    while (wait(&status) > 0)
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    t = bench_now_ns() - t;
+
+    long ops = 2L * writers * BENCH_OPS;
+    snprintf(name, sizeof(name), "%d writers, %s", writers,
+             overlap ? "overlapping" : "disjoint");
+    bench_report(out, name, t, ops);
+
+    // the header must agree with the records
+    if (stats_load(fd, &h) != NO_ERROR || rebuild_stats(fd) != (int)h.count) {
+        fprintf(out, "  header count %u disagrees with the records\n", h.count);
+        failed = 1;
+    }
+    close(fd);
+    return failed;
+}
+
+int main(void)
+{
+    const int writers[] = {1, 2, 4, 8};
+    int failed = 0;
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    fprintf(out, "add + delete pairs by concurrent processes, per op\n");
+    for (size_t i = 0; i < sizeof(writers) / sizeof(writers[0]); i++) {
+        failed |= run(out, writers[i], false);
+        failed |= run(out, writers[i], true);
+    }
+
+    unlink(DB_FILE);
+    fclose(out);
+    return failed;
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_logstore
+ *
+ *  Random-order inserts into the direct layout (the fd backend, a 64 byte
+ *  write at id * 64 for each) against the log backend (sdb_logdb.c, an
+ *  append to the current segment).  Every id up to MAX_STD_ID is added in
+ *  random order, then a random half is updated and deleted again, so the
+ *  log sees superseded entries and its compactor runs.  Detaching merges
+ *  the log into the file in id order, and the fdatasync() that follows
+ *  shows what each layout leaves the disk to do: the writes above land in
+ *  the page cache, so the difference the disk sees is only in that last
+ *  line and in the extent count of the file.
+ */
+
+//fixed seed so both layouts see the same order
+static void shuffle_ids(int *ids, int n)
+{
+    unsigned int seed = 12345;
+    for (int i = n - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        int j = (seed >> 8) % (i + 1);
+        int tmp = ids[i];
+        ids[i] = ids[j];
+        ids[j] = tmp;
+    }
+}
+
+static void run_layout(FILE *out, const char *name, int *order)
+{
+    student_t student;
+    long long t;
+    int n = MAX_STD_ID;
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0 || backend_select(name) != NO_ERROR || backend_attach(fd) != NO_ERROR) {
+        fprintf(out, "%s: could not open database\n", name);
+        exit(1);
+    }
+
+    fprintf(out, "%s backend, %d students\n", name, n);
+
+    t = bench_now_ns();
+    for (int i = 0; i < n; i++)
+        add_student(fd, order[i], "bench", "student", order[i] % (MAX_STD_GPA + 1));
+    bench_report(out, "add_student (random)", bench_now_ns() - t, n);
+
+    t = bench_now_ns();
+    for (int i = 0; i < n; i++) {
+        if (get_student(fd, order[i], &student) != NO_ERROR) {
+            fprintf(out, "%s: student %d missing\n", name, order[i]);
+            exit(1);
+        }
+    }
+    bench_report(out, "get_student (random)", bench_now_ns() - t, n);
+
+    t = bench_now_ns();
+    for (int i = 0; i < n / 2; i++)
+        update_student(fd, order[i], NULL, NULL, (order[i] + 1) % (MAX_STD_GPA + 1));
+    bench_report(out, "update_student (random)", bench_now_ns() - t, n / 2);
+
+    t = bench_now_ns();
+    for (int i = 0; i < n / 2; i++)
+        del_student(fd, order[n - 1 - i]);
+    bench_report(out, "del_student (random)", bench_now_ns() - t, n / 2);
+
+    t = bench_now_ns();
+    backend_detach();
+    bench_report(out, "detach (merge into file)", bench_now_ns() - t, 1);
+
+    t = bench_now_ns();
+    fdatasync(fd);
+    bench_report(out, "fdatasync", bench_now_ns() - t, 1);
+
+    if (get_student(fd, order[0], &student) != NO_ERROR ||
+        student.gpa != (order[0] + 1) % (MAX_STD_GPA + 1)) {
+        fprintf(out, "%s: student %d not updated\n", name, order[0]);
+        exit(1);
+    }
+
+    close(fd);
+    unlink(DB_FILE);
+}
+
+int main(void)
+{
+    int *order = malloc(MAX_STD_ID * sizeof(int));
+    if (order == NULL)
+        return 1;
+    for (int i = 0; i < MAX_STD_ID; i++)
+        order[i] = i + MIN_STD_ID;
+    shuffle_ids(order, MAX_STD_ID);
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    run_layout(out, "fd", order);
+    run_layout(out, "log", order);
+
+    fclose(out);
+    free(order);
+    return 0;
+}
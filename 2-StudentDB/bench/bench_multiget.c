@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_multiget
+ *
+ *  Looks up BENCH_LOOKUPS ids of a BENCH_N student database, first one
+ *  get_student() call at a time and then as one batch of find_students()
+ *  (sdb_multiget.c), with io_uring and with the pread thread pool.  The ids
+ *  come once in id order and once in random order, where the batch can no
+ *  longer lean on the records of one request sitting next to each other.
+ *  The page cache is warm, so this measures the syscalls saved rather than
+ *  disk seeks.
+ */
+
+#define BENCH_N         MAX_STD_ID
+#define BENCH_LOOKUPS   20000
+
+static void run_lookups(FILE *out, int fd, const char *order, const int *ids)
+{
+    student_t student;
+    long long t;
+    char name[64];
+
+    fprintf(out, "%s ids\n", order);
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        if (get_student(fd, ids[i], &student) != NO_ERROR) {
+            fprintf(out, "student %d missing\n", ids[i]);
+            exit(1);
+        }
+    }
+    bench_report(out, "get_student loop", bench_now_ns() - t, BENCH_LOOKUPS);
+
+    static const struct { int io; const char *name; } modes[] = {
+        {MULTI_IO_URING, "io_uring"},
+        {MULTI_IO_PREAD, "pread"},
+    };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        t = bench_now_ns();
+        int found = find_students(fd, ids, BENCH_LOOKUPS, modes[m].io);
+        fflush(stdout);
+        snprintf(name, sizeof(name), "find_students (%s)", modes[m].name);
+        if (found != BENCH_LOOKUPS) {
+            fprintf(out, "  %-28s failed\n", name);
+            continue;
+        }
+        bench_report(out, name, bench_now_ns() - t, BENCH_LOOKUPS);
+    }
+}
+
+int main(void)
+{
+    int *ids = malloc(BENCH_LOOKUPS * sizeof(int));
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0 || ids == NULL) {
+        fprintf(out, "could not open database\n");
+        return 1;
+    }
+    for (int id = MIN_STD_ID; id <= BENCH_N; id++)
+        add_student(fd, id, "bench", "student", id % (MAX_STD_GPA + 1));
+
+    for (int i = 0; i < BENCH_LOOKUPS; i++)
+        ids[i] = MIN_STD_ID + (int)((long long)i * BENCH_N / BENCH_LOOKUPS);
+    run_lookups(out, fd, "sorted", ids);
+
+    unsigned int seed = 12345;
+    for (int i = BENCH_LOOKUPS - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        int j = (seed >> 8) % (i + 1);
+        int tmp = ids[i];
+        ids[i] = ids[j];
+        ids[j] = tmp;
+    }
+    run_lookups(out, fd, "random", ids);
+
+    close(fd);
+    unlink(DB_FILE);
+    free(ids);
+    fclose(out);
+    return 0;
+}
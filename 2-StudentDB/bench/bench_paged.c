@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_paged
+ *
+ *  Compares the direct file format against the paged one (sdb_paged.c).
+ *  Each run adds BENCH_N students with random ids, looks them all up in
+ *  another random order, prints them with a full scan and reports the
+ *  file size next to the disk space actually used.  The direct and paged
+ *  runs draw ids up to MAX_STD_ID, the last run spreads them over the
+ *  whole 31 bit id space that only the paged format can hold.
+ */
+
+#define BENCH_N     20000
+
+//fixed seed so every run sees the same ids
+static void random_ids(int *ids, int n, int max_id)
+{
+    unsigned long long seed = 12345;
+    for (int i = 0; i < n; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        ids[i] = MIN_STD_ID + (int)((seed >> 33) % (unsigned)max_id);
+    }
+}
+
+static void run_format(FILE *out, const char *name, bool paged, int max_id)
+{
+    student_t student;
+    struct stat st;
+    long long t;
+    int *ids = malloc(BENCH_N * sizeof(int));
+    int n = 0;
+
+    int fd = open_db(DB_FILE, true);
+    if (fd >= 0 && paged)
+        fd = convert_db(fd, DB_HDR_VERSION_PAGED);
+    if (fd < 0 || ids == NULL) {
+        fprintf(out, "%s: could not open database\n", name);
+        exit(1);
+    }
+    random_ids(ids, BENCH_N, max_id);
+
+    fprintf(out, "%s format, %d random ids up to %d\n", name, BENCH_N, max_id);
+
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_N; i++) {
+        if (add_student(fd, ids[i], "bench", "student", ids[i] % (MAX_STD_GPA + 1)) == NO_ERROR)
+            n++;
+    }
+    bench_report(out, "add_student (random)", bench_now_ns() - t, BENCH_N);
+
+    // look the ids up in a different order than they were added
+    for (int i = 0; i < BENCH_N; i++) {
+        int j = (int)(((long long)i * 7919) % BENCH_N);
+        int tmp = ids[i];
+        ids[i] = ids[j];
+        ids[j] = tmp;
+    }
+    t = bench_now_ns();
+    for (int i = 0; i < BENCH_N; i++) {
+        if (get_student(fd, ids[i], &student) != NO_ERROR) {
+            fprintf(out, "%s: student %d missing\n", name, ids[i]);
+            exit(1);
+        }
+    }
+    bench_report(out, "get_student (random)", bench_now_ns() - t, BENCH_N);
+
+    t = bench_now_ns();
+    print_db(fd);
+    fflush(stdout);
+    bench_report(out, "print_db", bench_now_ns() - t, n);
+
+    if (fstat(fd, &st) == 0)
+        fprintf(out, "  %-28s %12lld bytes, %lld on disk\n", "file size",
+                (long long)st.st_size, (long long)st.st_blocks * 512);
+
+    close(fd);
+    unlink(DB_FILE);
+    free(ids);
+}
+
+int main(void)
+{
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    run_format(out, "direct", false, MAX_STD_ID);
+    run_format(out, "paged", true, MAX_STD_ID);
+    run_format(out, "paged", true, MAX_PAGED_STD_ID);
+
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_parprint
+ *
+ *  -p on a dense database of MAX_STD_ID students, printed to /dev/null:
+ *  print_db() against print_db_parallel() with a growing number of worker
+ *  threads.  The file is read once first so every run finds it in the page
+ *  cache, the figures are the cost of reading and formatting the rows.
+ */
+
+#define BENCH_REPEAT    5       //prints per measurement
+
+int main(void)
+{
+    const int threads[] = {1, 2, 4, 8};
+    char name[64];
+    long long t;
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0) {
+        fprintf(out, "could not open database\n");
+        return 1;
+    }
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++)
+        add_student(fd, id, "bench", "student", (id * 7919) % (MAX_STD_GPA + 1));
+
+    fprintf(out, "print of %d students, %ld online cpu(s)\n", MAX_STD_ID,
+            sysconf(_SC_NPROCESSORS_ONLN));
+    print_db(fd);
+    fflush(stdout);
+
+    t = bench_now_ns();
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        print_db(fd);
+        fflush(stdout);
+    }
+    bench_report(out, "print_db", bench_now_ns() - t, (long)BENCH_REPEAT * MAX_STD_ID);
+
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        t = bench_now_ns();
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            print_db_parallel(fd, threads[i], FMT_TABLE);
+            fflush(stdout);
+        }
+        snprintf(name, sizeof(name), "--threads %d", threads[i]);
+        bench_report(out, name, bench_now_ns() - t, (long)BENCH_REPEAT * MAX_STD_ID);
+    }
+
+    close(fd);
+    unlink(DB_FILE);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_query
+ *
+ *  The -q predicates (sdb_query.c) on a database of MAX_STD_ID students.
+ *  A filtered count and print are timed against the full print, which is
+ *  what filtering the text output downstream has to start from, and an id
+ *  range against the same range tested without narrowing the scan.
+ */
+
+static void bench_query(FILE *out, const char *name, int fd, const char *text,
+                        bool count, bool narrow)
+{
+    sdb_query_t q;
+    const char *err_at;
+
+    if (query_compile(text, &q, &err_at) != NO_ERROR) {
+        fprintf(out, "bad query %s\n", text);
+        exit(1);
+    }
+    if (!narrow) {
+        q.id_lo = MIN_STD_ID;
+        q.id_hi = MAX_STD_ID;
+    }
+
+    long long t = bench_now_ns();
+    if (count)
+        count_db_where(fd, &q);
+    else
+        print_db_where(fd, FMT_CSV, &q);
+    fflush(stdout);
+    bench_report(out, name, bench_now_ns() - t, MAX_STD_ID);
+}
+
+int main(void)
+{
+    static const char *last[] = {"Smith", "Jones", "Brown", "Adams", "Moore",
+                                 "Young", "Clark", "Lewis", "Hall"};
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0)
+        return 1;
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++)
+        add_student(fd, id, "bench", (char *)last[id % 9], (id * 37) % (MAX_STD_GPA + 1));
+
+    fprintf(out, "queries over %d students\n", MAX_STD_ID);
+    long long t = bench_now_ns();
+    print_db_fmt(fd, FMT_CSV);
+    fflush(stdout);
+    bench_report(out, "full print (csv)", bench_now_ns() - t, MAX_STD_ID);
+
+    bench_query(out, "gpa>=350 and lname^=Sm, count", fd,
+                "gpa>=350 and lname^=Sm", true, true);
+    bench_query(out, "gpa>=350 and lname^=Sm, print", fd,
+                "gpa>=350 and lname^=Sm", false, true);
+    bench_query(out, "id=50000..50999, scan all", fd, "id=50000..50999", true, false);
+    bench_query(out, "id=50000..50999, narrowed", fd, "id=50000..50999", true, true);
+
+    close(fd);
+    unlink(DB_FILE);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_scan
+ *
+ *  The empty slot test at the heart of every full table scan.  First the
+ *  live_slots kernels against the memcmp() per record loop they replaced,
+ *  on one scan batch at several densities of live records, then a whole
+ *  scan of a database file whose records are mostly deleted (allocated,
+ *  so the extents don't help) through the scan iterator.
+ */
+
+#define BENCH_REPEAT    20000   //batches per kernel measurement
+
+static student_t batch[SCAN_BUFF_RECS];
+static uint64_t bits[SCAN_BUFF_RECS / 64];
+
+//the loop the scan used to run
+static void live_slots_memcmp(const student_t *recs, int n, uint64_t *out)
+{
+    memset(out, 0, (n + 63) / 64 * sizeof(uint64_t));
+    for (int i = 0; i < n; i++)
+        if (memcmp(&recs[i], &EMPTY_STUDENT_RECORD, sizeof(student_t)) != 0)
+            out[i / 64] |= 1ULL << (i % 64);
+}
+
+static void fill_batch(int pct_live)
+{
+    memset(batch, 0, sizeof(batch));
+    for (int i = 0; i < SCAN_BUFF_RECS; i++) {
+        if ((i * 37 % 100) < pct_live) {
+            batch[i].id = i + 1;
+            // a non-zero byte late in the record is the memcmp worst case
+            batch[i].gpa = 300;
+        }
+    }
+}
+
+static void time_kernel(FILE *out, const char *name,
+                        void (*fn)(const student_t *, int, uint64_t *))
+{
+    volatile uint64_t sink = 0;
+    long long t = bench_now_ns();
+    for (int r = 0; r < BENCH_REPEAT; r++) {
+        fn(batch, SCAN_BUFF_RECS, bits);
+        sink += bits[r % (SCAN_BUFF_RECS / 64)];
+    }
+    bench_report(out, name, bench_now_ns() - t, (long)BENCH_REPEAT * SCAN_BUFF_RECS);
+}
+
+int main(void)
+{
+    const int densities[] = {0, 1, 50, 100};
+    const char *sets[] = {"scalar", "sse2", "avx2"};
+    student_t s;
+    long long t;
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+        fill_batch(densities[d]);
+        fprintf(out, "live_slots, %d%% live, per record\n", densities[d]);
+        time_kernel(out, "memcmp", live_slots_memcmp);
+        for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+            const simd_kernels_t *k = simd_kernels_named(sets[i]);
+            if (k != NULL)
+                time_kernel(out, k->name, k->live_slots);
+        }
+    }
+
+    // a full file where 1 record in 100 is still a student
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0) {
+        fprintf(out, "could not open database\n");
+        return 1;
+    }
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++)
+        add_student(fd, id, "bench", "student", 300);
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++)
+        if (id % 100 != 0)
+            del_student(fd, id);
+
+    db_scan_t *sc = malloc(sizeof(db_scan_t));
+    int found = 0;
+    fprintf(out, "scan of %d slots, 1%% live, kernel %s\n", MAX_STD_ID,
+            simd_kernels()->name);
+    t = bench_now_ns();
+    for (int r = 0; r < 10; r++) {
+        scan_open(sc, fd);
+        while (scan_next(sc, &s))
+            found++;
+    }
+    bench_report(out, "scan iterator", bench_now_ns() - t, 10L * MAX_STD_ID);
+
+    close(fd);
+    unlink(DB_FILE);
+    free(sc);
+    fclose(out);
+    return found == 0;
+}
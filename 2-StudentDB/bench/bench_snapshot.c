@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_snapshot
+ *
+ *  Backs up a sparse database of BENCH_N students, in runs spread over the
+ *  whole id range, three ways: a naive copy that read()s and write()s every byte
+ *  of the file, holes included, --snapshot to a file (a reflink, or the
+ *  data extents with copy_file_range()) and --snapshot as a stream, then
+ *  restores the image and the stream.  Each line reports the time and the
+ *  disk space the copy takes.
+ */
+
+#define BENCH_N         20000
+#define BENCH_RUN       500         //students with consecutive ids
+#define BENCH_GAP       2500        //the runs start this many ids apart
+#define BENCH_COPY_BUFF (256 * 1024)
+#define SNAP_IMAGE      "bench.snap"
+#define SNAP_STREAM     "bench.stream"
+
+static void report_size(FILE *out, const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) == 0)
+        fprintf(out, "  %-28s %12lld bytes, %lld on disk\n", path,
+                (long long)st.st_size, (long long)st.st_blocks * 512);
+}
+
+//what a backup with read() and write() costs, the holes come out as zeros
+static void naive_copy(const char *src, const char *dst)
+{
+    char *buf = malloc(BENCH_COPY_BUFF);
+    int in = open(src, O_RDONLY);
+    int outf = open(dst, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    ssize_t n;
+
+    while (buf != NULL && in >= 0 && outf >= 0 && (n = read(in, buf, BENCH_COPY_BUFF)) > 0) {
+        if (write(outf, buf, n) != n)
+            break;
+    }
+    close(in);
+    close(outf);
+    free(buf);
+}
+
+int main(void)
+{
+    long long t;
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0) {
+        fprintf(out, "could not open database\n");
+        return 1;
+    }
+    for (int i = 0; i < BENCH_N; i++) {
+        int id = MIN_STD_ID + (i / BENCH_RUN) * BENCH_GAP + i % BENCH_RUN;
+        add_student(fd, id, "bench", "student", id % (MAX_STD_GPA + 1));
+    }
+    fprintf(out, "%d students in runs of %d, %d ids apart\n", BENCH_N, BENCH_RUN, BENCH_GAP);
+    report_size(out, DB_FILE);
+
+    t = bench_now_ns();
+    naive_copy(DB_FILE, "naive.copy");
+    bench_report(out, "read/write copy", bench_now_ns() - t, 1);
+    report_size(out, "naive.copy");
+
+    t = bench_now_ns();
+    if (snapshot_db(fd, SNAP_IMAGE) != NO_ERROR) {
+        fprintf(out, "snapshot failed\n");
+        return 1;
+    }
+    bench_report(out, "snapshot (image)", bench_now_ns() - t, 1);
+    report_size(out, SNAP_IMAGE);
+
+    // the stream goes to stdout, point it at a file for the run
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int sfd = open(SNAP_STREAM, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (saved == -1 || sfd == -1 || dup2(sfd, STDOUT_FILENO) == -1) {
+        fprintf(out, "could not redirect stdout\n");
+        return 1;
+    }
+    close(sfd);
+    t = bench_now_ns();
+    int rc = snapshot_db(fd, "-");
+    long long ns = bench_now_ns() - t;
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    if (rc != NO_ERROR) {
+        fprintf(out, "stream snapshot failed\n");
+        return 1;
+    }
+    bench_report(out, "snapshot (stream)", ns, 1);
+    report_size(out, SNAP_STREAM);
+
+    t = bench_now_ns();
+    fd = restore_db(fd, SNAP_IMAGE);
+    bench_report(out, "restore (image)", bench_now_ns() - t, 1);
+
+    t = bench_now_ns();
+    if (fd >= 0)
+        fd = restore_db(fd, SNAP_STREAM);
+    bench_report(out, "restore (stream)", bench_now_ns() - t, 1);
+    if (fd < 0 || count_db_records(fd) != BENCH_N) {
+        fprintf(out, "restore failed\n");
+        return 1;
+    }
+
+    close(fd);
+    unlink(DB_FILE);
+    unlink(SNAP_IMAGE);
+    unlink(SNAP_STREAM);
+    unlink("naive.copy");
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_sort
+ *
+ *  The sorted print (sdb_sort.c) on a database of MAX_STD_ID students
+ *  against the plain print in id order.  Each key is sorted once within
+ *  the default memory budget and once with a 1 MB budget, which spills
+ *  sorted runs to temporary files and merges them.
+ */
+
+#define SPILL_BUDGET    "1048576"
+
+static void bench_print(FILE *out, const char *name, int fd, int sort)
+{
+    long long t = bench_now_ns();
+    if (sort < 0)
+        print_db_fmt(fd, FMT_CSV);
+    else
+        print_db_sorted(fd, FMT_CSV, sort, NULL);
+    fflush(stdout);
+    bench_report(out, name, bench_now_ns() - t, MAX_STD_ID);
+}
+
+int main(void)
+{
+    static const char *first[] = {"Ann", "Bob", "Cid", "Dee", "Eve", "Fay", "Gus"};
+    static const char *last[] = {"Smith", "Jones", "Brown", "Adams", "Moore",
+                                 "Young", "Clark", "Lewis", "Hall"};
+    char lname[32];
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0)
+        return 1;
+    for (int id = MIN_STD_ID; id <= MAX_STD_ID; id++) {
+        snprintf(lname, sizeof(lname), "%s%d", last[id % 9], (id * 7919) % 1000);
+        add_student(fd, id, (char *)first[id % 7], lname, (id * 37) % (MAX_STD_GPA + 1));
+    }
+
+    fprintf(out, "print of %d students as csv\n", MAX_STD_ID);
+    bench_print(out, "id order (print_db_fmt)", fd, -1);
+    bench_print(out, "--sort lname", fd, SORT_LNAME);
+    bench_print(out, "--sort gpa:desc", fd, SORT_GPA | SORT_DESC);
+
+    setenv(SDB_SORT_MEM_ENV, SPILL_BUDGET, 1);
+    bench_print(out, "--sort lname, 1 MB spilled", fd, SORT_LNAME);
+    bench_print(out, "--sort gpa:desc, 1 MB spilled", fd, SORT_GPA | SORT_DESC);
+
+    close(fd);
+    unlink(DB_FILE);
+    fclose(out);
+    return 0;
+}
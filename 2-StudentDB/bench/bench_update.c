@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_update
+ *
+ *  A nightly GPA recalculation three ways: a delete and an add per
+ *  student, as was needed before -u, update_student() per student, which
+ *  writes the 4 GPA bytes in place, and one bulk_update() pass over a file
+ *  of "id,,,gpa" rows with the database locked once.
+ */
+
+#define BENCH_N     50000
+#define BENCH_ROWS  "bench_update.csv"
+
+static int fill_db(void)
+{
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0) {
+        fprintf(stderr, "could not open database\n");
+        exit(1);
+    }
+    for (int id = MIN_STD_ID; id <= BENCH_N; id++)
+        add_student(fd, id, "bench", "student", id % (MAX_STD_GPA + 1));
+    return fd;
+}
+
+static void check_gpas(FILE *out, int fd, int shift, const char *name)
+{
+    student_t student;
+
+    for (int id = MIN_STD_ID; id <= BENCH_N; id++) {
+        if (get_student(fd, id, &student) != NO_ERROR ||
+            student.gpa != (id + shift) % (MAX_STD_GPA + 1)) {
+            fprintf(out, "%s: student %d not updated\n", name, id);
+            exit(1);
+        }
+    }
+}
+
+int main(void)
+{
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+    long long t;
+    int fd;
+
+    fprintf(out, "GPA recalculation, %d students\n", BENCH_N);
+
+    fd = fill_db();
+    t = bench_now_ns();
+    for (int id = MIN_STD_ID; id <= BENCH_N; id++) {
+        del_student(fd, id);
+        add_student(fd, id, "bench", "student", (id + 1) % (MAX_STD_GPA + 1));
+    }
+    bench_report(out, "del + add", bench_now_ns() - t, BENCH_N);
+    check_gpas(out, fd, 1, "del + add");
+    close(fd);
+
+    fd = fill_db();
+    t = bench_now_ns();
+    for (int id = MIN_STD_ID; id <= BENCH_N; id++)
+        update_student(fd, id, NULL, NULL, (id + 1) % (MAX_STD_GPA + 1));
+    bench_report(out, "update_student", bench_now_ns() - t, BENCH_N);
+    check_gpas(out, fd, 1, "update_student");
+
+    FILE *rows = fopen(BENCH_ROWS, "w");
+    if (rows == NULL) {
+        fprintf(out, "could not write %s\n", BENCH_ROWS);
+        exit(1);
+    }
+    for (int id = MIN_STD_ID; id <= BENCH_N; id++)
+        fprintf(rows, "%d,,,%d\n", id, (id + 2) % (MAX_STD_GPA + 1));
+    fclose(rows);
+
+    t = bench_now_ns();
+    if (bulk_update(fd, BENCH_ROWS) != BENCH_N) {
+        fprintf(out, "bulk_update: not every row applied\n");
+        exit(1);
+    }
+    bench_report(out, "bulk_update (one pass)", bench_now_ns() - t, BENCH_N);
+    check_gpas(out, fd, 2, "bulk_update");
+
+    close(fd);
+    unlink(BENCH_ROWS);
+    unlink(DB_FILE);
+    fclose(out);
+    return 0;
+}
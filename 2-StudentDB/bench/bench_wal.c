@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_wal
+ *
+ *  add_student() throughput under each durability level of the write-ahead
+ *  log.  batched is run with a wal_commit() every 1, 16 and 256 adds,
+ *  standing in for server rounds that answer that many clients at once,
+ *  which shows the fdatasync() being shared.  Each run ends with a
+ *  checkpoint, so all of the data is on disk by the time the clock stops.
+ */
+
+#define BENCH_FAST_OPS  20000   //adds for the levels that do not sync per add
+#define BENCH_SYNC_OPS  1000    //adds for the levels that do
+
+static void run(FILE *out, const char *label, int level, int group, int ops)
+{
+    char name[64];
+
+    unlink(WAL_FILE);
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0 || (level >= 0 && wal_open(level) != NO_ERROR)) {
+        fprintf(out, "could not open database\n");
+        exit(1);
+    }
+
+    long long t = bench_now_ns();
+    for (int i = 0; i < ops; i++) {
+        add_student(fd, MIN_STD_ID + i, "bench", "student", 300);
+        if (group > 0 && (i + 1) % group == 0)
+            wal_commit();
+    }
+    wal_commit();
+    if (level >= 0)
+        wal_checkpoint(fd);
+    else
+        fdatasync(fd);
+    t = bench_now_ns() - t;
+
+    snprintf(name, sizeof(name), "%-20s %8.0f ops/s", label, ops / (t / 1e9));
+    bench_report(out, name, t, ops);
+
+    wal_close(fd);
+    close(fd);
+}
+
+int main(void)
+{
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    fprintf(out, "add_student by write-ahead log durability\n");
+    run(out, "no log", -1, 0, BENCH_FAST_OPS);
+    run(out, "--wal none", WAL_NONE, 0, BENCH_FAST_OPS);
+    run(out, "--wal batched x256", WAL_BATCHED, 256, BENCH_FAST_OPS);
+    run(out, "--wal batched x16", WAL_BATCHED, 16, BENCH_FAST_OPS);
+    run(out, "--wal batched x1", WAL_BATCHED, 1, BENCH_SYNC_OPS);
+    run(out, "--wal per-op", WAL_PER_OP, 0, BENCH_SYNC_OPS);
+
+    unlink(WAL_FILE);
+    unlink(DB_FILE);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "db.h"
+#include "sdbsc.h"
+#include "bench.h"
+
+/*
+ *  bench_workload
+ *
+ *  A load generator for regression tracking.  Each workload fills a fresh
+ *  database to a density (the fraction of the id range holding a
+ *  student), then runs a number of operations drawn from a mix of adds,
+ *  gets, deletes and scans (print_db()), each on an id drawn from a
+ *  uniform, zipfian or sequential distribution.  Every operation is timed,
+ *  and the results go out as one JSON document: ops/sec and the p50, p99
+ *  and p999 latency per operation type, and the file size next to the
+ *  disk space actually allocated.  Everything is derived from the seed,
+ *  so two runs with the same options do the same work.
+ *
+ *  Without arguments (make bench) a fixed set of workloads runs.  One
+ *  workload can be described on the command line instead:
+ *
+ *    bench_workload [--dist uniform|zipf|seq] [--theta T]
+ *                   [--mix add:get:del:scan] [--density D] [--ids N]
+ *                   [--ops N] [--seed S] [--name NAME]
+ */
+
+#define WL_NTYPES   4
+enum { OP_ADD, OP_GET, OP_DEL, OP_SCAN };
+static const char *op_names[WL_NTYPES] = {"add", "get", "del", "scan"};
+
+enum { DIST_UNIFORM, DIST_ZIPF, DIST_SEQ };
+static const char *dist_names[] = {"uniform", "zipf", "seq"};
+
+typedef struct workload {
+    const char *name;
+    int dist;                       //DIST_*
+    double theta;                   //zipf skew, 0.99 is the YCSB default
+    int mix[WL_NTYPES];             //weights of the operation types
+    double density;                 //fraction of the ids added up front
+    int ids;                        //ids drawn from 1 .. ids
+    int ops;
+    uint64_t seed;
+} workload_t;
+
+static const workload_t default_workloads[] = {
+    {"read-mostly-uniform", DIST_UNIFORM, 0.99, {5, 90, 5, 0},  0.5,  MAX_STD_ID, 200000, 1},
+    {"read-mostly-zipf",    DIST_ZIPF,    0.99, {5, 90, 5, 0},  0.5,  MAX_STD_ID, 200000, 1},
+    {"write-heavy-seq",     DIST_SEQ,     0.99, {50, 20, 30, 0}, 0.1, MAX_STD_ID, 200000, 1},
+    {"mixed-sparse-zipf",   DIST_ZIPF,    0.99, {30, 60, 10, 0}, 0.02, MAX_STD_ID, 200000, 1},
+    {"scan-heavy",          DIST_UNIFORM, 0.99, {20, 20, 10, 1}, 0.2, MAX_STD_ID, 20000,  1},
+};
+
+//splitmix64, small and reproducible on every platform
+static uint64_t next_rand(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double next_unit(uint64_t *state)
+{
+    return (next_rand(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+typedef struct id_gen {
+    int dist;
+    int ids;
+    int seq;                        //next id of the sequential distribution
+    double *cdf;                    //zipf: cumulative probability of rank i
+} id_gen_t;
+
+static int gen_init(id_gen_t *g, const workload_t *w)
+{
+    g->dist = w->dist;
+    g->ids = w->ids;
+    g->seq = 0;
+    g->cdf = NULL;
+    if (w->dist != DIST_ZIPF)
+        return 0;
+
+    g->cdf = malloc(w->ids * sizeof(double));
+    if (g->cdf == NULL)
+        return -1;
+    double sum = 0;
+    for (int i = 0; i < w->ids; i++) {
+        sum += 1.0 / pow(i + 1, w->theta);
+        g->cdf[i] = sum;
+    }
+    for (int i = 0; i < w->ids; i++)
+        g->cdf[i] /= sum;
+    return 0;
+}
+
+//the next id, zipf ranks are scattered over the id range so the hot ids
+//are not all neighbours in the file
+static int gen_next(id_gen_t *g, uint64_t *state)
+{
+    if (g->dist == DIST_SEQ) {
+        g->seq = g->seq % g->ids + 1;
+        return g->seq;
+    }
+    if (g->dist == DIST_UNIFORM)
+        return MIN_STD_ID + (int)(next_rand(state) % (uint64_t)g->ids);
+
+    double u = next_unit(state);
+    int lo = 0, hi = g->ids - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (g->cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return MIN_STD_ID + (int)(((uint64_t)lo * 2654435761u) % (uint64_t)g->ids);
+}
+
+typedef struct op_stats {
+    long long *ns;                  //latency of every operation of the type
+    int n;
+    int ok;                         //operations that returned NO_ERROR
+    long long total_ns;
+} op_stats_t;
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+//nearest rank percentile of sorted latencies
+static long long percentile(const long long *ns, int n, double p)
+{
+    if (n == 0)
+        return 0;
+    int rank = (int)ceil(p * n);
+    return ns[rank > 0 ? rank - 1 : 0];
+}
+
+static void run_workload(FILE *out, const workload_t *w, bool first)
+{
+    op_stats_t st[WL_NTYPES] = {0};
+    student_t student;
+    struct stat fst;
+    id_gen_t gen;
+    uint64_t state = w->seed;
+    int weight = 0;
+
+    for (int t = 0; t < WL_NTYPES; t++) {
+        weight += w->mix[t];
+        st[t].ns = malloc((w->ops > 0 ? w->ops : 1) * sizeof(long long));
+        if (st[t].ns == NULL) {
+            fprintf(stderr, "%s: out of memory\n", w->name);
+            exit(1);
+        }
+    }
+    if (weight <= 0 || gen_init(&gen, w) != 0) {
+        fprintf(stderr, "%s: bad mix or out of memory\n", w->name);
+        exit(1);
+    }
+
+    int fd = open_db(DB_FILE, true);
+    if (fd < 0) {
+        fprintf(stderr, "%s: could not open database\n", w->name);
+        exit(1);
+    }
+    for (int id = MIN_STD_ID; id <= w->ids; id++) {
+        if (next_unit(&state) < w->density)
+            add_student(fd, id, "bench", "student", id % (MAX_STD_GPA + 1));
+    }
+
+    long long start = bench_now_ns();
+    for (int i = 0; i < w->ops; i++) {
+        int pick = (int)(next_rand(&state) % (uint64_t)weight);
+        int type = 0;
+        while (pick >= w->mix[type])
+            pick -= w->mix[type++];
+        int id = gen_next(&gen, &state);
+        int rc;
+
+        long long t = bench_now_ns();
+        switch (type) {
+        case OP_ADD:
+            rc = add_student(fd, id, "bench", "student", id % (MAX_STD_GPA + 1));
+            break;
+        case OP_GET:
+            rc = get_student(fd, id, &student);
+            break;
+        case OP_DEL:
+            rc = del_student(fd, id);
+            break;
+        default:
+            rc = print_db(fd);
+            fflush(stdout);
+            break;
+        }
+        t = bench_now_ns() - t;
+
+        st[type].ns[st[type].n++] = t;
+        st[type].total_ns += t;
+        if (rc == NO_ERROR)
+            st[type].ok++;
+    }
+    long long elapsed = bench_now_ns() - start;
+
+    if (fstat(fd, &fst) != 0)
+        memset(&fst, 0, sizeof(fst));
+    int students = count_db_records(fd);
+    close(fd);
+    unlink(DB_FILE);
+
+    fprintf(out, "%s    {\"name\": \"%s\", \"dist\": \"%s\"", first ? "" : ",\n",
+            w->name, dist_names[w->dist]);
+    if (w->dist == DIST_ZIPF)
+        fprintf(out, ", \"theta\": %.2f", w->theta);
+    fprintf(out, ", \"mix\": {\"add\": %d, \"get\": %d, \"del\": %d, \"scan\": %d}",
+            w->mix[OP_ADD], w->mix[OP_GET], w->mix[OP_DEL], w->mix[OP_SCAN]);
+    fprintf(out, ", \"density\": %.4f, \"ids\": %d, \"ops\": %d, \"seed\": %llu,\n",
+            w->density, w->ids, w->ops, (unsigned long long)w->seed);
+    fprintf(out, "     \"elapsed_ms\": %.3f, \"ops_per_sec\": %.0f, \"students\": %d,"
+            " \"file_size\": %lld, \"allocated\": %lld,\n     \"by_op\": {",
+            elapsed / 1e6, elapsed > 0 ? w->ops * 1e9 / elapsed : 0.0, students,
+            (long long)fst.st_size, (long long)fst.st_blocks * 512);
+
+    bool first_op = true;
+    for (int t = 0; t < WL_NTYPES; t++) {
+        if (st[t].n == 0)
+            continue;
+        qsort(st[t].ns, st[t].n, sizeof(long long), cmp_ll);
+        fprintf(out, "%s\n       \"%s\": {\"count\": %d, \"ok\": %d, \"ops_per_sec\": %.0f,"
+                " \"p50_ns\": %lld, \"p99_ns\": %lld, \"p999_ns\": %lld}",
+                first_op ? "" : ",", op_names[t], st[t].n, st[t].ok,
+                st[t].total_ns > 0 ? st[t].n * 1e9 / st[t].total_ns : 0.0,
+                percentile(st[t].ns, st[t].n, 0.50), percentile(st[t].ns, st[t].n, 0.99),
+                percentile(st[t].ns, st[t].n, 0.999));
+        first_op = false;
+    }
+    fprintf(out, "}}");
+
+    for (int t = 0; t < WL_NTYPES; t++)
+        free(st[t].ns);
+    free(gen.cdf);
+}
+
+static void usage_exit(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--dist uniform|zipf|seq] [--theta T] "
+            "[--mix add:get:del:scan] [--density D] [--ids N] [--ops N] "
+            "[--seed S] [--name NAME]\n", prog);
+    exit(2);
+}
+
+//fills w from the command line, returns false if there is nothing to fill
+static bool parse_workload(int argc, char *argv[], workload_t *w)
+{
+    *w = (workload_t){"custom", DIST_UNIFORM, 0.99, {10, 80, 10, 0}, 0.5,
+                      MAX_STD_ID, 100000, 1};
+    if (argc < 2)
+        return false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i], *val = (i + 1 < argc) ? argv[++i] : NULL;
+
+        if (val == NULL)
+            usage_exit(argv[0]);
+        if (strcmp(opt, "--dist") == 0) {
+            for (w->dist = 0; w->dist < 3 && strcmp(val, dist_names[w->dist]) != 0; w->dist++)
+                ;
+            if (w->dist == 3)
+                usage_exit(argv[0]);
+        } else if (strcmp(opt, "--theta") == 0) {
+            w->theta = atof(val);
+        } else if (strcmp(opt, "--mix") == 0) {
+            if (sscanf(val, "%d:%d:%d:%d", &w->mix[OP_ADD], &w->mix[OP_GET],
+                       &w->mix[OP_DEL], &w->mix[OP_SCAN]) != 4)
+                usage_exit(argv[0]);
+        } else if (strcmp(opt, "--density") == 0) {
+            w->density = atof(val);
+        } else if (strcmp(opt, "--ids") == 0) {
+            w->ids = atoi(val);
+        } else if (strcmp(opt, "--ops") == 0) {
+            w->ops = atoi(val);
+        } else if (strcmp(opt, "--seed") == 0) {
+            w->seed = strtoull(val, NULL, 10);
+        } else if (strcmp(opt, "--name") == 0) {
+            w->name = val;
+        } else {
+            usage_exit(argv[0]);
+        }
+    }
+    for (int t = 0; t < WL_NTYPES; t++) {
+        if (w->mix[t] < 0)
+            usage_exit(argv[0]);
+    }
+    if (w->ids < MIN_STD_ID || w->ids > MAX_STD_ID || w->ops < 0 ||
+        w->density < 0 || w->density > 1)
+        usage_exit(argv[0]);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    workload_t custom;
+    bool one = parse_workload(argc, argv, &custom);
+
+    bench_enter_scratch_dir();
+    FILE *out = bench_mute_stdout();
+
+    fprintf(out, "{\"benchmark\": \"sdbsc-workload\", \"record_size\": %d, \"results\": [\n",
+            STUDENT_RECORD_SIZE);
+    if (one) {
+        run_workload(out, &custom, true);
+    } else {
+        int n = sizeof(default_workloads) / sizeof(default_workloads[0]);
+        for (int i = 0; i < n; i++)
+            run_workload(out, &default_workloads[i], i == 0);
+    }
+    fprintf(out, "\n]}\n");
+
+    fclose(out);
+    return 0;
+}
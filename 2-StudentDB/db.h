@@ -1,6 +1,8 @@
 #ifndef __DB_H__
     #define __DB_H__
 
+#include <stdint.h>
+
 // Basic student database record.  Note:
 //  1. id must be > 0.  A student id==0 means the record has been deleted
 //  2. gpa is an int, should be between 0<=gpa<=500, real gpa is gpa/100.0 this
@@ -14,11 +16,38 @@ typedef struct student{
     int gpa; 
 } student_t;
 
+//Database header.  Student ids start at MIN_STD_ID so the record slot for
+//id 0 never holds a student, instead it holds this header.  It carries
+//running totals that add_student(), del_student() and compress_db() keep
+//up to date, so the record count and GPA statistics can be answered
+//without scanning the file.  The header is exactly one record in size.
+#define DB_HDR_MAGIC            0x48424453  //"SDBH" on disk
+#define DB_HDR_VERSION          1           //the direct format, id at id * 64
+#define DB_HDR_VERSION_PAGED    2           //the paged format, see sdb_paged.c
+#define DB_HDR_HIST_BUCKETS     10          //GPA histogram, 0.50 per bucket
+#define DB_HDR_F_MINMAX_STALE   0x0001      //a min or max student was deleted
+#define DB_HDR_F_WIDE_IDS       0x0002      //a student id is above MAX_STD_ID
+
+typedef struct db_header{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t count;                         //number of live students
+    uint16_t gpa_min;
+    uint16_t gpa_max;
+    uint64_t gpa_sum;
+    uint32_t gpa_hist[DB_HDR_HIST_BUCKETS];
+} db_header_t;
+
+_Static_assert(sizeof(db_header_t) == sizeof(student_t),
+               "the db header must fill exactly one record slot");
+
 //Define limits for sudent ids and allowable GPA ranges.  Note GPA values will
 //be stored as integers but printed as floats.  For example a GPA of 450 is really
 //that value divided by 100.0 or 4.50.
 #define MIN_STD_ID      1
 #define MAX_STD_ID      100000
+#define MAX_PAGED_STD_ID INT32_MAX  //the limit in a paged database
 #define MIN_STD_GPA     0
 #define MAX_STD_GPA     500
 
@@ -31,5 +60,17 @@ static const int DELETED_STUDENT_ID = 0;
 
 #define DB_FILE     "student.db"            //name of database file
 #define TMP_DB_FILE ".tmp_student.db"       //for extra credit
+#define NAME_IDX_FILE     "student.db.nameidx"      //name index, see sdb_nameidx.c
+#define NAME_IDX_TMP_FILE ".tmp_student.db.nameidx" //name index being rebuilt
+#define GPA_IDX_FILE      "student.db.gpaidx"       //GPA index, see sdb_gpaidx.c
+#define GPA_IDX_TMP_FILE  ".tmp_student.db.gpaidx"  //GPA index being rebuilt
+#define COL_GPA_FILE      "student.db.gpacol"       //GPA column, see sdb_colgpa.c
+#define COL_GPA_TMP_FILE  ".tmp_student.db.gpacol"  //GPA column being rebuilt
+#define WAL_FILE          "student.db.wal"          //write-ahead log, see sdb_wal.c
+#define LOG_SEG_FILE      "student.db.seg.%08u"     //log segment, see sdb_logdb.c
+#define LOG_SEG_GLOB      "student.db.seg.*"        //every log segment
+#define LOG_SEG_TMP_FILE  ".tmp_student.db.seg"     //segment being compacted
+#define SNAP_TMP_FILE     ".tmp_student.db.XXXXXX"  //restore being written, see sdb_snapshot.c
+#define SORT_TMP_FILE     ".tmp_student.db.sort.XXXXXX" //sorted run, see sdb_sort.c
 
 #endif
\ No newline at end of file
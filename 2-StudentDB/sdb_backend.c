@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Storage backends (--backend fd|mmap|mem|log, or $SDBSC_BACKEND).  The
+ *  record access of every operation goes through read_record() and
+ *  write_record(), which hand it to the backend attached to the database,
+ *  an sdb_backend_t of these functions:
+ *
+ *      open       attach to a database that open_db() opened
+ *      close      write back what is held in memory and detach
+ *      read_rec   copy one slot out, SRCH_NOT_FOUND past the end
+ *      write_rec  store one slot, growing the database as needed
+ *      scan       the slots as an array indexed by id when they are held
+ *                 in memory, so scans and the parallel print use them
+ *                 instead of reading the file, NULL when they are not
+ *      sync       write the changes held in memory to the file, so code
+ *                 that reads or copies the file itself sees them
+ *
+ *  fd (below) is the default, an lseek() and a read() or write() per
+ *  record, through the buffer pool when --cache is on.  mmap (sdb_mmap.c)
+ *  maps the file, and mem (sdb_memdb.c) reads it into the process once
+ *  and keeps every change there until it is synced, so the operations can
+ *  be run and measured without I/O in the way.  Neither maps a paged
+ *  database, whose slots are not at id * 64, they leave it to fd.  log
+ *  (sdb_logdb.c) appends every change to segment files and merges them
+ *  into the file in id order when synced.
+ *
+ *  One backend is selected for the process and attached to the one open
+ *  database.  Code that rewrites or reopens the file detaches it and
+ *  attaches it again to the result.
+ */
+
+static const sdb_backend_t *backends[] = {
+    &fd_backend, &mmap_backend, &mem_backend, &log_backend,
+};
+
+static const sdb_backend_t *selected = &fd_backend;
+
+static int fd_open(int fd)
+{
+    (void)fd;
+    return NO_ERROR;
+}
+
+static int fd_close(void)
+{
+    return NO_ERROR;
+}
+
+static bool fd_attached(int fd)
+{
+    return fd >= 0;
+}
+
+static int fd_read_rec(int fd, int id, student_t *s)
+{
+    if (bufpool_attached(fd))
+        return bufpool_read(id, s);
+
+    ssize_t n;
+
+    if (paged_db(fd)) {
+        off_t offset = paged_slot_offset(fd, id, false);
+        if (offset < 0)
+            return (int)offset;
+        INSTR_START(t);
+        n = pread(fd, s, sizeof(student_t), offset);
+        INSTR_STOP(INSTR_READ, t, n > 0 ? n : 0);
+        if (n != sizeof(student_t))
+            return SRCH_NOT_FOUND;
+        return NO_ERROR;
+    }
+
+    INSTR_START(t_seek);
+    off_t pos = lseek(fd, id * sizeof(student_t), SEEK_SET);
+    INSTR_STOP(INSTR_SEEK, t_seek, 0);
+    if (pos == -1)
+        return ERR_DB_FILE;
+
+    INSTR_START(t_read);
+    n = read(fd, s, sizeof(student_t));
+    INSTR_STOP(INSTR_READ, t_read, n > 0 ? n : 0);
+    if (n != sizeof(student_t))
+        return SRCH_NOT_FOUND;
+
+    return NO_ERROR;
+}
+
+static int fd_write_rec(int fd, int id, const student_t *s)
+{
+    if (bufpool_attached(fd))
+        return bufpool_write(id, s);
+
+    ssize_t n;
+
+    if (paged_db(fd)) {
+        off_t offset = paged_slot_offset(fd, id, true);
+        if (offset < 0)
+            return ERR_DB_FILE;
+        INSTR_START(t);
+        n = pwrite(fd, s, sizeof(student_t), offset);
+        INSTR_STOP(INSTR_WRITE, t, n > 0 ? n : 0);
+        if (n != sizeof(student_t))
+            return ERR_DB_FILE;
+        return NO_ERROR;
+    }
+
+    INSTR_START(t_seek);
+    off_t pos = lseek(fd, id * sizeof(student_t), SEEK_SET);
+    INSTR_STOP(INSTR_SEEK, t_seek, 0);
+    if (pos == -1)
+        return ERR_DB_FILE;
+
+    INSTR_START(t_write);
+    n = write(fd, s, sizeof(student_t));
+    INSTR_STOP(INSTR_WRITE, t_write, n > 0 ? n : 0);
+    if (n != sizeof(student_t))
+        return ERR_DB_FILE;
+
+    return NO_ERROR;
+}
+
+static student_t *fd_scan(size_t *nslots)
+{
+    *nslots = 0;
+    return NULL;
+}
+
+//only the buffer pool holds changes back from the file
+static int fd_sync(int fd)
+{
+    return bufpool_flush(fd);
+}
+
+const sdb_backend_t fd_backend = {
+    .name = "fd",
+    .open = fd_open,
+    .close = fd_close,
+    .attached = fd_attached,
+    .read_rec = fd_read_rec,
+    .write_rec = fd_write_rec,
+    .scan = fd_scan,
+    .sync = fd_sync,
+};
+
+/*
+ *  backend_select
+ *      name:  "fd", "mmap", "mem" or "log"
+ *
+ *  Chooses the backend backend_attach() attaches from now on.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_OP for an unknown name
+ */
+int backend_select(const char *name)
+{
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (strcmp(name, backends[i]->name) == 0) {
+            selected = backends[i];
+            return NO_ERROR;
+        }
+    }
+    return ERR_DB_OP;
+}
+
+//true when the selected backend holds the whole file lock while attached,
+//the server lets go of it when idle as it does of the buffer pool
+bool backend_exclusive(void)
+{
+    return selected->exclusive;
+}
+
+/*
+ *  backend_of
+ *      fd:  linux file descriptor
+ *
+ *  returns:  the backend serving fd's records, fd_backend unless the
+ *            selected one is attached to it
+ */
+const sdb_backend_t *backend_of(int fd)
+{
+    return selected->attached(fd) ? selected : &fd_backend;
+}
+
+/*
+ *  backend_attach
+ *      fd:  linux file descriptor of an open database
+ *
+ *  Attaches the selected backend to the database, detaching it from the
+ *  one before.  Nothing to do for fd.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int backend_attach(int fd)
+{
+    if (backend_detach() != NO_ERROR)
+        return ERR_DB_FILE;
+    return selected->open(fd);
+}
+
+/*
+ *  backend_detach
+ *
+ *  Writes back what the selected backend holds and detaches it, the
+ *  database file stays open.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if writing back failed, detached
+ *            either way
+ */
+int backend_detach(void)
+{
+    return selected->close();
+}
+
+//true when fd is served by a backend other than fd
+bool backend_attached(int fd)
+{
+    return backend_of(fd) != &fd_backend;
+}
+
+/*
+ *  backend_slots
+ *      fd:       linux file descriptor
+ *      *nslots:  set to the number of slots in the array
+ *
+ *  returns:  fd's record slots as an array indexed by id when its backend
+ *            holds them in memory, otherwise NULL
+ */
+student_t *backend_slots(int fd, size_t *nslots)
+{
+    return backend_of(fd)->scan(nslots);
+}
+
+/*
+ *  backend_sync
+ *      fd:  linux file descriptor
+ *
+ *  Writes the changes fd's backend (or the buffer pool) holds in memory to
+ *  the file, for code that reads or copies the file itself.  The file is
+ *  not synced to disk.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int backend_sync(int fd)
+{
+    return backend_of(fd)->sync(fd);
+}
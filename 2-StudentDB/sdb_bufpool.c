@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The buffer pool (--cache).  Without it every get, add and delete reads
+ *  or writes its 64 byte record with a syscall of its own, even when the
+ *  previous operation touched the record next door.  The pool keeps
+ *  BUFPOOL_FRAMES pages of BUFPOOL_PAGE_RECS records (4 KB, a data page of
+ *  the paged format) in the process.  read_record() and write_record()
+ *  go through it while it is attached, so a page is read once and then
+ *  served from memory, and changes collect in the page and are written
+ *  back when it is evicted, flushed or the pool is detached.
+ *
+ *  Pages are found through a hash of the page number and evicted by the
+ *  clock algorithm: a page that was used since the hand last passed gets a
+ *  second chance, the first one that was not is reused.  Each page keeps a
+ *  bitmap of the records changed in it, and only those are written back,
+ *  so records that code outside the pool wrote in the meantime (the bulk
+ *  loader, hole punching) are never overwritten with stale copies.
+ *
+ *  Other processes must not see the file while changes sit in the pool, or
+ *  change it under the pool, so the pool holds the whole file lock (see
+ *  sdb_lock.c) while it is attached.  A command run with --cache holds it
+ *  from start to end; the server holds it while requests keep arriving and
+ *  lets go when it goes idle, or every BUFPOOL_HOLD_ROUNDS rounds so other
+ *  processes are not locked out for long.  Code that reads the file
+ *  directly (scans, the parallel print) calls backend_sync() first, and
+ *  code that rewrites or reopens it detaches the pool like it detaches the
+ *  storage backend.  The mmap and mem backends already serve records from
+ *  memory, the pool is only used with the fd one.
+ */
+
+#define BUFPOOL_HASH    (2 * BUFPOOL_FRAMES)    //hash buckets, a power of 2
+
+typedef struct frame {
+    int lp;                         //page number, -1 for a free frame
+    int valid;                      //records that exist in the file
+    bool ref;                       //used since the clock hand passed
+    uint64_t dirty;                 //bit i: recs[i] changed since written
+    int next;                       //next frame in the hash bucket, -1 for none
+    student_t recs[BUFPOOL_PAGE_RECS];
+} frame_t;
+
+static struct {
+    int fd;                         //database the pool is attached to, -1 if none
+    int hand;                       //the clock hand, the next frame to look at
+    int bucket[BUFPOOL_HASH];       //first frame of each hash bucket
+    frame_t frames[BUFPOOL_FRAMES];
+} pool = {.fd = -1};
+
+static int page_hash(int lp)
+{
+    return (int)(((uint32_t)lp * 2654435761u) & (BUFPOOL_HASH - 1));
+}
+
+//empties every frame, their contents are forgotten
+static void drop_frames(void)
+{
+    for (int b = 0; b < BUFPOOL_HASH; b++)
+        pool.bucket[b] = -1;
+    for (int f = 0; f < BUFPOOL_FRAMES; f++) {
+        pool.frames[f].lp = -1;
+        pool.frames[f].dirty = 0;
+        pool.frames[f].ref = false;
+    }
+    pool.hand = 0;
+}
+
+/*
+ *  page_offset
+ *
+ *  Where page lp starts in the file.  In a paged database the page is
+ *  looked up in the directory, and allocated when alloc is set.
+ *
+ *  returns:  the offset, SRCH_NOT_FOUND for a page that does not exist or
+ *            ERR_DB_FILE
+ */
+static off_t page_offset(int lp, bool alloc)
+{
+    if (!paged_db(pool.fd))
+        return (off_t)lp * BUFPOOL_PAGE_RECS * STUDENT_RECORD_SIZE;
+    return paged_slot_offset(pool.fd, lp * BUFPOOL_PAGE_RECS, alloc);
+}
+
+/*
+ *  write_back
+ *
+ *  Writes the changed records of a frame, one pwrite() per run of
+ *  adjacent ones.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int write_back(frame_t *fr)
+{
+    if (fr->dirty == 0)
+        return NO_ERROR;
+
+    off_t base = page_offset(fr->lp, true);
+    if (base < 0)
+        return ERR_DB_FILE;
+
+    uint64_t bits = fr->dirty;
+    while (bits != 0) {
+        int first = __builtin_ctzll(bits);
+        uint64_t rest = ~(bits >> first);   // the run ends at its first 1
+        int n = (rest == 0) ? 64 : __builtin_ctzll(rest);
+        size_t len = (size_t)n * sizeof(student_t);
+
+        INSTR_START(t);
+        ssize_t wrote = pwrite(pool.fd, &fr->recs[first], len,
+                               base + (off_t)first * STUDENT_RECORD_SIZE);
+        INSTR_STOP(INSTR_WRITE, t, wrote > 0 ? wrote : 0);
+        if (wrote != (ssize_t)len)
+            return ERR_DB_FILE;
+        bits = (first + n == 64) ? 0 : bits & (~0ULL << (first + n));
+    }
+    fr->dirty = 0;
+    return NO_ERROR;
+}
+
+/*
+ *  get_frame
+ *
+ *  Finds page lp in the pool, reading it into a frame chosen by the clock
+ *  if it is not there.  A page past the end of the file, or missing from a
+ *  paged database, is loaded with no valid records.
+ *
+ *  returns:  the frame, or NULL on an I/O error
+ */
+static frame_t *get_frame(int lp)
+{
+    frame_t *fr;
+
+    for (int f = pool.bucket[page_hash(lp)]; f >= 0; f = pool.frames[f].next) {
+        if (pool.frames[f].lp == lp) {
+            pool.frames[f].ref = true;
+            return &pool.frames[f];
+        }
+    }
+
+    // second chance for the frames used since the hand passed them
+    for (;;) {
+        fr = &pool.frames[pool.hand];
+        pool.hand = (pool.hand + 1) % BUFPOOL_FRAMES;
+        if (!fr->ref)
+            break;
+        fr->ref = false;
+    }
+
+    if (fr->lp >= 0) {
+        if (write_back(fr) != NO_ERROR)
+            return NULL;
+        int *link = &pool.bucket[page_hash(fr->lp)];
+        while (*link != fr - pool.frames)
+            link = &pool.frames[*link].next;
+        *link = fr->next;
+        fr->lp = -1;
+    }
+
+    ssize_t got = 0;
+    off_t off = page_offset(lp, false);
+    if (off >= 0) {
+        INSTR_START(t);
+        got = pread(pool.fd, fr->recs, sizeof(fr->recs), off);
+        INSTR_STOP(INSTR_READ, t, got > 0 ? got : 0);
+    } else if (off != SRCH_NOT_FOUND)
+        return NULL;
+    if (got < 0)
+        return NULL;
+
+    memset((char *)fr->recs + got, 0, sizeof(fr->recs) - got);
+    fr->lp = lp;
+    fr->valid = got / STUDENT_RECORD_SIZE;
+    fr->ref = true;
+    fr->dirty = 0;
+    fr->next = pool.bucket[page_hash(lp)];
+    pool.bucket[page_hash(lp)] = fr - pool.frames;
+    return fr;
+}
+
+/*
+ *  bufpool_attach
+ *      fd:  linux file descriptor of an open database
+ *
+ *  Starts serving fd's records from the pool, taking the whole file lock
+ *  for as long as the pool stays attached.  Nothing is attached while the
+ *  mmap or mem backend serves fd.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if the lock could not be taken
+ *
+ *  console:  Does not produce any console I/O
+ */
+int bufpool_attach(int fd)
+{
+    bufpool_detach();
+    if (backend_attached(fd))
+        return NO_ERROR;
+    if (lock_db(fd, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    drop_frames();
+    pool.fd = fd;
+    return NO_ERROR;
+}
+
+/*
+ *  bufpool_detach
+ *
+ *  Writes back every changed record, empties the pool and releases the
+ *  whole file lock.  Does nothing when no database is attached.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE if a write failed, the pool is
+ *            detached either way
+ */
+int bufpool_detach(void)
+{
+    if (pool.fd < 0)
+        return NO_ERROR;
+
+    int rc = bufpool_flush(pool.fd);
+    unlock_db(pool.fd);
+    pool.fd = -1;
+    return rc;
+}
+
+/*
+ *  bufpool_attached
+ *      fd:  linux file descriptor
+ *
+ *  returns:  true if fd's records are currently served by the pool
+ */
+bool bufpool_attached(int fd)
+{
+    return fd >= 0 && fd == pool.fd;
+}
+
+/*
+ *  bufpool_flush
+ *      fd:  linux file descriptor of the database
+ *
+ *  Writes back every changed record, keeping the pages in the pool, so
+ *  code reading the file itself sees the changes.  Does nothing unless the
+ *  pool is attached to fd.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int bufpool_flush(int fd)
+{
+    if (!bufpool_attached(fd))
+        return NO_ERROR;
+
+    for (int f = 0; f < BUFPOOL_FRAMES; f++) {
+        if (pool.frames[f].lp >= 0 && write_back(&pool.frames[f]) != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  bufpool_read
+ *      id:  the slot to read
+ *      *s:  where the slot contents are copied
+ *
+ *  read_record() while the pool is attached.
+ *
+ *  returns:  NO_ERROR, SRCH_NOT_FOUND for a slot past the end of the file
+ *            (or in a missing page), or ERR_DB_FILE
+ */
+int bufpool_read(int id, student_t *s)
+{
+    frame_t *fr = get_frame(id / BUFPOOL_PAGE_RECS);
+    int i = id % BUFPOOL_PAGE_RECS;
+
+    if (fr == NULL)
+        return ERR_DB_FILE;
+    if (i >= fr->valid)
+        return SRCH_NOT_FOUND;
+    *s = fr->recs[i];
+    return NO_ERROR;
+}
+
+/*
+ *  bufpool_write
+ *      id:  the slot to write
+ *      *s:  the new contents
+ *
+ *  write_record() while the pool is attached.  The record is written back
+ *  later.  Writing a slot makes the file reach it, as a write() would, and
+ *  in a paged database brings its whole page into existence.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int bufpool_write(int id, const student_t *s)
+{
+    frame_t *fr = get_frame(id / BUFPOOL_PAGE_RECS);
+    int i = id % BUFPOOL_PAGE_RECS;
+
+    if (fr == NULL)
+        return ERR_DB_FILE;
+    fr->recs[i] = *s;
+    fr->dirty |= 1ULL << i;
+    if (paged_db(pool.fd))
+        fr->valid = BUFPOOL_PAGE_RECS;
+    else if (fr->valid <= i)
+        fr->valid = i + 1;
+    return NO_ERROR;
+}
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The GPA column.  A student's gpa sits in the last 4 bytes of its 64
+ *  byte record, so an aggregate over the records moves 16 times more data
+ *  than it uses.  The column keeps every gpa in a dense int32 array
+ *  indexed by id, next to a bitmap of the live ids, so the aggregates (-A)
+ *  read 4 bytes per slot plus a bit and run as the SIMD kernels in
+ *  sdb_simd.c.  Dead slots hold 0 in the array, the bitmap is what says
+ *  whether a slot counts.
+ *
+ *  The column is a sidecar file (COL_GPA_FILE, see sdb_sidecar.c): built
+ *  on the first -A, kept current by add_student() and del_student() once it
+ *  exists, and rebuilt when its count disagrees with the database header.
+ */
+
+#define COL_MAGIC       0x43424453  //"SDBC" on disk
+#define COL_VERSION     1
+#define COL_NWORDS      ((MAX_STD_ID + 1 + 63) / 64)
+#define COL_NSLOTS      (COL_NWORDS * 64)
+
+typedef struct col_file {
+    sidecar_hdr_t hdr;              //hdr.count is the number of live ids
+    char pad[64 - sizeof(sidecar_hdr_t)];   //keeps gpa[] cache line aligned
+    int32_t gpa[COL_NSLOTS];        //gpa of each id, 0 if not live
+    uint64_t live[COL_NWORDS];      //bit id % 64 of word id / 64
+} col_file_t;
+
+static col_file_t *col_map(const char *path, bool create)
+{
+    return sidecar_map(path, sizeof(col_file_t), COL_MAGIC, COL_VERSION, create);
+}
+
+static void col_unmap(col_file_t *c)
+{
+    sidecar_unmap(c, sizeof(col_file_t));
+}
+
+static bool col_is_live(const col_file_t *c, int id)
+{
+    return c->live[id / 64] & (1ULL << (id % 64));
+}
+
+static void col_set(col_file_t *c, int id, int gpa)
+{
+    c->gpa[id] = gpa;
+    c->live[id / 64] |= 1ULL << (id % 64);
+    c->hdr.count++;
+}
+
+static void col_clear(col_file_t *c, int id)
+{
+    c->gpa[id] = 0;
+    c->live[id / 64] &= ~(1ULL << (id % 64));
+    c->hdr.count--;
+}
+
+/*
+ *  colgpa_note_add / colgpa_note_del
+ *      s:  the student added or deleted
+ *
+ *  Keeps an existing column current.  A column that disagrees with the
+ *  change is removed and rebuilt on its next use.
+ */
+void colgpa_note_add(const student_t *s)
+{
+    col_file_t *c = col_map(COL_GPA_FILE, false);
+    if (c == NULL)
+        return;
+
+    if (s->id < MIN_STD_ID || s->id > MAX_STD_ID || col_is_live(c, s->id))
+        unlink(COL_GPA_FILE);
+    else
+        col_set(c, s->id, s->gpa);
+    col_unmap(c);
+}
+
+void colgpa_note_del(const student_t *s)
+{
+    col_file_t *c = col_map(COL_GPA_FILE, false);
+    if (c == NULL)
+        return;
+
+    if (s->id < MIN_STD_ID || s->id > MAX_STD_ID || !col_is_live(c, s->id))
+        unlink(COL_GPA_FILE);
+    else
+        col_clear(c, s->id);
+    col_unmap(c);
+}
+
+/*
+ *  rebuild_colgpa
+ *      fd:  linux file descriptor of the database
+ *
+ *  Builds the column from the records with one scan into a temporary file
+ *  that is renamed over COL_GPA_FILE.
+ *
+ *  returns:  <number>       the number of students in the column
+ *            ERR_DB_FILE    database or column file I/O issue
+ *
+ *  console:  Does not produce any console I/O
+ */
+int rebuild_colgpa(int fd)
+{
+    student_t student;
+    db_scan_t sc;
+
+    col_file_t *c = col_map(COL_GPA_TMP_FILE, true);
+    if (c == NULL)
+        return ERR_DB_FILE;
+
+    scan_open(&sc, fd);
+    while (scan_next(&sc, &student)) {
+        if (student.id >= MIN_STD_ID && student.id <= MAX_STD_ID &&
+            !col_is_live(c, student.id))
+            col_set(c, student.id, student.gpa);
+    }
+
+    int count = c->hdr.count;
+    col_unmap(c);
+
+    if (sc.failed || rename(COL_GPA_TMP_FILE, COL_GPA_FILE) == -1) {
+        unlink(COL_GPA_TMP_FILE);
+        return ERR_DB_FILE;
+    }
+    return count;
+}
+
+//the bitmap words up to the last one with a live id, the kernels skip
+//empty words cheaply but there is no need to visit the tail at all
+static size_t col_used_words(const col_file_t *c)
+{
+    size_t n = COL_NWORDS;
+    while (n > 0 && c->live[n - 1] == 0)
+        n--;
+    return n;
+}
+
+//print_aggregate() for a database with ids past the column, the header
+//computed by a scan has every aggregate
+static int print_scanned_aggregate(int fd, const char *what)
+{
+    db_header_t h;
+
+    if (stats_scan(fd, &h) != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (h.count == 0) {
+        printf(M_DB_EMPTY);
+    } else if (strcmp(what, "avg") == 0) {
+        printf(M_AGG_AVG, (double)h.gpa_sum / h.count / 100.0, (int)h.count);
+    } else if (strcmp(what, "min") == 0) {
+        printf(M_AGG_MIN, h.gpa_min / 100.0);
+    } else if (strcmp(what, "max") == 0) {
+        printf(M_AGG_MAX, h.gpa_max / 100.0);
+    } else {
+        int width = (MAX_STD_GPA + 1) / DB_HDR_HIST_BUCKETS;
+        for (int b = 0; b < DB_HDR_HIST_BUCKETS; b++) {
+            int hi = (b == DB_HDR_HIST_BUCKETS - 1) ? MAX_STD_GPA : (b + 1) * width - 1;
+            printf(M_DB_GPA_HIST, b * width / 100.0, hi / 100.0, h.gpa_hist[b]);
+        }
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  print_aggregate
+ *      fd:    linux file descriptor of the database
+ *      what:  "avg", "min", "max" or "hist"
+ *
+ *  Computes one GPA aggregate over all students from the column.  When the
+ *  column cannot hold every id (sidecars_cover_ids()) the aggregates come
+ *  from one scan of the records instead.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_OP      what is not a known aggregate
+ *            ERR_DB_FILE    database or column file I/O issue
+ *
+ *  console:  M_AGG_AVG, M_AGG_MIN, M_AGG_MAX or M_DB_GPA_HIST lines
+ *            M_DB_EMPTY       if there are no students
+ *            M_ERR_AGG        what is not a known aggregate
+ *            M_ERR_DB_READ    error reading the database or column file
+ */
+int print_aggregate(int fd, const char *what)
+{
+    uint32_t hist[DB_HDR_HIST_BUCKETS];
+
+    if (strcmp(what, "avg") != 0 && strcmp(what, "min") != 0 &&
+        strcmp(what, "max") != 0 && strcmp(what, "hist") != 0) {
+        printf(M_ERR_AGG, what);
+        return ERR_DB_OP;
+    }
+
+    if (!sidecars_cover_ids(fd))
+        return print_scanned_aggregate(fd, what);
+
+    col_file_t *c = sidecar_open_current(fd, COL_GPA_FILE, sizeof(col_file_t),
+                                         COL_MAGIC, COL_VERSION, rebuild_colgpa);
+    if (c == NULL) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    const simd_kernels_t *k = simd_kernels();
+    size_t nwords = col_used_words(c);
+    int count = simd_live_count(c->live, nwords);
+
+    if (count == 0) {
+        printf(M_DB_EMPTY);
+    } else if (strcmp(what, "avg") == 0) {
+        int64_t sum = k->gpa_sum(c->gpa, c->live, nwords);
+        printf(M_AGG_AVG, (double)sum / count / 100.0, count);
+    } else if (strcmp(what, "min") == 0) {
+        printf(M_AGG_MIN, k->gpa_min(c->gpa, c->live, nwords) / 100.0);
+    } else if (strcmp(what, "max") == 0) {
+        printf(M_AGG_MAX, k->gpa_max(c->gpa, c->live, nwords) / 100.0);
+    } else {
+        int width = (MAX_STD_GPA + 1) / DB_HDR_HIST_BUCKETS;
+        k->gpa_hist(c->gpa, c->live, nwords, hist);
+        for (int b = 0; b < DB_HDR_HIST_BUCKETS; b++) {
+            int hi = (b == DB_HDR_HIST_BUCKETS - 1) ? MAX_STD_GPA : (b + 1) * width - 1;
+            printf(M_DB_GPA_HIST, b * width / 100.0, hi / 100.0, hist[b]);
+        }
+    }
+
+    col_unmap(c);
+    return NO_ERROR;
+}
+
+/*
+ *  drop_colgpa
+ *
+ *  Removes the column, used when the database is emptied.
+ */
+void drop_colgpa(void)
+{
+    unlink(COL_GPA_FILE);
+}
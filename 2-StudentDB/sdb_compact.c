@@ -0,0 +1,264 @@
+#define _GNU_SOURCE //needed for fallocate(), SEEK_DATA and SEEK_HOLE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  In-place compaction.  A deleted student leaves a zeroed record behind,
+ *  and zeros written to a file take disk space like any other data.  Rather
+ *  than copying every live record to a new file, the compactor walks the
+ *  data extents of the database and hands every filesystem block that holds
+ *  nothing but empty records back to the filesystem with
+ *  fallocate(FALLOC_FL_PUNCH_HOLE), which turns the block into a hole that
+ *  still reads back as zeros.  Empty records at the end of the file are
+ *  simply truncated away.  The work is proportional to the data stored and
+ *  no second copy of the database is ever needed.
+ *
+ *  Only whole blocks can be released, a block that still holds one live
+ *  student keeps its deleted neighbours.  Which records are empty is found
+ *  with the live_slots SIMD kernel, a chunk at a time.
+ */
+
+#define COMPACT_CHUNK   (64 * 1024)     //bytes read per pread(), whole blocks
+#define COMPACT_RECS    (COMPACT_CHUNK / (int)sizeof(student_t))
+
+_Static_assert(COMPACT_RECS <= SCAN_BUFF_RECS, "chunk too big for live_slots");
+
+//set per operation from the --punch flag, see del_student()
+static bool punch_deletes = false;
+
+void set_punch_on_delete(bool val)
+{
+    punch_deletes = val;
+}
+
+bool punch_on_delete(void)
+{
+    return punch_deletes;
+}
+
+//true if len bytes at p are all zero, by comparing p with itself shifted
+static bool is_zero(const char *p, size_t len)
+{
+    return len == 0 || (p[0] == 0 && memcmp(p, p + 1, len - 1) == 0);
+}
+
+//the last set bit in [first, stop) of a live slot bitmap, or -1
+static int last_live(const uint64_t *live, int first, int stop)
+{
+    while (stop > first) {
+        int w = (stop - 1) / 64;
+        int lo = (w * 64 > first) ? w * 64 : first;
+        uint64_t bits = live[w];
+        if (stop - w * 64 < 64)
+            bits &= (1ULL << (stop - w * 64)) - 1;
+        bits &= ~0ULL << (lo - w * 64);
+        if (bits)
+            return w * 64 + 63 - __builtin_clzll(bits);
+        stop = lo;
+    }
+    return -1;
+}
+
+//the filesystem block size, used as the unit of hole punching
+static off_t block_size(const struct stat *st)
+{
+    off_t blk = st->st_blksize;
+    if (blk < STUDENT_RECORD_SIZE || blk > COMPACT_CHUNK || COMPACT_CHUNK % blk)
+        blk = 4096;
+    return blk;
+}
+
+/*
+ *  db_disk_usage
+ *      fd:  linux file descriptor
+ *
+ *  returns:  the bytes of disk space allocated to the file, -1 on error
+ */
+long long db_disk_usage(int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) == -1)
+        return -1;
+    return (long long)st.st_blocks * 512;
+}
+
+/*
+ *  punch_hole
+ *
+ *  Releases the blocks in [off, off + len) keeping the file size.
+ *
+ *  returns:  NO_ERROR       the range is now a hole
+ *            ERR_DB_OP      the filesystem cannot punch holes
+ *            ERR_DB_FILE    any other failure
+ */
+int punch_hole(int fd, off_t off, off_t len)
+{
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, len) == 0)
+        return NO_ERROR;
+    return (errno == EOPNOTSUPP || errno == ENOSYS) ? ERR_DB_OP : ERR_DB_FILE;
+}
+
+/*
+ *  compact_in_place
+ *      fd:  linux file descriptor, must not be attached to the mmap backend
+ *
+ *  Punches out every block made only of empty records and truncates the
+ *  file after the last non-empty record.  Adjacent empty blocks are punched
+ *  with one call.  The first punch is the one that finds out whether the
+ *  filesystem supports it, so when ERR_DB_OP comes back the file has not
+ *  been changed.  A paged database is compacted by paged_compact().
+ *
+ *  returns:  NO_ERROR       the file was compacted
+ *            ERR_DB_OP      hole punching is not supported, use a rewrite
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  Does not produce any console I/O
+ */
+int compact_in_place(int fd)
+{
+    static student_t buff[COMPACT_RECS];
+    static uint64_t live[COMPACT_RECS / 64];
+    struct stat st;
+    int rc;
+
+    if (paged_db(fd))
+        return paged_compact(fd);
+    if (fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+
+    off_t blk = block_size(&st);
+    off_t size = st.st_size;
+    off_t run = -1;                         // start of a run of empty blocks
+    off_t live_end = STUDENT_RECORD_SIZE;   // the header is always kept
+    off_t pos = 0;
+
+    while (pos < size) {
+        off_t end;
+        off_t data = lseek(fd, pos, SEEK_DATA);
+        if (data == -1) {
+            if (errno == ENXIO)
+                break;                      // only a hole remains
+            data = pos;                     // no SEEK_DATA, read everything
+            end = size;
+        } else {
+            end = lseek(fd, data, SEEK_HOLE);
+            if (end == -1)
+                end = size;
+        }
+
+        // a run of empty blocks may continue across a hole, punching the
+        // hole again is harmless and saves a call
+        for (pos = data - data % blk; pos < end; ) {
+            size_t len = (end - pos < COMPACT_CHUNK) ? end - pos : COMPACT_CHUNK;
+            ssize_t n = pread(fd, buff, len, pos);
+            if (n < 0)
+                return ERR_DB_FILE;
+            if (n == 0)
+                break;
+
+            // one bitmap for the chunk, a block is empty when its bits are
+            int nrec = n / STUDENT_RECORD_SIZE;
+            simd_kernels()->live_slots(buff, nrec, live);
+
+            for (off_t b = 0; b < n; b += blk) {
+                off_t bl = (n - b < blk) ? n - b : blk;
+                int first = b / STUDENT_RECORD_SIZE;
+                int stop = (b + bl) / STUDENT_RECORD_SIZE;
+                int last = last_live(live, first, stop);
+
+                // a partial record can only be the very end of the file
+                off_t tail = b + bl - (off_t)stop * STUDENT_RECORD_SIZE;
+                if (tail > 0 && !is_zero((char *)&buff[stop], tail))
+                    last = stop;
+
+                if (last < 0) {
+                    if (run < 0)
+                        run = pos + b;
+                    continue;
+                }
+
+                if (run >= 0) {
+                    rc = punch_hole(fd, run, pos + b - run);
+                    if (rc != NO_ERROR)
+                        return rc;
+                    run = -1;
+                }
+
+                // remember where the last non-empty record in the block ends
+                live_end = pos + (off_t)(last + 1) * STUDENT_RECORD_SIZE;
+            }
+            pos += n;
+        }
+    }
+
+    // any run still open lies past live_end and goes with the truncate
+    if (live_end < size && ftruncate(fd, live_end) == -1)
+        return ERR_DB_FILE;
+
+    return NO_ERROR;
+}
+
+/*
+ *  punch_record_block
+ *      fd:  linux file descriptor
+ *      id:  student id (slot) that was just emptied
+ *
+ *  Punches the filesystem block holding slot id if every record in it is
+ *  now empty.  This is what del_student() does with --punch, so a deleted
+ *  student's space is released at once instead of at the next -x.  A
+ *  filesystem without hole punching just keeps the block.  The caller
+ *  must not hold any record lock, the whole block is locked here.  In a
+ *  paged database the unit is the data page holding the slot, which stays
+ *  in its directory and reads back as empty records.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int punch_record_block(int fd, int id)
+{
+    static char buff[COMPACT_CHUNK];
+    struct stat st;
+
+    if (fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+
+    // the check reads the file, which must have the changes held in
+    // memory by the pool or the mem backend
+    if (backend_sync(fd) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    off_t blk = paged_db(fd) ? PG_SIZE : block_size(&st);
+    off_t start = (off_t)id * STUDENT_RECORD_SIZE;
+    start -= start % blk;
+
+    // the neighbours must not be written between the check and the punch
+    if (lock_range(fd, start, blk, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int rc = NO_ERROR;
+    off_t phys = paged_db(fd) ? paged_slot_offset(fd, id, false) : start;
+    ssize_t n = 0;
+    if (phys >= 0) {
+        phys -= phys % blk;
+        n = pread(fd, buff, blk, phys);
+    }
+    if (phys == SRCH_NOT_FOUND)
+        rc = NO_ERROR;
+    else if (phys < 0 || n < 0)
+        rc = ERR_DB_FILE;
+    else if (is_zero(buff, n))
+        rc = punch_hole(fd, phys, blk);
+    lock_range(fd, start, blk, F_UNLCK);
+
+    return rc == ERR_DB_OP ? NO_ERROR : rc;
+}
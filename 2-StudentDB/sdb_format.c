@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Row formatting and buffered output.  printf() of STUDENT_PRINT_FMT_STRING
+ *  parses the format and converts gpa / 100.0 as a double for every row,
+ *  which made formatting, not I/O, the cost of printing a large database.
+ *  The GPA is a fixed point int, so fmt_row() renders the table row with
+ *  integer arithmetic and memcpy(), byte for byte what the printf() did,
+ *  and the rows are collected in a large buffer that out_flush() write()s
+ *  straight to stdout.
+ *
+ *  The same code renders the export formats of -p --format:
+ *
+ *      csv    id,fname,lname,gpa   header line, names quoted when needed
+ *      tsv    the same with tabs   tab, newline and backslash escaped
+ *      jsonl  one object per line  {"id":1,"fname":"..","lname":"..","gpa":3.45}
+ *
+ *  In every format the GPA has two decimals like in the table.
+ */
+
+static const char digits2[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+//writes v in decimal, returns the number of chars
+static size_t put_uint(char *dst, unsigned long long v)
+{
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, &digits2[(v % 100) * 2], 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, &digits2[v * 2], 2);
+    } else {
+        *--p = '0' + v;
+    }
+
+    size_t n = tmp + sizeof(tmp) - p;
+    memcpy(dst, p, n);
+    return n;
+}
+
+static size_t put_int(char *dst, long long v)
+{
+    if (v < 0) {
+        *dst = '-';
+        return 1 + put_uint(dst + 1, -(unsigned long long)v);
+    }
+    return put_uint(dst, v);
+}
+
+//the "%.2f" of gpa / 100.0, exact for the fixed point value
+static size_t put_gpa(char *dst, int gpa)
+{
+    long long g = gpa;
+    size_t n = 0;
+
+    if (g < 0) {
+        dst[n++] = '-';
+        g = -g;
+    }
+    n += put_uint(dst + n, g / 100);
+    dst[n++] = '.';
+    memcpy(dst + n, &digits2[(g % 100) * 2], 2);
+    return n + 2;
+}
+
+//a name field of the record, up to its NUL or the end of the array
+static size_t put_name(char *dst, const char *name, size_t size)
+{
+    size_t n = strnlen(name, size);
+    memcpy(dst, name, n);
+    return n;
+}
+
+static size_t pad_to(char *dst, size_t n, size_t width)
+{
+    while (n < width)
+        dst[n++] = ' ';
+    return n;
+}
+
+static size_t put_csv_name(char *dst, const char *name, size_t size)
+{
+    size_t len = strnlen(name, size);
+    size_t n = 0;
+    bool quote = false;
+
+    for (size_t i = 0; i < len; i++)
+        quote |= name[i] == ',' || name[i] == '"' || name[i] == '\r' || name[i] == '\n';
+    if (!quote)
+        return put_name(dst, name, size);
+
+    dst[n++] = '"';
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] == '"')
+            dst[n++] = '"';
+        dst[n++] = name[i];
+    }
+    dst[n++] = '"';
+    return n;
+}
+
+static size_t put_tsv_name(char *dst, const char *name, size_t size)
+{
+    size_t len = strnlen(name, size);
+    size_t n = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (c == '\t' || c == '\n' || c == '\r' || c == '\\') {
+            dst[n++] = '\\';
+            c = (c == '\t') ? 't' : (c == '\n') ? 'n' : (c == '\r') ? 'r' : '\\';
+        }
+        dst[n++] = c;
+    }
+    return n;
+}
+
+static size_t put_json_name(char *dst, const char *name, size_t size)
+{
+    size_t len = strnlen(name, size);
+    size_t n = 0;
+
+    dst[n++] = '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = name[i];
+        if (c == '"' || c == '\\') {
+            dst[n++] = '\\';
+            dst[n++] = c;
+        } else if (c < 0x20) {
+            memcpy(dst + n, "\\u00", 4);
+            dst[n + 4] = "0123456789abcdef"[c >> 4];
+            dst[n + 5] = "0123456789abcdef"[c & 0xf];
+            n += 6;
+        } else {
+            dst[n++] = c;
+        }
+    }
+    dst[n++] = '"';
+    return n;
+}
+
+/*
+ *  fmt_parse
+ *      name:  "table", "csv", "tsv" or "jsonl"
+ *
+ *  returns:  the FMT_* value, or ERR_DB_OP for an unknown name
+ */
+int fmt_parse(const char *name)
+{
+    static const char *names[] = {"table", "csv", "tsv", "jsonl"};
+
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    return ERR_DB_OP;
+}
+
+/*
+ *  fmt_header
+ *      dst:  at least FMT_ROW_MAX bytes
+ *      fmt:  FMT_TABLE, FMT_CSV, FMT_TSV or FMT_JSONL
+ *
+ *  returns:  the length of the header line written to dst, 0 for jsonl
+ */
+size_t fmt_header(char *dst, int fmt)
+{
+    switch (fmt) {
+    case FMT_CSV:
+        memcpy(dst, "id,fname,lname,gpa\n", 19);
+        return 19;
+    case FMT_TSV:
+        memcpy(dst, "id\tfname\tlname\tgpa\n", 19);
+        return 19;
+    case FMT_JSONL:
+        return 0;
+    default:
+        return snprintf(dst, FMT_ROW_MAX, STUDENT_PRINT_HDR_STRING,
+                        "ID", "FIRST NAME", "LAST_NAME", "GPA");
+    }
+}
+
+/*
+ *  fmt_row
+ *      dst:  at least FMT_ROW_MAX bytes
+ *      s:    the student to render
+ *      fmt:  FMT_TABLE, FMT_CSV, FMT_TSV or FMT_JSONL
+ *
+ *  FMT_TABLE gives the same bytes as printf(STUDENT_PRINT_FMT_STRING, ...)
+ *  with s->gpa / 100.0.
+ *
+ *  returns:  the length of the line written to dst, newline included
+ */
+size_t fmt_row(char *dst, const student_t *s, int fmt)
+{
+    size_t n = 0;
+
+    switch (fmt) {
+    case FMT_CSV:
+        n += put_int(dst + n, s->id);
+        dst[n++] = ',';
+        n += put_csv_name(dst + n, s->fname, sizeof(s->fname));
+        dst[n++] = ',';
+        n += put_csv_name(dst + n, s->lname, sizeof(s->lname));
+        dst[n++] = ',';
+        break;
+    case FMT_TSV:
+        n += put_int(dst + n, s->id);
+        dst[n++] = '\t';
+        n += put_tsv_name(dst + n, s->fname, sizeof(s->fname));
+        dst[n++] = '\t';
+        n += put_tsv_name(dst + n, s->lname, sizeof(s->lname));
+        dst[n++] = '\t';
+        break;
+    case FMT_JSONL:
+        memcpy(dst, "{\"id\":", 6);
+        n = 6;
+        n += put_int(dst + n, s->id);
+        memcpy(dst + n, ",\"fname\":", 9);
+        n += 9;
+        n += put_json_name(dst + n, s->fname, sizeof(s->fname));
+        memcpy(dst + n, ",\"lname\":", 9);
+        n += 9;
+        n += put_json_name(dst + n, s->lname, sizeof(s->lname));
+        memcpy(dst + n, ",\"gpa\":", 7);
+        n += 7;
+        n += put_gpa(dst + n, s->gpa);
+        dst[n++] = '}';
+        dst[n++] = '\n';
+        return n;
+    default:
+        // "%-6d %-24.24s %-32.32s %-3.2f\n", the gpa is never under 4 chars
+        n = pad_to(dst, put_int(dst, s->id), 6);
+        dst[n++] = ' ';
+        n += pad_to(dst + n, put_name(dst + n, s->fname, 24), 24);
+        dst[n++] = ' ';
+        n += pad_to(dst + n, put_name(dst + n, s->lname, 32), 32);
+        dst[n++] = ' ';
+        break;
+    }
+
+    n += put_gpa(dst + n, s->gpa);
+    dst[n++] = '\n';
+    return n;
+}
+
+//the one output buffer, only one operation prints at a time
+static char out_space[OUT_BUFF_SZ];
+
+/*
+ *  out_begin
+ *      o:  the output buffer to start
+ *
+ *  Anything printf() still holds is flushed first, so output written
+ *  through the buffer comes after it.
+ */
+void out_begin(out_buf_t *o)
+{
+    fflush(stdout);
+    o->buff = out_space;
+    o->len = 0;
+    o->failed = false;
+}
+
+//write() all of p to stdout, after a failed write (a closed pipe, a full
+//disk) the rest of the output is dropped
+static void out_write(out_buf_t *o, const char *p, size_t len)
+{
+    while (!o->failed && len > 0) {
+        INSTR_START(t);
+        ssize_t n = write(STDOUT_FILENO, p, len);
+        INSTR_STOP(INSTR_OUT, t, n > 0 ? n : 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            o->failed = true;
+            break;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+/*
+ *  out_flush
+ *      o:  the output buffer
+ *
+ *  Writes the buffered bytes to stdout.
+ *
+ *  returns:  NO_ERROR or ERR_DB_OP if output has failed
+ */
+int out_flush(out_buf_t *o)
+{
+    out_write(o, o->buff, o->len);
+    o->len = 0;
+    return o->failed ? ERR_DB_OP : NO_ERROR;
+}
+
+//appends len bytes, a block larger than the buffer is written directly
+void out_bytes(out_buf_t *o, const char *p, size_t len)
+{
+    if (o->len + len > OUT_BUFF_SZ)
+        out_flush(o);
+    if (len > OUT_BUFF_SZ) {
+        out_write(o, p, len);
+        return;
+    }
+    memcpy(o->buff + o->len, p, len);
+    o->len += len;
+}
+
+//appends one formatted row
+void out_row(out_buf_t *o, const student_t *s, int fmt)
+{
+    if (o->len + FMT_ROW_MAX > OUT_BUFF_SZ)
+        out_flush(o);
+    INSTR_START(t);
+    o->len += fmt_row(o->buff + o->len, s, fmt);
+    INSTR_STOP(INSTR_FORMAT, t, 0);
+}
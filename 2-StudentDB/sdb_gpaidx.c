@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The GPA index.  GPA is an int from MIN_STD_GPA to MAX_STD_GPA, so
+ *  instead of a tree the index keeps one posting list per possible GPA:
+ *  a doubly linked list of the ids holding that GPA, threaded through
+ *  next[] and prev[] arrays indexed by id.  Adding or deleting a student is
+ *  a constant number of stores, and a query only visits the lists for the
+ *  GPAs it asks about, so -g lo hi and -t K cost in proportion to the
+ *  students they print (plus at most MAX_STD_GPA + 1 list heads).
+ *
+ *  The index file (GPA_IDX_FILE) is a fixed size image of gidx_file_t that
+ *  is used through mmap(), see sdb_sidecar.c.  Like the name index it is
+ *  built on the first query and kept current by add_student() and
+ *  del_student() once it exists.
+ */
+
+#define GIDX_MAGIC      0x47424453  //"SDBG" on disk
+#define GIDX_VERSION    1
+#define GIDX_NGPA       (MAX_STD_GPA + 1)
+#define GIDX_NIDS       (MAX_STD_ID + 1)
+#define GIDX_SCAN_FRACTION  16  //scan when a range holds over 1/16 of the db
+
+typedef struct gidx_file {
+    sidecar_hdr_t hdr;              //hdr.count is the number of ids indexed
+    int32_t head[GIDX_NGPA];        //first id with each gpa, 0 for none
+    uint32_t n[GIDX_NGPA];          //number of ids with each gpa
+    int32_t next[GIDX_NIDS];        //next id with the same gpa, 0 for none
+    int32_t prev[GIDX_NIDS];        //previous id with the same gpa
+    int16_t gpa_plus1[GIDX_NIDS];   //gpa + 1 of an indexed id, 0 if absent
+} gidx_file_t;
+
+static gidx_file_t *gidx_map(const char *path, bool create)
+{
+    return sidecar_map(path, sizeof(gidx_file_t), GIDX_MAGIC, GIDX_VERSION, create);
+}
+
+static void gidx_unmap(gidx_file_t *g)
+{
+    sidecar_unmap(g, sizeof(gidx_file_t));
+}
+
+static bool gidx_valid(int id, int gpa)
+{
+    return id >= MIN_STD_ID && id <= MAX_STD_ID &&
+           gpa >= MIN_STD_GPA && gpa <= MAX_STD_GPA;
+}
+
+static void gidx_link(gidx_file_t *g, int id, int gpa)
+{
+    int first = g->head[gpa];
+
+    g->next[id] = first;
+    g->prev[id] = 0;
+    if (first != 0)
+        g->prev[first] = id;
+    g->head[gpa] = id;
+    g->gpa_plus1[id] = gpa + 1;
+    g->n[gpa]++;
+    g->hdr.count++;
+}
+
+static void gidx_unlink(gidx_file_t *g, int id)
+{
+    int gpa = g->gpa_plus1[id] - 1;
+
+    if (g->prev[id] != 0)
+        g->next[g->prev[id]] = g->next[id];
+    else
+        g->head[gpa] = g->next[id];
+    if (g->next[id] != 0)
+        g->prev[g->next[id]] = g->prev[id];
+
+    g->next[id] = g->prev[id] = 0;
+    g->gpa_plus1[id] = 0;
+    g->n[gpa]--;
+    g->hdr.count--;
+}
+
+/*
+ *  gpa_idx_note_add / gpa_idx_note_del
+ *      s:  the student added or deleted
+ *
+ *  Keeps an existing index current, there is nothing to do if none has
+ *  been built.  An index that does not have the student in the expected
+ *  state is out of step with the database; it is removed so the next query
+ *  rebuilds it.
+ */
+void gpa_idx_note_add(const student_t *s)
+{
+    gidx_file_t *g = gidx_map(GPA_IDX_FILE, false);
+    if (g == NULL)
+        return;
+
+    if (!gidx_valid(s->id, s->gpa) || g->gpa_plus1[s->id] != 0)
+        unlink(GPA_IDX_FILE);
+    else
+        gidx_link(g, s->id, s->gpa);
+    gidx_unmap(g);
+}
+
+void gpa_idx_note_del(const student_t *s)
+{
+    gidx_file_t *g = gidx_map(GPA_IDX_FILE, false);
+    if (g == NULL)
+        return;
+
+    if (!gidx_valid(s->id, s->gpa) || g->gpa_plus1[s->id] != s->gpa + 1)
+        unlink(GPA_IDX_FILE);
+    else
+        gidx_unlink(g, s->id);
+    gidx_unmap(g);
+}
+
+/*
+ *  rebuild_gpa_idx
+ *      fd:  linux file descriptor of the database
+ *
+ *  Builds the GPA index from the records with one scan into a temporary
+ *  file, which is then renamed over GPA_IDX_FILE.
+ *
+ *  returns:  <number>       the number of students indexed
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  Does not produce any console I/O
+ */
+int rebuild_gpa_idx(int fd)
+{
+    student_t student;
+    db_scan_t sc;
+
+    gidx_file_t *g = gidx_map(GPA_IDX_TMP_FILE, true);
+    if (g == NULL)
+        return ERR_DB_FILE;
+
+    scan_open(&sc, fd);
+    while (scan_next(&sc, &student)) {
+        if (gidx_valid(student.id, student.gpa) && g->gpa_plus1[student.id] == 0)
+            gidx_link(g, student.id, student.gpa);
+    }
+
+    int count = g->hdr.count;
+    gidx_unmap(g);
+
+    if (sc.failed || rename(GPA_IDX_TMP_FILE, GPA_IDX_FILE) == -1) {
+        unlink(GPA_IDX_TMP_FILE);
+        return ERR_DB_FILE;
+    }
+    return count;
+}
+
+//maps the index for a query, (re)building it first if it is not current
+static gidx_file_t *gidx_open_current(int fd)
+{
+    return sidecar_open_current(fd, GPA_IDX_FILE, sizeof(gidx_file_t),
+                                GIDX_MAGIC, GIDX_VERSION, rebuild_gpa_idx);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    int ia = *(const int *)a, ib = *(const int *)b;
+    return (ia > ib) - (ia < ib);
+}
+
+/*
+ *  print_bucket
+ *
+ *  Adds up to limit students with the given gpa in id order to out,
+ *  after the table header before the first student of the query.  A
+ *  student another process deleted since the list was read is skipped.
+ *
+ *  returns:  the number of students printed, or ERR_DB_FILE
+ */
+static int print_bucket(int fd, const gidx_file_t *g, int gpa, int limit,
+                        int *ids, int *printed, out_buf_t *out)
+{
+    char hdr[FMT_ROW_MAX];
+    student_t student;
+    int n = 0;
+
+    for (int id = g->head[gpa]; id != 0 && n < (int)g->n[gpa]; id = g->next[id])
+        ids[n++] = id;
+    qsort(ids, n, sizeof(int), cmp_int);
+
+    if (n > limit)
+        n = limit;
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        int rc = get_student(fd, ids[i], &student);
+        if (rc == SRCH_NOT_FOUND)
+            continue;
+        if (rc != NO_ERROR)
+            return ERR_DB_FILE;
+        if ((*printed)++ == 0)
+            out_bytes(out, hdr, fmt_header(hdr, FMT_TABLE));
+        out_row(out, &student, FMT_TABLE);
+        found++;
+    }
+    return found;
+}
+
+//orders the students of a wide range scan like the posting lists would
+static int cmp_gpa_id(const void *a, const void *b)
+{
+    const student_t *sa = a, *sb = b;
+    if (sa->gpa != sb->gpa)
+        return (sa->gpa > sb->gpa) - (sa->gpa < sb->gpa);
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+//the order of -t, highest gpa first and by id among equal gpas
+static int cmp_gpa_desc_id(const void *a, const void *b)
+{
+    const student_t *sa = a, *sb = b;
+    if (sa->gpa != sb->gpa)
+        return (sa->gpa < sb->gpa) - (sa->gpa > sb->gpa);
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+/*
+ *  scan_gpa_range
+ *
+ *  The plan for a range that holds a large part of the database.  Fetching
+ *  each student by id costs a read per student, while the scan iterator
+ *  reads many at a time, so past GIDX_SCAN_FRACTION of the database one
+ *  scan plus a sort of the result is cheaper than following the lists.
+ *  It is also the only plan when the index does not cover the ids
+ *  (sidecars_cover_ids()), then expect is -1.  expect only sizes the
+ *  result, the students found are what the scan reads, since another
+ *  process may have added or deleted some in the range since the index
+ *  was read.  With top set the rows are printed highest GPA first and at
+ *  most limit of them.
+ */
+static int scan_gpa_range(int fd, int lo, int hi, int expect, bool top, int limit)
+{
+    int cap = (expect < 0) ? 1024 : expect + 1;
+    student_t *rows = malloc(cap * sizeof(student_t));
+    db_scan_t *sc = malloc(sizeof(db_scan_t));
+    char hdr[FMT_ROW_MAX];
+    out_buf_t out;
+    int n = 0;
+    bool failed = false;
+
+    if (rows == NULL || sc == NULL) {
+        free(sc);
+        free(rows);
+        return ERR_DB_FILE;
+    }
+
+    scan_open(sc, fd);
+    while (scan_next(sc, &rows[n])) {
+        if (rows[n].gpa < lo || rows[n].gpa > hi)
+            continue;
+        if (++n == cap) {
+            student_t *more = realloc(rows, 2 * cap * sizeof(student_t));
+            if (more == NULL) {
+                failed = true;
+                break;
+            }
+            rows = more;
+            cap *= 2;
+        }
+    }
+    failed = failed || sc->failed;
+    free(sc);
+
+    if (failed) {
+        free(rows);
+        return ERR_DB_FILE;
+    }
+
+    qsort(rows, n, sizeof(student_t), top ? cmp_gpa_desc_id : cmp_gpa_id);
+    if (n > limit)
+        n = limit;
+    out_begin(&out);
+    for (int i = 0; i < n; i++) {
+        if (i == 0)
+            out_bytes(&out, hdr, fmt_header(hdr, FMT_TABLE));
+        out_row(&out, &rows[i], FMT_TABLE);
+    }
+    out_flush(&out);
+    free(rows);
+    return n;
+}
+
+/*
+ *  find_by_gpa_range
+ *      fd:      linux file descriptor of the database
+ *      lo, hi:  inclusive GPA range, as stored (350 is 3.50)
+ *
+ *  Prints the students with lo <= gpa <= hi, by GPA and then by id.  The
+ *  list lengths give the exact result size up front, which picks between
+ *  following the posting lists and scan_gpa_range().  Without index
+ *  coverage of the ids the range is always scanned.
+ *
+ *  returns:  <number>       the number of students printed
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  the matching students in the print_db() format
+ *            M_GPA_NOT_FND    no student in the range
+ *            M_ERR_DB_READ    error reading the database or index file
+ */
+int find_by_gpa_range(int fd, int lo, int hi)
+{
+    static int ids[GIDX_NIDS];
+    int printed = 0, expect = 0, rc = NO_ERROR;
+    out_buf_t out;
+
+    if (!sidecars_cover_ids(fd)) {
+        rc = printed = scan_gpa_range(fd, lo, hi, -1, false, INT32_MAX);
+    } else {
+        gidx_file_t *g = gidx_open_current(fd);
+        if (g == NULL) {
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+
+        for (int gpa = lo; gpa <= hi; gpa++)
+            expect += g->n[gpa];
+
+        if (expect > (int)g->hdr.count / GIDX_SCAN_FRACTION) {
+            rc = printed = scan_gpa_range(fd, lo, hi, expect, false, INT32_MAX);
+        } else {
+            out_begin(&out);
+            for (int gpa = lo; gpa <= hi && rc == NO_ERROR; gpa++) {
+                if (print_bucket(fd, g, gpa, GIDX_NIDS, ids, &printed, &out) < 0)
+                    rc = ERR_DB_FILE;
+            }
+            out_flush(&out);
+        }
+        gidx_unmap(g);
+    }
+
+    if (rc < 0) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (printed == 0)
+        printf(M_GPA_NOT_FND, lo / 100.0, hi / 100.0);
+    return printed;
+}
+
+/*
+ *  find_top_gpa
+ *      fd:  linux file descriptor of the database
+ *      k:   number of students wanted
+ *
+ *  Prints the k students with the highest GPA, highest first and by id
+ *  among equal GPAs, or all students if there are fewer than k.  Without
+ *  index coverage of the ids this is a scan and a sort.
+ *
+ *  returns:  <number>       the number of students printed
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  the students in the print_db() format
+ *            M_DB_EMPTY       the database is empty
+ *            M_ERR_DB_READ    error reading the database or index file
+ */
+int find_top_gpa(int fd, int k)
+{
+    static int ids[GIDX_NIDS];
+    int printed = 0, rc = NO_ERROR;
+    out_buf_t out;
+
+    if (!sidecars_cover_ids(fd)) {
+        printed = scan_gpa_range(fd, MIN_STD_GPA, MAX_STD_GPA, -1, true, k);
+        if (printed < 0) {
+            printf(M_ERR_DB_READ);
+            return ERR_DB_FILE;
+        }
+        if (printed == 0)
+            printf(M_DB_EMPTY);
+        return printed;
+    }
+
+    gidx_file_t *g = gidx_open_current(fd);
+    if (g == NULL) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    out_begin(&out);
+    for (int gpa = MAX_STD_GPA; gpa >= MIN_STD_GPA && printed < k && rc == NO_ERROR; gpa--) {
+        if (print_bucket(fd, g, gpa, k - printed, ids, &printed, &out) < 0)
+            rc = ERR_DB_FILE;
+    }
+    out_flush(&out);
+    gidx_unmap(g);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (printed == 0)
+        printf(M_DB_EMPTY);
+    return printed;
+}
+
+/*
+ *  drop_gpa_idx
+ *
+ *  Removes the index, used when the database is emptied.
+ */
+void drop_gpa_idx(void)
+{
+    unlink(GPA_IDX_FILE);
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Instrumentation (--stats, or $SDBSC_STATS).  The storage primitives are
+ *  bracketed with INSTR_START() and INSTR_STOP() (see sdbsc.h), which
+ *  count every call of a kind, the bytes it moved and the monotonic clock
+ *  time it took: the seeks, reads and writes of records, the record locks,
+ *  the log appends and syncs, formatting rows and writing the console
+ *  output.  Scans count the slots they looked at and the students among
+ *  them.  When the process ends, or the server stops, a summary goes to
+ *  stderr as a table or as JSON, so it never mixes with an export on
+ *  stdout.
+ *
+ *  The hooks are only compiled in with SDBSC_INSTR (make INSTR=1, the
+ *  default).  Built with make INSTR=0 they expand to nothing, and with
+ *  SDBSC_INSTR but without --stats each costs one well predicted branch.
+ */
+
+#ifdef SDBSC_INSTR
+#define INSTR_SYSCALLS  ((1 << INSTR_SEEK) | (1 << INSTR_READ) | (1 << INSTR_WRITE) | \
+                         (1 << INSTR_LOCK) | (1 << INSTR_LOG) | (1 << INSTR_SYNC) | \
+                         (1 << INSTR_OUT))
+
+static const char *ev_names[INSTR_NEVENTS] = {
+    "operation", "seek", "read", "write", "lock", "log", "sync", "output",
+    "format", "scanned", "live",
+};
+
+bool instr_enabled = false;
+
+static int instr_mode;                  // INSTR_TABLE or INSTR_JSON
+static struct {
+    long long calls;
+    long long ns;
+    long long bytes;
+} ev[INSTR_NEVENTS];
+
+long long instr_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//one call of kind e that started at t0 and moved bytes, the parallel
+//print and the batched lookups call it from several threads
+void instr_note(int e, long long t0, long long bytes)
+{
+    __atomic_fetch_add(&ev[e].calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ev[e].ns, instr_clock() - t0, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ev[e].bytes, bytes, __ATOMIC_RELAXED);
+}
+
+//n occurrences of e, nothing timed
+void instr_count(int e, long long n)
+{
+    __atomic_fetch_add(&ev[e].calls, n, __ATOMIC_RELAXED);
+}
+#endif
+
+/*
+ *  instr_parse
+ *      name:  "table" or "json", a value of $SDBSC_STATS
+ *
+ *  returns:  INSTR_TABLE or INSTR_JSON, or -1 for anything else
+ */
+int instr_parse(const char *name)
+{
+    if (strcmp(name, "table") == 0 || strcmp(name, "1") == 0)
+        return INSTR_TABLE;
+    if (strcmp(name, "json") == 0)
+        return INSTR_JSON;
+    return -1;
+}
+
+/*
+ *  instr_start
+ *      mode:  INSTR_TABLE or INSTR_JSON, the format of the summary
+ *
+ *  Starts counting.  A build without SDBSC_INSTR has nothing to count.
+ *
+ *  console:  M_ERR_INSTR_OFF on stderr in a build without SDBSC_INSTR
+ */
+void instr_start(int mode)
+{
+#ifdef SDBSC_INSTR
+    memset(ev, 0, sizeof(ev));
+    instr_mode = mode;
+    instr_enabled = true;
+#else
+    (void)mode;
+    fprintf(stderr, M_ERR_INSTR_OFF);
+#endif
+}
+
+/*
+ *  instr_report
+ *
+ *  Prints what was counted since instr_start() and stops counting.  Does
+ *  nothing when counting was never started.
+ *
+ *  console:  the summary, on stderr
+ */
+void instr_report(void)
+{
+#ifdef SDBSC_INSTR
+    long long syscalls = 0;
+
+    if (!instr_enabled)
+        return;
+    instr_enabled = false;
+    fflush(stdout);             // the operation's output comes first
+
+    for (int e = 0; e < INSTR_NEVENTS; e++) {
+        if (INSTR_SYSCALLS & (1 << e))
+            syscalls += ev[e].calls;
+    }
+
+    if (instr_mode == INSTR_JSON) {
+        fprintf(stderr, "{\"syscalls\": %lld", syscalls);
+        for (int e = 0; e < INSTR_NEVENTS; e++) {
+            if (e >= INSTR_SCANNED)
+                fprintf(stderr, ", \"%s\": %lld", ev_names[e], ev[e].calls);
+            else
+                fprintf(stderr, ", \"%s\": {\"calls\": %lld, \"ns\": %lld, \"bytes\": %lld}",
+                        ev_names[e], ev[e].calls, ev[e].ns, ev[e].bytes);
+        }
+        fprintf(stderr, "}\n");
+        return;
+    }
+
+    fprintf(stderr, "%-12s %10s %14s %12s %14s\n", "stats", "calls", "total us",
+            "avg ns", "bytes");
+    for (int e = 0; e < INSTR_SCANNED; e++) {
+        if (ev[e].calls == 0)
+            continue;
+        fprintf(stderr, "%-12s %10lld %14.1f %12lld %14lld\n", ev_names[e],
+                ev[e].calls, ev[e].ns / 1e3, ev[e].ns / ev[e].calls, ev[e].bytes);
+    }
+    fprintf(stderr, "%-12s %10lld\n", "syscalls", syscalls);
+    if (ev[INSTR_SCANNED].calls > 0)
+        fprintf(stderr, "%-12s %10lld slots, %lld live\n", "scanned",
+                ev[INSTR_SCANNED].calls, ev[INSTR_LIVE].calls);
+#endif
+}
@@ -0,0 +1,563 @@
+#define _GNU_SOURCE //needed for IOV_MAX
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Bulk loading.  Running ./sdbsc -a once per student costs a process
+ *  launch plus an open, seek, read, seek, write and close per row.  The
+ *  bulk loader reads "id,fname,lname,gpa" rows from a file or stdin, keeps
+ *  the set of used ids in an in-memory bitmap (so duplicate checks never
+ *  touch the disk), sorts each batch by id and writes runs of consecutive
+ *  ids with one pwritev() per run.  In a paged database a run is split at
+ *  the end of each data page, the pages need not follow each other in the
+ *  file.  Bulk updates take the same rows and change the students in
+ *  place, one pass over the input with the file locked.
+ */
+
+#define BULK_BATCH_ROWS     65536   //rows sorted and written together
+#define BULK_IOV_RECS       256     //records covered by one iovec
+
+//occupancy bitmap, one bit per possible student id.  A paged database
+//takes any 32 bit id, so the bitmap is kept in blocks of USED_BLOCK_IDS
+//ids that are only allocated once an id in them is seen
+#define USED_BLOCK_IDS      65536
+
+static uint64_t *used_ids[MAX_PAGED_STD_ID / USED_BLOCK_IDS + 1];
+
+static bool id_used(int id)
+{
+    const uint64_t *blk = used_ids[id / USED_BLOCK_IDS];
+    int bit = id % USED_BLOCK_IDS;
+    return blk != NULL && (blk[bit / 64] & (1ULL << (bit % 64)));
+}
+
+//returns false when out of memory
+static bool mark_id(int id)
+{
+    uint64_t **blk = &used_ids[id / USED_BLOCK_IDS];
+    int bit = id % USED_BLOCK_IDS;
+
+    if (*blk == NULL && (*blk = calloc(USED_BLOCK_IDS / 64, sizeof(uint64_t))) == NULL)
+        return false;
+    (*blk)[bit / 64] |= 1ULL << (bit % 64);
+    return true;
+}
+
+static void clear_ids(void)
+{
+    for (size_t i = 0; i < sizeof(used_ids) / sizeof(used_ids[0]); i++) {
+        free(used_ids[i]);
+        used_ids[i] = NULL;
+    }
+}
+
+//rejected rows are kept so they can be reported after the summary
+typedef struct rejected_row {
+    long line;
+    const char *reason;
+    char *text;
+} rejected_row_t;
+
+static rejected_row_t *rejects;
+static int n_rejects, cap_rejects;
+
+static void reject_row(long line, const char *reason, const char *text)
+{
+    if (n_rejects == cap_rejects) {
+        int cap = cap_rejects ? cap_rejects * 2 : 64;
+        rejected_row_t *r = realloc(rejects, cap * sizeof(rejected_row_t));
+        if (r == NULL)
+            return; // still counted as not loaded, just not itemized
+        rejects = r;
+        cap_rejects = cap;
+    }
+    rejects[n_rejects].line = line;
+    rejects[n_rejects].reason = reason;
+    rejects[n_rejects].text = strdup(text);
+    n_rejects++;
+}
+
+static int cmp_student_id(const void *a, const void *b)
+{
+    const student_t *sa = a, *sb = b;
+    return (sa->id > sb->id) - (sa->id < sb->id);
+}
+
+/*
+ *  load_existing_ids
+ *
+ *  Marks every id already present in the database with one pass of the
+ *  scan iterator.
+ */
+static int load_existing_ids(int fd)
+{
+    static db_scan_t sc;
+    student_t student;
+
+    clear_ids();
+
+    scan_open(&sc, fd);
+    while (scan_next(&sc, &student)) {
+        if (student.id >= MIN_STD_ID && !mark_id(student.id))
+            return ERR_DB_FILE;
+    }
+
+    return sc.failed ? ERR_DB_FILE : NO_ERROR;
+}
+
+/*
+ *  write_span
+ *
+ *  Writes n records to the file from offset on.  The span is contiguous
+ *  both in memory and in the file so it goes out with as few pwritev()
+ *  calls as the iovec limit allows.
+ */
+static int write_span(int fd, student_t *recs, int n, off_t offset)
+{
+    struct iovec iov[IOV_MAX];
+    char *base = (char *)recs;
+    size_t total = (size_t)n * sizeof(student_t);
+    size_t chunk = BULK_IOV_RECS * sizeof(student_t);
+    size_t done = 0;
+
+    while (done < total) {
+        int niov = 0;
+        for (size_t pos = done; pos < total && niov < IOV_MAX; pos += chunk) {
+            iov[niov].iov_base = base + pos;
+            iov[niov].iov_len = (total - pos < chunk) ? total - pos : chunk;
+            niov++;
+        }
+
+        // a short write is resumed from the first byte not written
+        ssize_t wrote = pwritev(fd, iov, niov, offset + done);
+        if (wrote <= 0)
+            return ERR_DB_FILE;
+        done += wrote;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  write_run
+ *
+ *  Writes n records with consecutive ids, starting with recs[0], to their
+ *  slots, as one span in a direct database and one per data page in a
+ *  paged one.
+ */
+static int write_run(int fd, student_t *recs, int n)
+{
+    while (n > 0) {
+        int len = n;
+        off_t offset = (off_t)recs[0].id * STUDENT_RECORD_SIZE;
+
+        if (paged_db(fd)) {
+            if (len > PG_RECS - recs[0].id % PG_RECS)
+                len = PG_RECS - recs[0].id % PG_RECS;
+            offset = paged_slot_offset(fd, recs[0].id, true);
+        }
+        if (offset < 0 || write_span(fd, recs, len, offset) != NO_ERROR)
+            return ERR_DB_FILE;
+        recs += len;
+        n -= len;
+    }
+    return NO_ERROR;
+}
+
+//sorts a batch and writes it as runs of consecutive ids
+static int flush_batch(int fd, student_t *batch, int n)
+{
+    qsort(batch, n, sizeof(student_t), cmp_student_id);
+
+    int start = 0;
+    for (int i = 1; i <= n; i++) {
+        if (i == n || batch[i].id != batch[i - 1].id + 1) {
+            if (write_run(fd, &batch[start], i - start) != NO_ERROR)
+                return ERR_DB_FILE;
+            start = i;
+        }
+    }
+    return NO_ERROR;
+}
+
+//trims leading and trailing blanks from a field in place
+static char *trim(char *s)
+{
+    while (isspace((unsigned char)*s))
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+//strict integer parse, the whole field must be a number
+static bool parse_int(const char *s, int *out)
+{
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || v < INT_MIN || v > INT_MAX)
+        return false;
+    *out = (int)v;
+    return true;
+}
+
+/*
+ *  parse_row
+ *      line:  one input line, modified in place
+ *      *s:    where the parsed student is built
+ *
+ *  returns:  NULL if the row is valid, otherwise the reason it is rejected
+ */
+static const char *parse_row(char *line, student_t *s)
+{
+    char *field[4];
+    char *p = line;
+    int id, gpa;
+
+    for (int i = 0; i < 4; i++) {
+        field[i] = p;
+        p = strchr(p, ',');
+        if (i < 3) {
+            if (p == NULL)
+                return "expected id,fname,lname,gpa";
+            *p++ = '\0';
+        } else if (p != NULL) {
+            return "expected id,fname,lname,gpa";
+        }
+        field[i] = trim(field[i]);
+    }
+
+    if (!parse_int(field[0], &id) || !parse_int(field[3], &gpa))
+        return "id and gpa must be integers";
+    if (*field[1] == '\0' || *field[2] == '\0')
+        return "missing name";
+    if (validate_range(id, gpa) != NO_ERROR)
+        return "id or gpa out of range";
+
+    memset(s, 0, sizeof(student_t));
+    s->id = id;
+    strncpy(s->fname, field[1], sizeof(s->fname) - 1);
+    strncpy(s->lname, field[2], sizeof(s->lname) - 1);
+    s->gpa = gpa;
+    return NULL;
+}
+
+/*
+ *  bulk_load
+ *      fd:    linux file descriptor
+ *      path:  file of "id,fname,lname,gpa" rows, or "-" for stdin
+ *
+ *  Loads many students in one pass.  Every row is validated with
+ *  validate_range() and checked against the occupancy bitmap, which starts
+ *  out holding the ids already in the database and gains each id as it is
+ *  accepted, so duplicates inside the input are rejected as well.  Blank
+ *  lines are ignored.  The database header is updated once at the end.
+ *
+ *  returns:  <number>       number of students loaded
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      the input could not be opened
+ *
+ *  console:  M_BULK_SUMMARY   on success, followed by one M_BULK_REJECT
+ *                             line per rejected row
+ *            M_ERR_BULK_INPUT the input could not be opened
+ *            M_ERR_DB_READ    error reading the database file
+ *            M_ERR_DB_WRITE   error writing the database file
+ */
+int bulk_load(int fd, char *path)
+{
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (in == NULL) {
+        printf(M_ERR_BULK_INPUT, path);
+        return ERR_DB_OP;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    student_t *batch = malloc(BULK_BATCH_ROWS * sizeof(student_t));
+    char *line = NULL;
+    size_t line_cap = 0;
+    long line_no = 0;
+    int n_batch = 0, loaded = 0, rc = NO_ERROR;
+    const char *err_msg = M_ERR_DB_WRITE;
+    db_header_t hdr;
+
+    n_rejects = 0;
+
+    // the loader writes behind the backend's back, so the mmap or mem
+    // backend is detached (trimming the mapping's slack or writing back)
+    // and re-attached when the load is done, and so is the buffer pool
+    // after writing back its changes
+    bool remap = backend_attached(fd);
+    bool recache = bufpool_attached(fd);
+
+    // the duplicate checks use the bitmap, not the file, so no other
+    // process may change the file during the load
+    if (backend_detach() != NO_ERROR || lock_current(fd, -1) != NO_ERROR ||
+        bufpool_detach() != NO_ERROR)
+        rc = ERR_DB_FILE;
+
+    // the rows are not logged, with the write-ahead log on the database is
+    // checkpointed before the load and synced after it instead
+    if (rc != NO_ERROR || batch == NULL || wal_checkpoint(fd) != NO_ERROR) {
+        rc = ERR_DB_FILE;
+    } else if (load_existing_ids(fd) != NO_ERROR ||
+               stats_load(fd, &hdr) != NO_ERROR) {
+        err_msg = M_ERR_DB_READ;
+        rc = ERR_DB_FILE;
+    }
+
+    while (rc == NO_ERROR && getline(&line, &line_cap, in) != -1) {
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (*trim(line) == '\0')
+            continue;
+
+        char *text = strdup(line);
+        const char *reason = parse_row(line, &batch[n_batch]);
+        if (reason == NULL && id_used(batch[n_batch].id))
+            reason = "duplicate id";
+
+        if (reason != NULL) {
+            reject_row(line_no, reason, text ? text : "");
+        } else if (!mark_id(batch[n_batch].id)) {
+            rc = ERR_DB_FILE;
+        } else {
+            stats_hdr_add(&hdr, &batch[n_batch]);
+            if (++n_batch == BULK_BATCH_ROWS) {
+                rc = flush_batch(fd, batch, n_batch);
+                loaded += n_batch;
+                n_batch = 0;
+            }
+        }
+        free(text);
+    }
+
+    if (rc == NO_ERROR && n_batch > 0) {
+        rc = flush_batch(fd, batch, n_batch);
+        loaded += n_batch;
+    }
+
+    // the header is written once for the whole load
+    if (rc == NO_ERROR && loaded > 0)
+        rc = stats_save(fd, &hdr);
+    if (rc == NO_ERROR && loaded > 0)
+        rc = wal_checkpoint(fd);
+    unlock_db(fd);
+
+    if (rc == NO_ERROR && remap && backend_attach(fd) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc == NO_ERROR && recache && bufpool_attach(fd) != NO_ERROR)
+        rc = ERR_DB_FILE;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    if (rc == NO_ERROR) {
+        printf(M_BULK_SUMMARY, loaded, n_rejects, secs,
+               secs > 0 ? loaded / secs : 0.0);
+        for (int i = 0; i < n_rejects; i++)
+            printf(M_BULK_REJECT, rejects[i].line, rejects[i].reason,
+                   rejects[i].text ? rejects[i].text : "");
+    } else {
+        printf("%s", err_msg);
+    }
+
+    for (int i = 0; i < n_rejects; i++)
+        free(rejects[i].text);
+    clear_ids();
+    free(line);
+    free(batch);
+    if (in != stdin)
+        fclose(in);
+
+    return rc == NO_ERROR ? loaded : rc;
+}
+
+/*
+ *  parse_update
+ *      line:  one input line, modified in place
+ *      *id:   where the id is stored
+ *      **fname, **lname:  set to the new names, or NULL for an empty field
+ *      *gpa:  set to the new GPA, or -1 for an empty field
+ *
+ *  returns:  NULL if the row is valid, otherwise the reason it is rejected
+ */
+static const char *parse_update(char *line, int *id, char **fname, char **lname,
+                                int *gpa)
+{
+    char *field[4];
+    char *p = line;
+
+    for (int i = 0; i < 4; i++) {
+        field[i] = p;
+        p = strchr(p, ',');
+        if (i < 3) {
+            if (p == NULL)
+                return "expected id,fname,lname,gpa";
+            *p++ = '\0';
+        } else if (p != NULL) {
+            return "expected id,fname,lname,gpa";
+        }
+        field[i] = trim(field[i]);
+    }
+
+    *gpa = -1;
+    if (!parse_int(field[0], id) || (*field[3] != '\0' && !parse_int(field[3], gpa)))
+        return "id and gpa must be integers";
+    if (*id < MIN_STD_ID || *id > db_max_std_id() ||
+        (*field[3] != '\0' && (*gpa < MIN_STD_GPA || *gpa > MAX_STD_GPA)))
+        return "id or gpa out of range";
+    if (*field[1] == '\0' && *field[2] == '\0' && *field[3] == '\0')
+        return "nothing to update";
+
+    *fname = *field[1] != '\0' ? field[1] : NULL;
+    *lname = *field[2] != '\0' ? field[2] : NULL;
+    return NULL;
+}
+
+/*
+ *  bulk_update
+ *      fd:    linux file descriptor
+ *      path:  file of "id,fname,lname,gpa" rows, or "-" for stdin
+ *
+ *  Updates many students in one pass, such as a nightly recalculation of
+ *  every GPA ("17,,,385").  An empty field keeps what is stored.  Each row
+ *  costs one read of the record and one write of the bytes that changed
+ *  (see patch_record()).  The whole file is locked for the pass, so the
+ *  record and header locks of update_student() are not taken per row, and
+ *  the header is written once at the end.  Rows for ids that are not in
+ *  the database are rejected, blank lines are ignored.
+ *
+ *  returns:  <number>       number of students updated
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      the input could not be opened
+ *
+ *  console:  M_UPD_SUMMARY    on success, followed by one M_BULK_REJECT
+ *                             line per rejected row
+ *            M_ERR_BULK_INPUT the input could not be opened
+ *            M_ERR_DB_READ    error reading the database file
+ *            M_ERR_DB_WRITE   error writing the database file
+ */
+int bulk_update(int fd, char *path)
+{
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (in == NULL) {
+        printf(M_ERR_BULK_INPUT, path);
+        return ERR_DB_OP;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    long line_no = 0;
+    int updated = 0, rc = NO_ERROR;
+    bool hdr_changed = false;
+    const char *err_msg = M_ERR_DB_WRITE;
+    db_header_t hdr;
+
+    n_rejects = 0;
+
+    // the rows are not logged, with the write-ahead log on the database is
+    // checkpointed before the pass and synced after it instead
+    if (lock_current(fd, -1) != NO_ERROR || wal_checkpoint(fd) != NO_ERROR) {
+        rc = ERR_DB_FILE;
+    } else if (stats_load(fd, &hdr) != NO_ERROR) {
+        err_msg = M_ERR_DB_READ;
+        rc = ERR_DB_FILE;
+    }
+
+    while (rc == NO_ERROR && getline(&line, &line_cap, in) != -1) {
+        student_t student, upd;
+        char *fname, *lname;
+        int id, gpa;
+
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (*trim(line) == '\0')
+            continue;
+
+        char *text = strdup(line);
+        const char *reason = parse_update(line, &id, &fname, &lname, &gpa);
+        if (reason == NULL) {
+            int found = get_student(fd, id, &student);
+            if (found == ERR_DB_FILE) {
+                err_msg = M_ERR_DB_READ;
+                rc = ERR_DB_FILE;
+            } else if (found == SRCH_NOT_FOUND) {
+                reason = "student not in database";
+            }
+        }
+
+        if (reason != NULL) {
+            reject_row(line_no, reason, text ? text : "");
+        } else if (rc == NO_ERROR) {
+            upd = student;
+            if (fname != NULL) {
+                memset(upd.fname, 0, sizeof(upd.fname));
+                strncpy(upd.fname, fname, sizeof(upd.fname) - 1);
+            }
+            if (lname != NULL) {
+                memset(upd.lname, 0, sizeof(upd.lname));
+                strncpy(upd.lname, lname, sizeof(upd.lname) - 1);
+            }
+            if (gpa >= 0 && gpa != student.gpa) {
+                upd.gpa = gpa;
+                stats_hdr_del(&hdr, student.gpa);
+                stats_hdr_add(&hdr, &upd);
+                hdr_changed = true;
+            }
+            rc = patch_record(fd, &student, &upd);
+            if (rc == NO_ERROR) {
+                sidecars_note_del(&student);
+                sidecars_note_add(&upd);
+                updated++;
+            }
+        }
+        free(text);
+    }
+
+    // the header is written once for the whole pass
+    if (rc == NO_ERROR && hdr_changed)
+        rc = stats_save(fd, &hdr);
+    if (rc == NO_ERROR && updated > 0)
+        rc = wal_checkpoint(fd);
+    unlock_db(fd);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    if (rc == NO_ERROR) {
+        printf(M_UPD_SUMMARY, updated, n_rejects, secs,
+               secs > 0 ? updated / secs : 0.0);
+        for (int i = 0; i < n_rejects; i++)
+            printf(M_BULK_REJECT, rejects[i].line, rejects[i].reason,
+                   rejects[i].text ? rejects[i].text : "");
+    } else {
+        printf("%s", err_msg);
+    }
+
+    for (int i = 0; i < n_rejects; i++)
+        free(rejects[i].text);
+    free(line);
+    if (in != stdin)
+        fclose(in);
+
+    return rc == NO_ERROR ? updated : rc;
+}
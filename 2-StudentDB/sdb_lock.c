@@ -0,0 +1,192 @@
+#define _GNU_SOURCE //needed for F_OFD_SETLKW
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Record locks.  Any number of sdbsc processes may work on student.db at
+ *  once, so the read-check-write of add_student() and del_student() has to
+ *  be atomic with respect to the others, or two processes adding the same
+ *  id can both find the slot empty and both write it.  A lock on the whole
+ *  file would serialize every operation, so instead each operation locks
+ *  just the 64 byte range of the record it works on, with open file
+ *  description (OFD) locks from fcntl(F_OFD_SETLKW).  Unlike classic POSIX
+ *  record locks these belong to the open file rather than the process, so
+ *  they also work between the threads of the parallel print and are not
+ *  dropped when some other fd of the same file is closed.
+ *
+ *  The rules, which keep lock waits free of cycles:
+ *
+ *    - a change locks its record exclusively, then the header (slot 0)
+ *      exclusively for the read-modify-write of the header, the log and
+ *      the sidecars.  Nothing else is ever held while waiting for a record.
+ *    - a scan locks each batch shared while it reads it, holding no other
+ *      lock.
+ *    - compress, -z, a bulk load, --rebuild-stats and log recovery lock
+ *      the whole file exclusively.  While the whole file is held the
+ *      record locks taken by the code they call are no-ops.
+ *    - a process with the write-ahead log open holds a shared lock on
+ *      WAL_FILE, log recovery only replays a log it can lock exclusively
+ *      without waiting (see sdb_wal.c).
+ *
+ *  The locks are advisory, they only keep sdbsc processes apart.  On a
+ *  filesystem without OFD lock support the functions do nothing.
+ */
+
+static int whole_fd = -1;       // fd holding the whole file lock, if any
+static int whole_depth = 0;     // lock_db() calls not yet undone
+static bool no_locks = false;   // the filesystem has no OFD locks
+
+/*
+ *  lock_range
+ *      fd:     linux file descriptor of the database
+ *      start:  first byte of the range
+ *      len:    bytes in the range, 0 for up to the end of the file and beyond
+ *      type:   F_RDLCK, F_WRLCK or F_UNLCK
+ *
+ *  Takes, changes or releases a lock, waiting for conflicting locks held
+ *  by others to go away.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int lock_range(int fd, off_t start, off_t len, short type)
+{
+    struct flock fl = {0};
+
+    if (no_locks || fd == whole_fd)
+        return NO_ERROR;
+
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = len;
+
+    // the time includes waiting for the lock
+    INSTR_START(t);
+    while (fcntl(fd, F_OFD_SETLKW, &fl) == -1) {
+        if (errno == EINTR)
+            continue;
+        if (errno == EINVAL || errno == ENOLCK) {
+            no_locks = true;
+            return NO_ERROR;
+        }
+        return ERR_DB_FILE;
+    }
+    INSTR_STOP(INSTR_LOCK, t, 0);
+    return NO_ERROR;
+}
+
+/*
+ *  trylock_range
+ *      fd, start, len, type:  as for lock_range()
+ *
+ *  Takes or changes a lock like lock_range(), but does not wait when a
+ *  conflicting lock is held by another open file.
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP if the range is locked by someone else,
+ *            or ERR_DB_FILE
+ */
+int trylock_range(int fd, off_t start, off_t len, short type)
+{
+    struct flock fl = {0};
+
+    if (no_locks || fd == whole_fd)
+        return NO_ERROR;
+
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = len;
+
+    while (fcntl(fd, F_OFD_SETLK, &fl) == -1) {
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EACCES)
+            return ERR_DB_OP;
+        if (errno == EINVAL || errno == ENOLCK) {
+            no_locks = true;
+            return NO_ERROR;
+        }
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  lock_record / unlock_record
+ *      fd:    linux file descriptor of the database
+ *      id:    the slot, 0 is the header
+ *      type:  F_RDLCK or F_WRLCK
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int lock_record(int fd, int id, short type)
+{
+    return lock_range(fd, (off_t)id * STUDENT_RECORD_SIZE, STUDENT_RECORD_SIZE, type);
+}
+
+void unlock_record(int fd, int id)
+{
+    lock_range(fd, (off_t)id * STUDENT_RECORD_SIZE, STUDENT_RECORD_SIZE, F_UNLCK);
+}
+
+/*
+ *  lock_db / unlock_db
+ *      fd:    linux file descriptor of the database
+ *      type:  F_RDLCK or F_WRLCK
+ *
+ *  Locks the whole file.  Until unlock_db() the record and range locks on
+ *  fd do nothing, the whole file lock already covers them.  Whole file
+ *  locks on the same fd nest, so an operation that takes one can run
+ *  while the buffer pool (sdb_bufpool.c) holds it; the lock is released
+ *  by the unlock_db() matching the first lock_db().
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int lock_db(int fd, short type)
+{
+    if (fd == whole_fd) {
+        whole_depth++;
+        return NO_ERROR;
+    }
+
+    int rc = lock_range(fd, 0, 0, type);
+    if (rc == NO_ERROR) {
+        whole_fd = fd;
+        whole_depth = 1;
+    }
+    return rc;
+}
+
+void unlock_db(int fd)
+{
+    if (fd != whole_fd || --whole_depth > 0)
+        return;
+    whole_fd = -1;
+    lock_range(fd, 0, 0, F_UNLCK);
+}
+
+/*
+ *  unlock_db_closing
+ *      fd:  linux file descriptor about to be closed
+ *
+ *  Closing fd drops its locks, so the whole file lock on it is forgotten
+ *  here, however deeply nested, before the fd number can be reused by a
+ *  file that is not locked.  The unlock_db() calls still to come for fd
+ *  do nothing.
+ */
+void unlock_db_closing(int fd)
+{
+    if (fd != whole_fd)
+        return;
+    whole_fd = -1;
+    whole_depth = 0;
+}
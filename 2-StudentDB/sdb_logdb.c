@@ -0,0 +1,705 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The log-structured storage backend (--backend log).  In the direct
+ *  format every change is a 64 byte write at id * 64, so a run of adds or
+ *  deletes in random id order scatters small writes all over the file.
+ *  With this backend nothing is written in place while it is attached:
+ *  every record written, the header included, is appended as an entry to
+ *  the current segment file (LOG_SEG_FILE), LOG_BUF_BYTES at a time, and a
+ *  delete appends the empty record as a tombstone.  An in-memory table maps
+ *  each id written to the segment and offset of its latest entry, reads
+ *  are served from there, and ids not in the table from the file.
+ *
+ *  A segment is sealed once it holds LOG_SEG_BYTES and a new one started.
+ *  Each segment counts its entries that are still the latest for their id,
+ *  and when LOG_COMPACT_SEGS sealed segments are at least half superseded
+ *  a compactor thread copies their live entries, tombstones included, into
+ *  one new segment while the changes keep being appended.  The result takes
+ *  the number of the newest segment it replaces, so replaying the segments
+ *  in order still ends with the latest entry of every id.
+ *
+ *  Syncing the backend merges the segments into the database file: the
+ *  latest entries are written in id order, runs of consecutive ids with one
+ *  pwrite() each, then the segments are removed.  It happens before scans
+ *  and snapshots read the file and when the backend is detached, so -x
+ *  compacts the log into the file first and then compresses the file.
+ *
+ *  Like mem the backend holds the whole file lock while it is attached.
+ *  Segments left behind by a process that died are replayed into the file
+ *  by open_db(), before the write-ahead log, whose entries are newer.  The
+ *  entries not yet written out are lost with the process, as with mem, the
+ *  write-ahead log is what makes changes durable.  A paged database works
+ *  too, its merge writes through the directory a record at a time.
+ */
+
+#define LOG_MAGIC           0x4c424453          //"SDBL" on disk
+#define LOG_SEG_BYTES       (1024 * 1024)       //a segment is sealed at this size
+#define LOG_BUF_BYTES       (64 * 1024)         //appends are written this many at a time
+#define LOG_COMPACT_SEGS    4                   //half dead sealed segments that start the compactor
+#define LOG_IDX_MIN         4096                //initial slots of the id table
+#define LOG_NAME_MAX        32                  //room for a segment's file name
+
+typedef struct log_entry {
+    uint32_t magic;
+    uint32_t crc;                   //crc32 of everything after this field
+    int32_t id;                     //slot of rec
+    uint32_t unused;
+    student_t rec;                  //the slot after the change, empty for a tombstone
+} log_entry_t;
+
+#define LOG_BUF_ENTRIES     (LOG_BUF_BYTES / sizeof(log_entry_t))
+#define LOG_RUN_RECS        (LOG_BUF_BYTES / sizeof(student_t))
+
+typedef struct log_seg {
+    uint32_t no;                    //number in the file name, in append order
+    int fd;
+    off_t size;                     //bytes written to the file
+    uint32_t live;                  //entries still the latest for their id
+} log_seg_t;
+
+typedef struct log_loc {
+    int32_t id;                     //-1 for an unused slot of the table
+    uint32_t seg;
+    uint32_t off;
+} log_loc_t;
+
+//a compaction: the sealed segments it merges, in number order
+typedef struct log_job {
+    int n;
+    log_seg_t seg[];
+} log_job_t;
+
+//an entry the compactor copied, re-pointed if still the latest
+typedef struct log_move {
+    int32_t id;
+    uint32_t old_seg;
+    uint32_t old_off;
+    uint32_t new_off;
+} log_move_t;
+
+static struct {
+    int fd;                 // fd of the attached database, -1 if none
+    log_seg_t *segs;        // by number, the last one is appended to
+    int nsegs;
+    uint32_t next_no;       // number of the next segment started
+    char buf[LOG_BUF_BYTES];// appends not yet written to the last segment
+    size_t buf_len;
+    log_loc_t *idx;         // id -> latest entry, open addressing
+    size_t idx_cap;
+    size_t idx_used;
+    pthread_mutex_t lock;   // the segments and the table, with the compactor
+    pthread_t compactor;
+    bool compacting;        // the compactor has not finished
+    bool joinable;          // the compactor has not been joined
+} lg = {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static uint32_t entry_crc(const log_entry_t *e)
+{
+    return sdb_crc32(&e->id, sizeof(*e) - offsetof(log_entry_t, id));
+}
+
+static void seg_name(char *name, uint32_t no)
+{
+    snprintf(name, LOG_NAME_MAX, LOG_SEG_FILE, no);
+}
+
+static log_seg_t *seg_find(uint32_t no)
+{
+    for (int i = lg.nsegs - 1; i >= 0; i--) {
+        if (lg.segs[i].no == no)
+            return &lg.segs[i];
+    }
+    return NULL;
+}
+
+static int write_all(int fd, const void *buf, size_t len, off_t off)
+{
+    for (size_t done = 0; done < len; ) {
+        INSTR_START(t);
+        ssize_t n = pwrite(fd, (const char *)buf + done, len - done, off + done);
+        INSTR_STOP(INSTR_WRITE, t, n > 0 ? n : 0);
+        if (n <= 0)
+            return ERR_DB_FILE;
+        done += n;
+    }
+    return NO_ERROR;
+}
+
+//the slot of id in the table, or the unused slot where it would go
+static log_loc_t *idx_find(int id)
+{
+    size_t mask = lg.idx_cap - 1;
+    size_t i = ((uint32_t)id * 2654435761u) & mask;
+
+    while (lg.idx[i].id != id && lg.idx[i].id != -1)
+        i = (i + 1) & mask;
+    return &lg.idx[i];
+}
+
+static int idx_grow(void)
+{
+    log_loc_t *old = lg.idx;
+    size_t old_cap = lg.idx_cap;
+    size_t cap = old_cap ? old_cap * 2 : LOG_IDX_MIN;
+
+    log_loc_t *idx = malloc(cap * sizeof(log_loc_t));
+    if (idx == NULL)
+        return ERR_DB_FILE;
+    memset(idx, 0xff, cap * sizeof(log_loc_t));
+
+    lg.idx = idx;
+    lg.idx_cap = cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].id != -1)
+            *idx_find(old[i].id) = old[i];
+    }
+    free(old);
+    return NO_ERROR;
+}
+
+//points id at a new entry, moving the live count from the segment of the
+//entry it supersedes
+static int idx_put(int id, uint32_t seg, uint32_t off)
+{
+    if ((lg.idx_used + 1) * 2 > lg.idx_cap && idx_grow() != NO_ERROR)
+        return ERR_DB_FILE;
+
+    log_loc_t *l = idx_find(id);
+    if (l->id == -1) {
+        l->id = id;
+        lg.idx_used++;
+    } else {
+        log_seg_t *prev = seg_find(l->seg);
+        if (prev != NULL)
+            prev->live--;
+    }
+    l->seg = seg;
+    l->off = off;
+    seg_find(seg)->live++;
+    return NO_ERROR;
+}
+
+//writes the buffered appends to the end of the last segment
+static int logdb_flush(void)
+{
+    if (lg.buf_len == 0)
+        return NO_ERROR;
+
+    log_seg_t *a = &lg.segs[lg.nsegs - 1];
+    if (write_all(a->fd, lg.buf, lg.buf_len, a->size) != NO_ERROR)
+        return ERR_DB_FILE;
+    a->size += lg.buf_len;
+    lg.buf_len = 0;
+    return NO_ERROR;
+}
+
+static int seg_start(void)
+{
+    char name[LOG_NAME_MAX];
+    log_seg_t *segs = realloc(lg.segs, (lg.nsegs + 1) * sizeof(log_seg_t));
+    if (segs == NULL)
+        return ERR_DB_FILE;
+    lg.segs = segs;
+
+    seg_name(name, lg.next_no);
+    int fd = open(name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return ERR_DB_FILE;
+
+    lg.segs[lg.nsegs++] = (log_seg_t){lg.next_no++, fd, 0, 0};
+    return NO_ERROR;
+}
+
+//copies the entry at off in segment no, which may still be buffered
+static int read_entry(uint32_t no, uint32_t off, log_entry_t *e)
+{
+    log_seg_t *s = seg_find(no);
+    if (s == NULL)
+        return ERR_DB_FILE;
+
+    if (s == &lg.segs[lg.nsegs - 1] && off >= s->size) {
+        memcpy(e, lg.buf + (off - s->size), sizeof(*e));
+        return NO_ERROR;
+    }
+
+    INSTR_START(t);
+    ssize_t n = pread(s->fd, e, sizeof(*e), off);
+    INSTR_STOP(INSTR_READ, t, n > 0 ? n : 0);
+    return n == sizeof(*e) ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  logdb_compact
+ *      arg:  the log_job_t of the segments to merge, freed here
+ *
+ *  The compactor thread.  The segments of the job are sealed, so they are
+ *  read without the lock, which is only taken to check which entries are
+ *  still the latest and, once their copies are written, to put the new
+ *  segment in place of the old ones.  An entry superseded meanwhile keeps
+ *  its newer location.  On any error the old segments are left as they
+ *  are, compaction only saves space.
+ */
+static void *logdb_compact(void *arg)
+{
+    log_job_t *job = arg;
+    uint32_t target = job->seg[job->n - 1].no;
+    log_entry_t *in = malloc(LOG_BUF_BYTES);
+    log_entry_t *out = malloc(LOG_BUF_BYTES);
+    log_move_t *moved = NULL;
+    size_t nmoved = 0, moved_cap = 0, nout = 0;
+    off_t out_size = 0;
+    char name[LOG_NAME_MAX];
+
+    int tfd = open(LOG_SEG_TMP_FILE, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    bool ok = in != NULL && out != NULL && tfd != -1;
+
+    for (int j = 0; ok && j < job->n; j++) {
+        log_seg_t *s = &job->seg[j];
+
+        for (off_t pos = 0; ok && pos < s->size; ) {
+            INSTR_START(t);
+            ssize_t got = pread(s->fd, in, LOG_BUF_ENTRIES * sizeof(log_entry_t), pos);
+            INSTR_STOP(INSTR_READ, t, got > 0 ? got : 0);
+            size_t n = got > 0 ? (size_t)got / sizeof(log_entry_t) : 0;
+            if (n == 0) {
+                ok = false;
+                break;
+            }
+
+            // room for every entry of the chunk, the writes outside the lock
+            if (nout + n > LOG_BUF_ENTRIES) {
+                ok = write_all(tfd, out, nout * sizeof(log_entry_t), out_size) == NO_ERROR;
+                out_size += nout * sizeof(log_entry_t);
+                nout = 0;
+            }
+            if (nmoved + n > moved_cap) {
+                moved_cap = (nmoved + n) * 2;
+                log_move_t *m = realloc(moved, moved_cap * sizeof(log_move_t));
+                ok = ok && m != NULL;
+                if (m != NULL)
+                    moved = m;
+            }
+
+            pthread_mutex_lock(&lg.lock);
+            for (size_t k = 0; ok && k < n; k++) {
+                uint32_t off = pos + k * sizeof(log_entry_t);
+                log_loc_t *l = idx_find(in[k].id);
+                if (l->id != in[k].id || l->seg != s->no || l->off != off)
+                    continue;
+                moved[nmoved++] = (log_move_t){in[k].id, s->no, off,
+                                               out_size + nout * sizeof(log_entry_t)};
+                out[nout++] = in[k];
+            }
+            pthread_mutex_unlock(&lg.lock);
+            pos += n * sizeof(log_entry_t);
+        }
+    }
+    if (ok && write_all(tfd, out, nout * sizeof(log_entry_t), out_size) != NO_ERROR)
+        ok = false;
+    out_size += nout * sizeof(log_entry_t);
+
+    pthread_mutex_lock(&lg.lock);
+    seg_name(name, target);
+    if (ok && rename(LOG_SEG_TMP_FILE, name) == 0) {
+        uint32_t live = 0;
+        for (size_t i = 0; i < nmoved; i++) {
+            log_loc_t *l = idx_find(moved[i].id);
+            if (l->seg == moved[i].old_seg && l->off == moved[i].old_off) {
+                l->seg = target;
+                l->off = moved[i].new_off;
+                live++;
+            }
+        }
+
+        // the old segments go, the new one takes the place of the last
+        int w = 0;
+        for (int i = 0; i < lg.nsegs; i++) {
+            log_seg_t *s = &lg.segs[i];
+            bool merged = false;
+            for (int j = 0; j < job->n && !merged; j++)
+                merged = job->seg[j].no == s->no;
+            if (!merged) {
+                lg.segs[w++] = *s;
+                continue;
+            }
+            close(s->fd);
+            if (s->no != target) {
+                seg_name(name, s->no);
+                unlink(name);
+            } else {
+                lg.segs[w++] = (log_seg_t){target, tfd, out_size, live};
+                tfd = -1;
+            }
+        }
+        lg.nsegs = w;
+    } else {
+        unlink(LOG_SEG_TMP_FILE);
+    }
+    lg.compacting = false;
+    pthread_mutex_unlock(&lg.lock);
+
+    if (tfd != -1)
+        close(tfd);
+    free(moved);
+    free(out);
+    free(in);
+    free(job);
+    return NULL;
+}
+
+static void logdb_join(void)
+{
+    if (lg.joinable) {
+        pthread_join(lg.compactor, NULL);
+        lg.joinable = false;
+    }
+}
+
+static bool seg_half_dead(const log_seg_t *s)
+{
+    return (off_t)(s->live * sizeof(log_entry_t) * 2) <= s->size;
+}
+
+//starts the compactor when enough sealed segments are half dead, called
+//with the lock held
+static void logdb_maybe_compact(void)
+{
+    int n = 0;
+
+    if (lg.compacting)
+        return;
+    logdb_join();
+
+    for (int i = 0; i < lg.nsegs - 1; i++) {
+        if (seg_half_dead(&lg.segs[i]))
+            n++;
+    }
+    if (n < LOG_COMPACT_SEGS)
+        return;
+
+    log_job_t *job = malloc(sizeof(log_job_t) + n * sizeof(log_seg_t));
+    if (job == NULL)
+        return;
+    job->n = 0;
+    for (int i = 0; i < lg.nsegs - 1; i++) {
+        if (seg_half_dead(&lg.segs[i]))
+            job->seg[job->n++] = lg.segs[i];
+    }
+
+    lg.compacting = true;
+    if (pthread_create(&lg.compactor, NULL, logdb_compact, job) != 0) {
+        lg.compacting = false;
+        free(job);
+        return;
+    }
+    lg.joinable = true;
+}
+
+//closes every segment, removing the files unless they must be replayed
+static void logdb_drop(bool remove)
+{
+    char name[LOG_NAME_MAX];
+
+    for (int i = 0; i < lg.nsegs; i++) {
+        close(lg.segs[i].fd);
+        if (remove) {
+            seg_name(name, lg.segs[i].no);
+            unlink(name);
+        }
+    }
+    free(lg.segs);
+    lg.segs = NULL;
+    lg.nsegs = 0;
+    lg.buf_len = 0;
+    if (lg.idx != NULL)
+        memset(lg.idx, 0xff, lg.idx_cap * sizeof(log_loc_t));
+    lg.idx_used = 0;
+}
+
+static int cmp_loc(const void *a, const void *b)
+{
+    const log_loc_t *x = a, *y = b;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/*
+ *  logdb_sync
+ *      fd:  linux file descriptor of the attached database
+ *
+ *  Merges the segments into the file: the latest entry of every id is
+ *  written in id order, a run of consecutive ids with one pwrite() in the
+ *  direct format, then the segments are removed.
+ */
+static int logdb_sync(int fd)
+{
+    log_entry_t e;
+    int rc = NO_ERROR;
+
+    logdb_join();
+    if (lg.nsegs == 0)
+        return NO_ERROR;
+    if (logdb_flush() != NO_ERROR)
+        return ERR_DB_FILE;
+
+    log_loc_t *locs = malloc((lg.idx_used + 1) * sizeof(log_loc_t));
+    student_t *run = malloc(LOG_RUN_RECS * sizeof(student_t));
+    if (locs == NULL || run == NULL) {
+        free(locs);
+        free(run);
+        return ERR_DB_FILE;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < lg.idx_cap; i++) {
+        if (lg.idx[i].id != -1)
+            locs[n++] = lg.idx[i];
+    }
+    qsort(locs, n, sizeof(log_loc_t), cmp_loc);
+
+    bool paged = paged_db(fd);
+    for (size_t i = 0; i < n && rc == NO_ERROR; ) {
+        int first = locs[i].id;
+        size_t k = 0;
+
+        while (i < n && k < LOG_RUN_RECS && locs[i].id == first + (int)k &&
+               (k == 0 || !paged)) {
+            rc = read_entry(locs[i].seg, locs[i].off, &e);
+            if (rc != NO_ERROR)
+                break;
+            run[k++] = e.rec;
+            i++;
+        }
+        if (rc != NO_ERROR)
+            break;
+
+        if (paged)
+            rc = fd_backend.write_rec(fd, first, &run[0]);
+        else
+            rc = write_all(fd, run, k * sizeof(student_t), (off_t)first * sizeof(student_t));
+    }
+    free(run);
+    free(locs);
+    if (rc != NO_ERROR)
+        return ERR_DB_FILE;
+
+    logdb_drop(true);
+    return NO_ERROR;
+}
+
+static int logdb_close(void)
+{
+    int rc = NO_ERROR;
+
+    if (lg.fd < 0)
+        return NO_ERROR;
+    rc = logdb_sync(lg.fd);
+    // what could not be merged stays in its segments for open_db()
+    logdb_drop(rc == NO_ERROR);
+    unlock_db(lg.fd);
+
+    free(lg.idx);
+    lg.idx = NULL;
+    lg.idx_cap = 0;
+    lg.fd = -1;
+    return rc;
+}
+
+static int logdb_open(int fd)
+{
+    logdb_close();
+    if (lock_db(fd, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (logdb_recover(fd) < 0 || idx_grow() != NO_ERROR) {
+        unlock_db(fd);
+        return ERR_DB_FILE;
+    }
+    lg.next_no = 1;
+    lg.fd = fd;
+    return NO_ERROR;
+}
+
+static bool logdb_attached(int fd)
+{
+    return fd >= 0 && fd == lg.fd;
+}
+
+static int logdb_read_rec(int fd, int id, student_t *s)
+{
+    log_entry_t e;
+
+    pthread_mutex_lock(&lg.lock);
+    log_loc_t *l = idx_find(id);
+    if (l->id != id) {
+        pthread_mutex_unlock(&lg.lock);
+        return fd_backend.read_rec(fd, id, s);
+    }
+    int rc = read_entry(l->seg, l->off, &e);
+    pthread_mutex_unlock(&lg.lock);
+
+    if (rc == NO_ERROR)
+        *s = e.rec;
+    return rc;
+}
+
+static int logdb_write_rec(int fd, int id, const student_t *s)
+{
+    log_entry_t e = {.magic = LOG_MAGIC, .id = id, .rec = *s};
+    int rc = NO_ERROR;
+
+    (void)fd;
+    if (id < 0)
+        return ERR_DB_FILE;
+    e.crc = entry_crc(&e);
+
+    pthread_mutex_lock(&lg.lock);
+    log_seg_t *a = lg.nsegs ? &lg.segs[lg.nsegs - 1] : NULL;
+    if (a == NULL || a->size + lg.buf_len + sizeof(e) > LOG_SEG_BYTES) {
+        // seal the segment and start the next
+        if (logdb_flush() != NO_ERROR || seg_start() != NO_ERROR)
+            rc = ERR_DB_FILE;
+        else
+            logdb_maybe_compact();
+    } else if (lg.buf_len + sizeof(e) > LOG_BUF_BYTES) {
+        rc = logdb_flush();
+    }
+
+    if (rc == NO_ERROR) {
+        a = &lg.segs[lg.nsegs - 1];
+        uint32_t off = a->size + lg.buf_len;
+        memcpy(lg.buf + lg.buf_len, &e, sizeof(e));
+        lg.buf_len += sizeof(e);
+        rc = idx_put(id, a->no, off);
+    }
+    pthread_mutex_unlock(&lg.lock);
+    return rc;
+}
+
+static student_t *logdb_scan(size_t *nslots)
+{
+    *nslots = 0;
+    return NULL;
+}
+
+const sdb_backend_t log_backend = {
+    .name = "log",
+    .exclusive = true,
+    .open = logdb_open,
+    .close = logdb_close,
+    .attached = logdb_attached,
+    .read_rec = logdb_read_rec,
+    .write_rec = logdb_write_rec,
+    .scan = logdb_scan,
+    .sync = logdb_sync,
+};
+
+/*
+ *  logdb_recover
+ *      fd:  linux file descriptor of a just opened database, the log
+ *           backend not attached to it
+ *
+ *  Replays the segments a process left behind into the file, in number
+ *  order and each up to its first torn or corrupt entry, then removes
+ *  them.  The whole file is locked meanwhile, a process that has the
+ *  backend attached merges and removes its own segments before letting go
+ *  of it.
+ *
+ *  returns:  the number of entries replayed, or ERR_DB_FILE
+ */
+int logdb_recover(int fd)
+{
+    glob_t g;
+    int replayed = 0;
+
+    // the segments of an attached backend are its own
+    if (lg.fd >= 0 || glob(LOG_SEG_GLOB, 0, NULL, &g) != 0)
+        return 0;
+    globfree(&g);
+
+    if (lock_db(fd, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+    // another process may have merged them while this one waited
+    if (glob(LOG_SEG_GLOB, 0, NULL, &g) != 0) {
+        unlock_db(fd);
+        return 0;
+    }
+
+    log_entry_t *in = malloc(LOG_BUF_BYTES);
+    if (in == NULL)
+        replayed = ERR_DB_FILE;
+
+    // the names are zero padded, so glob()'s order is the number order
+    for (size_t i = 0; replayed >= 0 && i < g.gl_pathc; i++) {
+        int sfd = open(g.gl_pathv[i], O_RDONLY | O_CLOEXEC);
+        off_t pos = 0;
+        bool torn = false;
+
+        if (sfd == -1) {
+            replayed = ERR_DB_FILE;
+            break;
+        }
+        while (!torn && replayed >= 0) {
+            ssize_t got = pread(sfd, in, LOG_BUF_ENTRIES * sizeof(log_entry_t), pos);
+            size_t n = got > 0 ? (size_t)got / sizeof(log_entry_t) : 0;
+            if (n == 0)
+                break;
+            for (size_t k = 0; k < n; k++) {
+                if (in[k].magic != LOG_MAGIC || in[k].crc != entry_crc(&in[k]) ||
+                    in[k].id < 0) {
+                    torn = true;
+                    break;
+                }
+                if (write_record(fd, in[k].id, &in[k].rec) != NO_ERROR) {
+                    replayed = ERR_DB_FILE;
+                    break;
+                }
+                replayed++;
+            }
+            pos += n * sizeof(log_entry_t);
+        }
+        close(sfd);
+    }
+
+    if (replayed > 0)
+        sidecars_drop();
+    if (replayed >= 0) {
+        for (size_t i = 0; i < g.gl_pathc; i++)
+            unlink(g.gl_pathv[i]);
+    }
+    free(in);
+    globfree(&g);
+    unlock_db(fd);
+    return replayed;
+}
+
+/*
+ *  logdb_discard
+ *
+ *  Throws away segments left behind, used when the database is emptied by
+ *  opening it with truncation.
+ */
+void logdb_discard(void)
+{
+    glob_t g;
+
+    if (lg.fd >= 0 || glob(LOG_SEG_GLOB, 0, NULL, &g) != 0)
+        return;
+    for (size_t i = 0; i < g.gl_pathc; i++)
+        unlink(g.gl_pathv[i]);
+    globfree(&g);
+}
@@ -0,0 +1,243 @@
+#define _GNU_SOURCE //needed for mremap()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The in-memory storage backend (--backend mem).  The database file is
+ *  read into an anonymous mapping once, when the backend is attached, and
+ *  from then on every get, add and delete is a copy in memory, without a
+ *  syscall.  Changed slots are marked in a bitmap and written back when
+ *  the backend is synced or detached, as runs of consecutive changed slots
+ *  with one pwrite() each, so slots that were never written stay holes.
+ *  A database opened with truncation starts empty and never touches the
+ *  file until then, which lets the benchmarks time the operations without
+ *  the I/O.
+ *
+ *  Like the buffer pool, the backend holds the whole file lock (see
+ *  sdb_lock.c) while it is attached, since other processes must not see
+ *  the file without the changes in memory or change it underneath them.
+ *  A paged database is left to the fd backend, as with mmap.
+ */
+
+#define MEMDB_MIN_SLOTS     1024    //slots allocated for an empty file
+
+static struct {
+    int fd;             // fd of the attached database, -1 if none
+    student_t *slots;   // slots[id] is student id
+    size_t nslots;      // logical number of records, the file's size
+    size_t cap;         // slots allocated
+    uint64_t *dirty;    // bit i: slots[i] changed since written back
+} mem = {.fd = -1};
+
+static size_t bitmap_bytes(size_t cap)
+{
+    return (cap + 63) / 64 * sizeof(uint64_t);
+}
+
+//grows the slots and the bitmap to hold at least n slots
+static int mem_reserve(size_t n)
+{
+    size_t cap = mem.cap ? mem.cap : MEMDB_MIN_SLOTS;
+    while (cap < n)
+        cap *= 2;
+    if (cap == mem.cap)
+        return NO_ERROR;
+
+    void *p;
+    if (mem.slots == NULL)
+        p = mmap(NULL, cap * sizeof(student_t), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    else
+        p = mremap(mem.slots, mem.cap * sizeof(student_t),
+                   cap * sizeof(student_t), MREMAP_MAYMOVE);
+    if (p == MAP_FAILED)
+        return ERR_DB_FILE;
+    mem.slots = p;
+
+    uint64_t *d = realloc(mem.dirty, bitmap_bytes(cap));
+    if (d == NULL)
+        return ERR_DB_FILE;
+    memset((char *)d + bitmap_bytes(mem.cap), 0,
+           bitmap_bytes(cap) - bitmap_bytes(mem.cap));
+    mem.dirty = d;
+    mem.cap = cap;
+    return NO_ERROR;
+}
+
+static bool is_dirty(size_t i)
+{
+    return mem.dirty[i / 64] & (1ULL << (i % 64));
+}
+
+/*
+ *  mem_load
+ *
+ *  Reads the data extents of the file into the slots, the holes are the
+ *  zeroes of the fresh anonymous memory.
+ */
+static int mem_load(int fd, off_t size)
+{
+    off_t pos = 0;
+
+    while (pos < size) {
+        off_t data = lseek(fd, pos, SEEK_DATA);
+        if (data == -1 || data >= size)
+            break;
+        off_t hole = lseek(fd, data, SEEK_HOLE);
+        if (hole == -1 || hole > size)
+            hole = size;
+
+        while (data < hole) {
+            INSTR_START(t);
+            ssize_t n = pread(fd, (char *)mem.slots + data, hole - data, data);
+            INSTR_STOP(INSTR_READ, t, n > 0 ? n : 0);
+            if (n <= 0)
+                return ERR_DB_FILE;
+            data += n;
+        }
+        pos = hole;
+    }
+    return NO_ERROR;
+}
+
+static int mem_close(void);
+
+static int mem_open(int fd)
+{
+    struct stat st;
+
+    mem_close();
+    if (paged_db(fd))
+        return NO_ERROR;
+    // the size is only certain once no other process can change it
+    if (lock_db(fd, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (fstat(fd, &st) == -1) {
+        unlock_db(fd);
+        return ERR_DB_FILE;
+    }
+
+    mem.nslots = st.st_size / STUDENT_RECORD_SIZE;
+    if (mem_reserve(mem.nslots) != NO_ERROR ||
+        mem_load(fd, (off_t)mem.nslots * STUDENT_RECORD_SIZE) != NO_ERROR) {
+        mem.fd = fd;        // so mem_close() lets go of the lock
+        mem.nslots = 0;     // with nothing to write back
+        mem_close();
+        return ERR_DB_FILE;
+    }
+    mem.fd = fd;
+    return NO_ERROR;
+}
+
+//writes back each run of consecutive changed slots with one pwrite()
+static int mem_sync(int fd)
+{
+    (void)fd;
+    size_t i = 0;
+
+    while (i < mem.nslots) {
+        if (mem.dirty[i / 64] == 0) {
+            i = (i / 64 + 1) * 64;
+            continue;
+        }
+        if (!is_dirty(i)) {
+            i++;
+            continue;
+        }
+
+        size_t end = i;
+        while (end < mem.nslots && is_dirty(end))
+            end++;
+
+        size_t len = (end - i) * sizeof(student_t);
+        off_t off = (off_t)i * sizeof(student_t);
+        for (size_t done = 0; done < len; ) {
+            INSTR_START(t);
+            ssize_t n = pwrite(mem.fd, (char *)&mem.slots[i] + done, len - done,
+                               off + done);
+            INSTR_STOP(INSTR_WRITE, t, n > 0 ? n : 0);
+            if (n <= 0)
+                return ERR_DB_FILE;
+            done += n;
+        }
+        for (; i < end; i++)
+            mem.dirty[i / 64] &= ~(1ULL << (i % 64));
+    }
+    return NO_ERROR;
+}
+
+static int mem_close(void)
+{
+    int rc = NO_ERROR;
+
+    if (mem.fd < 0)
+        return NO_ERROR;
+    if (mem.slots != NULL) {
+        rc = mem_sync(mem.fd);
+        munmap(mem.slots, mem.cap * sizeof(student_t));
+    }
+    unlock_db(mem.fd);
+    free(mem.dirty);
+
+    mem.fd = -1;
+    mem.slots = NULL;
+    mem.nslots = 0;
+    mem.cap = 0;
+    mem.dirty = NULL;
+    return rc;
+}
+
+static bool mem_attached(int fd)
+{
+    return fd >= 0 && fd == mem.fd;
+}
+
+static int mem_read_rec(int fd, int id, student_t *s)
+{
+    (void)fd;
+    if (id < 0 || (size_t)id >= mem.nslots)
+        return SRCH_NOT_FOUND;
+    *s = mem.slots[id];
+    return NO_ERROR;
+}
+
+static int mem_write_rec(int fd, int id, const student_t *s)
+{
+    (void)fd;
+    if (id < 0 || mem_reserve((size_t)id + 1) != NO_ERROR)
+        return ERR_DB_FILE;
+    if ((size_t)id >= mem.nslots)
+        mem.nslots = (size_t)id + 1;
+    mem.slots[id] = *s;
+    mem.dirty[id / 64] |= 1ULL << (id % 64);
+    return NO_ERROR;
+}
+
+static student_t *mem_scan(size_t *nslots)
+{
+    *nslots = mem.nslots;
+    return mem.slots;
+}
+
+const sdb_backend_t mem_backend = {
+    .name = "mem",
+    .exclusive = true,
+    .open = mem_open,
+    .close = mem_close,
+    .attached = mem_attached,
+    .read_rec = mem_read_rec,
+    .write_rec = mem_write_rec,
+    .scan = mem_scan,
+    .sync = mem_sync,
+};
@@ -0,0 +1,250 @@
+#define _GNU_SOURCE //needed for mremap()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The mmap storage backend.  Instead of doing an lseek() plus a 64 byte
+ *  read() or write() for every record, the whole database file is mapped
+ *  into memory and treated as an array of student_t indexed by student id.
+ *  Because the mapping is MAP_SHARED, stores into the array land in the
+ *  page cache exactly like write() would, so a database written in mmap
+ *  mode is byte-for-byte identical to one written through the fd.
+ *
+ *  Appending past the end of the file would cost an ftruncate() and an
+ *  mremap() per record, so the file and the mapping are grown by doubling
+ *  and the file is trimmed back to the logical end (the end of the highest
+ *  slot written) when the backend is detached.
+ *
+ *  The mapping, its size and the slack past the logical end are only
+ *  right while no other process changes the file, so like mem the backend
+ *  holds the whole file lock (see sdb_lock.c) while it is attached.  A
+ *  file another process shrank under a mapping would fault on the next
+ *  read, and trimming it back to a stale logical end would cut off their
+ *  records.
+ *
+ *  Only one database is attached at a time, this program never has more
+ *  than one open.
+ */
+static struct {
+    int fd;             // fd of the attached database, -1 if none
+    student_t *slots;   // mapped view of the file, slots[id] is student id
+    size_t nslots;      // logical number of records in the file
+    size_t file_size;   // physical size of the file, may exceed nslots
+    size_t map_len;     // number of bytes currently mapped
+} mdb = {-1, NULL, 0, 0, 0};
+
+// round a byte count up to a whole number of pages, mmap() and mremap()
+// work in page units
+static size_t page_round(size_t len)
+{
+    size_t pg = (size_t)sysconf(_SC_PAGESIZE);
+    return (len + pg - 1) / pg * pg;
+}
+
+/*
+ *  mmap_db_attach
+ *      fd:  linux file descriptor of an open database file
+ *
+ *  Maps the database file so that record access functions use memory
+ *  instead of syscalls.  An empty file is allowed, the mapping is created
+ *  the first time a record is added.  A paged database (sdb_paged.c) is
+ *  left unmapped, its slots are not at id * 64 and the syscall path is used.
+ *
+ *  returns:  NO_ERROR       mapping created, or skipped for a paged file
+ *            ERR_DB_FILE    the file could not be locked or mapped
+ *
+ *  console:  Does not produce any console I/O
+ */
+int mmap_db_attach(int fd)
+{
+    struct stat st;
+
+    mmap_db_detach();
+    if (paged_db(fd))
+        return NO_ERROR;
+    // the size is only certain once no other process can change it
+    if (lock_db(fd, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (fstat(fd, &st) == -1) {
+        unlock_db(fd);
+        return ERR_DB_FILE;
+    }
+
+    mdb.fd = fd;
+    mdb.nslots = st.st_size / STUDENT_RECORD_SIZE;
+    mdb.file_size = st.st_size;
+    mdb.map_len = page_round(st.st_size);
+
+    if (mdb.map_len > 0) {
+        mdb.slots = mmap(NULL, mdb.map_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+        if (mdb.slots == MAP_FAILED) {
+            mdb.slots = NULL;
+            mdb.fd = -1;
+            unlock_db(fd);
+            return ERR_DB_FILE;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ *  mmap_db_detach
+ *
+ *  Removes the mapping, if any, trims any growth slack off the end of the
+ *  file and lets go of the whole file lock.  Dirty pages are already in
+ *  the page cache so there is nothing to flush, the caller still owns (and
+ *  closes) the fd.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if the slack could not be trimmed,
+ *            detached either way
+ */
+int mmap_db_detach(void)
+{
+    int rc = NO_ERROR;
+
+    if (mdb.fd < 0)
+        return NO_ERROR;
+    if (mdb.slots != NULL)
+        munmap(mdb.slots, mdb.map_len);
+
+    // the slack is all zero slots, the file is still whole if this fails
+    size_t logical = mdb.nslots * STUDENT_RECORD_SIZE;
+    if (mdb.file_size != logical && ftruncate(mdb.fd, logical) == -1)
+        rc = ERR_DB_FILE;
+    unlock_db(mdb.fd);
+
+    mdb.fd = -1;
+    mdb.slots = NULL;
+    mdb.nslots = 0;
+    mdb.file_size = 0;
+    mdb.map_len = 0;
+    return rc;
+}
+
+/*
+ *  mmap_db_attached
+ *      fd:  linux file descriptor
+ *
+ *  returns:  true if fd is the database currently served by the mapping
+ */
+bool mmap_db_attached(int fd)
+{
+    return fd >= 0 && fd == mdb.fd;
+}
+
+/*
+ *  mmap_db_slot
+ *      id:    student id (slot index)
+ *      grow:  extend the file if the slot is past the current end
+ *
+ *  Returns a pointer to the slot for id inside the mapping.  When the slot
+ *  is beyond the logical end of the file and grow is true the logical end
+ *  moves to just after the slot, the same size a write() at that offset
+ *  produces.  If the file or the mapping is too small they are enlarged
+ *  with ftruncate() and mremap().
+ *
+ *  returns:  pointer to the slot, or NULL if the slot is past the end of
+ *            the file and grow is false, or if growing failed
+ */
+student_t *mmap_db_slot(int id, bool grow)
+{
+    if (id < 0)
+        return NULL;
+
+    if ((size_t)id < mdb.nslots)
+        return &mdb.slots[id];
+
+    if (!grow || mdb.fd < 0)
+        return NULL;
+
+    size_t new_size = ((size_t)id + 1) * STUDENT_RECORD_SIZE;
+    if (new_size > mdb.file_size) {
+        size_t grow_to = page_round(new_size);
+        if (grow_to < 2 * mdb.file_size)
+            grow_to = 2 * mdb.file_size;
+        if (ftruncate(mdb.fd, grow_to) == -1)
+            return NULL;
+        mdb.file_size = grow_to;
+    }
+
+    size_t new_len = page_round(mdb.file_size);
+    if (new_len > mdb.map_len) {
+        void *p;
+        if (mdb.slots == NULL)
+            p = mmap(NULL, new_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     mdb.fd, 0);
+        else
+            p = mremap(mdb.slots, mdb.map_len, new_len, MREMAP_MAYMOVE);
+        if (p == MAP_FAILED)
+            return NULL;
+        mdb.slots = p;
+        mdb.map_len = new_len;
+    }
+
+    mdb.nslots = (size_t)id + 1;
+    return &mdb.slots[id];
+}
+
+// the backend functions (see sdb_backend.c) on top of the ones above
+
+static int mmap_close(void)
+{
+    return mmap_db_detach();
+}
+
+static int mmap_read_rec(int fd, int id, student_t *s)
+{
+    (void)fd;
+    student_t *slot = mmap_db_slot(id, false);
+    if (slot == NULL)
+        return SRCH_NOT_FOUND;
+    *s = *slot;
+    return NO_ERROR;
+}
+
+static int mmap_write_rec(int fd, int id, const student_t *s)
+{
+    (void)fd;
+    student_t *slot = mmap_db_slot(id, true);
+    if (slot == NULL)
+        return ERR_DB_FILE;
+    *slot = *s;
+    return NO_ERROR;
+}
+
+static student_t *mmap_scan(size_t *nslots)
+{
+    *nslots = mdb.nslots;
+    return mdb.slots;
+}
+
+//stores into a shared mapping are in the page cache already
+static int mmap_sync(int fd)
+{
+    (void)fd;
+    return NO_ERROR;
+}
+
+const sdb_backend_t mmap_backend = {
+    .name = "mmap",
+    .exclusive = true,
+    .open = mmap_db_attach,
+    .close = mmap_close,
+    .attached = mmap_db_attached,
+    .read_rec = mmap_read_rec,
+    .write_rec = mmap_write_rec,
+    .scan = mmap_scan,
+    .sync = mmap_sync,
+};
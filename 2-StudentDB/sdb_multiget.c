@@ -0,0 +1,506 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Batched lookups (-f id id ... or -f - for ids on stdin).  One lookup per
+ *  process costs a fork, an exec and an open for a 64 byte read; a batch
+ *  pays those once and then keeps the device busy with many reads at a
+ *  time:
+ *
+ *    1. every requested id is turned into the file offset of its slot,
+ *    2. the offsets are sorted and merged into ranges, slots less than
+ *       MULTI_GAP apart share one read of up to MULTI_RANGE_MAX bytes,
+ *    3. the ranges are read as one batch through io_uring, up to
+ *       MULTI_QUEUE_DEPTH reads in flight, or by MULTI_THREADS threads
+ *       doing pread() where io_uring is not available,
+ *    4. the students are printed in the order they were asked for,
+ *       followed by a line for every id that was not found.
+ *
+ *  io_uring is driven with the raw system calls, so there is nothing extra
+ *  to link.  The batch holds a shared lock on the whole file, like a scan
+ *  holds one on its batch (see sdb_lock.c).  With the mmap or mem backend
+ *  or the buffer pool the records are already in memory and are simply
+ *  copied.
+ */
+
+#define MULTI_GAP       4096        //bytes between slots still read together
+#define MULTI_RANGE_MAX (64 * 1024) //bytes in one read at most
+
+typedef struct mg_req {
+    off_t off;                      //where the slot is in the file
+    int idx;                        //position in the request
+    int range;                      //the read that covers it
+} mg_req_t;
+
+typedef struct mg_range {
+    off_t off;
+    size_t len;
+    char *buf;
+    ssize_t got;                    //bytes read, or -errno
+} mg_range_t;
+
+static int cmp_req_off(const void *a, const void *b)
+{
+    const mg_req_t *ra = a, *rb = b;
+    if (ra->off != rb->off)
+        return (ra->off > rb->off) - (ra->off < rb->off);
+    return ra->idx - rb->idx;
+}
+
+/*
+ *  A minimal io_uring, only what one batch of reads needs: the submission
+ *  and completion rings and the array of submission entries, all mapped
+ *  from the ring fd.
+ */
+typedef struct uring {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len;
+} uring_t;
+
+static void uring_exit(uring_t *u)
+{
+    if (u->sqes != NULL)
+        munmap(u->sqes, u->entries * sizeof(struct io_uring_sqe));
+    if (u->cq_ptr != NULL && u->cq_ptr != u->sq_ptr)
+        munmap(u->cq_ptr, u->cq_len);
+    if (u->sq_ptr != NULL)
+        munmap(u->sq_ptr, u->sq_len);
+    if (u->fd >= 0)
+        close(u->fd);
+}
+
+//returns NO_ERROR, or ERR_DB_OP when io_uring cannot be used here
+static int uring_init(uring_t *u, unsigned entries)
+{
+    struct io_uring_params p = {0};
+
+    memset(u, 0, sizeof(*u));
+    u->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (u->fd < 0)
+        return ERR_DB_OP;
+
+    u->entries = p.sq_entries;
+    u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_len > u->sq_len)
+            u->sq_len = u->cq_len;
+        u->cq_len = u->sq_len;
+    }
+
+    u->sq_ptr = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ptr == MAP_FAILED) {
+        u->sq_ptr = NULL;
+        uring_exit(u);
+        return ERR_DB_OP;
+    }
+    u->cq_ptr = u->sq_ptr;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        u->cq_ptr = mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ptr == MAP_FAILED) {
+            u->cq_ptr = NULL;
+            uring_exit(u);
+            return ERR_DB_OP;
+        }
+    }
+    u->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                   IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        uring_exit(u);
+        return ERR_DB_OP;
+    }
+
+    char *sq = u->sq_ptr, *cq = u->cq_ptr;
+    u->sq_head = (unsigned *)(sq + p.sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p.sq_off.array);
+    u->cq_head = (unsigned *)(cq + p.cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return NO_ERROR;
+}
+
+/*
+ *  read_ranges_uring
+ *
+ *  Reads every range through io_uring, keeping the submission queue full
+ *  until all reads have completed.
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP when io_uring is not available (nothing
+ *            has been read then) or ERR_DB_FILE
+ */
+static int read_ranges_uring(int fd, mg_range_t *ranges, int nranges)
+{
+    uring_t u;
+    int next = 0, done = 0;
+    unsigned inflight = 0;
+
+    if (uring_init(&u, MULTI_QUEUE_DEPTH) != NO_ERROR)
+        return ERR_DB_OP;
+
+    while (done < nranges) {
+        unsigned tail = *u.sq_tail;
+        while (next < nranges && inflight < u.entries) {
+            unsigned i = tail & *u.sq_mask;
+            struct io_uring_sqe *sqe = &u.sqes[i];
+
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = fd;
+            sqe->off = ranges[next].off;
+            sqe->addr = (uintptr_t)ranges[next].buf;
+            sqe->len = ranges[next].len;
+            sqe->user_data = next;
+            u.sq_array[i] = i;
+            tail++;
+            next++;
+            inflight++;
+        }
+        __atomic_store_n(u.sq_tail, tail, __ATOMIC_RELEASE);
+
+        unsigned to_submit = tail - __atomic_load_n(u.sq_head, __ATOMIC_ACQUIRE);
+        if (syscall(__NR_io_uring_enter, u.fd, to_submit, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+            uring_exit(&u);
+            return ERR_DB_FILE;
+        }
+
+        unsigned head = *u.cq_head;
+        while (head != __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &u.cqes[head & *u.cq_mask];
+            mg_range_t *rg = &ranges[cqe->user_data];
+
+            // a kernel without IORING_OP_READ rejects it, read it directly
+            rg->got = cqe->res;
+            if (rg->got == -EINVAL || rg->got == -EOPNOTSUPP)
+                rg->got = pread(fd, rg->buf, rg->len, rg->off);
+            head++;
+            inflight--;
+            done++;
+        }
+        __atomic_store_n(u.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    uring_exit(&u);
+    return NO_ERROR;
+}
+
+typedef struct mg_pool {
+    int fd;
+    mg_range_t *ranges;
+    int nranges;
+    int next;                       //next range to read, taken atomically
+} mg_pool_t;
+
+//pread() worker, reads ranges until none are left
+static void *pread_worker(void *arg)
+{
+    mg_pool_t *mp = arg;
+    int r;
+
+    while ((r = __atomic_fetch_add(&mp->next, 1, __ATOMIC_RELAXED)) < mp->nranges) {
+        mg_range_t *rg = &mp->ranges[r];
+        rg->got = pread(mp->fd, rg->buf, rg->len, rg->off);
+        if (rg->got < 0)
+            rg->got = -errno;
+    }
+    return NULL;
+}
+
+//reads every range with MULTI_THREADS threads doing pread(), or with the
+//calling thread alone if none can be started
+static void read_ranges_pread(int fd, mg_range_t *ranges, int nranges)
+{
+    pthread_t tids[MULTI_THREADS];
+    mg_pool_t mp = {fd, ranges, nranges, 0};
+    int started = 0;
+
+    while (started < MULTI_THREADS && started < nranges &&
+           pthread_create(&tids[started], NULL, pread_worker, &mp) == 0)
+        started++;
+    pread_worker(&mp);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+}
+
+/*
+ *  fetch_batch
+ *
+ *  Reads the slots of ids into recs, leaving a slot zeroed when there is
+ *  no such student.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int fetch_batch(int fd, const int *ids, int n, student_t *recs, int io)
+{
+    mg_req_t *reqs = malloc(n * sizeof(mg_req_t));
+    mg_range_t *ranges = malloc(n * sizeof(mg_range_t));
+    char *buf = NULL;
+    int nreqs = 0, nranges = 0, rc = NO_ERROR;
+    int max_id = db_max_std_id();
+
+    if (reqs == NULL || ranges == NULL) {
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+
+    // 1. the offsets, in a paged database one directory lookup per page
+    int last_lp = -1;
+    off_t last_base = SRCH_NOT_FOUND;
+    for (int i = 0; i < n; i++) {
+        int id = ids[i];
+        off_t off = (off_t)id * STUDENT_RECORD_SIZE;
+
+        if (id < MIN_STD_ID || id > max_id)
+            continue;
+        if (paged_db(fd)) {
+            if (id / PG_RECS != last_lp) {
+                last_lp = id / PG_RECS;
+                last_base = paged_slot_offset(fd, last_lp * PG_RECS, false);
+                if (last_base < 0 && last_base != SRCH_NOT_FOUND) {
+                    rc = ERR_DB_FILE;
+                    goto done;
+                }
+            }
+            if (last_base < 0)
+                continue;
+            off = last_base + (off_t)(id % PG_RECS) * STUDENT_RECORD_SIZE;
+        }
+        reqs[nreqs].off = off;
+        reqs[nreqs].idx = i;
+        nreqs++;
+    }
+
+    // 2. sorted by offset, nearby slots merged into one read
+    qsort(reqs, nreqs, sizeof(mg_req_t), cmp_req_off);
+    size_t total = 0;
+    for (int i = 0; i < nreqs; i++) {
+        off_t end = reqs[i].off + STUDENT_RECORD_SIZE;
+        mg_range_t *rg = &ranges[nranges - 1];
+
+        if (nranges > 0 && reqs[i].off <= rg->off + (off_t)rg->len + MULTI_GAP &&
+            end - rg->off <= MULTI_RANGE_MAX) {
+            if (end > rg->off + (off_t)rg->len) {
+                total += end - (rg->off + rg->len);
+                rg->len = end - rg->off;
+            }
+        } else {
+            rg = &ranges[nranges++];
+            rg->off = reqs[i].off;
+            rg->len = STUDENT_RECORD_SIZE;
+            total += STUDENT_RECORD_SIZE;
+        }
+        reqs[i].range = nranges - 1;
+    }
+
+    buf = malloc(total > 0 ? total : 1);
+    if (buf == NULL) {
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+    size_t pos = 0;
+    for (int r = 0; r < nranges; r++) {
+        ranges[r].buf = buf + pos;
+        ranges[r].got = 0;
+        pos += ranges[r].len;
+    }
+
+    // 3. one batch of reads
+    rc = (io == MULTI_IO_PREAD) ? ERR_DB_OP : read_ranges_uring(fd, ranges, nranges);
+    if (rc == ERR_DB_OP && io != MULTI_IO_URING) {
+        read_ranges_pread(fd, ranges, nranges);
+        rc = NO_ERROR;
+    }
+    if (rc != NO_ERROR) {
+        rc = ERR_DB_FILE;
+        goto done;
+    }
+
+    // a slot past the end of a short read does not exist, one holding
+    // another id (or none) is not the student asked for
+    for (int i = 0; i < nreqs; i++) {
+        mg_range_t *rg = &ranges[reqs[i].range];
+        off_t rel = reqs[i].off - rg->off;
+        student_t *s = &recs[reqs[i].idx];
+
+        if (rg->got < 0) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        if (rel + STUDENT_RECORD_SIZE > rg->got)
+            continue;
+        memcpy(s, rg->buf + rel, sizeof(student_t));
+        if (s->id != ids[reqs[i].idx])
+            memset(s, 0, sizeof(student_t));
+    }
+
+done:
+    free(buf);
+    free(ranges);
+    free(reqs);
+    return rc;
+}
+
+/*
+ *  find_students
+ *      fd:   linux file descriptor
+ *      ids:  the student ids to look up, in the order to print them
+ *      n:    number of ids
+ *      io:   MULTI_IO_AUTO, or MULTI_IO_URING / MULTI_IO_PREAD to use
+ *            only that way of reading (for the benchmarks)
+ *
+ *  Looks up every id with one batch of reads and prints the students found
+ *  as one table, in the order of ids, then M_STD_NOT_FND_MSG for every id
+ *  that was not found, also in order.  An id may be asked for more than
+ *  once.
+ *
+ *  returns:  <number>       the number of ids found
+ *            ERR_DB_FILE    database file I/O issue, or io_uring was
+ *                           required and is not available
+ *
+ *  console:  the found students in the print_db() format
+ *            M_STD_NOT_FND_MSG  for each id not found
+ *            M_ERR_DB_READ      error reading the database
+ */
+int find_students(int fd, const int *ids, int n, int io)
+{
+    student_t *recs = calloc(n > 0 ? n : 1, sizeof(student_t));
+    int found = 0, rc = NO_ERROR;
+    char hdr[FMT_ROW_MAX];
+    out_buf_t out;
+
+    if (recs == NULL || lock_db(fd, F_RDLCK) != NO_ERROR) {
+        free(recs);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (backend_attached(fd) || bufpool_attached(fd)) {
+        // already in memory, nothing to batch
+        for (int i = 0; i < n && rc == NO_ERROR; i++) {
+            if (ids[i] >= MIN_STD_ID && read_record(fd, ids[i], &recs[i]) == ERR_DB_FILE)
+                rc = ERR_DB_FILE;
+            if (recs[i].id != ids[i])
+                memset(&recs[i], 0, sizeof(student_t));
+        }
+    } else {
+        rc = fetch_batch(fd, ids, n, recs, io);
+    }
+    unlock_db(fd);
+
+    if (rc != NO_ERROR) {
+        free(recs);
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    out_begin(&out);
+    for (int i = 0; i < n; i++) {
+        if (recs[i].id == 0)
+            continue;
+        if (found++ == 0)
+            out_bytes(&out, hdr, fmt_header(hdr, FMT_TABLE));
+        out_row(&out, &recs[i], FMT_TABLE);
+    }
+    out_flush(&out);
+
+    for (int i = 0; i < n; i++) {
+        if (recs[i].id == 0)
+            printf(M_STD_NOT_FND_MSG, ids[i]);
+    }
+    free(recs);
+    return found;
+}
+
+//parses one id, false unless the whole word is a number that fits an int
+static bool parse_id(const char *word, int *id)
+{
+    char *end;
+    errno = 0;
+    long v = strtol(word, &end, 10);
+    if (errno != 0 || end == word || *end != '\0' || v < INT_MIN || v > INT_MAX)
+        return false;
+    *id = (int)v;
+    return true;
+}
+
+/*
+ *  read_id_list
+ *      words:  ids as strings, used when in is NULL
+ *      n:      number of words
+ *      in:     stream with ids separated by white space, or NULL
+ *      *ids:   set to a malloc'd array of the ids, freed by the caller
+ *
+ *  returns:  <number>       the number of ids
+ *            ERR_DB_OP      a word is not an id, M_ERR_FIND_ID was printed
+ *            ERR_DB_FILE    out of memory
+ */
+int read_id_list(char *words[], int n, FILE *in, int **ids)
+{
+    char word[32];
+    int cap = (in == NULL) ? n : 1024, count = 0;
+    int *list = malloc((cap > 0 ? cap : 1) * sizeof(int));
+
+    *ids = NULL;
+    if (list == NULL)
+        return ERR_DB_FILE;
+
+    for (;;) {
+        const char *w;
+        if (in == NULL) {
+            if (count == n)
+                break;
+            w = words[count];
+        } else {
+            if (fscanf(in, "%31s", word) != 1)
+                break;
+            w = word;
+        }
+
+        if (count == cap) {
+            int *more = realloc(list, 2 * cap * sizeof(int));
+            if (more == NULL) {
+                free(list);
+                return ERR_DB_FILE;
+            }
+            list = more;
+            cap *= 2;
+        }
+        if (!parse_id(w, &list[count])) {
+            printf(M_ERR_FIND_ID, w);
+            free(list);
+            return ERR_DB_OP;
+        }
+        count++;
+    }
+
+    *ids = list;
+    return count;
+}
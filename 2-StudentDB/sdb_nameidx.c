@@ -0,0 +1,605 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The name index.  A B+tree in its own file (NAME_IDX_FILE) keyed on
+ *  (lname, fname, id), so students can be found by name with a handful of
+ *  page reads instead of a scan of the whole database.  Including the id
+ *  makes every key unique, so students sharing a name are simply adjacent
+ *  keys.
+ *
+ *  The file is an array of 4K pages.  Page 0 holds the meta data, every
+ *  other page is a tree node.  Leaves hold keys and are chained left to
+ *  right, inner nodes hold separator keys and child page numbers.  With 68
+ *  keys per leaf and 64 children per inner node a full database of 100000
+ *  students is a tree of height 3.
+ *
+ *  add_student() and del_student() keep an existing index up to date.  The
+ *  index is not created until the first -n query, which builds it from the
+ *  database in one scan, so nobody pays for it who does not use it.  Deletes
+ *  only remove the key from its leaf, pages are never merged; a rebuild
+ *  packs the tree again.  The meta page records the number of keys, and an
+ *  index whose count disagrees with the database header (after a bulk load,
+ *  or a failed update) is rebuilt on the next query.
+ */
+
+#define NIDX_PAGE_SIZE  4096
+#define NIDX_MAGIC      0x4e424453  //"SDBN" on disk
+#define NIDX_VERSION    1
+#define NIDX_MAX_HEIGHT 16
+
+typedef struct nidx_key {
+    char lname[sizeof(((student_t *)0)->lname)];
+    char fname[sizeof(((student_t *)0)->fname)];
+    int32_t id;
+} nidx_key_t;
+
+typedef struct nidx_meta {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t height;        //1 when the root is a leaf
+    uint32_t root;
+    uint32_t npages;        //pages in the file, including the meta page
+    uint32_t count;         //number of keys in the tree
+} nidx_meta_t;
+
+#define NIDX_NODE_HDR   16
+#define NIDX_LEAF_MAX   ((NIDX_PAGE_SIZE - NIDX_NODE_HDR) / sizeof(nidx_key_t))
+#define NIDX_INNER_MAX  ((NIDX_PAGE_SIZE - NIDX_NODE_HDR) / sizeof(nidx_ent_t))
+
+//an inner node entry, child holds the keys >= key
+typedef struct nidx_ent {
+    nidx_key_t key;
+    uint32_t child;
+} nidx_ent_t;
+
+typedef struct nidx_page {
+    uint16_t leaf;          //1 for a leaf, 0 for an inner node
+    uint16_t n;             //keys (leaf) or entries (inner) in use
+    uint32_t next;          //leaf: the leaf to the right, 0 for none
+    uint32_t child0;        //inner: child holding the keys < ents[0].key
+    uint32_t unused;
+    union {
+        nidx_key_t keys[NIDX_LEAF_MAX];
+        nidx_ent_t ents[NIDX_INNER_MAX];
+        char raw[NIDX_PAGE_SIZE - NIDX_NODE_HDR];
+    };
+} nidx_page_t;
+
+_Static_assert(sizeof(nidx_page_t) == NIDX_PAGE_SIZE,
+               "an index node must fill exactly one page");
+
+static int key_cmp(const nidx_key_t *a, const nidx_key_t *b)
+{
+    int c = strncmp(a->lname, b->lname, sizeof(a->lname));
+    if (c == 0)
+        c = strncmp(a->fname, b->fname, sizeof(a->fname));
+    if (c == 0)
+        c = (a->id > b->id) - (a->id < b->id);
+    return c;
+}
+
+static int key_qsort_cmp(const void *a, const void *b)
+{
+    return key_cmp(a, b);
+}
+
+static void make_key(nidx_key_t *k, const student_t *s)
+{
+    memcpy(k->lname, s->lname, sizeof(k->lname));
+    memcpy(k->fname, s->fname, sizeof(k->fname));
+    k->lname[sizeof(k->lname) - 1] = '\0';
+    k->fname[sizeof(k->fname) - 1] = '\0';
+    k->id = s->id;
+}
+
+static int read_page(int ifd, uint32_t pg, void *p)
+{
+    ssize_t n = pread(ifd, p, NIDX_PAGE_SIZE, (off_t)pg * NIDX_PAGE_SIZE);
+    return n == NIDX_PAGE_SIZE ? NO_ERROR : ERR_DB_FILE;
+}
+
+static int write_page(int ifd, uint32_t pg, const void *p)
+{
+    ssize_t n = pwrite(ifd, p, NIDX_PAGE_SIZE, (off_t)pg * NIDX_PAGE_SIZE);
+    return n == NIDX_PAGE_SIZE ? NO_ERROR : ERR_DB_FILE;
+}
+
+static int read_meta(int ifd, nidx_meta_t *m)
+{
+    if (pread(ifd, m, sizeof(*m), 0) != sizeof(*m))
+        return ERR_DB_FILE;
+    if (m->magic != NIDX_MAGIC || m->version != NIDX_VERSION ||
+        m->height == 0 || m->height > NIDX_MAX_HEIGHT)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+static int write_meta(int ifd, const nidx_meta_t *m)
+{
+    char pg[NIDX_PAGE_SIZE] = {0};
+
+    memcpy(pg, m, sizeof(*m));
+    return write_page(ifd, 0, pg);
+}
+
+//first key in a leaf that is >= k
+static int leaf_lower_bound(const nidx_page_t *p, const nidx_key_t *k)
+{
+    int lo = 0, hi = p->n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (key_cmp(&p->keys[mid], k) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+//the number of entries in an inner node whose key is <= k, which picks the
+//child to descend into: 0 is child0, i is ents[i - 1].child
+static int inner_slot(const nidx_page_t *p, const nidx_key_t *k)
+{
+    int lo = 0, hi = p->n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (key_cmp(&p->ents[mid].key, k) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static uint32_t inner_child(const nidx_page_t *p, int slot)
+{
+    return slot == 0 ? p->child0 : p->ents[slot - 1].child;
+}
+
+/*
+ *  descend
+ *
+ *  Walks from the root to the leaf that holds (or would hold) k, reading
+ *  one page per level.  The page numbers on the way are left in path[],
+ *  path[0] is the root and path[height - 1] the leaf, which ends up in *p.
+ */
+static int descend(int ifd, const nidx_meta_t *m, const nidx_key_t *k,
+                   uint32_t *path, nidx_page_t *p)
+{
+    uint32_t pg = m->root;
+
+    for (int level = 0; level < m->height; level++) {
+        path[level] = pg;
+        if (read_page(ifd, pg, p) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (p->leaf != (level == m->height - 1))
+            return ERR_DB_FILE;
+        if (!p->leaf)
+            pg = inner_child(p, inner_slot(p, k));
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  insert_key
+ *
+ *  Adds k to its leaf.  A full node is split in half and the first key of
+ *  the right half is pushed into the parent, which may split in turn; a
+ *  split root makes the tree one level taller.
+ */
+static int insert_key(int ifd, nidx_meta_t *m, const nidx_key_t *k)
+{
+    static nidx_page_t p, right;
+    uint32_t path[NIDX_MAX_HEIGHT];
+
+    if (descend(ifd, m, k, path, &p) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int at = leaf_lower_bound(&p, k);
+    if (at < p.n && key_cmp(&p.keys[at], k) == 0)
+        return NO_ERROR;    // already indexed
+
+    nidx_key_t up_key;
+    uint32_t up_child = 0;
+    int level = m->height - 1;
+
+    if (p.n < NIDX_LEAF_MAX) {
+        memmove(&p.keys[at + 1], &p.keys[at], (p.n - at) * sizeof(nidx_key_t));
+        p.keys[at] = *k;
+        p.n++;
+        return write_page(ifd, path[level], &p);
+    }
+
+    // split the leaf, the new key goes to whichever half it belongs in
+    static nidx_key_t keys[NIDX_LEAF_MAX + 1];
+    memcpy(keys, p.keys, at * sizeof(nidx_key_t));
+    keys[at] = *k;
+    memcpy(&keys[at + 1], &p.keys[at], (p.n - at) * sizeof(nidx_key_t));
+
+    int total = p.n + 1, half = total / 2;
+    memset(&right, 0, sizeof(right));
+    right.leaf = 1;
+    right.n = total - half;
+    right.next = p.next;
+    memcpy(right.keys, &keys[half], right.n * sizeof(nidx_key_t));
+    p.n = half;
+    memcpy(p.keys, keys, half * sizeof(nidx_key_t));
+    memset(&p.keys[half], 0, (NIDX_LEAF_MAX - half) * sizeof(nidx_key_t));
+
+    up_child = m->npages++;
+    p.next = up_child;
+    up_key = right.keys[0];
+    if (write_page(ifd, up_child, &right) != NO_ERROR ||
+        write_page(ifd, path[level], &p) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // push the separator up until a parent has room
+    static nidx_ent_t ents[NIDX_INNER_MAX + 1];
+    while (--level >= 0) {
+        if (read_page(ifd, path[level], &p) != NO_ERROR)
+            return ERR_DB_FILE;
+
+        at = inner_slot(&p, &up_key);
+        if (p.n < NIDX_INNER_MAX) {
+            memmove(&p.ents[at + 1], &p.ents[at], (p.n - at) * sizeof(nidx_ent_t));
+            p.ents[at].key = up_key;
+            p.ents[at].child = up_child;
+            p.n++;
+            return write_page(ifd, path[level], &p);
+        }
+
+        memcpy(ents, p.ents, at * sizeof(nidx_ent_t));
+        ents[at].key = up_key;
+        ents[at].child = up_child;
+        memcpy(&ents[at + 1], &p.ents[at], (p.n - at) * sizeof(nidx_ent_t));
+
+        // the middle entry moves up, its child becomes child0 on the right
+        total = p.n + 1;
+        half = total / 2;
+        memset(&right, 0, sizeof(right));
+        right.child0 = ents[half].child;
+        right.n = total - half - 1;
+        memcpy(right.ents, &ents[half + 1], right.n * sizeof(nidx_ent_t));
+        p.n = half;
+        memcpy(p.ents, ents, half * sizeof(nidx_ent_t));
+        memset(&p.ents[half], 0, (NIDX_INNER_MAX - half) * sizeof(nidx_ent_t));
+
+        up_key = ents[half].key;
+        up_child = m->npages++;
+        if (write_page(ifd, up_child, &right) != NO_ERROR ||
+            write_page(ifd, path[level], &p) != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+
+    // the root split, grow a new root above it
+    if (m->height == NIDX_MAX_HEIGHT)
+        return ERR_DB_FILE;
+    memset(&p, 0, sizeof(p));
+    p.child0 = m->root;
+    p.n = 1;
+    p.ents[0].key = up_key;
+    p.ents[0].child = up_child;
+    m->root = m->npages++;
+    m->height++;
+    return write_page(ifd, m->root, &p);
+}
+
+//removes k from its leaf, returns SRCH_NOT_FOUND if it was not indexed
+static int delete_key(int ifd, nidx_meta_t *m, const nidx_key_t *k)
+{
+    static nidx_page_t p;
+    uint32_t path[NIDX_MAX_HEIGHT];
+
+    if (descend(ifd, m, k, path, &p) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    int at = leaf_lower_bound(&p, k);
+    if (at == p.n || key_cmp(&p.keys[at], k) != 0)
+        return SRCH_NOT_FOUND;
+
+    memmove(&p.keys[at], &p.keys[at + 1], (p.n - at - 1) * sizeof(nidx_key_t));
+    p.n--;
+    memset(&p.keys[p.n], 0, sizeof(nidx_key_t));
+    return write_page(ifd, path[m->height - 1], &p);
+}
+
+/*
+ *  name_idx_update
+ *      s:    the student added or deleted
+ *      add:  true for an add, false for a delete
+ *
+ *  Applies one add or delete to the index, if there is one.  A failure
+ *  leaves the index in an unknown state so the file is removed, the next
+ *  query builds a fresh one.  Either way the database itself is unaffected.
+ */
+static void name_idx_update(const student_t *s, bool add)
+{
+    nidx_meta_t m;
+    nidx_key_t k;
+
+    int ifd = open(NAME_IDX_FILE, O_RDWR);
+    if (ifd == -1)
+        return;     // no index to maintain
+
+    make_key(&k, s);
+    int rc = read_meta(ifd, &m);
+    if (rc == NO_ERROR)
+        rc = add ? insert_key(ifd, &m, &k) : delete_key(ifd, &m, &k);
+
+    if (rc == NO_ERROR) {
+        m.count += add ? 1 : -1;
+        rc = write_meta(ifd, &m);
+    }
+    close(ifd);
+
+    if (rc == ERR_DB_FILE)
+        unlink(NAME_IDX_FILE);
+}
+
+void name_idx_note_add(const student_t *s)
+{
+    name_idx_update(s, true);
+}
+
+void name_idx_note_del(const student_t *s)
+{
+    name_idx_update(s, false);
+}
+
+/*
+ *  build_level
+ *
+ *  Writes the inner nodes above one level of the tree during a rebuild.
+ *  first[] and pages[] hold the smallest key and the page number of each
+ *  of the n nodes below, they are overwritten with the same for the new
+ *  level.
+ *
+ *  returns:  the number of nodes in the new level, or ERR_DB_FILE
+ */
+static int build_level(int ifd, nidx_meta_t *m, nidx_key_t *first,
+                       uint32_t *pages, int n)
+{
+    static nidx_page_t p;
+    int out = 0;
+
+    for (int i = 0; i < n; ) {
+        int take = n - i;
+        if (take > (int)NIDX_INNER_MAX + 1)
+            take = NIDX_INNER_MAX + 1;
+        // don't leave a lone child for the last node
+        if (n - i - take == 1)
+            take--;
+
+        memset(&p, 0, sizeof(p));
+        p.child0 = pages[i];
+        p.n = take - 1;
+        for (int j = 1; j < take; j++) {
+            p.ents[j - 1].key = first[i + j];
+            p.ents[j - 1].child = pages[i + j];
+        }
+
+        uint32_t pg = m->npages++;
+        if (write_page(ifd, pg, &p) != NO_ERROR)
+            return ERR_DB_FILE;
+        first[out] = first[i];
+        pages[out] = pg;
+        out++;
+        i += take;
+    }
+    return out;
+}
+
+/*
+ *  rebuild_name_idx
+ *      fd:  linux file descriptor of the database
+ *
+ *  Builds the name index from the records with one scan: the keys are
+ *  sorted in memory, written out as full leaves and the inner levels are
+ *  built bottom up.  The new index is written to a temporary file and
+ *  renamed over NAME_IDX_FILE so a reader never sees half of it.
+ *
+ *  returns:  <number>       the number of students indexed
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  Does not produce any console I/O
+ */
+int rebuild_name_idx(int fd)
+{
+    static nidx_page_t p;
+    student_t student;
+    db_scan_t sc;
+    nidx_meta_t m = {NIDX_MAGIC, NIDX_VERSION, 1, 0, 1, 0};
+    int n = 0, cap = 1024, rc = NO_ERROR;
+
+    nidx_key_t *keys = malloc(cap * sizeof(nidx_key_t));
+    if (keys == NULL)
+        return ERR_DB_FILE;
+
+    scan_open(&sc, fd);
+    while (scan_next(&sc, &student)) {
+        if (n == cap) {
+            nidx_key_t *k = realloc(keys, 2 * cap * sizeof(nidx_key_t));
+            if (k == NULL) {
+                free(keys);
+                return ERR_DB_FILE;
+            }
+            keys = k;
+            cap *= 2;
+        }
+        make_key(&keys[n++], &student);
+    }
+    if (sc.failed) {
+        free(keys);
+        return ERR_DB_FILE;
+    }
+    qsort(keys, n, sizeof(nidx_key_t), key_qsort_cmp);
+
+    int nleaves = n ? (n + NIDX_LEAF_MAX - 1) / NIDX_LEAF_MAX : 1;
+    nidx_key_t *first = malloc(nleaves * sizeof(nidx_key_t));
+    uint32_t *pages = malloc(nleaves * sizeof(uint32_t));
+    int ifd = open(NAME_IDX_TMP_FILE, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (first == NULL || pages == NULL || ifd == -1)
+        rc = ERR_DB_FILE;
+
+    // leaves are packed full, pages are numbered in key order so a range
+    // read walks the file forwards
+    for (int i = 0; rc == NO_ERROR && i < nleaves; i++) {
+        int at = i * NIDX_LEAF_MAX;
+        memset(&p, 0, sizeof(p));
+        p.leaf = 1;
+        p.n = (n - at < (int)NIDX_LEAF_MAX) ? n - at : (int)NIDX_LEAF_MAX;
+        memcpy(p.keys, &keys[at], p.n * sizeof(nidx_key_t));
+        pages[i] = m.npages++;
+        p.next = (i + 1 < nleaves) ? pages[i] + 1 : 0;
+        if (p.n > 0)
+            first[i] = keys[at];
+        rc = write_page(ifd, pages[i], &p);
+    }
+
+    int level = nleaves;
+    while (rc == NO_ERROR && level > 1) {
+        level = build_level(ifd, &m, first, pages, level);
+        if (level < 0)
+            rc = ERR_DB_FILE;
+        m.height++;
+    }
+
+    if (rc == NO_ERROR) {
+        m.root = pages[0];
+        m.count = n;
+        rc = write_meta(ifd, &m);
+    }
+    if (ifd != -1)
+        close(ifd);
+    if (rc == NO_ERROR && rename(NAME_IDX_TMP_FILE, NAME_IDX_FILE) == -1)
+        rc = ERR_DB_FILE;
+    if (rc != NO_ERROR)
+        unlink(NAME_IDX_TMP_FILE);
+
+    free(pages);
+    free(first);
+    free(keys);
+    return rc == NO_ERROR ? n : rc;
+}
+
+//true if a key's name starts with the lname (and fname) being looked for
+static bool name_matches(const nidx_key_t *k, const char *lname,
+                         const char *fname)
+{
+    if (fname == NULL)
+        return strncmp(k->lname, lname, strlen(lname)) == 0;
+    return strncmp(k->lname, lname, sizeof(k->lname)) == 0 &&
+           strncmp(k->fname, fname, strlen(fname)) == 0;
+}
+
+/*
+ *  find_by_name
+ *      fd:     linux file descriptor of the database
+ *      lname:  last name, or the start of one when fname is NULL
+ *      fname:  start of the first name, or NULL
+ *
+ *  Prints the students whose last name starts with lname or, when fname
+ *  is given, whose last name is lname and whose first name starts with
+ *  fname, ordered by name.  The index is descended to the first possible
+ *  match and the leaf chain is read until the names stop matching, each
+ *  match is then read from the database by id.  A missing or out of date
+ *  index is rebuilt first.
+ *
+ *  returns:  <number>       the number of students printed
+ *            ERR_DB_FILE    database or index file I/O issue
+ *
+ *  console:  the matching students in the print_db() format
+ *            M_NAME_NOT_FND   no student matches
+ *            M_ERR_DB_READ    error reading the database or index file
+ */
+int find_by_name(int fd, char *lname, char *fname)
+{
+    static nidx_page_t p;
+    uint32_t path[NIDX_MAX_HEIGHT];
+    nidx_meta_t m;
+    db_header_t h;
+    nidx_key_t k;
+    student_t student;
+    char hdr[FMT_ROW_MAX];
+    out_buf_t out;
+    int found = 0, rc = NO_ERROR;
+
+    int ifd = open(NAME_IDX_FILE, O_RDONLY);
+    if (ifd == -1 || read_meta(ifd, &m) != NO_ERROR ||
+        stats_load(fd, &h) != NO_ERROR || m.count != h.count) {
+        if (ifd != -1)
+            close(ifd);
+        if (rebuild_name_idx(fd) < 0 ||
+            (ifd = open(NAME_IDX_FILE, O_RDONLY)) == -1 ||
+            read_meta(ifd, &m) != NO_ERROR) {
+            printf(M_ERR_DB_READ);
+            if (ifd != -1)
+                close(ifd);
+            return ERR_DB_FILE;
+        }
+    }
+
+    // the smallest key that can match
+    memset(&k, 0, sizeof(k));
+    strncpy(k.lname, lname, sizeof(k.lname) - 1);
+    if (fname != NULL)
+        strncpy(k.fname, fname, sizeof(k.fname) - 1);
+    k.id = INT_MIN;
+
+    if (descend(ifd, &m, &k, path, &p) != NO_ERROR)
+        rc = ERR_DB_FILE;
+
+    int i = (rc == NO_ERROR) ? leaf_lower_bound(&p, &k) : 0;
+    out_begin(&out);
+    while (rc == NO_ERROR) {
+        if (i == p.n) {
+            if (p.next == 0 || read_page(ifd, p.next, &p) != NO_ERROR) {
+                rc = (p.next == 0) ? NO_ERROR : ERR_DB_FILE;
+                break;
+            }
+            i = 0;
+            continue;
+        }
+        if (!name_matches(&p.keys[i], lname, fname))
+            break;
+
+        if (get_student(fd, p.keys[i].id, &student) == NO_ERROR) {
+            if (found++ == 0)
+                out_bytes(&out, hdr, fmt_header(hdr, FMT_TABLE));
+            out_row(&out, &student, FMT_TABLE);
+        }
+        i++;
+    }
+    out_flush(&out);
+    close(ifd);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return rc;
+    }
+    if (found == 0)
+        printf(M_NAME_NOT_FND, lname, fname ? " " : "", fname ? fname : "");
+    return found;
+}
+
+/*
+ *  drop_name_idx
+ *
+ *  Removes the index, used when the database is emptied.
+ */
+void drop_name_idx(void)
+{
+    unlink(NAME_IDX_FILE);
+}
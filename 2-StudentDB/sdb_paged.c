@@ -0,0 +1,548 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The paged file format.  The direct format keeps student id at offset
+ *  id * 64, so the file is as long as the largest id and ids have to stop
+ *  at MAX_STD_ID: 32 bit ids would make a 128 GB sparse file, and its holes
+ *  cost extent metadata of their own.  A paged database keeps the records
+ *  in 4K data pages of PG_RECS consecutive ids instead, allocated at the
+ *  end of the file when one of their ids is first written, and finds them
+ *  through a two level directory:
+ *
+ *      page 0          the header in slot 0 and ids 1 to 63, as in the
+ *                      direct format, so the header stays at offset 0
+ *      pages 1 - 32    the root, one page number per directory page
+ *      directory page  PG_DIR_ENTRIES page numbers of data pages, each
+ *                      directory page covers 65536 ids
+ *      data page       PG_RECS records, slot id % PG_RECS holds id
+ *
+ *  A page number of 0 means the page does not exist.  The root is read
+ *  when the database is opened and kept in memory, so a lookup is one read
+ *  of the directory entry plus one of the record.  Root entries never
+ *  change once set, directory pages are never freed, but a directory entry
+ *  is always read from the file since another process may have allocated
+ *  the page, or a compaction freed it, in the meantime.
+ *
+ *  Pages are only allocated by writes made holding the header lock or the
+ *  whole file (see sdb_lock.c), so no page is ever handed out twice.
+ *  Record locks keep covering the range id * 64: that is no longer where
+ *  the record lives, but it is still one lock per id.
+ *
+ *  open_db() tells the formats apart by the header version and --convert
+ *  rewrites a database in either format (see rewrite_db(), which uses the
+ *  builder at the end of this file).  The mmap backend only maps direct
+ *  databases, a paged one is always read and written with pread()/pwrite().
+ */
+
+#define PG_ROOT_ENTRIES ((MAX_PAGED_STD_ID / PG_RECS) / PG_DIR_ENTRIES + 1)
+#define PG_ROOT_FIRST   1                                   //first page of the root
+#define PG_ROOT_PAGES   (PG_ROOT_ENTRIES / PG_DIR_ENTRIES)
+#define PG_FIRST_FREE   (PG_ROOT_FIRST + PG_ROOT_PAGES)     //first allocated page
+#define PG_NCHUNKS      (PG_ROOT_ENTRIES * (PG_DIR_ENTRIES / PG_CHUNK_PAGES))
+
+_Static_assert(PG_RECS * (int)sizeof(student_t) == PG_SIZE, "records must fill a page");
+_Static_assert(PG_DIR_ENTRIES % PG_CHUNK_PAGES == 0, "a chunk must not span directories");
+_Static_assert(PG_ROOT_ENTRIES % PG_DIR_ENTRIES == 0, "the root must fill its pages");
+
+static struct {
+    int fd;             // the paged database open, -1 if none
+    uint32_t *root;     // PG_ROOT_ENTRIES directory page numbers
+} pdb = {-1, NULL};
+
+static off_t root_off(int ri)
+{
+    return (off_t)PG_ROOT_FIRST * PG_SIZE + (off_t)ri * sizeof(uint32_t);
+}
+
+static off_t dir_off(uint32_t dir_pg, int di)
+{
+    return (off_t)dir_pg * PG_SIZE + (off_t)di * sizeof(uint32_t);
+}
+
+//reads len bytes at off, what lies past the end of the file reads as zeros
+static int read_zero_filled(int fd, void *p, size_t len, off_t off)
+{
+    INSTR_START(t);
+    ssize_t n = pread(fd, p, len, off);
+    INSTR_STOP(INSTR_READ, t, n > 0 ? n : 0);
+    if (n < 0)
+        return ERR_DB_FILE;
+    memset((char *)p + n, 0, len - n);
+    return NO_ERROR;
+}
+
+//a new, zeroed page at the end of the file
+static int new_page(int fd, uint32_t *pg)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+
+    off_t npages = (st.st_size + PG_SIZE - 1) / PG_SIZE;
+    if (npages < PG_FIRST_FREE)
+        npages = PG_FIRST_FREE;
+    if (npages >= UINT32_MAX || ftruncate(fd, (npages + 1) * PG_SIZE) == -1)
+        return ERR_DB_FILE;
+
+    *pg = npages;
+    return NO_ERROR;
+}
+
+/*
+ *  dir_page
+ *
+ *  Finds the directory page of root entry ri, allocating it if alloc is
+ *  set.  An entry still 0 in memory is read again from the file, in case
+ *  another process has allocated the directory page since.
+ *
+ *  returns:  NO_ERROR with *dir_pg 0 if there is no such page, or
+ *            ERR_DB_FILE
+ */
+static int dir_page(int fd, int ri, bool alloc, uint32_t *dir_pg)
+{
+    uint32_t pg = pdb.root[ri];
+
+    if (pg == 0) {
+        if (read_zero_filled(fd, &pg, sizeof(pg), root_off(ri)) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (pg == 0 && alloc &&
+            (new_page(fd, &pg) != NO_ERROR ||
+             pwrite(fd, &pg, sizeof(pg), root_off(ri)) != sizeof(pg)))
+            return ERR_DB_FILE;
+        pdb.root[ri] = pg;
+    }
+    *dir_pg = pg;
+    return NO_ERROR;
+}
+
+/*
+ *  paged_attach
+ *      fd:  linux file descriptor of a just opened database
+ *
+ *  Looks at the header version and, for a paged database, loads the root
+ *  so that paged_db(fd) holds and record access goes through the
+ *  directory.  Any database attached before is detached.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int paged_attach(int fd)
+{
+    db_header_t h;
+
+    paged_detach();
+
+    // a new file or one without a header is a direct database
+    if (stats_load(fd, &h) != NO_ERROR || h.version != DB_HDR_VERSION_PAGED)
+        return NO_ERROR;
+
+    uint32_t *root = malloc(PG_ROOT_ENTRIES * sizeof(uint32_t));
+    if (root == NULL ||
+        read_zero_filled(fd, root, PG_ROOT_ENTRIES * sizeof(uint32_t),
+                         root_off(0)) != NO_ERROR) {
+        free(root);
+        return ERR_DB_FILE;
+    }
+
+    pdb.fd = fd;
+    pdb.root = root;
+    return NO_ERROR;
+}
+
+void paged_detach(void)
+{
+    free(pdb.root);
+    pdb.root = NULL;
+    pdb.fd = -1;
+}
+
+//true if fd is the open paged database
+bool paged_db(int fd)
+{
+    return fd >= 0 && fd == pdb.fd;
+}
+
+//the largest student id the open database can hold
+int db_max_std_id(void)
+{
+    return pdb.fd >= 0 ? MAX_PAGED_STD_ID : MAX_STD_ID;
+}
+
+/*
+ *  paged_slot_offset
+ *      fd:     linux file descriptor of a paged database
+ *      id:     the slot, 0 is the header
+ *      alloc:  allocate the directory and data page if they do not exist,
+ *              the caller holds the header lock or the whole file
+ *
+ *  returns:  the file offset of the slot
+ *            SRCH_NOT_FOUND  the slot's page does not exist
+ *            ERR_DB_FILE     database file I/O issue
+ */
+off_t paged_slot_offset(int fd, int id, bool alloc)
+{
+    int lp = id / PG_RECS;
+    uint32_t dir_pg, pg;
+
+    // the first ids share page 0 with the header
+    if (lp == 0)
+        return (off_t)id * STUDENT_RECORD_SIZE;
+
+    if (dir_page(fd, lp / PG_DIR_ENTRIES, alloc, &dir_pg) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (dir_pg == 0)
+        return SRCH_NOT_FOUND;
+
+    off_t ent = dir_off(dir_pg, lp % PG_DIR_ENTRIES);
+    if (read_zero_filled(fd, &pg, sizeof(pg), ent) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (pg == 0 && alloc &&
+        (new_page(fd, &pg) != NO_ERROR || pwrite(fd, &pg, sizeof(pg), ent) != sizeof(pg)))
+        return ERR_DB_FILE;
+    if (pg == 0)
+        return SRCH_NOT_FOUND;
+
+    return (off_t)pg * PG_SIZE + (off_t)(id % PG_RECS) * STUDENT_RECORD_SIZE;
+}
+
+/*
+ *  paged_cursor_init
+ *      fd:   linux file descriptor of a paged database
+ *      cur:  the cursor to set up
+ *
+ *  Starts a walk over the chunks with paged_next_chunk().  The root is
+ *  read again first so that the walk sees the directory pages other
+ *  processes have added.
+ */
+void paged_cursor_init(int fd, paged_cursor_t *cur)
+{
+    uint32_t *fresh = malloc(PG_ROOT_ENTRIES * sizeof(uint32_t));
+
+    // the cached root is still good if it cannot be read again
+    if (fresh != NULL &&
+        read_zero_filled(fd, fresh, PG_ROOT_ENTRIES * sizeof(uint32_t),
+                         root_off(0)) == NO_ERROR)
+        memcpy(pdb.root, fresh, PG_ROOT_ENTRIES * sizeof(uint32_t));
+    free(fresh);
+
+    cur->ri = -1;
+}
+
+/*
+ *  paged_next_chunk
+ *      fd:     linux file descriptor of a paged database
+ *      cur:    a cursor set up with paged_cursor_init()
+ *      chunk:  where to start looking
+ *
+ *  A chunk is the PG_CHUNK_PAGES data pages holding ids chunk *
+ *  SCAN_BUFF_RECS and up, the unit the scans read.  This finds the first
+ *  chunk at or after chunk with at least one data page, skipping whole
+ *  directory pages that do not exist.  Chunk 0 always has page 0.
+ *
+ *  returns:  the chunk
+ *            SRCH_NOT_FOUND  there are no more
+ *            ERR_DB_FILE     database file I/O issue
+ */
+int paged_next_chunk(int fd, paged_cursor_t *cur, int chunk)
+{
+    const int per_dir = PG_DIR_ENTRIES / PG_CHUNK_PAGES;
+
+    if (chunk == 0)
+        return 0;
+
+    while (chunk < PG_NCHUNKS) {
+        int ri = chunk / per_dir;
+        if (pdb.root[ri] == 0) {
+            chunk = (ri + 1) * per_dir;
+            continue;
+        }
+
+        if (cur->ri != ri) {
+            if (read_zero_filled(fd, cur->dir, sizeof(cur->dir),
+                                 dir_off(pdb.root[ri], 0)) != NO_ERROR)
+                return ERR_DB_FILE;
+            cur->ri = ri;
+        }
+
+        const uint32_t *ent = &cur->dir[(chunk % per_dir) * PG_CHUNK_PAGES];
+        for (int i = 0; i < PG_CHUNK_PAGES; i++)
+            if (ent[i] != 0)
+                return chunk;
+        chunk++;
+    }
+    return SRCH_NOT_FOUND;
+}
+
+/*
+ *  paged_read_chunk
+ *      fd:     linux file descriptor of a paged database
+ *      chunk:  the chunk to read
+ *      recs:   SCAN_BUFF_RECS records
+ *
+ *  Reads the slots of a chunk into recs, missing pages as empty records.
+ *  The directory entries are read from the file, so holding a shared lock
+ *  on the chunk's ids is enough for a consistent result.  Data pages that
+ *  follow each other in the file, as a bulk load or a conversion leaves
+ *  them, are read with one pread().
+ *
+ *  returns:  the number of data pages that exist, or ERR_DB_FILE
+ */
+int paged_read_chunk(int fd, int chunk, student_t *recs)
+{
+    uint32_t pg[PG_CHUNK_PAGES] = {0};
+    int lp = chunk * PG_CHUNK_PAGES;
+    int present = 0;
+    uint32_t dir_pg;
+
+    if (dir_page(fd, lp / PG_DIR_ENTRIES, false, &dir_pg) != NO_ERROR)
+        return ERR_DB_FILE;
+    if (dir_pg != 0 &&
+        read_zero_filled(fd, pg, sizeof(pg), dir_off(dir_pg, lp % PG_DIR_ENTRIES)) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    for (int i = 0; i < PG_CHUNK_PAGES; ) {
+        student_t *dst = &recs[i * PG_RECS];
+        bool page0 = (lp + i == 0);
+
+        if (pg[i] == 0 && !page0) {
+            memset(dst, 0, PG_SIZE);
+            i++;
+            continue;
+        }
+
+        // the run of pages that are next to each other in the file
+        int run = 1;
+        while (!page0 && i + run < PG_CHUNK_PAGES && pg[i + run] == pg[i] + run)
+            run++;
+
+        if (read_zero_filled(fd, dst, (size_t)run * PG_SIZE, (off_t)pg[i] * PG_SIZE) != NO_ERROR)
+            return ERR_DB_FILE;
+        present += run;
+        i += run;
+    }
+    return present;
+}
+
+/*
+ *  paged_compact
+ *      fd:  linux file descriptor of a paged database, the caller holds
+ *           the whole file
+ *
+ *  compact_in_place() for a paged database: every data page that holds
+ *  only empty records is punched out and dropped from its directory, and
+ *  the file is truncated after the last page still in use.  Directory
+ *  pages are kept.  The first punch tells whether the filesystem can, so
+ *  when ERR_DB_OP comes back nothing has been changed.
+ *
+ *  returns:  NO_ERROR       the file was compacted
+ *            ERR_DB_OP      hole punching is not supported, use a rewrite
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int paged_compact(int fd)
+{
+    static uint32_t dir[PG_DIR_ENTRIES];
+    static student_t page[PG_RECS];
+    uint64_t live[PG_RECS / 64];
+    paged_cursor_t cur;
+    struct stat st;
+    uint32_t last = PG_FIRST_FREE - 1;      // page 0 and the root are kept
+
+    paged_cursor_init(fd, &cur);
+
+    for (int ri = 0; ri < PG_ROOT_ENTRIES; ri++) {
+        uint32_t dir_pg = pdb.root[ri];
+        bool changed = false;
+
+        if (dir_pg == 0)
+            continue;
+        if (dir_pg > last)
+            last = dir_pg;
+        if (read_zero_filled(fd, dir, sizeof(dir), dir_off(dir_pg, 0)) != NO_ERROR)
+            return ERR_DB_FILE;
+
+        for (int di = 0; di < PG_DIR_ENTRIES; di++) {
+            if (dir[di] == 0)
+                continue;
+            if (read_zero_filled(fd, page, PG_SIZE, (off_t)dir[di] * PG_SIZE) != NO_ERROR)
+                return ERR_DB_FILE;
+
+            simd_kernels()->live_slots(page, PG_RECS, live);
+            if (live[0] != 0) {
+                if (dir[di] > last)
+                    last = dir[di];
+                continue;
+            }
+
+            int rc = punch_hole(fd, (off_t)dir[di] * PG_SIZE, PG_SIZE);
+            if (rc != NO_ERROR)
+                return rc;
+            dir[di] = 0;
+            changed = true;
+        }
+
+        if (changed && pwrite(fd, dir, sizeof(dir), dir_off(dir_pg, 0)) != sizeof(dir))
+            return ERR_DB_FILE;
+    }
+
+    off_t end = ((off_t)last + 1) * PG_SIZE;
+    if (fstat(fd, &st) == -1 || (st.st_size > end && ftruncate(fd, end) == -1))
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  The builder writes a whole paged database into an empty file from
+ *  students given in id order, which is what rewrite_db() has from its
+ *  scan.  Pages are filled in memory and written once each, data pages
+ *  in id order, so the result reads back with few large pread()s.
+ */
+struct paged_build {
+    int fd;
+    bool failed;
+    uint32_t npages;                //pages used so far
+    uint32_t root[PG_ROOT_ENTRIES];
+    int ri;                         //root entry of dir, -1 before the first
+    uint32_t dir[PG_DIR_ENTRIES];
+    int lp;                         //logical page in page, 0 before the first
+    student_t page[PG_RECS];
+    student_t page0[PG_RECS];       //the header and ids below PG_RECS
+};
+
+static void build_write(paged_build_t *b, const void *p, size_t len, uint32_t pg)
+{
+    if (!b->failed && pwrite(b->fd, p, len, (off_t)pg * PG_SIZE) != (ssize_t)len)
+        b->failed = true;
+}
+
+static void build_flush_page(paged_build_t *b)
+{
+    if (b->lp != 0)
+        build_write(b, b->page, PG_SIZE, b->dir[b->lp % PG_DIR_ENTRIES]);
+}
+
+static void build_flush_dir(paged_build_t *b)
+{
+    if (b->ri >= 0)
+        build_write(b, b->dir, PG_SIZE, b->root[b->ri]);
+}
+
+/*
+ *  paged_build_begin
+ *      fd:  linux file descriptor of an empty file
+ *
+ *  returns:  the builder, or NULL when out of memory
+ */
+paged_build_t *paged_build_begin(int fd)
+{
+    paged_build_t *b = calloc(1, sizeof(paged_build_t));
+    if (b == NULL)
+        return NULL;
+
+    b->fd = fd;
+    b->npages = PG_FIRST_FREE;
+    b->ri = -1;
+    return b;
+}
+
+/*
+ *  paged_build_add
+ *      b:  the builder
+ *      s:  the next student, with a larger id than the one before
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int paged_build_add(paged_build_t *b, const student_t *s)
+{
+    int lp = s->id / PG_RECS;
+
+    if (lp == 0) {
+        b->page0[s->id] = *s;
+        return b->failed ? ERR_DB_FILE : NO_ERROR;
+    }
+
+    if (lp != b->lp) {
+        build_flush_page(b);
+        if (lp / PG_DIR_ENTRIES != b->ri) {
+            build_flush_dir(b);
+            b->ri = lp / PG_DIR_ENTRIES;
+            b->root[b->ri] = b->npages++;
+            memset(b->dir, 0, sizeof(b->dir));
+        }
+        b->dir[lp % PG_DIR_ENTRIES] = b->npages++;
+        memset(b->page, 0, sizeof(b->page));
+        b->lp = lp;
+    }
+
+    b->page[s->id % PG_RECS] = *s;
+    return b->failed ? ERR_DB_FILE : NO_ERROR;
+}
+
+/*
+ *  paged_build_end
+ *      b:  the builder, freed here
+ *      h:  the header, its version is made DB_HDR_VERSION_PAGED
+ *
+ *  Writes the pages still in memory, page 0 with the header and the
+ *  parts of the root in use.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int paged_build_end(paged_build_t *b, const db_header_t *h)
+{
+    db_header_t hdr = *h;
+
+    build_flush_page(b);
+    build_flush_dir(b);
+
+    hdr.version = DB_HDR_VERSION_PAGED;
+    memcpy(&b->page0[0], &hdr, sizeof(hdr));
+    build_write(b, b->page0, PG_SIZE, 0);
+
+    // root pages without a directory stay holes
+    for (int rp = 0; rp < PG_ROOT_PAGES; rp++) {
+        const uint32_t *ents = &b->root[rp * PG_DIR_ENTRIES];
+        for (int i = 0; i < PG_DIR_ENTRIES; i++) {
+            if (ents[i] != 0) {
+                build_write(b, ents, PG_SIZE, PG_ROOT_FIRST + rp);
+                break;
+            }
+        }
+    }
+
+    if (!b->failed && ftruncate(b->fd, (off_t)b->npages * PG_SIZE) == -1)
+        b->failed = true;
+
+    int rc = b->failed ? ERR_DB_FILE : NO_ERROR;
+    free(b);
+    return rc;
+}
+
+/*
+ *  paged_format
+ *      fd:  linux file descriptor of a database just emptied by open_db()
+ *
+ *  Turns the empty database into an empty paged one, for -z on a paged
+ *  database.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int paged_format(int fd)
+{
+    db_header_t h;
+
+    stats_hdr_init(&h);
+    paged_build_t *b = paged_build_begin(fd);
+    if (b == NULL || paged_build_end(b, &h) != NO_ERROR)
+        return ERR_DB_FILE;
+    return paged_attach(fd);
+}
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE //needed for SEEK_DATA
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Parallel print (-p --threads N).  The slots of the database are split
+ *  into fixed ranges (chunks) of PAR_CHUNK_RECS records.  Worker threads
+ *  take the next chunk from a shared counter, read it with one pread(),
+ *  find its students with the live_slots kernel and format them into the
+ *  buffer of a ring slot they own until the chunk is done.  The calling
+ *  thread is the writer: it waits for chunk 0, 1, 2 ... in turn, writes
+ *  each buffer to stdout and hands the ring slot back.  So the output is in
+ *  id order and byte for byte what print_db() prints, however the chunks
+ *  were scheduled.
+ *
+ *  Workers never run more than the ring size ahead of the writer, so the
+ *  memory used is bounded no matter how large the database is.  Chunks
+ *  that lie in a hole of the sparse file are found with SEEK_DATA and not
+ *  read at all.  In a paged database (see sdb_paged.c) the chunks with
+ *  data pages are listed up front and only those are handed out.
+ */
+
+#define PAR_CHUNK_RECS  SCAN_BUFF_RECS  //slots per chunk, one live_slots call
+#define PAR_RING_PER_T  4               //ring slots per worker thread
+#define PAR_BUFF_SZ     (PAR_CHUNK_RECS * 80)  //a chunk of table rows
+
+typedef struct par_slot {
+    char *buf;                      //formatted rows of the chunk
+    size_t len;
+    size_t cap;
+    bool done;                      //set by the worker, cleared by the writer
+    bool failed;                    //the chunk could not be read
+} par_slot_t;
+
+typedef struct par_print {
+    int fd;
+    int fmt;                        //FMT_* of the rows
+    int nchunks;                    //chunks covering the whole file
+    int *chunk_ids;                 //paged: the chunks to print, in order
+    student_t *slots;               //the records, if the backend holds them
+    size_t nslots;
+    int ring_len;
+    int next;                       //next chunk to hand to a worker
+    int written;                    //chunks written so far
+    bool stop;                      //the writer gave up, workers quit
+    par_slot_t *ring;               //chunk c is formatted in ring[c % ring_len]
+    pthread_mutex_t lock;
+    pthread_cond_t ready;           //a chunk is done
+    pthread_cond_t room;            //the writer released a ring slot
+} par_print_t;
+
+/*
+ *  format_chunk
+ *
+ *  Reads chunk c and formats its students into slot->buf, growing it when
+ *  an export's escaped names need more room.  recs is the worker's own
+ *  read buffer.
+ *
+ *  returns:  NO_ERROR, ERR_DB_FILE on a read error or ERR_DB_OP when out
+ *            of memory
+ */
+static int format_chunk(par_print_t *pp, int c, par_slot_t *slot, student_t *recs)
+{
+    uint64_t live[PAR_CHUNK_RECS / 64];
+    const student_t *r = recs;
+    int first = (pp->chunk_ids ? pp->chunk_ids[c] : c) * PAR_CHUNK_RECS;
+    int n = PAR_CHUNK_RECS;
+    off_t pos = (off_t)first * STUDENT_RECORD_SIZE;
+    off_t len = (off_t)sizeof(student_t) * n;
+
+    slot->len = 0;
+
+    if (pp->chunk_ids) {
+        int got = ERR_DB_FILE;
+        if (lock_range(pp->fd, pos, len, F_RDLCK) == NO_ERROR) {
+            got = paged_read_chunk(pp->fd, first / PAR_CHUNK_RECS, recs);
+            lock_range(pp->fd, pos, len, F_UNLCK);
+        }
+        if (got < 0)
+            return ERR_DB_FILE;
+    } else if (pp->slots != NULL) {
+        if ((size_t)first + n > pp->nslots)
+            n = pp->nslots - first;
+        r = pp->slots + first;
+    } else {
+        // a chunk wholly inside a hole holds no students
+        off_t data = lseek(pp->fd, pos, SEEK_DATA);
+        if (data == -1 && errno == ENXIO)
+            return NO_ERROR;
+        if (data >= pos + (off_t)sizeof(student_t) * n)
+            return NO_ERROR;
+
+        ssize_t got = -1;
+        if (lock_range(pp->fd, pos, len, F_RDLCK) == NO_ERROR) {
+            INSTR_START(t);
+            got = pread(pp->fd, recs, len, pos);
+            INSTR_STOP(INSTR_READ, t, got > 0 ? got : 0);
+            lock_range(pp->fd, pos, len, F_UNLCK);
+        }
+        if (got < 0)
+            return ERR_DB_FILE;
+        n = got / STUDENT_RECORD_SIZE;
+    }
+    if (n <= 0 || r == NULL)
+        return NO_ERROR;
+
+    simd_kernels()->live_slots(r, n, live);
+    for (int i = 0; first + i < MIN_STD_ID && i < n; i++)
+        live[i / 64] &= ~(1ULL << (i % 64));
+
+    for (int w = 0; w < (n + 63) / 64; w++) {
+        for (uint64_t bits = live[w]; bits != 0; bits &= bits - 1) {
+            if (slot->cap - slot->len < FMT_ROW_MAX) {
+                char *p = realloc(slot->buf, slot->cap * 2);
+                if (p == NULL)
+                    return ERR_DB_OP;
+                slot->buf = p;
+                slot->cap *= 2;
+            }
+            INSTR_START(t);
+            slot->len += fmt_row(slot->buf + slot->len,
+                                 &r[w * 64 + __builtin_ctzll(bits)], pp->fmt);
+            INSTR_STOP(INSTR_FORMAT, t, 0);
+        }
+    }
+    return NO_ERROR;
+}
+
+//worker thread, formats chunks until there are none left or the writer stops
+static void *par_worker(void *arg)
+{
+    par_print_t *pp = arg;
+    student_t *recs = malloc(sizeof(student_t) * PAR_CHUNK_RECS);
+
+    pthread_mutex_lock(&pp->lock);
+    for (;;) {
+        while (!pp->stop && pp->next < pp->nchunks &&
+               pp->next >= pp->written + pp->ring_len)
+            pthread_cond_wait(&pp->room, &pp->lock);
+        if (pp->stop || pp->next >= pp->nchunks)
+            break;
+
+        int c = pp->next++;
+        par_slot_t *slot = &pp->ring[c % pp->ring_len];
+        pthread_mutex_unlock(&pp->lock);
+
+        bool failed = recs == NULL || format_chunk(pp, c, slot, recs) != NO_ERROR;
+
+        pthread_mutex_lock(&pp->lock);
+        slot->failed = failed;
+        slot->done = true;
+        pthread_cond_broadcast(&pp->ready);
+    }
+    pthread_mutex_unlock(&pp->lock);
+
+    free(recs);
+    return NULL;
+}
+
+//fills chunk_ids with the chunks of a paged database that have data pages
+static int list_paged_chunks(par_print_t *pp)
+{
+    paged_cursor_t *cur = malloc(sizeof(paged_cursor_t));
+    int cap = 0, rc = NO_ERROR;
+
+    pp->nchunks = 0;
+    if (cur == NULL)
+        return ERR_DB_FILE;
+
+    paged_cursor_init(pp->fd, cur);
+    for (int c = 0; (c = paged_next_chunk(pp->fd, cur, c)) >= 0; c++) {
+        if (pp->nchunks == cap) {
+            cap = cap ? cap * 2 : 256;
+            int *ids = realloc(pp->chunk_ids, cap * sizeof(int));
+            if (ids == NULL) {
+                rc = ERR_DB_FILE;
+                break;
+            }
+            pp->chunk_ids = ids;
+        }
+        pp->chunk_ids[pp->nchunks++] = c;
+    }
+    free(cur);
+    return rc;
+}
+
+/*
+ *  print_db_parallel
+ *      fd:        linux file descriptor
+ *      nthreads:  worker threads formatting records, 1 to PAR_MAX_THREADS
+ *      fmt:       FMT_* output format, as for print_db_fmt()
+ *
+ *  Prints all records in the database exactly like print_db_fmt(), with
+ *  the reading and formatting spread over nthreads worker threads.  If no
+ *  thread can be started print_db_fmt() does the work.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  the same as print_db_fmt()
+ */
+int print_db_parallel(int fd, int nthreads, int fmt)
+{
+    pthread_t tids[PAR_MAX_THREADS];
+    par_print_t pp = {0};
+    struct stat st;
+    off_t file_end;
+    int started = 0;
+    int rc = NO_ERROR;
+    char hdr[FMT_ROW_MAX];
+    out_buf_t out;
+    bool header = false;
+
+    // the workers read the file, changes in the buffer pool or the mem
+    // backend go there first
+    if (backend_sync(fd) != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    pp.slots = backend_slots(fd, &pp.nslots);
+    if (pp.slots != NULL)
+        file_end = (off_t)pp.nslots * STUDENT_RECORD_SIZE;
+    else if (fstat(fd, &st) == 0)
+        file_end = st.st_size;
+    else {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (nthreads > PAR_MAX_THREADS)
+        nthreads = PAR_MAX_THREADS;
+
+    pp.fd = fd;
+    pp.fmt = fmt;
+    pp.nchunks = (file_end / STUDENT_RECORD_SIZE + PAR_CHUNK_RECS - 1) / PAR_CHUNK_RECS;
+    if (paged_db(fd) && list_paged_chunks(&pp) != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    pp.ring_len = nthreads * PAR_RING_PER_T;
+    pp.ring = calloc(pp.ring_len, sizeof(par_slot_t));
+    pthread_mutex_init(&pp.lock, NULL);
+    pthread_cond_init(&pp.ready, NULL);
+    pthread_cond_init(&pp.room, NULL);
+
+    for (int i = 0; pp.ring != NULL && i < pp.ring_len; i++) {
+        pp.ring[i].buf = malloc(PAR_BUFF_SZ);
+        pp.ring[i].cap = PAR_BUFF_SZ;
+        if (pp.ring[i].buf == NULL)
+            goto done;
+    }
+    while (pp.ring != NULL && started < nthreads &&
+           pthread_create(&tids[started], NULL, par_worker, &pp) == 0)
+        started++;
+    if (started == 0)
+        goto done;
+
+    // the writer, chunks come out in id order, an export's header first
+    out_begin(&out);
+    if (fmt != FMT_TABLE) {
+        out_bytes(&out, hdr, fmt_header(hdr, fmt));
+        header = true;
+    }
+    for (int c = 0; c < pp.nchunks; c++) {
+        par_slot_t *slot = &pp.ring[c % pp.ring_len];
+
+        pthread_mutex_lock(&pp.lock);
+        while (!slot->done)
+            pthread_cond_wait(&pp.ready, &pp.lock);
+        pthread_mutex_unlock(&pp.lock);
+
+        if (slot->failed) {
+            rc = ERR_DB_FILE;
+            break;
+        }
+        if (slot->len > 0) {
+            if (!header) {
+                out_bytes(&out, hdr, fmt_header(hdr, fmt));
+                header = true;
+            }
+            out_bytes(&out, slot->buf, slot->len);
+        }
+
+        pthread_mutex_lock(&pp.lock);
+        slot->done = false;
+        pp.written++;
+        pthread_cond_broadcast(&pp.room);
+        pthread_mutex_unlock(&pp.lock);
+    }
+
+    out_flush(&out);
+
+    pthread_mutex_lock(&pp.lock);
+    pp.stop = true;
+    pthread_cond_broadcast(&pp.room);
+    pthread_mutex_unlock(&pp.lock);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+done:
+    for (int i = 0; pp.ring != NULL && i < pp.ring_len; i++)
+        free(pp.ring[i].buf);
+    free(pp.ring);
+    free(pp.chunk_ids);
+    pthread_cond_destroy(&pp.room);
+    pthread_cond_destroy(&pp.ready);
+    pthread_mutex_destroy(&pp.lock);
+
+    if (started == 0)
+        return print_db_fmt(fd, fmt);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return rc;
+    }
+    if (!header)
+        printf(M_DB_EMPTY);
+    return NO_ERROR;
+}
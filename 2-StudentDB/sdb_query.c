@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Query predicates (-q "gpa>=350 and lname^=Sm").  A query is compiled
+ *  once by query_compile() into a program of QUERY_MAX_OPS postfix
+ *  instructions, and query_match() runs the program on a binary student_t
+ *  as the scans of print_db_where() and count_db_where() return them.
+ *  Nothing is formatted to decide whether a record matches.
+ *
+ *      query  := or
+ *      or     := and { "or" and }
+ *      and    := unary { "and" unary }
+ *      unary  := "not" unary | "(" or ")" | field op value
+ *      field  := id | gpa | fname | lname
+ *
+ *  id and gpa take = (or ==), !=, <, <=, > and >=, and = or != with a
+ *  range lo..hi, both ends included.  A GPA is given as stored, 350, or
+ *  as printed, 3.50.  fname and lname take = and != for an exact match and
+ *  ^= for a prefix, the value a word or a "quoted string".
+ *
+ *  Every comparison of a number compiles to a test of lo <= field <= hi,
+ *  negated for !=.  While parsing, each subexpression also works out the
+ *  range of ids it can match, intersected by and, joined by or, and
+ *  unbounded under not or for the other fields.  The range of the whole
+ *  query is handed to scan_limit(), so id ranges narrow the part of the
+ *  file the scan reads.
+ */
+
+enum { Q_TEST, Q_AND, Q_OR, Q_NOT };                //instruction codes
+enum { Q_ID, Q_GPA, Q_FNAME, Q_LNAME };             //fields tested
+enum { T_END, T_LPAREN, T_RPAREN, T_OP, T_WORD };   //tokens
+enum { C_EQ, C_NE, C_LT, C_LE, C_GT, C_GE, C_PREFIX };  //comparisons
+
+typedef struct query_parser {
+    const char *p;                  //after the current token
+    const char *tok;                //the current token
+    size_t len;
+    int kind;                       //T_* of the current token
+    bool quoted;                    //the T_WORD was a "quoted string"
+    sdb_query_t *q;
+} query_parser_t;
+
+static const char *field_names[] = {"id", "gpa", "fname", "lname"};
+
+static bool is_op_char(char c)
+{
+    return c == '=' || c == '!' || c == '<' || c == '>' || c == '^';
+}
+
+//moves to the next token
+static void next_token(query_parser_t *ps)
+{
+    const char *p = ps->p;
+
+    while (isspace((unsigned char)*p))
+        p++;
+    ps->tok = p;
+    ps->quoted = false;
+
+    if (*p == '\0') {
+        ps->kind = T_END;
+    } else if (*p == '(' || *p == ')') {
+        ps->kind = (*p == '(') ? T_LPAREN : T_RPAREN;
+        p++;
+    } else if (is_op_char(*p)) {
+        ps->kind = T_OP;
+        p += (p[1] == '=') ? 2 : 1;
+    } else if (*p == '"') {
+        ps->kind = T_WORD;
+        ps->quoted = true;
+        ps->tok = ++p;
+        while (*p != '\0' && *p != '"')
+            p++;
+        ps->len = p - ps->tok;
+        ps->p = (*p == '"') ? p + 1 : p;
+        return;
+    } else {
+        ps->kind = T_WORD;
+        while (*p != '\0' && !isspace((unsigned char)*p) && *p != '(' &&
+               *p != ')' && !is_op_char(*p))
+            p++;
+    }
+    ps->len = p - ps->tok;
+    ps->p = p;
+}
+
+static bool tok_is(const query_parser_t *ps, const char *word)
+{
+    return ps->kind == T_WORD && !ps->quoted && strlen(word) == ps->len &&
+           strncasecmp(ps->tok, word, ps->len) == 0;
+}
+
+static bool emit(query_parser_t *ps, query_op_t op)
+{
+    if (ps->q->n == QUERY_MAX_OPS)
+        return false;
+    ps->q->ops[ps->q->n++] = op;
+    return true;
+}
+
+//a number of the field, a GPA with a decimal point (or printed, in a
+//range where the other end has one) is scaled by 100
+static bool parse_number(const char *s, size_t len, int field, bool printed, int *v)
+{
+    char buf[32], *end;
+
+    if (len == 0 || len >= sizeof(buf))
+        return false;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+
+    if (field == Q_GPA && (printed || strchr(buf, '.') != NULL)) {
+        double d = strtod(buf, &end);
+        if (*end != '\0' || d < -1e6 || d > 1e6)
+            return false;
+        *v = (int)(d * 100 + (d < 0 ? -0.5 : 0.5));
+        return true;
+    }
+    long l = strtol(buf, &end, 10);
+    if (*end != '\0' || l < INT32_MIN || l > INT32_MAX)
+        return false;
+    *v = (int)l;
+    return true;
+}
+
+//the C_* comparison of an operator token, or -1
+static int parse_cmp(const char *tok, size_t len)
+{
+    static const char *ops[] = {"=", "==", "!=", "<", "<=", ">", ">=", "^="};
+    static const int cmps[] = {C_EQ, C_EQ, C_NE, C_LT, C_LE, C_GT, C_GE, C_PREFIX};
+
+    for (int i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++)
+        if (strlen(ops[i]) == len && strncmp(tok, ops[i], len) == 0)
+            return cmps[i];
+    return -1;
+}
+
+//the number test of cmp v as a range, false if it can not be one
+static bool number_test(query_op_t *op, int cmp, int v)
+{
+    switch (cmp) {
+    case C_EQ:
+    case C_NE:
+        op->lo = op->hi = v;
+        op->neg = (cmp == C_NE);
+        return true;
+    case C_LT:
+        op->hi = v - 1;
+        return v != INT32_MIN;
+    case C_LE:
+        op->hi = v;
+        return true;
+    case C_GT:
+        op->lo = v + 1;
+        return v != INT32_MAX;
+    case C_GE:
+        op->lo = v;
+        return true;
+    }
+    return false;
+}
+
+/*
+ *  parse_test
+ *      *lo, *hi:  set to the ids the test can match
+ *
+ *  field op value, compiled to one Q_TEST.
+ */
+static bool parse_test(query_parser_t *ps, int *lo, int *hi)
+{
+    query_op_t op = {.code = Q_TEST, .lo = INT32_MIN, .hi = INT32_MAX};
+    int field = -1;
+
+    for (int f = 0; f < (int)(sizeof(field_names) / sizeof(field_names[0])); f++)
+        if (tok_is(ps, field_names[f]))
+            field = f;
+    if (field < 0)
+        return false;
+    op.field = field;
+
+    next_token(ps);
+    int cmp = (ps->kind == T_OP) ? parse_cmp(ps->tok, ps->len) : -1;
+    bool name = (field == Q_FNAME || field == Q_LNAME);
+    if (cmp < 0 || (name && cmp != C_EQ && cmp != C_NE && cmp != C_PREFIX) ||
+        (!name && cmp == C_PREFIX))
+        return false;
+
+    next_token(ps);
+    if (ps->kind != T_WORD)
+        return false;
+
+    if (name) {
+        if (ps->len >= sizeof(op.str))
+            return false;
+        memcpy(op.str, ps->tok, ps->len);
+        op.len = ps->len;
+        op.prefix = (cmp == C_PREFIX);
+        op.neg = (cmp == C_NE);
+    } else {
+        const char *dots = ps->quoted ? NULL : strstr(ps->tok, "..");
+        int v, v2;
+
+        if (dots != NULL && dots < ps->tok + ps->len) {
+            // lo..hi, only with = and !=
+            size_t lo_len = dots - ps->tok, hi_len = ps->tok + ps->len - dots - 2;
+            bool printed = memchr(ps->tok, '.', lo_len) || memchr(dots + 2, '.', hi_len);
+            if (!parse_number(ps->tok, lo_len, field, printed, &v) ||
+                !parse_number(dots + 2, hi_len, field, printed, &v2) ||
+                (cmp != C_EQ && cmp != C_NE))
+                return false;
+            op.lo = v;
+            op.hi = v2;
+            op.neg = (cmp == C_NE);
+        } else if (!parse_number(ps->tok, ps->len, field, false, &v) ||
+                   !number_test(&op, cmp, v)) {
+            return false;
+        }
+    }
+
+    if (field == Q_ID && !op.neg) {
+        *lo = op.lo;
+        *hi = op.hi;
+    }
+    next_token(ps);
+    return emit(ps, op);
+}
+
+static bool parse_or(query_parser_t *ps, int *lo, int *hi);
+
+static bool parse_unary(query_parser_t *ps, int *lo, int *hi)
+{
+    *lo = INT32_MIN;
+    *hi = INT32_MAX;
+
+    if (tok_is(ps, "not")) {
+        int l, h;
+        next_token(ps);
+        // the ids of not x are not a range, whatever x is
+        return parse_unary(ps, &l, &h) && emit(ps, (query_op_t){.code = Q_NOT});
+    }
+    if (ps->kind == T_LPAREN) {
+        next_token(ps);
+        if (!parse_or(ps, lo, hi) || ps->kind != T_RPAREN)
+            return false;
+        next_token(ps);
+        return true;
+    }
+    return parse_test(ps, lo, hi);
+}
+
+static bool parse_and(query_parser_t *ps, int *lo, int *hi)
+{
+    int l, h;
+
+    if (!parse_unary(ps, lo, hi))
+        return false;
+    while (tok_is(ps, "and")) {
+        next_token(ps);
+        if (!parse_unary(ps, &l, &h) || !emit(ps, (query_op_t){.code = Q_AND}))
+            return false;
+        if (l > *lo)
+            *lo = l;
+        if (h < *hi)
+            *hi = h;
+    }
+    return true;
+}
+
+static bool parse_or(query_parser_t *ps, int *lo, int *hi)
+{
+    int l, h;
+
+    if (!parse_and(ps, lo, hi))
+        return false;
+    while (tok_is(ps, "or")) {
+        next_token(ps);
+        if (!parse_and(ps, &l, &h) || !emit(ps, (query_op_t){.code = Q_OR}))
+            return false;
+        // an empty range (lo > hi) adds nothing
+        if (*lo > *hi) {
+            *lo = l;
+            *hi = h;
+        } else if (l <= h) {
+            if (l < *lo)
+                *lo = l;
+            if (h > *hi)
+                *hi = h;
+        }
+    }
+    return true;
+}
+
+/*
+ *  query_compile
+ *      text:     the query
+ *      q:        the compiled program
+ *      *err_at:  set to where in text the query stopped making sense
+ *
+ *  returns:  NO_ERROR, or ERR_DB_OP if text is not a query or needs more
+ *            than QUERY_MAX_OPS instructions
+ */
+int query_compile(const char *text, sdb_query_t *q, const char **err_at)
+{
+    query_parser_t ps = {.p = text, .q = q};
+
+    q->n = 0;
+    next_token(&ps);
+    if (!parse_or(&ps, &q->id_lo, &q->id_hi) || ps.kind != T_END) {
+        *err_at = ps.tok;
+        return ERR_DB_OP;
+    }
+    return NO_ERROR;
+}
+
+static bool test_name(const query_op_t *op, const char *field, size_t size)
+{
+    if (op->prefix)
+        return strncmp(field, op->str, op->len) == 0;
+    return strncmp(field, op->str, size) == 0;
+}
+
+/*
+ *  query_match
+ *      q:  a program from query_compile()
+ *      s:  the record to test
+ *
+ *  returns:  true if s matches the query
+ */
+bool query_match(const sdb_query_t *q, const student_t *s)
+{
+    bool stack[QUERY_MAX_OPS];
+    int sp = 0;
+
+    for (int i = 0; i < q->n; i++) {
+        const query_op_t *op = &q->ops[i];
+        bool v;
+
+        switch (op->code) {
+        case Q_TEST:
+            switch (op->field) {
+            case Q_ID:
+                v = s->id >= op->lo && s->id <= op->hi;
+                break;
+            case Q_GPA:
+                v = s->gpa >= op->lo && s->gpa <= op->hi;
+                break;
+            case Q_FNAME:
+                v = test_name(op, s->fname, sizeof(s->fname));
+                break;
+            default:
+                v = test_name(op, s->lname, sizeof(s->lname));
+                break;
+            }
+            stack[sp++] = v != op->neg;
+            break;
+        case Q_AND:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] && stack[sp];
+            break;
+        case Q_OR:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] || stack[sp];
+            break;
+        case Q_NOT:
+            stack[sp - 1] = !stack[sp - 1];
+            break;
+        }
+    }
+    return sp > 0 && stack[0];
+}
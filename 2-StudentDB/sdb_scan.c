@@ -0,0 +1,283 @@
+#define _GNU_SOURCE //needed for SEEK_DATA and SEEK_HOLE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The scan iterator used by every full-table operation (print_db,
+ *  rebuild_stats, compress_db and the bulk loader).
+ *
+ *  The database is a sparse file: a student's record lives at
+ *  id * sizeof(student_t) and the space between students is usually a
+ *  hole that takes no disk space.  Reading holes still costs a read() per
+ *  record though, so a database holding ids 1 and 99999 would take ~100k
+ *  reads to scan.  Instead the iterator asks the filesystem where the data
+ *  is with lseek(SEEK_DATA) and lseek(SEEK_HOLE) and only reads those
+ *  extents, a buffer at a time, so a scan costs in proportion to the data
+ *  actually stored.  Filesystems without SEEK_DATA support report the
+ *  whole file as one extent, which degrades to a plain sequential scan.
+ *
+ *  With the mmap or mem backend the records are used in place, but the
+ *  extents are still honoured so holes are never faulted in.  A paged database
+ *  (see sdb_paged.c) has no holes to skip, it is read a chunk of
+ *  SCAN_BUFF_RECS ids at a time, visiting only the chunks that have data
+ *  pages.
+ *
+ *  Each batch is turned into a bitmap of its live slots by one call to the
+ *  live_slots SIMD kernel (sdb_simd.c), and scan_next() only visits the
+ *  set bits, so runs of deleted records cost a few bit operations.
+ *  scan_limit() narrows a scan to a range of ids, the -q queries use it to
+ *  read only the part of the file their ids can be in.
+ */
+
+/*
+ *  scan_open
+ *      sc:  the iterator to initialize
+ *      fd:  linux file descriptor of the database
+ *
+ *  Positions the iterator before the first student.  The iterator uses
+ *  pread() so the file position of fd does not matter and is not changed.
+ *  Changes held in the buffer pool or the mem backend are written back
+ *  first, the scan finds the extents in the file itself.
+ */
+void scan_open(db_scan_t *sc, int fd)
+{
+    struct stat st;
+    size_t nslots;
+
+    memset(sc, 0, sizeof(*sc));
+    sc->fd = fd;
+    sc->lo_slot = MIN_STD_ID;       // the header slot never counts
+    sc->hi_slot = INT32_MAX;
+
+    if (backend_sync(fd) != NO_ERROR) {
+        sc->failed = true;
+    } else if (paged_db(fd)) {
+        sc->paged = true;
+        paged_cursor_init(fd, &sc->cursor);
+    } else if (backend_slots(fd, &nslots) != NULL) {
+        sc->file_end = (off_t)nslots * STUDENT_RECORD_SIZE;
+    } else if (fstat(fd, &st) == 0) {
+        sc->file_end = st.st_size - st.st_size % STUDENT_RECORD_SIZE;
+    } else {
+        sc->failed = true;
+    }
+}
+
+/*
+ *  scan_limit
+ *      sc:  an iterator just set up with scan_open()
+ *      lo:  the lowest id to return
+ *      hi:  the highest id to return
+ *
+ *  Narrows the scan to the ids lo to hi, so only that part of the file is
+ *  read: the direct format starts reading at lo and stops after hi, a
+ *  paged database starts at the chunk of lo.  An empty range returns no
+ *  students at all.
+ */
+void scan_limit(db_scan_t *sc, int lo, int hi)
+{
+    if (lo > sc->lo_slot)
+        sc->lo_slot = lo;
+    if (hi < sc->hi_slot)
+        sc->hi_slot = hi;
+
+    if (sc->paged) {
+        sc->chunk = sc->lo_slot / SCAN_BUFF_RECS;
+        return;
+    }
+    off_t end = ((off_t)sc->hi_slot + 1) * STUDENT_RECORD_SIZE;
+    if (end < sc->file_end)
+        sc->file_end = end;
+    sc->pos = (off_t)sc->lo_slot * STUDENT_RECORD_SIZE;
+    if (sc->pos > sc->file_end)
+        sc->pos = sc->file_end;
+}
+
+/*
+ *  next_extent
+ *
+ *  Moves pos to the start of the next data extent at or after pos and sets
+ *  data_end to where that extent ends.
+ *
+ *  returns:  false when there is no more data
+ */
+static bool next_extent(db_scan_t *sc)
+{
+    INSTR_START(t);
+    off_t data = lseek(sc->fd, sc->pos, SEEK_DATA);
+    INSTR_STOP(INSTR_SEEK, t, 0);
+    if (data == -1) {
+        if (errno == ENXIO)
+            return false;           // only a hole remains
+        data = sc->pos;             // no SEEK_DATA, treat it all as data
+        sc->data_end = sc->file_end;
+    } else {
+        INSTR_START(t_hole);
+        off_t hole = lseek(sc->fd, data, SEEK_HOLE);
+        INSTR_STOP(INSTR_SEEK, t_hole, 0);
+        sc->data_end = (hole == -1) ? sc->file_end : hole;
+    }
+
+    // extents are block aligned, records are 64 bytes, so this only
+    // rounds when the filesystem reports finer grained extents
+    sc->pos = data - data % STUDENT_RECORD_SIZE;
+    if (sc->data_end % STUDENT_RECORD_SIZE)
+        sc->data_end += STUDENT_RECORD_SIZE - sc->data_end % STUDENT_RECORD_SIZE;
+    if (sc->data_end > sc->file_end)
+        sc->data_end = sc->file_end;
+
+    return sc->pos < sc->data_end;
+}
+
+/*
+ *  fill_paged
+ *
+ *  fill() for a paged database, reads the next chunk that has data pages.
+ *
+ *  returns:  false after the last chunk or on a read error
+ */
+static bool fill_paged(db_scan_t *sc)
+{
+    int chunk = paged_next_chunk(sc->fd, &sc->cursor, sc->chunk);
+    if (chunk < 0) {
+        sc->failed = (chunk != SRCH_NOT_FOUND);
+        return false;
+    }
+    if ((long long)chunk * SCAN_BUFF_RECS > sc->hi_slot)
+        return false;
+
+    // the chunk's ids are locked, where its pages are in the file does
+    // not matter to other processes
+    off_t pos = (off_t)chunk * SCAN_BUFF_RECS * STUDENT_RECORD_SIZE;
+    int got = ERR_DB_FILE;
+    if (lock_range(sc->fd, pos, sizeof(sc->buff), F_RDLCK) == NO_ERROR) {
+        got = paged_read_chunk(sc->fd, chunk, sc->buff);
+        lock_range(sc->fd, pos, sizeof(sc->buff), F_UNLCK);
+    }
+    if (got < 0) {
+        sc->failed = true;
+        return false;
+    }
+
+    sc->chunk = chunk + 1;
+    sc->first_slot = chunk * SCAN_BUFF_RECS;
+    sc->recs = sc->buff;
+    sc->n = SCAN_BUFF_RECS;
+    return true;
+}
+
+/*
+ *  fill_extent
+ *
+ *  Makes the next batch of slots from the current extent available in
+ *  sc->recs, reading them into the iterator's buffer unless they can be
+ *  used in place from the mapping.
+ *
+ *  returns:  false at the end of the file or on a read error
+ */
+static bool fill_extent(db_scan_t *sc)
+{
+    if (sc->pos >= sc->data_end && !next_extent(sc))
+        return false;
+
+    off_t len = sc->data_end - sc->pos;
+    if (len > (off_t)sizeof(sc->buff))
+        len = sizeof(sc->buff);
+
+    sc->first_slot = sc->pos / STUDENT_RECORD_SIZE;
+
+    size_t nslots;
+    student_t *slots = backend_slots(sc->fd, &nslots);
+    if (slots != NULL) {
+        sc->recs = slots + sc->first_slot;
+    } else {
+        // a shared lock keeps writers out of the batch while it is read
+        ssize_t n = -1;
+        if (lock_range(sc->fd, sc->pos, len, F_RDLCK) == NO_ERROR) {
+            INSTR_START(t);
+            n = pread(sc->fd, sc->buff, len, sc->pos);
+            INSTR_STOP(INSTR_READ, t, n > 0 ? n : 0);
+            lock_range(sc->fd, sc->pos, len, F_UNLCK);
+        }
+        if (n < 0) {
+            sc->failed = true;
+            return false;
+        }
+        len = n - n % STUDENT_RECORD_SIZE;
+        if (len == 0)
+            return false;
+        sc->recs = sc->buff;
+    }
+
+    sc->n = len / STUDENT_RECORD_SIZE;
+    sc->pos += len;
+    return true;
+}
+
+/*
+ *  fill
+ *
+ *  Reads the next batch of slots and finds the students in it.
+ *
+ *  returns:  false at the end of the database or on a read error
+ */
+static bool fill(db_scan_t *sc)
+{
+    if (!(sc->paged ? fill_paged(sc) : fill_extent(sc)))
+        return false;
+    sc->i = 0;
+
+    // find the students in the batch at once, then drop the slots outside
+    // the limits, the header slot at least
+    simd_kernels()->live_slots(sc->recs, sc->n, sc->live);
+    int end = sc->first_slot + sc->n;
+    for (int slot = sc->first_slot; slot < sc->lo_slot && slot < end; slot++)
+        sc->live[(slot - sc->first_slot) / 64] &= ~(1ULL << ((slot - sc->first_slot) % 64));
+    for (int slot = end - 1; slot > sc->hi_slot && slot >= sc->first_slot; slot--)
+        sc->live[(slot - sc->first_slot) / 64] &= ~(1ULL << ((slot - sc->first_slot) % 64));
+    INSTR_COUNT(INSTR_SCANNED, sc->n);
+    INSTR_COUNT(INSTR_LIVE, simd_live_count(sc->live, (sc->n + 63) / 64));
+    return true;
+}
+
+/*
+ *  scan_next
+ *      sc:  an iterator set up with scan_open()
+ *      *s:  where the next student is copied
+ *
+ *  Returns students in id order.  Empty (deleted) slots and the header in
+ *  slot 0 are skipped by walking the set bits of the batch's live bitmap.
+ *
+ *  returns:  true if a student was copied, false when the scan is done.
+ *            sc->failed tells an I/O error apart from the end of the file
+ */
+bool scan_next(db_scan_t *sc, student_t *s)
+{
+    for (;;) {
+        while (sc->i < sc->n) {
+            // the live bits at or after slot i of the batch
+            uint64_t bits = sc->live[sc->i / 64] & (~0ULL << (sc->i % 64));
+            if (bits == 0) {
+                sc->i = (sc->i / 64 + 1) * 64;
+                continue;
+            }
+            int i = (sc->i / 64) * 64 + __builtin_ctzll(bits);
+            sc->i = i + 1;
+            *s = sc->recs[i];
+            return true;
+        }
+        if (sc->failed || !fill(sc))
+            return false;
+    }
+}
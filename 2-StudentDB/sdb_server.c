@@ -0,0 +1,701 @@
+#define _GNU_SOURCE //needed for memfd_create()
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Server mode.  Launching ./sdbsc for every operation costs a fork, an
+ *  exec and an open/close of the database, all far more expensive than the
+ *  64 byte record I/O the operation actually does.  In server mode one
+ *  process keeps student.db open and runs operations for any number of
+ *  local clients over a unix domain socket.
+ *
+ *  The server is a single thread multiplexing its clients with poll().
+ *  Operations are short, so running them one at a time keeps them
+ *  serialized on the single database fd without any locking, while slow
+ *  clients never hold up others because responses are written only when
+ *  the client's socket can take them.
+ *
+ *  Operations report through printf(), so while one runs stdout is pointed
+ *  at an in-memory file and whatever it printed becomes the response.
+ *
+ *  With the write-ahead log on (--wal, see sdb_wal.c) the log is committed
+ *  at the end of every poll() round, before any response built in that
+ *  round can be sent, so a batched log costs one fdatasync() per round
+ *  however many clients changed the database in it.  When no request
+ *  arrives for WAL_IDLE_MS the server checkpoints the log.
+ *
+ *  With --cache the records are served from the buffer pool (see
+ *  sdb_bufpool.c), which holds the whole file lock.  The server attaches
+ *  it when requests come in and keeps it over the following rounds, so
+ *  pages stay cached while the clients are busy.  As soon as a poll()
+ *  finds nothing to do, or after BUFPOOL_HOLD_ROUNDS rounds, the pool is
+ *  written back and detached so other processes get at the file.  The mem,
+ *  mmap and log backends (--backend) lock the file too and are held the
+ *  same way.
+ */
+
+#define WAL_IDLE_MS     1000        //quiet time before the log is checkpointed
+
+#define RESP_CHUNK_SZ   (1024*64)   //client copies output in chunks this big
+
+typedef struct client {
+    int fd;
+    char *in;           // received bytes not yet consumed
+    size_t in_len;
+    char *out;          // response being sent
+    size_t out_len;
+    size_t out_sent;
+} client_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+//writes all of buff, retrying short writes
+static int write_all(int fd, const void *buff, size_t len)
+{
+    const char *p = buff;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return ERR_DB_COMM;
+        p += n;
+        len -= n;
+    }
+    return NO_ERROR;
+}
+
+//reads exactly len bytes, failing on EOF
+static int read_all(int fd, void *buff, size_t len)
+{
+    char *p = buff;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return ERR_DB_COMM;
+        p += n;
+        len -= n;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  boot_server
+ *      sock_path:  filesystem path of the unix domain socket
+ *
+ *  Creates, binds and listens on the server socket.  A stale socket file
+ *  left by a server that did not shut down cleanly is removed first.
+ *
+ *  returns:  the listening socket, or ERR_DB_COMM on failure
+ */
+static int boot_server(char *sock_path)
+{
+    struct sockaddr_un addr = {0};
+
+    if (strlen(sock_path) >= sizeof(addr.sun_path))
+        return ERR_DB_COMM;
+
+    int svr = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (svr == -1)
+        return ERR_DB_COMM;
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    unlink(sock_path);
+
+    if (bind(svr, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(svr, SDB_LISTEN_BACKLOG) == -1) {
+        close(svr);
+        return ERR_DB_COMM;
+    }
+
+    return svr;
+}
+
+static void drop_client(client_t *c)
+{
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+/*
+ *  exec_request
+ *      c:         the client that sent the request
+ *      payload:   the request payload, NUL terminated argv strings
+ *      len:       payload length
+ *      *db_fd:    the open database, updated if the operation reopens it
+ *      out_fd:    in-memory file that captures the operation's output
+ *
+ *  Runs the requested operation with run_op() and turns its exit code and
+ *  captured console output into the client's pending response.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_COMM if the request is malformed or the
+ *            response could not be built
+ */
+static int exec_request(client_t *c, char *payload, uint32_t len, int *db_fd,
+                        int out_fd)
+{
+    int argc = 0;
+
+    if (len == 0 || payload[len - 1] != '\0')
+        return ERR_DB_COMM;
+
+    // one word per NUL, the request size is the only limit on their number
+    for (uint32_t i = 0; i < len; i++)
+        argc += (payload[i] == '\0');
+    char **argv = malloc((argc + 1) * sizeof(char *));
+    if (argv == NULL)
+        return ERR_DB_COMM;
+
+    argc = 0;
+    for (char *p = payload; p < payload + len; p += strlen(p) + 1)
+        argv[argc++] = p;
+    argv[argc] = NULL;
+
+    // point stdout at the capture file while the operation runs
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (saved_stdout == -1 || ftruncate(out_fd, 0) == -1 ||
+        lseek(out_fd, 0, SEEK_SET) == -1 ||
+        dup2(out_fd, STDOUT_FILENO) == -1) {
+        if (saved_stdout != -1)
+            close(saved_stdout);
+        free(argv);
+        return ERR_DB_COMM;
+    }
+
+    INSTR_START(t_op);
+    int32_t exit_code = run_op(db_fd, argc, argv);
+    INSTR_STOP(INSTR_OP, t_op, 0);
+    free(argv);
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    // -x and -z reopen the database, if that failed try to get it back
+    // so the server can keep serving
+    if (*db_fd < 0) {
+        *db_fd = open_db(DB_FILE, false);
+        if (*db_fd >= 0)
+            backend_attach(*db_fd);
+    }
+
+    off_t out_len = lseek(out_fd, 0, SEEK_END);
+    if (out_len < 0 || out_len > UINT32_MAX)
+        return ERR_DB_COMM;
+
+    uint32_t out_len32 = out_len;
+    char *out = malloc(2 * sizeof(uint32_t) + out_len);
+    if (out == NULL)
+        return ERR_DB_COMM;
+
+    memcpy(out, &exit_code, sizeof(exit_code));
+    memcpy(out + sizeof(exit_code), &out_len32, sizeof(out_len32));
+    if (pread(out_fd, out + 2 * sizeof(uint32_t), out_len, 0) != out_len) {
+        free(out);
+        return ERR_DB_COMM;
+    }
+
+    c->out = out;
+    c->out_len = 2 * sizeof(uint32_t) + out_len;
+    c->out_sent = 0;
+    return NO_ERROR;
+}
+
+/*
+ *  service_input
+ *
+ *  Executes the oldest complete request buffered for a client, unless the
+ *  client is still being sent an earlier response.  Requests that arrive
+ *  while a response is pending stay buffered so responses go out in order.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_COMM if the client should be dropped
+ */
+static int service_input(client_t *c, int *db_fd, int out_fd)
+{
+    uint32_t len;
+
+    if (c->out != NULL || c->in_len < sizeof(len))
+        return NO_ERROR;
+
+    memcpy(&len, c->in, sizeof(len));
+    if (len > SDB_MAX_REQ_SZ)
+        return ERR_DB_COMM;
+    if (c->in_len < sizeof(len) + len)
+        return NO_ERROR;
+
+    int rc = exec_request(c, c->in + sizeof(len), len, db_fd, out_fd);
+
+    c->in_len -= sizeof(len) + len;
+    memmove(c->in, c->in + sizeof(len) + len, c->in_len);
+    return rc;
+}
+
+//writes back and detaches the buffer pool, or a storage backend that
+//locks the file, letting go of the file
+static void release_pool(void)
+{
+    int rc = bufpool_detach();
+    if (backend_exclusive() && backend_detach() != NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        fflush(stdout);
+    }
+}
+
+/*
+ *  follow_db
+ *      db_fd:      the database fd, replaced by the new one
+ *      wal_level:  WAL_* durability of the write-ahead log, -1 for no log
+ *
+ *  Moves the server over to the file another process's restore or
+ *  rewrite renamed over DB_FILE (see db_replaced()).  The log is closed,
+ *  which checkpoints it against the old file, a restore unlinks it
+ *  anyway, and opened again with the new one.  The backend and the pool are attached
+ *  to the new file if they were to the old one.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE, *db_fd is -1 if the new file could
+ *            not be opened
+ */
+static int follow_db(int *db_fd, int wal_level)
+{
+    bool remap = backend_attached(*db_fd);
+    bool recache = bufpool_attached(*db_fd);
+    int rc = NO_ERROR;
+
+    if (wal_close(*db_fd) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (bufpool_detach() != NO_ERROR || backend_detach() != NO_ERROR)
+        rc = ERR_DB_FILE;
+    close(*db_fd);
+
+    *db_fd = open_db(DB_FILE, false);
+    if (*db_fd < 0)
+        return ERR_DB_FILE;
+    if ((remap && backend_attach(*db_fd) != NO_ERROR) ||
+        (recache && bufpool_attach(*db_fd) != NO_ERROR) ||
+        (wal_level >= 0 && wal_open(wal_level) != NO_ERROR))
+        rc = ERR_DB_FILE;
+    return rc;
+}
+
+/*
+ *  serve_db
+ *      sock_path:  filesystem path of the unix domain socket to listen on
+ *      use_cache:  serve records through the buffer pool while busy
+ *      wal_level:  WAL_* durability of the write-ahead log, -1 for no log
+ *
+ *  Opens the database and serves client requests until SIGINT or SIGTERM
+ *  is received.  The socket file is removed on the way out.  The records
+ *  are reached through the selected storage backend (see sdb_backend.c).
+ *
+ *  returns:  EXIT_OK after a requested shutdown, EXIT_FAIL_DB if the
+ *            database or the socket could not be set up
+ *
+ *  console:  M_SRV_START and M_SRV_STOP, or M_ERR_SRV_SOCKET
+ */
+int serve_db(char *sock_path, bool use_cache, int wal_level)
+{
+    int held_rounds = 0;    // rounds the buffer pool has held the file
+
+    // a backend that locks the file is attached and released with the
+    // rounds, like the buffer pool
+    bool lazy = backend_exclusive();
+
+    int db_fd = open_db(DB_FILE, false);
+    if (db_fd < 0)
+        return EXIT_FAIL_DB;
+
+    if (!lazy && backend_attach(db_fd) != NO_ERROR) {
+        printf(M_ERR_DB_OPEN);
+        close(db_fd);
+        return EXIT_FAIL_DB;
+    }
+
+    if (wal_level >= 0 && wal_open(wal_level) != NO_ERROR) {
+        printf(M_ERR_WAL_OPEN);
+        backend_detach();
+        close(db_fd);
+        return EXIT_FAIL_DB;
+    }
+
+    int out_fd = memfd_create("sdbsc-output", MFD_CLOEXEC);
+    int svr = boot_server(sock_path);
+    if (svr < 0 || out_fd == -1) {
+        printf(M_ERR_SRV_SOCKET, sock_path);
+        if (svr >= 0)
+            close(svr);
+        wal_close(db_fd);
+        backend_detach();
+        close(db_fd);
+        return EXIT_FAIL_DB;
+    }
+
+    struct sigaction sa = {0};
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf(M_SRV_START, DB_FILE, sock_path);
+    fflush(stdout);
+
+    client_t *clients = NULL;
+    struct pollfd *pfds = NULL;
+    int n_clients = 0;
+
+    while (!stop_requested) {
+        // slot 0 is the listening socket, slot i+1 is clients[i]
+        struct pollfd *grown = realloc(pfds, (n_clients + 1) * sizeof(*pfds));
+        if (grown == NULL)
+            break;
+        pfds = grown;
+
+        pfds[0].fd = svr;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < n_clients; i++) {
+            pfds[i + 1].fd = clients[i].fd;
+            pfds[i + 1].events = clients[i].out ? POLLOUT : POLLIN;
+            pfds[i + 1].revents = 0;
+        }
+
+        // a log with entries in it is checkpointed once things are quiet,
+        // an attached buffer pool only checks whether they are
+        bool held = bufpool_attached(db_fd) || (lazy && backend_attached(db_fd));
+        int timeout = wal_needs_checkpoint(true) ? WAL_IDLE_MS : -1;
+        if (held)
+            timeout = 0;
+        int ready = poll(pfds, n_clients + 1, timeout);
+        if (ready == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (ready == 0 && held) {
+            release_pool();
+            continue;
+        }
+        if (ready == 0) {
+            if (wal_checkpoint(db_fd) != NO_ERROR) {
+                printf(M_ERR_WAL_SYNC);
+                fflush(stdout);
+            }
+            continue;
+        }
+
+        // without the lock the round simply runs uncached
+        if (!held && lazy && backend_attach(db_fd) == NO_ERROR)
+            held_rounds = 0;
+        if (use_cache && !bufpool_attached(db_fd) && bufpool_attach(db_fd) == NO_ERROR)
+            held_rounds = 0;
+
+        // checked once the lock is held, if the backend or pool takes it
+        if (db_fd >= 0 && db_replaced(db_fd) && follow_db(&db_fd, wal_level) != NO_ERROR) {
+            printf(M_ERR_DB_OPEN);
+            fflush(stdout);
+        }
+
+        for (int i = 0; i < n_clients; i++) {
+            client_t *c = &clients[i];
+            short rev = pfds[i + 1].revents;
+            int rc = NO_ERROR;
+
+            if (rev & POLLOUT) {
+                ssize_t n = write(c->fd, c->out + c->out_sent,
+                                  c->out_len - c->out_sent);
+                if (n < 0 && (errno == EAGAIN || errno == EINTR))
+                    continue;
+                if (n <= 0) {
+                    drop_client(c);
+                    continue;
+                }
+                c->out_sent += n;
+                if (c->out_sent == c->out_len) {
+                    free(c->out);
+                    c->out = NULL;
+                    rc = service_input(c, &db_fd, out_fd);
+                }
+            } else if (rev & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t n = read(c->fd, c->in + c->in_len,
+                                 sizeof(uint32_t) + SDB_MAX_REQ_SZ - c->in_len);
+                if (n < 0 && (errno == EAGAIN || errno == EINTR))
+                    continue;
+                if (n <= 0) {
+                    drop_client(c);
+                    continue;
+                }
+                c->in_len += n;
+                rc = service_input(c, &db_fd, out_fd);
+            }
+
+            if (rc != NO_ERROR)
+                drop_client(c);
+        }
+
+        // group commit, every change made this round is synced before its
+        // response is sent, which only happens in a later round
+        if (wal_commit() != NO_ERROR ||
+            (wal_needs_checkpoint(false) && wal_checkpoint(db_fd) != NO_ERROR)) {
+            printf(M_ERR_WAL_SYNC);
+            fflush(stdout);
+        }
+        held = bufpool_attached(db_fd) || (lazy && backend_attached(db_fd));
+        if (held && ++held_rounds >= BUFPOOL_HOLD_ROUNDS)
+            release_pool();
+
+        // forget the clients that were dropped
+        int kept = 0;
+        for (int i = 0; i < n_clients; i++) {
+            if (clients[i].fd != -1)
+                clients[kept++] = clients[i];
+        }
+        n_clients = kept;
+
+        if (pfds[0].revents & POLLIN) {
+            int cli;
+            while ((cli = accept4(svr, NULL, NULL,
+                                  SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+                client_t *more = realloc(clients, (n_clients + 1) * sizeof(client_t));
+                char *in = malloc(sizeof(uint32_t) + SDB_MAX_REQ_SZ);
+                if (more == NULL || in == NULL) {
+                    if (more != NULL)
+                        clients = more;
+                    free(in);
+                    close(cli);
+                    continue;
+                }
+                clients = more;
+                memset(&clients[n_clients], 0, sizeof(client_t));
+                clients[n_clients].fd = cli;
+                clients[n_clients].in = in;
+                n_clients++;
+            }
+        }
+    }
+
+    for (int i = 0; i < n_clients; i++)
+        drop_client(&clients[i]);
+    free(clients);
+    free(pfds);
+
+    close(svr);
+    close(out_fd);
+    unlink(sock_path);
+    release_pool();
+    if (wal_close(db_fd) != NO_ERROR)
+        printf(M_ERR_WAL_SYNC);
+    if (backend_detach() != NO_ERROR)
+        printf(M_ERR_DB_WRITE);
+    close(db_fd);
+    printf(M_SRV_STOP);
+    instr_report();
+    return EXIT_OK;
+}
+
+//frees the argv built by words_from_stdin()
+static void free_words(char **words, int argc)
+{
+    for (int i = 2; i < argc; i++)
+        free(words[i]);
+    free(words);
+}
+
+/*
+ *  words_from_stdin
+ *      argv:   the command line of -f -
+ *      *argc:  set to the number of words in the new command line
+ *
+ *  The server cannot read the client's stdin, so the client reads the ids
+ *  of -f - itself, separated by white space as read_id_list() reads them,
+ *  and sends them as if they had been given on the command line.
+ *
+ *  returns:  a malloc'd argv, free it with free_words(), or NULL if out
+ *            of memory
+ */
+static char **words_from_stdin(char *argv[], int *argc)
+{
+    char word[32];
+    int n = 2, cap = 1024;
+    char **words = malloc(cap * sizeof(char *));
+
+    if (words == NULL)
+        return NULL;
+    words[0] = argv[0];
+    words[1] = argv[1];
+
+    while (fscanf(stdin, "%31s", word) == 1) {
+        if (n + 1 == cap) {
+            char **more = realloc(words, 2 * cap * sizeof(char *));
+            if (more == NULL)
+                break;
+            words = more;
+            cap *= 2;
+        }
+        if ((words[n] = strdup(word)) == NULL)
+            break;
+        n++;
+    }
+    words[n] = NULL;
+
+    if (!feof(stdin)) {
+        free_words(words, n);
+        return NULL;
+    }
+    *argc = n;
+    return words;
+}
+
+/*
+ *  client_run
+ *      sock_path:  filesystem path of the server's unix domain socket
+ *      argc:       argument count, long options already removed
+ *      argv:       the command line, forwarded as is
+ *
+ *  The thin client.  Sends the command line to the server, copies the
+ *  operation's output to stdout and hands back the operation's exit code,
+ *  so scripts see exactly what running the operation locally would show.
+ *  Bulk load, bulk update and snapshot file names are made absolute
+ *  because the server resolves them from its own working directory, and
+ *  the ids of -f - are read here and sent as words (see
+ *  words_from_stdin()).  A request can hold up to SDB_MAX_REQ_SZ bytes of
+ *  words.
+ *
+ *  returns:  the exit code of the remote operation, or EXIT_FAIL_DB if the
+ *            server could not be reached, EXIT_FAIL_ARGS for -L -, -u -,
+ *            --snapshot - and --restore -
+ *
+ *  console:  the operation's output, or M_ERR_CLI_CONNECT, M_ERR_CLI_COMM
+ *            or M_ERR_CLI_STDIN
+ */
+int client_run(char *sock_path, int argc, char *argv[])
+{
+    struct sockaddr_un addr = {0};
+    char load_path[PATH_MAX];
+    char snap_paths[2][PATH_MAX];
+    int nsnap = 0;
+    char *req;
+    uint32_t len = 0;
+
+    if (argc == 3 && strcmp(argv[1], "-f") == 0 && strcmp(argv[2], "-") == 0) {
+        int nwords;
+        char **words = words_from_stdin(argv, &nwords);
+        if (words == NULL) {
+            printf(M_ERR_DB_READ);
+            return EXIT_FAIL_DB;
+        }
+        int exit_code = client_run(sock_path, nwords, words);
+        free_words(words, nwords);
+        return exit_code;
+    }
+    // -u with a file (not an id) is a bulk update, given like -L
+    if ((argc >= 3 && strcmp(argv[1], "-L") == 0) ||
+        (argc == 3 && strcmp(argv[1], "-u") == 0 &&
+         argv[2][strspn(argv[2], "0123456789")] != '\0')) {
+        if (strcmp(argv[2], "-") == 0) {
+            printf(M_ERR_CLI_STDIN);
+            return EXIT_FAIL_ARGS;
+        }
+        if (realpath(argv[2], load_path) != NULL)
+            argv[2] = load_path;
+    }
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--snapshot") != 0 && strcmp(argv[i], "--restore") != 0)
+            continue;
+        if (strcmp(argv[i + 1], "-") == 0) {
+            printf(M_ERR_CLI_STDIN);
+            return EXIT_FAIL_ARGS;
+        }
+        // a snapshot being written does not exist yet, realpath() cannot help
+        char cwd[PATH_MAX];
+        if (argv[i + 1][0] != '/' && nsnap < 2 && getcwd(cwd, sizeof(cwd)) != NULL &&
+            snprintf(snap_paths[nsnap], PATH_MAX, "%s/%s", cwd, argv[i + 1]) < PATH_MAX)
+            argv[i + 1] = snap_paths[nsnap++];
+    }
+
+    for (int i = 0; i < argc; i++)
+        len += strlen(argv[i]) + 1;
+    if (len > SDB_MAX_REQ_SZ) {
+        usage(argv[0]);
+        return EXIT_FAIL_ARGS;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    addr.sun_family = AF_UNIX;
+    if (sock == -1 || strlen(sock_path) >= sizeof(addr.sun_path)) {
+        printf(M_ERR_CLI_CONNECT, sock_path);
+        return EXIT_FAIL_DB;
+    }
+    strcpy(addr.sun_path, sock_path);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        printf(M_ERR_CLI_CONNECT, sock_path);
+        close(sock);
+        return EXIT_FAIL_DB;
+    }
+
+    req = malloc(sizeof(len) + len);
+    if (req == NULL) {
+        close(sock);
+        return EXIT_FAIL_DB;
+    }
+    memcpy(req, &len, sizeof(len));
+    char *p = req + sizeof(len);
+    for (int i = 0; i < argc; i++) {
+        size_t n = strlen(argv[i]) + 1;
+        memcpy(p, argv[i], n);
+        p += n;
+    }
+
+    int32_t exit_code;
+    uint32_t out_len;
+    int rc = write_all(sock, req, sizeof(len) + len);
+    free(req);
+    if (rc == NO_ERROR)
+        rc = read_all(sock, &exit_code, sizeof(exit_code));
+    if (rc == NO_ERROR)
+        rc = read_all(sock, &out_len, sizeof(out_len));
+
+    // stream the output through, it can be large for -p
+    char buff[RESP_CHUNK_SZ];
+    while (rc == NO_ERROR && out_len > 0) {
+        size_t want = out_len < sizeof(buff) ? out_len : sizeof(buff);
+        rc = read_all(sock, buff, want);
+        if (rc == NO_ERROR)
+            rc = write_all(STDOUT_FILENO, buff, want);
+        out_len -= want;
+    }
+    close(sock);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_CLI_COMM);
+        return EXIT_FAIL_DB;
+    }
+    return exit_code;
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Sidecar files.  The name index, the GPA index and the GPA column are
+ *  files next to the database that add_student() and del_student() keep up
+ *  to date through sidecars_note_add() and sidecars_note_del() below.
+ *
+ *  The GPA index and the GPA column are fixed size files used through a
+ *  shared mapping.  Each starts with a sidecar_hdr_t whose count must match
+ *  the database header for the file to be trusted; adds and deletes move
+ *  both counts together, anything else (a bulk load, a failed update)
+ *  makes them disagree and the sidecar is rebuilt on its next use.
+ */
+
+/*
+ *  sidecar_map
+ *      path:     file to map
+ *      size:     the exact size of the file
+ *      magic:    expected magic number, version is checked as well
+ *      version:
+ *      create:   create (or truncate) the file and initialize its header
+ *
+ *  A new file is created sparse, so only the pages written take disk
+ *  space.
+ *
+ *  returns:  the mapping, or NULL if the file is missing, of the wrong
+ *            size or format, or cannot be mapped
+ */
+void *sidecar_map(const char *path, size_t size, uint32_t magic,
+                  uint16_t version, bool create)
+{
+    struct stat st;
+    int flags = O_RDWR | (create ? O_CREAT | O_TRUNC : 0);
+
+    int sfd = open(path, flags, S_IRUSR | S_IWUSR);
+    if (sfd == -1)
+        return NULL;
+
+    if ((create && ftruncate(sfd, size) == -1) ||
+        fstat(sfd, &st) == -1 || (size_t)st.st_size != size) {
+        close(sfd);
+        return NULL;
+    }
+
+    sidecar_hdr_t *h = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            sfd, 0);
+    close(sfd);     // the mapping keeps the file
+    if (h == MAP_FAILED)
+        return NULL;
+
+    if (create) {
+        h->magic = magic;
+        h->version = version;
+    } else if (h->magic != magic || h->version != version) {
+        munmap(h, size);
+        return NULL;
+    }
+    return h;
+}
+
+void sidecar_unmap(void *h, size_t size)
+{
+    munmap(h, size);
+}
+
+/*
+ *  sidecar_open_current
+ *      fd:       linux file descriptor of the database
+ *      path, size, magic, version:  as for sidecar_map()
+ *      rebuild:  builds the sidecar from the database
+ *
+ *  Maps a sidecar for a query, rebuilding it first if it is missing or
+ *  its count disagrees with the database header.
+ *
+ *  returns:  the mapping, or NULL on any failure
+ */
+void *sidecar_open_current(int fd, const char *path, size_t size,
+                           uint32_t magic, uint16_t version,
+                           int (*rebuild)(int fd))
+{
+    db_header_t h;
+
+    if (stats_load(fd, &h) != NO_ERROR)
+        return NULL;
+
+    sidecar_hdr_t *s = sidecar_map(path, size, magic, version, false);
+    if (s != NULL && s->count == h.count)
+        return s;
+    if (s != NULL)
+        sidecar_unmap(s, size);
+
+    if (rebuild(fd) < 0)
+        return NULL;
+    return sidecar_map(path, size, magic, version, false);
+}
+
+/*
+ *  sidecars_note_add / sidecars_note_del
+ *      s:  the student just added to or deleted from the database
+ *
+ *  Passes one change on to every index and column that exists.
+ */
+void sidecars_note_add(const student_t *s)
+{
+    name_idx_note_add(s);
+    gpa_idx_note_add(s);
+    colgpa_note_add(s);
+}
+
+void sidecars_note_del(const student_t *s)
+{
+    name_idx_note_del(s);
+    gpa_idx_note_del(s);
+    colgpa_note_del(s);
+}
+
+/*
+ *  sidecars_rebuild
+ *      fd:  linux file descriptor of the database
+ *
+ *  Rebuilds the name index, the GPA index and the GPA column.
+ *
+ *  returns:  <number>       the number of students indexed
+ *            ERR_DB_FILE    database or sidecar file I/O issue
+ */
+int sidecars_rebuild(int fd)
+{
+    int rc = rebuild_name_idx(fd);
+    if (rc >= 0 && (rebuild_gpa_idx(fd) < 0 || rebuild_colgpa(fd) < 0))
+        rc = ERR_DB_FILE;
+    return rc;
+}
+
+/*
+ *  sidecars_cover_ids
+ *      fd:  linux file descriptor of the database
+ *
+ *  The GPA index and the GPA column are arrays indexed by id that stop at
+ *  MAX_STD_ID.  A paged database may hold larger ids, which the header
+ *  flags, and then their queries scan the records instead.  The flag is
+ *  only cleared when the header is recomputed (-x, --convert,
+ *  --rebuild-stats).
+ *
+ *  returns:  true if the dense sidecars can answer for every student
+ */
+bool sidecars_cover_ids(int fd)
+{
+    db_header_t h;
+
+    return stats_load(fd, &h) != NO_ERROR || !(h.flags & DB_HDR_F_WIDE_IDS);
+}
+
+//removes every sidecar, used when the database is emptied
+void sidecars_drop(void)
+{
+    drop_name_idx();
+    drop_gpa_idx();
+    drop_colgpa();
+}
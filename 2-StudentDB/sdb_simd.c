@@ -0,0 +1,472 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__)     //SSE2 is part of the x86-64 baseline
+#include <immintrin.h>
+#define SDB_SIMD_X86 1
+#endif
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  SIMD kernels.  Each kernel comes in a scalar version that runs
+ *  everywhere and, on x86, SSE2 and AVX2 versions.  The AVX2 code is
+ *  compiled with a target attribute so the program itself still builds
+ *  for (and runs on) any x86-64 CPU, simd_kernels() checks the CPU at run
+ *  time and hands out the widest set it supports.  The SDBSC_SIMD
+ *  environment variable (scalar, sse2 or avx2) forces a set, which is how
+ *  the tests check the versions against each other.
+ *
+ *  The GPA kernels work on a column of gpas indexed by id, with a live
+ *  bitmap saying which slots hold a student (see sdb_colgpa.c).  Groups of
+ *  64 slots whose bitmap word is zero are skipped without touching the
+ *  column, the rest are processed 4 (SSE2) or 8 (AVX2) lanes at a time
+ *  with the bitmap expanded into lane masks.
+ *
+ *  The live slot kernels go the other way, from a buffer of records to a
+ *  bitmap of the ones that are not empty.  This is the inner loop of every
+ *  full table scan (see sdb_scan.c) and of compaction, a record is tested
+ *  for all zero with a few wide ORs instead of a memcmp().
+ */
+
+#define HIST_WIDTH  ((MAX_STD_GPA + 1) / DB_HDR_HIST_BUCKETS)
+
+// a lane sums at most MAX_STD_ID gpas, that has to fit in an int32
+_Static_assert((long long)MAX_STD_ID * MAX_STD_GPA < INT_MAX,
+               "32 bit lane sums would overflow");
+
+//the histogram bucket of a gpa, the same bucketing as the db header
+static int hist_bucket(int gpa)
+{
+    int b = gpa / HIST_WIDTH;
+    return b < DB_HDR_HIST_BUCKETS ? b : DB_HDR_HIST_BUCKETS - 1;
+}
+
+/*
+ *  The scalar kernels visit the set bits of each bitmap word.
+ */
+static int64_t gpa_sum_scalar(const int32_t *gpa, const uint64_t *live, size_t nwords)
+{
+    int64_t sum = 0;
+    for (size_t w = 0; w < nwords; w++)
+        for (uint64_t bits = live[w]; bits; bits &= bits - 1)
+            sum += gpa[w * 64 + __builtin_ctzll(bits)];
+    return sum;
+}
+
+static int gpa_min_scalar(const int32_t *gpa, const uint64_t *live, size_t nwords)
+{
+    int min = INT_MAX;
+    for (size_t w = 0; w < nwords; w++)
+        for (uint64_t bits = live[w]; bits; bits &= bits - 1)
+            if (gpa[w * 64 + __builtin_ctzll(bits)] < min)
+                min = gpa[w * 64 + __builtin_ctzll(bits)];
+    return min;
+}
+
+static int gpa_max_scalar(const int32_t *gpa, const uint64_t *live, size_t nwords)
+{
+    int max = INT_MIN;
+    for (size_t w = 0; w < nwords; w++)
+        for (uint64_t bits = live[w]; bits; bits &= bits - 1)
+            if (gpa[w * 64 + __builtin_ctzll(bits)] > max)
+                max = gpa[w * 64 + __builtin_ctzll(bits)];
+    return max;
+}
+
+static void gpa_hist_scalar(const int32_t *gpa, const uint64_t *live, size_t nwords,
+                            uint32_t *hist)
+{
+    memset(hist, 0, DB_HDR_HIST_BUCKETS * sizeof(uint32_t));
+    for (size_t w = 0; w < nwords; w++)
+        for (uint64_t bits = live[w]; bits; bits &= bits - 1)
+            hist[hist_bucket(gpa[w * 64 + __builtin_ctzll(bits)])]++;
+}
+
+/*
+ *  The live slot kernels set bit i of bits[] when record i is not all
+ *  zero.  n is at most SCAN_BUFF_RECS and bits[] has room for it.
+ */
+static void live_slots_scalar(const student_t *recs, int n, uint64_t *bits)
+{
+    memset(bits, 0, (n + 63) / 64 * sizeof(uint64_t));
+    for (int i = 0; i < n; i++) {
+        uint64_t q[sizeof(student_t) / sizeof(uint64_t)];
+        memcpy(q, &recs[i], sizeof(q));
+        if (q[0] | q[1] | q[2] | q[3] | q[4] | q[5] | q[6] | q[7])
+            bits[i / 64] |= 1ULL << (i % 64);
+    }
+}
+
+static const simd_kernels_t scalar_kernels = {
+    "scalar", gpa_sum_scalar, gpa_min_scalar, gpa_max_scalar, gpa_hist_scalar,
+    live_slots_scalar
+};
+
+//the number of live slots, shared by every kernel set
+static int live_count(const uint64_t *live, size_t nwords)
+{
+    int n = 0;
+    for (size_t w = 0; w < nwords; w++)
+        n += __builtin_popcountll(live[w]);
+    return n;
+}
+
+/*
+ *  The histogram is built from "how many gpas are >= each bucket start"
+ *  counts, which vectorize as compares, and then differenced.  ge[0] is
+ *  the number of live slots.
+ */
+static void hist_from_ge(const int64_t *ge, uint32_t *hist)
+{
+    for (int b = 0; b < DB_HDR_HIST_BUCKETS; b++)
+        hist[b] = ge[b] - (b + 1 < DB_HDR_HIST_BUCKETS ? ge[b + 1] : 0);
+}
+
+#ifdef SDB_SIMD_X86
+
+/*
+ *  SSE2, 4 lanes.  SSE2 has no 32 bit min or max, so those are a compare
+ *  and a blend.
+ */
+static inline __m128i mask4(unsigned nibble)
+{
+    const __m128i sel = _mm_setr_epi32(1, 2, 4, 8);
+    return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(nibble), sel), sel);
+}
+
+static inline __m128i blend4(__m128i m, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+static int hsum4(__m128i v)
+{
+    int32_t lane[4];
+    _mm_storeu_si128((__m128i *)lane, v);
+    return lane[0] + lane[1] + lane[2] + lane[3];
+}
+
+static int64_t gpa_sum_sse2(const int32_t *gpa, const uint64_t *live, size_t nwords)
+{
+    __m128i acc = _mm_setzero_si128();
+    for (size_t w = 0; w < nwords; w++) {
+        if (live[w] == 0)
+            continue;
+        for (int i = 0; i < 64; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)&gpa[w * 64 + i]);
+            acc = _mm_add_epi32(acc, _mm_and_si128(v, mask4(live[w] >> i & 0xf)));
+        }
+    }
+    return hsum4(acc);
+}
+
+static int gpa_min_sse2(const int32_t *gpa, const uint64_t *live, size_t nwords)
+{
+    const __m128i big = _mm_set1_epi32(INT_MAX);
+    __m128i cur = big;
+    for (size_t w = 0; w < nwords; w++) {
+        if (live[w] == 0)
+            continue;
+        for (int i = 0; i < 64; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)&gpa[w * 64 + i]);
+            v = blend4(mask4(live[w] >> i & 0xf), v, big);
+            cur = blend4(_mm_cmplt_epi32(v, cur), v, cur);
+        }
+    }
+    int32_t lane[4];
+    _mm_storeu_si128((__m128i *)lane, cur);
+    int min = lane[0];
+    for (int i = 1; i < 4; i++)
+        min = lane[i] < min ? lane[i] : min;
+    return min;
+}
+
+static int gpa_max_sse2(const int32_t *gpa, const uint64_t *live, size_t nwords)
+{
+    const __m128i small = _mm_set1_epi32(INT_MIN);
+    __m128i cur = small;
+    for (size_t w = 0; w < nwords; w++) {
+        if (live[w] == 0)
+            continue;
+        for (int i = 0; i < 64; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)&gpa[w * 64 + i]);
+            v = blend4(mask4(live[w] >> i & 0xf), v, small);
+            cur = blend4(_mm_cmpgt_epi32(v, cur), v, cur);
+        }
+    }
+    int32_t lane[4];
+    _mm_storeu_si128((__m128i *)lane, cur);
+    int max = lane[0];
+    for (int i = 1; i < 4; i++)
+        max = lane[i] > max ? lane[i] : max;
+    return max;
+}
+
+static void gpa_hist_sse2(const int32_t *gpa, const uint64_t *live, size_t nwords,
+                          uint32_t *hist)
+{
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i ge[DB_HDR_HIST_BUCKETS];
+    int64_t total[DB_HDR_HIST_BUCKETS];
+
+    for (int b = 0; b < DB_HDR_HIST_BUCKETS; b++)
+        ge[b] = _mm_setzero_si128();
+
+    for (size_t w = 0; w < nwords; w++) {
+        if (live[w] == 0)
+            continue;
+        for (int i = 0; i < 64; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)&gpa[w * 64 + i]);
+            // dead lanes become -1, below every bucket
+            v = _mm_or_si128(v, _mm_xor_si128(mask4(live[w] >> i & 0xf), ones));
+            // a true compare is -1, so subtracting it counts
+#pragma GCC unroll 16
+            for (int b = 1; b < DB_HDR_HIST_BUCKETS; b++) {
+                __m128i hit = _mm_cmpgt_epi32(v, _mm_set1_epi32(b * HIST_WIDTH - 1));
+                ge[b] = _mm_sub_epi32(ge[b], hit);
+            }
+        }
+    }
+
+    total[0] = live_count(live, nwords);
+    for (int b = 1; b < DB_HDR_HIST_BUCKETS; b++)
+        total[b] = hsum4(ge[b]);
+    hist_from_ge(total, hist);
+}
+
+//a record is four 16 byte vectors ORed together, folded to one 64 bit
+//value and compared with zero, four records per compare
+static inline __m128i fold_rec_sse2(const student_t *r)
+{
+    const __m128i *p = (const __m128i *)r;
+    __m128i x = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+                             _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+    return _mm_or_si128(x, _mm_srli_si128(x, 8));
+}
+
+static void live_slots_sse2(const student_t *recs, int n, uint64_t *bits)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    memset(bits, 0, (n + 63) / 64 * sizeof(uint64_t));
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_unpacklo_epi64(fold_rec_sse2(&recs[i]), fold_rec_sse2(&recs[i + 1]));
+        __m128i b = _mm_unpacklo_epi64(fold_rec_sse2(&recs[i + 2]), fold_rec_sse2(&recs[i + 3]));
+        // two bits per record, both set when its 64 bit OR is zero
+        unsigned m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, zero))) |
+                     _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(b, zero))) << 4;
+        unsigned empty = m & (m >> 1);
+        unsigned live = ~((empty & 1) | (empty >> 1 & 2) | (empty >> 2 & 4) |
+                          (empty >> 3 & 8)) & 0xf;
+        bits[i / 64] |= (uint64_t)live << (i % 64);
+    }
+    for (; i < n; i++)
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(fold_rec_sse2(&recs[i]), zero)) != 0xffff)
+            bits[i / 64] |= 1ULL << (i % 64);
+}
+
+static const simd_kernels_t sse2_kernels = {
+    "sse2", gpa_sum_sse2, gpa_min_sse2, gpa_max_sse2, gpa_hist_sse2,
+    live_slots_sse2
+};
+
+/*
+ *  AVX2, 8 lanes, one byte of the bitmap per vector.
+ */
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i mask8(unsigned byte)
+{
+    const __m256i sel = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(byte), sel), sel);
+}
+
+AVX2 static int hsum8(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+    return hsum4(s);
+}
+
+AVX2 static int64_t gpa_sum_avx2(const int32_t *gpa, const uint64_t *live, size_t nwords)
+{
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t w = 0; w < nwords; w++) {
+        if (live[w] == 0)
+            continue;
+        for (int i = 0; i < 64; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)&gpa[w * 64 + i]);
+            acc = _mm256_add_epi32(acc, _mm256_and_si256(v, mask8(live[w] >> i & 0xff)));
+        }
+    }
+    return hsum8(acc);
+}
+
+AVX2 static int gpa_min_avx2(const int32_t *gpa, const uint64_t *live, size_t nwords)
+{
+    const __m256i big = _mm256_set1_epi32(INT_MAX);
+    __m256i cur = big;
+    for (size_t w = 0; w < nwords; w++) {
+        if (live[w] == 0)
+            continue;
+        for (int i = 0; i < 64; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)&gpa[w * 64 + i]);
+            v = _mm256_blendv_epi8(big, v, mask8(live[w] >> i & 0xff));
+            cur = _mm256_min_epi32(cur, v);
+        }
+    }
+    __m128i m = _mm_min_epi32(_mm256_castsi256_si128(cur),
+                              _mm256_extracti128_si256(cur, 1));
+    m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(m);
+}
+
+AVX2 static int gpa_max_avx2(const int32_t *gpa, const uint64_t *live, size_t nwords)
+{
+    const __m256i small = _mm256_set1_epi32(INT_MIN);
+    __m256i cur = small;
+    for (size_t w = 0; w < nwords; w++) {
+        if (live[w] == 0)
+            continue;
+        for (int i = 0; i < 64; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)&gpa[w * 64 + i]);
+            v = _mm256_blendv_epi8(small, v, mask8(live[w] >> i & 0xff));
+            cur = _mm256_max_epi32(cur, v);
+        }
+    }
+    __m128i m = _mm_max_epi32(_mm256_castsi256_si128(cur),
+                              _mm256_extracti128_si256(cur, 1));
+    m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+    m = _mm_max_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(m);
+}
+
+AVX2 static void gpa_hist_avx2(const int32_t *gpa, const uint64_t *live, size_t nwords,
+                               uint32_t *hist)
+{
+    const __m256i ones = _mm256_set1_epi32(-1);
+    __m256i ge[DB_HDR_HIST_BUCKETS];
+    int64_t total[DB_HDR_HIST_BUCKETS];
+
+    for (int b = 0; b < DB_HDR_HIST_BUCKETS; b++)
+        ge[b] = _mm256_setzero_si256();
+
+    for (size_t w = 0; w < nwords; w++) {
+        if (live[w] == 0)
+            continue;
+        for (int i = 0; i < 64; i += 8) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)&gpa[w * 64 + i]);
+            v = _mm256_or_si256(v, _mm256_xor_si256(mask8(live[w] >> i & 0xff), ones));
+#pragma GCC unroll 16
+            for (int b = 1; b < DB_HDR_HIST_BUCKETS; b++) {
+                __m256i hit = _mm256_cmpgt_epi32(v, _mm256_set1_epi32(b * HIST_WIDTH - 1));
+                ge[b] = _mm256_sub_epi32(ge[b], hit);
+            }
+        }
+    }
+
+    total[0] = live_count(live, nwords);
+    for (int b = 1; b < DB_HDR_HIST_BUCKETS; b++)
+        total[b] = hsum8(ge[b]);
+    hist_from_ge(total, hist);
+}
+
+//a record is two 32 byte vectors ORed together, four records are then
+//reduced side by side to one 64 bit OR each and compared with zero at once
+AVX2 static inline __m256i or_rec_avx2(const student_t *r)
+{
+    const __m256i *p = (const __m256i *)r;
+    return _mm256_or_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(p + 1));
+}
+
+AVX2 static void live_slots_avx2(const student_t *recs, int n, uint64_t *bits)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+
+    memset(bits, 0, (n + 63) / 64 * sizeof(uint64_t));
+    for (; i + 4 <= n; i += 4) {
+        __m256i a = or_rec_avx2(&recs[i]), b = or_rec_avx2(&recs[i + 1]);
+        __m256i c = or_rec_avx2(&recs[i + 2]), d = or_rec_avx2(&recs[i + 3]);
+        // [a0|a1 b0|b1 | a2|a3 b2|b3] and the same for c and d
+        __m256i ab = _mm256_or_si256(_mm256_unpacklo_epi64(a, b), _mm256_unpackhi_epi64(a, b));
+        __m256i cd = _mm256_or_si256(_mm256_unpacklo_epi64(c, d), _mm256_unpackhi_epi64(c, d));
+        // [a b c d], each the OR of a whole record
+        __m256i x = _mm256_or_si256(_mm256_permute2x128_si256(ab, cd, 0x20),
+                                    _mm256_permute2x128_si256(ab, cd, 0x31));
+        unsigned empty = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(x, zero)));
+        bits[i / 64] |= (uint64_t)(~empty & 0xf) << (i % 64);
+    }
+    for (; i < n; i++) {
+        __m256i x = or_rec_avx2(&recs[i]);
+        if (!_mm256_testz_si256(x, x))
+            bits[i / 64] |= 1ULL << (i % 64);
+    }
+}
+
+static const simd_kernels_t avx2_kernels = {
+    "avx2", gpa_sum_avx2, gpa_min_avx2, gpa_max_avx2, gpa_hist_avx2,
+    live_slots_avx2
+};
+
+#endif
+
+/*
+ *  simd_kernels_named
+ *      name:  "scalar", "sse2" or "avx2"
+ *
+ *  returns:  the kernel set, or NULL if it is unknown or this CPU cannot
+ *            run it
+ */
+const simd_kernels_t *simd_kernels_named(const char *name)
+{
+    if (strcmp(name, "scalar") == 0)
+        return &scalar_kernels;
+#ifdef SDB_SIMD_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+        return &sse2_kernels;
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+        return &avx2_kernels;
+#endif
+    return NULL;
+}
+
+/*
+ *  simd_kernels
+ *
+ *  returns:  the kernel set named by $SDBSC_SIMD if it is usable, else the
+ *            widest one this CPU supports
+ */
+const simd_kernels_t *simd_kernels(void)
+{
+    static const simd_kernels_t *chosen;
+
+    if (chosen != NULL)
+        return chosen;
+
+    const char *want = getenv(SDB_SIMD_ENV);
+    if (want != NULL)
+        chosen = simd_kernels_named(want);
+    if (chosen == NULL)
+        chosen = simd_kernels_named("avx2");
+    if (chosen == NULL)
+        chosen = simd_kernels_named("sse2");
+    if (chosen == NULL)
+        chosen = &scalar_kernels;
+    return chosen;
+}
+
+int simd_live_count(const uint64_t *live, size_t nwords)
+{
+    return live_count(live, nwords);
+}
@@ -0,0 +1,462 @@
+#define _GNU_SOURCE //needed for SEEK_DATA, copy_file_range() and splice()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Snapshots (--snapshot out, --restore in).  cp of the database inflates
+ *  the holes of the sparse file on some systems and -x rewrites it, so a
+ *  snapshot copies only the data extents of the file, found with
+ *  SEEK_DATA and SEEK_HOLE, and leaves the holes as holes.  There are two
+ *  kinds, chosen by where the snapshot goes:
+ *
+ *    image   to a regular file: a sparse copy of the database that can be
+ *            opened as it is.  Where the filesystem can share blocks
+ *            between files (FICLONE, a reflink) the copy is made without
+ *            copying any data, otherwise every extent is copied inside the
+ *            kernel with copy_file_range().
+ *    stream  to stdout, a pipe or a socket: a snap_hdr_t, then every data
+ *            extent as a snap_ext_t followed by its raw records, then an
+ *            extent of length 0.  The extents are sent with sendfile(),
+ *            so a stream can go straight into ssh or nc and be restored
+ *            on another host.
+ *
+ *  --restore tells the two apart by the first bytes.  The snapshot is
+ *  written to a temporary file with its holes, checked, and renamed over
+ *  the database like rewrite_db() does, so a failed restore leaves the
+ *  database as it was.  A snapshot holds the database file only: the
+ *  write-ahead log is checkpointed into the file first, and the indexes
+ *  and the GPA column are rebuilt after a restore on their next use.
+ */
+
+#define SNAP_MAGIC      0x53424453  //"SDBS" on disk
+#define SNAP_VERSION    1
+#define SNAP_BUFF_SZ    (256 * 1024) //bytes per read() when the kernel cannot copy
+
+typedef struct snap_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t size;                  //size of the database file
+} snap_hdr_t;
+
+typedef struct snap_ext {
+    uint64_t off;                   //where the extent goes in the file
+    uint64_t len;                   //bytes that follow, 0 ends the stream
+} snap_ext_t;
+
+//reads exactly len bytes from a stream, returns false on a short read
+static bool read_full(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool write_full(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ *  copy_bytes
+ *      in, *in_off:    source, read at *in_off or, if in_off is NULL, at
+ *                      its file position (a pipe)
+ *      out, *out_off:  destination, likewise
+ *      len:            bytes to copy
+ *
+ *  Moves len bytes without bringing them into the process where the
+ *  kernel allows it: copy_file_range() between regular files, sendfile()
+ *  from a file into anything, splice() out of a pipe.  Whatever the
+ *  kernel turns down is copied through a buffer.  The offsets are
+ *  advanced by the bytes copied.
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP if the input ended early or ERR_DB_FILE
+ */
+static int copy_bytes(int in, off_t *in_off, int out, off_t *out_off, off_t len)
+{
+    int how = (in_off && out_off) ? 0 : in_off ? 1 : 2;   //the first try
+    char *buf = NULL;
+    int rc = NO_ERROR;
+
+    while (len > 0 && rc == NO_ERROR) {
+        size_t want = (len > SNAP_BUFF_SZ * 16) ? SNAP_BUFF_SZ * 16 : len;
+        ssize_t n = -1;
+
+        if (how == 0)
+            n = copy_file_range(in, in_off, out, out_off, want, 0);
+        else if (how == 1)
+            n = sendfile(out, in, in_off, want);
+        else if (how == 2)
+            n = splice(in, in_off, out, out_off, want, 0);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && how < 3) {
+            how = 3;                // the kernel path does not apply here
+            continue;
+        }
+        if (how == 3) {
+            if (buf == NULL && (buf = malloc(SNAP_BUFF_SZ)) == NULL) {
+                rc = ERR_DB_FILE;
+                break;
+            }
+            want = (want > SNAP_BUFF_SZ) ? SNAP_BUFF_SZ : want;
+            n = in_off ? pread(in, buf, want, *in_off) : read(in, buf, want);
+            if (n > 0 && (out_off ? pwrite(out, buf, n, *out_off) != n
+                                  : !write_full(out, buf, n)))
+                n = -1;
+            if (n > 0 && in_off)
+                *in_off += n;
+            if (n > 0 && out_off)
+                *out_off += n;
+        }
+        if (n < 0)
+            rc = ERR_DB_FILE;
+        else if (n == 0)
+            rc = ERR_DB_OP;
+        else
+            len -= n;
+    }
+    free(buf);
+    return rc;
+}
+
+/*
+ *  copy_extents
+ *      src, dst:  regular files, dst is empty
+ *
+ *  Makes dst a sparse copy of src: the data extents are copied to the
+ *  same offsets and dst is sized like src, so the holes stay holes.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int copy_extents(int src, int dst)
+{
+    struct stat st;
+
+    if (fstat(src, &st) == -1 || ftruncate(dst, st.st_size) == -1)
+        return ERR_DB_FILE;
+
+    off_t pos = 0;
+    while (pos < st.st_size) {
+        off_t data = lseek(src, pos, SEEK_DATA);
+        if (data == -1 && errno == ENXIO)
+            break;                  // a hole up to the end
+        off_t hole = (data == -1) ? -1 : lseek(src, data, SEEK_HOLE);
+        if (hole == -1)
+            return ERR_DB_FILE;
+
+        off_t in_off = data, out_off = data;
+        if (copy_bytes(src, &in_off, dst, &out_off, hole - data) != NO_ERROR)
+            return ERR_DB_FILE;
+        pos = hole;
+    }
+    return NO_ERROR;
+}
+
+/*
+ *  write_stream
+ *      fd:   linux file descriptor of the database
+ *      out:  where the stream goes
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+static int write_stream(int fd, int out)
+{
+    struct stat st;
+    snap_hdr_t hdr = {.magic = SNAP_MAGIC, .version = SNAP_VERSION};
+    snap_ext_t ext;
+
+    if (fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+    hdr.size = st.st_size;
+    if (!write_full(out, &hdr, sizeof(hdr)))
+        return ERR_DB_FILE;
+
+    off_t pos = 0;
+    while (pos < st.st_size) {
+        off_t data = lseek(fd, pos, SEEK_DATA);
+        if (data == -1 && errno == ENXIO)
+            break;
+        off_t hole = (data == -1) ? -1 : lseek(fd, data, SEEK_HOLE);
+        if (hole == -1)
+            return ERR_DB_FILE;
+
+        ext.off = data;
+        ext.len = hole - data;
+        off_t in_off = data;
+        if (!write_full(out, &ext, sizeof(ext)) ||
+            copy_bytes(fd, &in_off, out, NULL, hole - data) != NO_ERROR)
+            return ERR_DB_FILE;
+        pos = hole;
+    }
+
+    ext.off = st.st_size;
+    ext.len = 0;
+    return write_full(out, &ext, sizeof(ext)) ? NO_ERROR : ERR_DB_FILE;
+}
+
+/*
+ *  read_stream
+ *      in:   the stream, its magic already read into hdr->magic
+ *      dst:  empty file the database is written to
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP for a stream that is cut short or
+ *            malformed, or ERR_DB_FILE
+ */
+static int read_stream(int in, snap_hdr_t *hdr, int dst)
+{
+    snap_ext_t ext;
+    uint64_t end = 0;
+
+    if (!read_full(in, (char *)hdr + sizeof(hdr->magic),
+                   sizeof(*hdr) - sizeof(hdr->magic)) ||
+        hdr->version != SNAP_VERSION || hdr->size > INT64_MAX)
+        return ERR_DB_OP;
+    if (ftruncate(dst, hdr->size) == -1)
+        return ERR_DB_FILE;
+
+    for (;;) {
+        if (!read_full(in, &ext, sizeof(ext)))
+            return ERR_DB_OP;
+        if (ext.len == 0)
+            break;
+        // extents come in file order and stay inside the file
+        if (ext.off < end || ext.len > hdr->size || ext.off > hdr->size - ext.len)
+            return ERR_DB_OP;
+
+        off_t out_off = ext.off;
+        int rc = copy_bytes(in, NULL, dst, &out_off, ext.len);
+        if (rc != NO_ERROR)
+            return rc;
+        end = ext.off + ext.len;
+    }
+    return (ext.off == hdr->size) ? NO_ERROR : ERR_DB_OP;
+}
+
+/*
+ *  snapshot_db
+ *      fd:    linux file descriptor of the database
+ *      path:  file to write, or "-" for a stream on stdout
+ *
+ *  Writes a snapshot of the database, an image to a regular file and a
+ *  stream to stdout or anything else (see the top of this file).  The whole file is
+ *  share locked meanwhile, so writers wait but readers do not, and the
+ *  write-ahead log, the buffer pool and the storage backend put their
+ *  changes in the file first.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database or snapshot file I/O issue
+ *
+ *  console:  M_DB_SNAPSHOT  on success, except for a stream on stdout
+ *            M_ERR_SNAP_OPEN  the snapshot file could not be created
+ *            M_ERR_DB_READ    error reading the database or writing the
+ *                             snapshot
+ */
+int snapshot_db(int fd, const char *path)
+{
+    bool to_stdout = (strcmp(path, "-") == 0);
+    const char *kind = "stream";
+    struct stat st;
+    int rc;
+
+    int out = to_stdout ? STDOUT_FILENO :
+              open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (out == -1) {
+        printf(M_ERR_SNAP_OPEN, path);
+        return ERR_DB_FILE;
+    }
+
+    if (lock_db(fd, F_RDLCK) != NO_ERROR || wal_checkpoint(fd) != NO_ERROR ||
+        backend_sync(fd) != NO_ERROR) {
+        rc = ERR_DB_FILE;
+    } else if (fstat(out, &st) == -1) {
+        rc = ERR_DB_FILE;
+    } else if (to_stdout || !S_ISREG(st.st_mode)) {
+        fflush(stdout);
+        rc = write_stream(fd, out);
+    } else if (ioctl(out, FICLONE, fd) == 0) {
+        kind = "reflink";
+        rc = NO_ERROR;
+    } else {
+        kind = "sparse copy";
+        rc = copy_extents(fd, out);
+    }
+    unlock_db(fd);
+
+    if (!to_stdout && close(out) == -1)
+        rc = ERR_DB_FILE;
+    if (rc != NO_ERROR) {
+        if (!to_stdout)
+            unlink(path);
+        printf(M_ERR_DB_READ);
+        return rc;
+    }
+    if (!to_stdout)
+        printf(M_DB_SNAPSHOT, path, kind);
+    return NO_ERROR;
+}
+
+/*
+ *  load_snapshot
+ *      in:   the snapshot, an image or a stream
+ *      dst:  empty file the database is written to
+ *
+ *  returns:  NO_ERROR, ERR_DB_OP if in is not a snapshot or ERR_DB_FILE
+ */
+static int load_snapshot(int in, int dst)
+{
+    snap_hdr_t hdr;
+    db_header_t dbh;
+    struct stat st;
+    int rc;
+
+    if (fstat(in, &st) == -1)
+        return ERR_DB_FILE;
+
+    if (S_ISREG(st.st_mode) && pread(in, &dbh, sizeof(dbh), 0) == sizeof(dbh) &&
+        dbh.magic == DB_HDR_MAGIC) {
+        rc = ioctl(dst, FICLONE, in) == 0 ? NO_ERROR : copy_extents(in, dst);
+    } else if (read_full(in, &hdr.magic, sizeof(hdr.magic)) && hdr.magic == SNAP_MAGIC) {
+        rc = read_stream(in, &hdr, dst);
+    } else {
+        return ERR_DB_OP;
+    }
+
+    // whatever came in has to be a database this program can open
+    if (rc == NO_ERROR &&
+        (pread(dst, &dbh, sizeof(dbh), 0) != sizeof(dbh) || dbh.magic != DB_HDR_MAGIC ||
+         (dbh.version != DB_HDR_VERSION && dbh.version != DB_HDR_VERSION_PAGED)))
+        rc = ERR_DB_OP;
+    if (rc == NO_ERROR && fdatasync(dst) == -1)
+        rc = ERR_DB_FILE;
+    return rc;
+}
+
+/*
+ *  restore_db
+ *      fd:    linux file descriptor of the database
+ *      path:  snapshot to restore, or "-" to read a stream from stdin
+ *
+ *  Replaces the database with a snapshot written by snapshot_db().  The
+ *  snapshot is first written to a temporary file of its own, with no lock
+ *  held, so a stream may come from a snapshot of this very database.  The
+ *  whole file is locked only to rename the complete copy over it.  The
+ *  storage backend and the buffer pool are re-established on the new file,
+ *  and the write-ahead log and the indexes of the old one are dropped.
+ *
+ *  returns:  <number>       the fd of the restored database
+ *            ERR_DB_OP      path is not a snapshot or is cut short, fd is
+ *                           still open and the database unchanged
+ *            ERR_DB_FILE    database or snapshot file I/O issue
+ *
+ *  console:  M_DB_RESTORED  on success
+ *            M_ERR_SNAP_OPEN  the snapshot could not be opened
+ *            M_ERR_SNAP_BAD   the snapshot is not one
+ *            M_ERR_DB_OPEN, M_ERR_DB_CREATE or M_ERR_DB_WRITE as for
+ *            compress_db()
+ */
+int restore_db(int fd, const char *path)
+{
+    bool from_stdin = (strcmp(path, "-") == 0);
+    char temp_path[] = SNAP_TMP_FILE;
+    db_header_t h;
+    int rc = ERR_DB_FILE;
+
+    int in = from_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+    if (in == -1) {
+        printf(M_ERR_SNAP_OPEN, path);
+        return ERR_DB_OP;
+    }
+
+    int temp_fd = mkstemp(temp_path);
+    if (temp_fd != -1) {
+        rc = load_snapshot(in, temp_fd);
+        close(temp_fd);
+    }
+    if (!from_stdin)
+        close(in);
+    if (rc != NO_ERROR) {
+        if (temp_fd != -1)
+            unlink(temp_path);
+        if (rc == ERR_DB_OP)
+            printf(M_ERR_SNAP_BAD, path);
+        else
+            printf(M_ERR_DB_WRITE);
+        return rc;
+    }
+
+    // the old file's changes are not needed, but the pool and the backend
+    // have to let go
+    bool remap = backend_attached(fd);
+    bool recache = bufpool_attached(fd);
+    if (lock_db(fd, F_WRLCK) != NO_ERROR) {
+        unlink(temp_path);
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+    backend_detach();
+    bufpool_detach();
+
+    if (rename(temp_path, DB_FILE) == -1) {
+        unlink(temp_path);
+        unlock_db(fd);
+        printf(M_ERR_DB_CREATE);
+        if ((remap && backend_attach(fd) != NO_ERROR) ||
+            (recache && bufpool_attach(fd) != NO_ERROR))
+            printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    // the log and the indexes describe the old database
+    wal_discard();
+    sidecars_drop();
+    unlock_db(fd);
+    close(fd);
+
+    fd = open_db(DB_FILE, false);
+    if (fd < 0)
+        return ERR_DB_FILE;
+    if ((remap && backend_attach(fd) != NO_ERROR) ||
+        (recache && bufpool_attach(fd) != NO_ERROR)) {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+
+    printf(M_DB_RESTORED, path, stats_load(fd, &h) == NO_ERROR ? (int)h.count : 0);
+    return fd;
+}
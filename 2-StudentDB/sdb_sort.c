@@ -0,0 +1,431 @@
+#define _GNU_SOURCE //needed for qsort_r()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  Sorted print (-p --sort lname|fname|gpa[:desc]).  The students are
+ *  collected from a scan as binary records into a buffer of the memory
+ *  budget, SORT_MEM_BYTES or $SDBSC_SORT_MEM bytes.  When they all fit
+ *  they are sorted there with qsort_r() and printed.  Otherwise every full
+ *  buffer is sorted and spilled to an unlinked temporary file as a run,
+ *  and the runs are merged k ways through a heap of their smallest
+ *  records, each read back a share of the budget at a time.  Beyond
+ *  SORT_FANIN runs, the first SORT_FANIN are merged into one new run until
+ *  the rest can be merged at once.  Only the final merged stream is
+ *  formatted, with the same rows print_db_fmt() gives.
+ *
+ *  lname sorts by last name then first name, fname the other way round,
+ *  and gpa by GPA.  :desc reverses the key.  Equal keys are always in id
+ *  order, so the output is the same however the runs fell.
+ */
+
+#define SORT_MEM_BYTES  (16 * 1024 * 1024)  //records sorted in memory at once
+#define SORT_MIN_RECS   2                   //smallest budget, in records
+#define SORT_FANIN      64                  //runs merged at once
+
+typedef struct sort_run {
+    int fd;                         //unlinked temporary file
+    off_t len;                      //records in the file
+    off_t next;                     //next record to read into buf
+    student_t *buf;
+    size_t cap;                     //records buf holds
+    size_t n;                       //records in buf
+    size_t i;                       //next record of buf
+} sort_run_t;
+
+//where merged records go: a new run, or the formatted output
+typedef int (*sort_emit_t)(void *ctx, const student_t *s);
+
+typedef struct run_writer {
+    int fd;
+    student_t *buf;
+    size_t cap;
+    size_t n;                       //records in buf
+    off_t len;                      //records written
+} run_writer_t;
+
+typedef struct sort_print {
+    out_buf_t out;
+    int fmt;
+    bool first;                     //no row printed yet
+} sort_print_t;
+
+static const char *sort_keys[] = {"lname", "fname", "gpa"};
+
+/*
+ *  sort_parse
+ *      spec:  "lname", "fname" or "gpa", followed by ":asc" or ":desc"
+ *
+ *  returns:  the SORT_* key, or'ed with SORT_DESC for :desc, or ERR_DB_OP
+ *            for anything else
+ */
+int sort_parse(const char *spec)
+{
+    const char *dir = strchr(spec, ':');
+    size_t len = dir ? (size_t)(dir - spec) : strlen(spec);
+    int desc = 0;
+
+    if (dir != NULL && strcmp(dir, ":desc") == 0)
+        desc = SORT_DESC;
+    else if (dir != NULL && strcmp(dir, ":asc") != 0)
+        return ERR_DB_OP;
+
+    for (int i = 0; i < (int)(sizeof(sort_keys) / sizeof(sort_keys[0])); i++)
+        if (strlen(sort_keys[i]) == len && strncmp(spec, sort_keys[i], len) == 0)
+            return i | desc;
+    return ERR_DB_OP;
+}
+
+static int cmp_students(const student_t *a, const student_t *b, int sort)
+{
+    int c = 0;
+
+    switch (sort & ~SORT_DESC) {
+    case SORT_LNAME:
+        c = strncmp(a->lname, b->lname, sizeof(a->lname));
+        if (c == 0)
+            c = strncmp(a->fname, b->fname, sizeof(a->fname));
+        break;
+    case SORT_FNAME:
+        c = strncmp(a->fname, b->fname, sizeof(a->fname));
+        if (c == 0)
+            c = strncmp(a->lname, b->lname, sizeof(a->lname));
+        break;
+    case SORT_GPA:
+        c = (a->gpa > b->gpa) - (a->gpa < b->gpa);
+        break;
+    }
+    if (sort & SORT_DESC)
+        c = -c;
+    // equal keys in id order either way, so the order is total
+    return c != 0 ? c : (a->id > b->id) - (a->id < b->id);
+}
+
+static int cmp_qsort(const void *a, const void *b, void *sort)
+{
+    return cmp_students(a, b, *(int *)sort);
+}
+
+//the budget in records, from $SDBSC_SORT_MEM if set
+static size_t budget_recs(void)
+{
+    const char *want = getenv(SDB_SORT_MEM_ENV);
+    long long bytes = want ? atoll(want) : 0;
+
+    if (bytes <= 0)
+        bytes = SORT_MEM_BYTES;
+    size_t n = bytes / sizeof(student_t);
+    return n < SORT_MIN_RECS ? SORT_MIN_RECS : n;
+}
+
+static int write_recs(int fd, const student_t *recs, size_t n, off_t at)
+{
+    const char *p = (const char *)recs;
+    size_t len = n * sizeof(student_t);
+    off_t off = at * sizeof(student_t);
+
+    while (len > 0) {
+        INSTR_START(t);
+        ssize_t w = pwrite(fd, p, len, off);
+        INSTR_STOP(INSTR_WRITE, t, w > 0 ? w : 0);
+        if (w <= 0)
+            return ERR_DB_FILE;
+        p += w;
+        off += w;
+        len -= w;
+    }
+    return NO_ERROR;
+}
+
+//a new, already unlinked, temporary file
+static int temp_run_fd(void)
+{
+    char path[] = SORT_TMP_FILE;
+
+    int fd = mkstemp(path);
+    if (fd != -1)
+        unlink(path);
+    return fd;
+}
+
+static int add_run(sort_run_t **runs, int *nruns, int fd, off_t len)
+{
+    sort_run_t *r = realloc(*runs, (*nruns + 1) * sizeof(sort_run_t));
+    if (r == NULL)
+        return ERR_DB_FILE;
+    *runs = r;
+    r[(*nruns)++] = (sort_run_t){.fd = fd, .len = len};
+    return NO_ERROR;
+}
+
+//writes n sorted records as a new run
+static int spill(const student_t *recs, size_t n, sort_run_t **runs, int *nruns)
+{
+    int fd = temp_run_fd();
+
+    if (fd == -1)
+        return ERR_DB_FILE;
+    if (write_recs(fd, recs, n, 0) != NO_ERROR ||
+        add_run(runs, nruns, fd, n) != NO_ERROR) {
+        close(fd);
+        return ERR_DB_FILE;
+    }
+    return NO_ERROR;
+}
+
+//reads the next buffer of r, returns the records read, 0 at its end
+static int run_fill(sort_run_t *r)
+{
+    size_t want = r->len - r->next;
+
+    if (want > r->cap)
+        want = r->cap;
+    r->n = 0;
+    r->i = 0;
+    while (r->n < want) {
+        INSTR_START(t);
+        ssize_t got = pread(r->fd, (char *)(r->buf + r->n),
+                            (want - r->n) * sizeof(student_t),
+                            (r->next + r->n) * sizeof(student_t));
+        INSTR_STOP(INSTR_READ, t, got > 0 ? got : 0);
+        if (got <= 0 || got % sizeof(student_t) != 0)
+            return ERR_DB_FILE;
+        r->n += got / sizeof(student_t);
+    }
+    r->next += r->n;
+    return (int)r->n;
+}
+
+static bool heap_less(sort_run_t *runs, int a, int b, int sort)
+{
+    return cmp_students(&runs[a].buf[runs[a].i], &runs[b].buf[runs[b].i], sort) < 0;
+}
+
+static void sift_down(int *heap, int h, sort_run_t *runs, int sort, int at)
+{
+    for (;;) {
+        int least = at, l = 2 * at + 1, r = l + 1;
+        if (l < h && heap_less(runs, heap[l], heap[least], sort))
+            least = l;
+        if (r < h && heap_less(runs, heap[r], heap[least], sort))
+            least = r;
+        if (least == at)
+            return;
+        int tmp = heap[at];
+        heap[at] = heap[least];
+        heap[least] = tmp;
+        at = least;
+    }
+}
+
+/*
+ *  merge_runs
+ *      runs:  k sorted runs
+ *      per:   records to read from a run at a time
+ *
+ *  Hands the records of all k runs to emit in order, through a heap of the
+ *  runs keyed by their next record.
+ *
+ *  returns:  NO_ERROR, or ERR_DB_FILE if a run could not be read or emit
+ *            failed
+ */
+static int merge_runs(sort_run_t *runs, int k, int sort, size_t per,
+                      sort_emit_t emit, void *ctx)
+{
+    int *heap = malloc(k * sizeof(int));
+    int h = 0, rc = heap ? NO_ERROR : ERR_DB_FILE;
+
+    for (int j = 0; j < k; j++)
+        runs[j].buf = NULL;
+    for (int j = 0; rc == NO_ERROR && j < k; j++) {
+        runs[j].cap = per;
+        runs[j].next = 0;
+        runs[j].buf = malloc(per * sizeof(student_t));
+        int got = runs[j].buf ? run_fill(&runs[j]) : ERR_DB_FILE;
+        if (got < 0)
+            rc = ERR_DB_FILE;
+        else if (got > 0)
+            heap[h++] = j;
+    }
+    for (int at = h / 2 - 1; rc == NO_ERROR && at >= 0; at--)
+        sift_down(heap, h, runs, sort, at);
+
+    while (rc == NO_ERROR && h > 0) {
+        sort_run_t *r = &runs[heap[0]];
+        rc = emit(ctx, &r->buf[r->i]);
+        if (rc == NO_ERROR && ++r->i == r->n) {
+            int got = run_fill(r);
+            if (got < 0)
+                rc = ERR_DB_FILE;
+            else if (got == 0)
+                heap[0] = heap[--h];
+        }
+        sift_down(heap, h, runs, sort, 0);
+    }
+
+    for (int j = 0; j < k; j++)
+        free(runs[j].buf);
+    free(heap);
+    return rc;
+}
+
+static int emit_run(void *ctx, const student_t *s)
+{
+    run_writer_t *w = ctx;
+
+    w->buf[w->n++] = *s;
+    if (w->n < w->cap)
+        return NO_ERROR;
+    int rc = write_recs(w->fd, w->buf, w->n, w->len);
+    w->len += w->n;
+    w->n = 0;
+    return rc;
+}
+
+//merges the first SORT_FANIN runs into one new run at the end
+static int merge_pass(sort_run_t **runs, int *nruns, int sort, size_t cap)
+{
+    size_t per = cap / (SORT_FANIN + 1);
+    run_writer_t w = {.fd = temp_run_fd(), .cap = per ? per : 1};
+    int rc = ERR_DB_FILE;
+
+    w.buf = malloc(w.cap * sizeof(student_t));
+    if (w.fd != -1 && w.buf != NULL) {
+        rc = merge_runs(*runs, SORT_FANIN, sort, w.cap, emit_run, &w);
+        if (rc == NO_ERROR && w.n > 0)
+            rc = write_recs(w.fd, w.buf, w.n, w.len);
+        w.len += w.n;
+    }
+    free(w.buf);
+    if (rc == NO_ERROR)
+        rc = add_run(runs, nruns, w.fd, w.len);
+    if (rc != NO_ERROR) {
+        if (w.fd != -1)
+            close(w.fd);
+        return ERR_DB_FILE;
+    }
+
+    for (int j = 0; j < SORT_FANIN; j++)
+        close((*runs)[j].fd);
+    *nruns -= SORT_FANIN;
+    memmove(*runs, *runs + SORT_FANIN, *nruns * sizeof(sort_run_t));
+    return NO_ERROR;
+}
+
+//the rows as print_db_fmt() prints them
+static void rows_begin(sort_print_t *sp, int fmt)
+{
+    char hdr[FMT_ROW_MAX];
+
+    out_begin(&sp->out);
+    sp->fmt = fmt;
+    sp->first = true;
+    // an export has its header even when there are no rows
+    if (fmt != FMT_TABLE) {
+        out_bytes(&sp->out, hdr, fmt_header(hdr, fmt));
+        sp->first = false;
+    }
+}
+
+static int emit_row(void *ctx, const student_t *s)
+{
+    sort_print_t *sp = ctx;
+    char hdr[FMT_ROW_MAX];
+
+    if (sp->first) {
+        out_bytes(&sp->out, hdr, fmt_header(hdr, sp->fmt));
+        sp->first = false;
+    }
+    out_row(&sp->out, s, sp->fmt);
+    return NO_ERROR;
+}
+
+/*
+ *  print_db_sorted
+ *      fd:    linux file descriptor
+ *      fmt:   FMT_TABLE, FMT_CSV, FMT_TSV or FMT_JSONL
+ *      sort:  a key from sort_parse()
+ *      q:     a compiled query (see sdb_query.c), or NULL for every record
+ *
+ *  Prints the students matching q like print_db_fmt(), in the order of
+ *  sort.  Records that do not match are never kept.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    the database or a temporary run file could
+ *                           not be read or written
+ *
+ *  console:  the table or export, or M_DB_EMPTY, M_QUERY_NOT_FND when q
+ *            matched nothing, as for print_db_where()
+ *            M_ERR_DB_READ    error reading the database or a run
+ */
+int print_db_sorted(int fd, int fmt, int sort, const sdb_query_t *q)
+{
+    size_t cap = budget_recs();
+    student_t *recs = malloc(cap * sizeof(student_t));
+    sort_run_t *runs = NULL;
+    int nruns = 0, rc = recs ? NO_ERROR : ERR_DB_FILE;
+    size_t n = 0;
+    db_scan_t sc;
+    sort_print_t sp;
+
+    scan_open(&sc, fd);
+    if (q != NULL)
+        scan_limit(&sc, q->id_lo, q->id_hi);
+    while (rc == NO_ERROR && scan_next(&sc, &recs[n])) {
+        if (q != NULL && !query_match(q, &recs[n]))
+            continue;
+        if (++n == cap) {
+            qsort_r(recs, n, sizeof(student_t), cmp_qsort, &sort);
+            rc = spill(recs, n, &runs, &nruns);
+            n = 0;
+        }
+    }
+    if (sc.failed)
+        rc = ERR_DB_FILE;
+
+    if (rc == NO_ERROR) {
+        qsort_r(recs, n, sizeof(student_t), cmp_qsort, &sort);
+        // once anything was spilled the rest is too, and the budget goes
+        // to the read buffers of the merge
+        if (nruns > 0 && n > 0)
+            rc = spill(recs, n, &runs, &nruns);
+    }
+    if (nruns > 0) {
+        free(recs);
+        recs = NULL;
+    }
+    while (rc == NO_ERROR && nruns > SORT_FANIN)
+        rc = merge_pass(&runs, &nruns, sort, cap);
+
+    if (rc == NO_ERROR) {
+        rows_begin(&sp, fmt);
+        if (nruns == 0) {
+            for (size_t i = 0; i < n; i++)
+                emit_row(&sp, &recs[i]);
+        } else {
+            size_t per = cap / nruns;
+            rc = merge_runs(runs, nruns, sort, per ? per : 1, emit_row, &sp);
+        }
+        out_flush(&sp.out);
+    }
+
+    for (int j = 0; j < nruns; j++)
+        close(runs[j].fd);
+    free(runs);
+    free(recs);
+
+    if (rc != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+    if (sp.first)
+        printf(q != NULL ? M_QUERY_NOT_FND : M_DB_EMPTY);
+    return NO_ERROR;
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The database header in slot 0, see db_header_t in db.h.  The header is
+ *  updated on every add and delete so the count (-c) and the GPA
+ *  statistics (-s) are a single record read.  Minimum and maximum cannot
+ *  be maintained incrementally when the student holding them is deleted,
+ *  so that case only marks them stale and the next -s recomputes them.
+ *  If the header is ever out of step with the records, for example after
+ *  a crash between a record write and the header write, --rebuild-stats
+ *  recomputes everything from the records.
+ */
+
+//the GPA histogram bucket for a gpa, 5.00 shares the top bucket
+static int hist_bucket(int gpa)
+{
+    int b = gpa / ((MAX_STD_GPA + 1) / DB_HDR_HIST_BUCKETS);
+    return b < DB_HDR_HIST_BUCKETS ? b : DB_HDR_HIST_BUCKETS - 1;
+}
+
+//resets a header to describe an empty database
+void stats_hdr_init(db_header_t *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->magic = DB_HDR_MAGIC;
+    h->version = DB_HDR_VERSION;
+}
+
+//accounts for one student being added, an id past MAX_STD_ID (only a paged
+//database has those) is flagged for the GPA index and column, which stop
+//at MAX_STD_ID
+void stats_hdr_add(db_header_t *h, const student_t *s)
+{
+    int gpa = s->gpa;
+
+    if (s->id > MAX_STD_ID)
+        h->flags |= DB_HDR_F_WIDE_IDS;
+    if (h->count == 0 || gpa < h->gpa_min)
+        h->gpa_min = gpa;
+    if (h->count == 0 || gpa > h->gpa_max)
+        h->gpa_max = gpa;
+    h->count++;
+    h->gpa_sum += gpa;
+    h->gpa_hist[hist_bucket(gpa)]++;
+}
+
+//accounts for one student with the given gpa being deleted
+void stats_hdr_del(db_header_t *h, int gpa)
+{
+    if (h->count == 0)
+        return;
+
+    h->count--;
+    h->gpa_sum -= gpa;
+    h->gpa_hist[hist_bucket(gpa)]--;
+
+    if (h->count == 0)
+        h->flags &= ~DB_HDR_F_MINMAX_STALE;
+    else if (gpa == h->gpa_min || gpa == h->gpa_max)
+        h->flags |= DB_HDR_F_MINMAX_STALE;
+}
+
+/*
+ *  stats_load
+ *      fd:  linux file descriptor
+ *      *h:  where the header is copied
+ *
+ *  returns:  NO_ERROR       header copied into *h
+ *            SRCH_NOT_FOUND slot 0 does not hold a header
+ *            ERR_DB_FILE    database file I/O issue
+ */
+int stats_load(int fd, db_header_t *h)
+{
+    student_t slot;
+
+    int rc = read_record(fd, 0, &slot);
+    if (rc != NO_ERROR)
+        return rc;
+
+    memcpy(h, &slot, sizeof(*h));
+    return h->magic == DB_HDR_MAGIC ? NO_ERROR : SRCH_NOT_FOUND;
+}
+
+/*
+ *  stats_save
+ *      fd:  linux file descriptor
+ *      *h:  the header to store in slot 0
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int stats_save(int fd, const db_header_t *h)
+{
+    student_t slot;
+
+    memcpy(&slot, h, sizeof(slot));
+    return write_record(fd, 0, &slot);
+}
+
+/*
+ *  stats_scan
+ *      fd:  linux file descriptor
+ *      *h:  where the header computed from the records is built
+ *
+ *  Computes a header from the records with one full scan, in the format
+ *  of the database (direct or paged).
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int stats_scan(int fd, db_header_t *h)
+{
+    student_t student;
+    db_scan_t sc;
+
+    stats_hdr_init(h);
+    if (paged_db(fd))
+        h->version = DB_HDR_VERSION_PAGED;
+
+    scan_open(&sc, fd);
+    while (scan_next(&sc, &student))
+        stats_hdr_add(h, &student);
+
+    return sc.failed ? ERR_DB_FILE : NO_ERROR;
+}
+
+/*
+ *  rebuild_stats
+ *      fd:  linux file descriptor
+ *
+ *  Recomputes the header from the records with one full scan and stores
+ *  it.  This recovers from a stale header and is also how a database
+ *  written before the header existed gets one.
+ *
+ *  returns:  <number>       the number of students found
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  Does not produce any console I/O
+ */
+int rebuild_stats(int fd)
+{
+    db_header_t h;
+
+    // the count must not change under the scan
+    if (lock_db(fd, F_WRLCK) != NO_ERROR)
+        return ERR_DB_FILE;
+
+    // a logged header replayed later would undo the rebuild, so with the
+    // write-ahead log on the result is checkpointed
+    int rc = NO_ERROR;
+    if (stats_scan(fd, &h) != NO_ERROR || stats_save(fd, &h) != NO_ERROR ||
+        wal_checkpoint(fd) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    unlock_db(fd);
+
+    return rc == NO_ERROR ? (int)h.count : rc;
+}
+
+/*
+ *  stats_init
+ *      fd:  linux file descriptor of a just opened database
+ *
+ *  Makes sure the database has a current header.  A new (empty) file gets
+ *  a fresh header, a file from before the header existed has slot 0 empty
+ *  and gets one rebuilt from its records.  A header from a newer version
+ *  of this program is refused rather than misread, a paged database has
+ *  already been attached by open_db().
+ *
+ *  returns:  NO_ERROR       the database has a usable header
+ *            ERR_DB_FILE    database file I/O issue or unsupported format
+ */
+int stats_init(int fd)
+{
+    struct stat st;
+    db_header_t h;
+    student_t slot;
+
+    if (fstat(fd, &st) == -1)
+        return ERR_DB_FILE;
+
+    if (st.st_size == 0) {
+        stats_hdr_init(&h);
+        return stats_save(fd, &h);
+    }
+
+    int rc = stats_load(fd, &h);
+    if (rc == NO_ERROR)
+        return h.version <= DB_HDR_VERSION_PAGED ? NO_ERROR : ERR_DB_FILE;
+
+    // no header, only an empty slot 0 means this is an older database
+    if (read_record(fd, 0, &slot) == SRCH_NOT_FOUND ||
+        memcmp(&slot, &EMPTY_STUDENT_RECORD, sizeof(student_t)) == 0)
+        return rebuild_stats(fd) < 0 ? ERR_DB_FILE : NO_ERROR;
+
+    return ERR_DB_FILE;
+}
+
+/*
+ *  print_stats
+ *      fd:     linux file descriptor
+ *
+ *  Prints the record count, GPA average, minimum and maximum and the GPA
+ *  histogram, all straight from the header.  Only if a delete left the
+ *  minimum or maximum stale is the file scanned, once, to recompute them.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_DB_RECORD_CNT followed by M_DB_GPA_STATS and the histogram
+ *            M_DB_EMPTY       if there are no students
+ *            M_ERR_DB_READ    error reading the database file
+ */
+int print_stats(int fd)
+{
+    db_header_t h;
+
+    if (stats_load(fd, &h) != NO_ERROR ||
+        ((h.flags & DB_HDR_F_MINMAX_STALE) &&
+         (rebuild_stats(fd) < 0 || stats_load(fd, &h) != NO_ERROR))) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    if (h.count == 0) {
+        printf(M_DB_EMPTY);
+        return NO_ERROR;
+    }
+
+    printf(M_DB_RECORD_CNT, h.count);
+    printf(M_DB_GPA_STATS, (double)h.gpa_sum / h.count / 100.0,
+           h.gpa_min / 100.0, h.gpa_max / 100.0);
+
+    int width = (MAX_STD_GPA + 1) / DB_HDR_HIST_BUCKETS;
+    for (int b = 0; b < DB_HDR_HIST_BUCKETS; b++) {
+        int hi = (b == DB_HDR_HIST_BUCKETS - 1) ? MAX_STD_GPA : (b + 1) * width - 1;
+        printf(M_DB_GPA_HIST, b * width / 100.0, hi / 100.0, h.gpa_hist[b]);
+    }
+
+    return NO_ERROR;
+}
@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// database include files
+#include "db.h"
+#include "sdbsc.h"
+
+/*
+ *  The write-ahead log (--wal).  add_student() and del_student() write
+ *  their record and the header in place with no fsync, so a crash can
+ *  lose a change that was already reported done, or keep the record and
+ *  lose the header update.  With the log on, every change is first
+ *  appended to WAL_FILE as one entry holding the new image of the record
+ *  slot and of the header slot, then written in place as before.  Entries
+ *  are full images, so replaying one any number of times gives the same
+ *  database: recovery simply rewrites every intact entry in order.
+ *
+ *  How soon an entry is on disk is the durability level:
+ *
+ *      none      appended, never synced (survives a killed process)
+ *      batched   synced by wal_commit(), one fdatasync() for every change
+ *                made since the last one.  A command syncs before it exits,
+ *                the server once per poll() round, so all the clients
+ *                answered in that round share one sync (group commit)
+ *      per-op    synced before the change is applied and reported
+ *
+ *  A checkpoint makes the database file itself durable and empties the
+ *  log.  It runs on -x, around a bulk load, whenever a process closes a
+ *  log with entries in it, and in the server once WAL_CKPT_BYTES are
+ *  logged or it is idle.  A log left behind with entries only ever means
+ *  a crash.
+ *
+ *  Every process with the log open holds a shared lock on WAL_FILE (see
+ *  sdb_lock.c).  A log nobody holds was left by a process that died, and
+ *  open_db() replays it whether or not --wal is given, so a database is
+ *  never used with changes still sitting in a log.  A log that is held is
+ *  live, its entries are already in the file, and replaying them would
+ *  undo whatever changed the same slots or the header without the log
+ *  since, so it is left alone.
+ */
+
+#define WAL_MAGIC       0x57424453  //"SDBW" on disk
+#define WAL_CKPT_BYTES  (1024 * 1024)   //log size that forces a checkpoint
+
+typedef struct wal_entry {
+    uint32_t magic;
+    uint32_t crc;                   //crc32 of everything after this field
+    uint64_t seq;                   //1, 2, 3 ... since the last checkpoint
+    int32_t id;                     //slot of rec
+    uint32_t unused;
+    student_t rec;                  //the slot after the change
+    db_header_t hdr;                //the header after the change
+} wal_entry_t;
+
+static struct {
+    int fd;             // the open log, -1 when the log is off
+    int level;          // WAL_NONE, WAL_BATCHED or WAL_PER_OP
+    int pending;        // entries appended since the last fdatasync()
+    uint64_t seq;       // seq of the last entry appended
+    off_t size;         // bytes in the log
+} wal = {-1, WAL_NONE, 0, 0, 0};
+
+static uint32_t crc_table[256];
+
+//the common crc32 (as in zlib), the table is built on first use, the log
+//segments of sdb_logdb.c are checked with it as well
+uint32_t sdb_crc32(const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    uint32_t crc = 0xffffffff;
+
+    if (crc_table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    }
+    while (len--)
+        crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+static uint32_t entry_crc(const wal_entry_t *e)
+{
+    return sdb_crc32(&e->seq, sizeof(*e) - offsetof(wal_entry_t, seq));
+}
+
+/*
+ *  wal_parse_level
+ *      name:  "none", "batched" or "per-op"
+ *
+ *  returns:  the WAL_* level, or ERR_DB_OP for an unknown name
+ */
+int wal_parse_level(const char *name)
+{
+    if (strcmp(name, "none") == 0)
+        return WAL_NONE;
+    if (strcmp(name, "batched") == 0)
+        return WAL_BATCHED;
+    if (strcmp(name, "per-op") == 0)
+        return WAL_PER_OP;
+    return ERR_DB_OP;
+}
+
+/*
+ *  wal_open
+ *      level:  WAL_NONE, WAL_BATCHED or WAL_PER_OP
+ *
+ *  Turns the log on for the changes that follow.  The database must have
+ *  been opened with open_db(), which has already replayed any old log.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_open(int level)
+{
+    struct stat st;
+
+    wal_close(-1);
+
+    int fd = open(WAL_FILE, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+                  S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+    if (fd == -1)
+        return ERR_DB_FILE;
+    // held until the log is closed, so recovery knows the log is live
+    if (lock_range(fd, 0, 0, F_RDLCK) != NO_ERROR || fstat(fd, &st) == -1) {
+        close(fd);
+        return ERR_DB_FILE;
+    }
+
+    wal.fd = fd;
+    wal.level = level;
+    wal.pending = 0;
+    wal.size = st.st_size - st.st_size % sizeof(wal_entry_t);
+    wal.seq = wal.size / sizeof(wal_entry_t);
+    return NO_ERROR;
+}
+
+/*
+ *  wal_commit
+ *
+ *  Makes every entry appended so far durable with one fdatasync().  Does
+ *  nothing when the level is none or nothing is pending.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_commit(void)
+{
+    if (wal.fd < 0 || wal.pending == 0 || wal.level == WAL_NONE)
+        return NO_ERROR;
+    INSTR_START(t);
+    int rc = fdatasync(wal.fd);
+    INSTR_STOP(INSTR_SYNC, t, 0);
+    if (rc == -1)
+        return ERR_DB_FILE;
+    wal.pending = 0;
+    return NO_ERROR;
+}
+
+/*
+ *  wal_apply
+ *      fd:   linux file descriptor of the database
+ *      id:   the slot being changed
+ *      rec:  its new contents, EMPTY_STUDENT_RECORD for a delete
+ *      hdr:  the header after the change
+ *
+ *  Stores one change: the entry is logged (and with per-op synced) first,
+ *  then the record and the header are written in place.  Without the log
+ *  this is just the two writes.  The caller holds the header lock (see
+ *  sdb_lock.c).
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_apply(int fd, int id, const student_t *rec, const db_header_t *hdr)
+{
+    if (wal.fd >= 0) {
+        wal_entry_t e = {0};
+
+        // other processes may append to the log too, the caller's header
+        // lock orders the appends and the size gives the next seq
+        off_t end = lseek(wal.fd, 0, SEEK_END);
+        if (end == -1)
+            return ERR_DB_FILE;
+        wal.size = end - end % sizeof(wal_entry_t);
+        wal.seq = wal.size / sizeof(wal_entry_t);
+
+        e.magic = WAL_MAGIC;
+        e.seq = wal.seq + 1;
+        e.id = id;
+        e.rec = *rec;
+        e.hdr = *hdr;
+        e.crc = entry_crc(&e);
+
+        INSTR_START(t);
+        ssize_t n = write(wal.fd, &e, sizeof(e));
+        INSTR_STOP(INSTR_LOG, t, n > 0 ? n : 0);
+        if (n != sizeof(e))
+            return ERR_DB_FILE;
+        wal.seq++;
+        wal.size += sizeof(e);
+        wal.pending++;
+
+        if (wal.level == WAL_PER_OP && wal_commit() != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+
+    if (write_record(fd, id, rec) != NO_ERROR || stats_save(fd, hdr) != NO_ERROR)
+        return ERR_DB_FILE;
+    return NO_ERROR;
+}
+
+/*
+ *  wal_checkpoint
+ *      fd:  linux file descriptor of the database
+ *
+ *  Syncs the database file, then empties the log, whose entries are all
+ *  in the file now.  A no-op when the log is off.  Also used to make
+ *  changes written around the log (a bulk load) durable.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_checkpoint(int fd)
+{
+    if (wal.fd < 0)
+        return NO_ERROR;
+
+    // the header lock keeps other processes from logging meanwhile, and
+    // fsync() also writes back pages dirtied through the mmap backend,
+    // the buffer pool's and the mem backend's changes have to be written
+    // to the file first
+    int rc = lock_record(fd, 0, F_WRLCK);
+    if (rc == NO_ERROR && backend_sync(fd) != NO_ERROR)
+        rc = ERR_DB_FILE;
+    if (rc == NO_ERROR && (fdatasync(fd) == -1 || ftruncate(wal.fd, 0) == -1 ||
+                           fdatasync(wal.fd) == -1))
+        rc = ERR_DB_FILE;
+    unlock_record(fd, 0);
+    if (rc != NO_ERROR)
+        return rc;
+
+    wal.pending = 0;
+    wal.seq = 0;
+    wal.size = 0;
+    return NO_ERROR;
+}
+
+//true when the log has grown past WAL_CKPT_BYTES, or when idle is set and
+//it holds anything at all
+bool wal_needs_checkpoint(bool idle)
+{
+    return wal.fd >= 0 && (wal.size >= WAL_CKPT_BYTES || (idle && wal.size > 0));
+}
+
+//true when changes are logged, that is the log is open
+bool wal_active(void)
+{
+    return wal.fd >= 0;
+}
+
+/*
+ *  wal_close
+ *      fd:  linux file descriptor of the database, or -1 to skip the
+ *           checkpoint
+ *
+ *  Commits what is pending and, if the log holds any entries, checkpoints
+ *  it, then turns the log off.  Processes that opened the database while
+ *  the log was live did not replay it and may have changed the same slots
+ *  since, so entries left in it would be replayed over their changes.
+ *
+ *  returns:  NO_ERROR or ERR_DB_FILE
+ */
+int wal_close(int fd)
+{
+    int rc = NO_ERROR;
+
+    if (wal.fd < 0)
+        return NO_ERROR;
+
+    if (wal_commit() != NO_ERROR ||
+        (fd >= 0 && wal_needs_checkpoint(true) && wal_checkpoint(fd) != NO_ERROR))
+        rc = ERR_DB_FILE;
+
+    close(wal.fd);
+    wal.fd = -1;
+    return rc;
+}
+
+/*
+ *  wal_discard
+ *
+ *  Throws the log away, used when the database is emptied with -z.
+ */
+void wal_discard(void)
+{
+    if (wal.fd >= 0 && ftruncate(wal.fd, 0) == 0) {
+        wal.pending = 0;
+        wal.seq = 0;
+        wal.size = 0;
+    } else {
+        unlink(WAL_FILE);
+    }
+}
+
+/*
+ *  wal_recover
+ *      fd:  linux file descriptor of a just opened database, not attached
+ *           to the mmap backend
+ *
+ *  Replays the log left by an earlier run, if any.  A log another process
+ *  has open, which holds a lock on it, is not replayed.  Entries are
+ *  applied in order up to the first one that is torn or out of sequence,
+ *  which is where an interrupted append ends.  The database is then synced and the
+ *  log emptied.  The indexes and the GPA column cannot tell which changes
+ *  they already saw, so after a replay they are dropped and rebuilt on
+ *  their next use.
+ *
+ *  returns:  <number>       the number of entries replayed
+ *            ERR_DB_FILE    database or log file I/O issue
+ *
+ *  console:  Does not produce any console I/O
+ */
+int wal_recover(int fd)
+{
+    wal_entry_t e;
+    struct stat st;
+    int replayed = 0;
+    off_t pos = 0;
+
+    int lfd = (wal.fd >= 0) ? wal.fd : open(WAL_FILE, O_RDWR | O_CLOEXEC);
+    if (lfd == -1)
+        return errno == ENOENT ? 0 : ERR_DB_FILE;
+
+    // a log another process holds is live, only one nobody holds is left
+    // over; our own shared lock is converted and taken back afterwards
+    int rc = trylock_range(lfd, 0, 0, F_WRLCK);
+    if (rc == ERR_DB_OP) {
+        if (lfd != wal.fd)
+            close(lfd);
+        return 0;
+    }
+
+    // replaying takes the whole file, so no process sees it half done
+    if (rc != NO_ERROR || fstat(lfd, &st) == -1) {
+        replayed = ERR_DB_FILE;
+    } else if (st.st_size > 0 && lock_db(fd, F_WRLCK) != NO_ERROR) {
+        replayed = ERR_DB_FILE;
+    } else if (st.st_size > 0) {
+        while (pread(lfd, &e, sizeof(e), pos) == sizeof(e)) {
+            if (e.magic != WAL_MAGIC || e.crc != entry_crc(&e) ||
+                e.seq != (uint64_t)replayed + 1 || e.id < MIN_STD_ID)
+                break;
+
+            if (write_record(fd, e.id, &e.rec) != NO_ERROR ||
+                stats_save(fd, &e.hdr) != NO_ERROR) {
+                replayed = ERR_DB_FILE;
+                break;
+            }
+            replayed++;
+            pos += sizeof(e);
+        }
+
+        if (replayed > 0)
+            sidecars_drop();
+        if (replayed >= 0 && (fdatasync(fd) == -1 || ftruncate(lfd, 0) == -1 ||
+                              fdatasync(lfd) == -1))
+            replayed = ERR_DB_FILE;
+        unlock_db(fd);
+    }
+
+    if (lfd != wal.fd) {
+        close(lfd);
+        return replayed;
+    }
+    lock_range(lfd, 0, 0, F_RDLCK);
+    if (replayed >= 0) {
+        wal.pending = 0;
+        wal.seq = 0;
+        wal.size = 0;
+    }
+    return replayed;
+}
@@ -10,15 +10,28 @@
 #include "db.h"
 #include "sdbsc.h"
 
+static int rewrite_db(int fd, int version);
+
 /*
  *  open_db
  *      dbFile:  name of the database file
  *      should_truncate:  indicates if opening the file also empties it
  *
+ *  Slot 0 of the file holds the database header (see db_header_t in db.h).
+ *  A new or truncated file is given a fresh header and a file written
+ *  before the header existed has one built from its records.  The header
+ *  version tells a paged database from a direct one, and a paged one is
+ *  attached so that record access goes through its directory (see
+ *  sdb_paged.c).  Changes left
+ *  in log segments (see sdb_logdb.c) and then in a write-ahead log by an
+ *  earlier run are replayed first (see sdb_wal.c), and truncating the file
+ *  throws them away.
+ *
  *  returns:  File descriptor on success, or ERR_DB_FILE on failure
  *
  *  console:  Does not produce any console I/O on success
  *            M_ERR_DB_OPEN on error
+ *            M_ERR_DB_FORMAT if the header is from a newer version
  *
  */
 int open_db(char *dbFile, bool should_truncate)
@@ -44,9 +57,180 @@ int open_db(char *dbFile, bool should_truncate)
         return ERR_DB_FILE;
     }
 
+    if (paged_attach(fd) != NO_ERROR)
+    {
+        printf(M_ERR_DB_READ);
+        close(fd);
+        return ERR_DB_FILE;
+    }
+
+    if (should_truncate)
+    {
+        logdb_discard();
+        wal_discard();
+    }
+    else if (logdb_recover(fd) < 0 || wal_recover(fd) < 0)
+    {
+        printf(M_ERR_DB_READ);
+        close(fd);
+        return ERR_DB_FILE;
+    }
+
+    if (stats_init(fd) != NO_ERROR)
+    {
+        printf(M_ERR_DB_FORMAT);
+        close(fd);
+        return ERR_DB_FILE;
+    }
+
     return fd;
 }
 
+/*
+ *  db_replaced
+ *      fd:  linux file descriptor of an open database
+ *
+ *  A restore or a rewrite (compress, convert) renames a new file over
+ *  DB_FILE.  Another process that keeps the old file open, the server,
+ *  would go on reading and writing a file no one else sees.
+ *
+ *  returns:  true if DB_FILE is no longer the file fd has open
+ */
+bool db_replaced(int fd)
+{
+    struct stat open_st, path_st;
+
+    if (fstat(fd, &open_st) == -1 || stat(DB_FILE, &path_st) == -1)
+        return false;
+    return open_st.st_ino != path_st.st_ino || open_st.st_dev != path_st.st_dev;
+}
+
+/*
+ *  lock_current
+ *      fd:  linux file descriptor of the open database
+ *      id:  the record to write lock, or -1 for the whole file
+ *
+ *  Takes the write lock a change needs on the file that is DB_FILE.  A
+ *  writer that waited behind a rewrite or a restore gets its lock on the
+ *  old file once the new one has been renamed over it, and would write
+ *  where no one looks.  It lets go, reopens DB_FILE onto the same fd so
+ *  the caller's descriptor stays good, and waits again.  While the backend
+ *  or the buffer pool is attached this process holds the whole file lock
+ *  and nothing can be renamed over the file, so only the paged state
+ *  needs attaching to the new one.
+ *
+ *  returns:  NO_ERROR with the lock held, or ERR_DB_FILE
+ */
+int lock_current(int fd, int id)
+{
+    for (;;) {
+        if ((id < 0 ? lock_db(fd, F_WRLCK) : lock_record(fd, id, F_WRLCK)) != NO_ERROR)
+            return ERR_DB_FILE;
+        if (!db_replaced(fd))
+            return NO_ERROR;
+
+        if (id < 0)
+            unlock_db(fd);
+        else
+            unlock_record(fd, id);
+
+        int new_fd = open(DB_FILE, O_RDWR);
+        if (new_fd == -1)
+            return ERR_DB_FILE;
+        int rc = dup2(new_fd, fd);
+        close(new_fd);
+        if (rc == -1 || paged_attach(fd) != NO_ERROR)
+            return ERR_DB_FILE;
+    }
+}
+
+/*
+ *  read_record
+ *      fd:  linux file descriptor
+ *      id:  the slot (student id) to read
+ *      *s:  where the raw slot contents are copied
+ *
+ *  Reads one raw record slot, empty or not, through the storage backend
+ *  serving the database (see sdb_backend.c): from the mapping or memory
+ *  when the mmap or mem backend is attached, otherwise from the buffer
+ *  pool when that is, or with lseek() and read().  In a paged database the
+ *  slot is found through the directory and read with pread().
+ *
+ *  returns:  NO_ERROR       slot copied into *s
+ *            ERR_DB_FILE    the seek failed
+ *            SRCH_NOT_FOUND the slot is past the end of the file, or its
+ *                           page does not exist
+ */
+int read_record(int fd, int id, student_t *s)
+{
+    return backend_of(fd)->read_rec(fd, id, s);
+}
+
+/*
+ *  write_record
+ *      fd:  linux file descriptor
+ *      id:  the slot (student id) to write
+ *      *s:  the record to store, EMPTY_STUDENT_RECORD clears the slot
+ *
+ *  Stores one record slot through the storage backend, growing the
+ *  mapping or memory if the slot is past the end.  With the mem backend
+ *  or the buffer pool the record is written back later.  In a paged
+ *  database the slot's page is allocated if it does not exist yet, so the
+ *  caller must hold the header lock or the whole file (see sdb_paged.c).
+ *
+ *  returns:  NO_ERROR       record written
+ *            ERR_DB_FILE    the seek or write failed
+ */
+int write_record(int fd, int id, const student_t *s)
+{
+    return backend_of(fd)->write_rec(fd, id, s);
+}
+
+/*
+ *  patch_record
+ *      fd:    linux file descriptor
+ *      *old:  the record as it is stored now
+ *      *upd:  the record it becomes, with the same id
+ *
+ *  Like write_record() for a slot that already holds a student, but only
+ *  the bytes from the first to the last one that differ are written, with
+ *  one pwrite() at their offset inside the slot.  Changing the GPA alone
+ *  writes its 4 bytes.  The mmap and mem backends and the buffer pool
+ *  hold the whole record in memory, so there the record is simply
+ *  replaced.
+ *
+ *  returns:  NO_ERROR       record written, or nothing differed
+ *            ERR_DB_FILE    the write failed
+ */
+int patch_record(int fd, const student_t *old, const student_t *upd)
+{
+    const unsigned char *a = (const unsigned char *)old;
+    const unsigned char *b = (const unsigned char *)upd;
+    size_t first = 0, last = sizeof(student_t);
+
+    while (first < last && a[first] == b[first])
+        first++;
+    if (first == last)
+        return NO_ERROR;
+    while (a[last - 1] == b[last - 1])
+        last--;
+
+    if (backend_attached(fd) || bufpool_attached(fd))
+        return write_record(fd, upd->id, upd);
+
+    off_t offset = (off_t)upd->id * sizeof(student_t);
+    if (paged_db(fd) && (offset = paged_slot_offset(fd, upd->id, false)) < 0)
+        return ERR_DB_FILE;
+
+    INSTR_START(t);
+    ssize_t n = pwrite(fd, b + first, last - first, offset + first);
+    INSTR_STOP(INSTR_WRITE, t, n > 0 ? n : 0);
+    if (n != (ssize_t)(last - first))
+        return ERR_DB_FILE;
+
+    return NO_ERROR;
+}
+
 /*
  *  get_student
  *      fd:  linux file descriptor
@@ -62,17 +246,19 @@ int open_db(char *dbFile, bool should_truncate)
  */
 int get_student(int fd, int id, student_t *s)
 {
-    // Calculate the offset for the student record based on their ID
-    off_t offset = id * sizeof(student_t);
+    // Slots below MIN_STD_ID are not students, slot 0 is the header
+    if (id < MIN_STD_ID) {
+        return SRCH_NOT_FOUND;
+    }
 
-    // Seek to the position where the student record should be
-    if (lseek(fd, offset, SEEK_SET) == -1) {
+    // Read the slot for this ID, the slot is at id * sizeof(student_t)
+    int rc = read_record(fd, id, s);
+    if (rc == ERR_DB_FILE) {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
 
-    // Attempt to read the student record from the database
-    if (read(fd, s, sizeof(student_t)) != sizeof(student_t)) {
+    if (rc == SRCH_NOT_FOUND) {
         return SRCH_NOT_FOUND; // Student not found if read fails
     }
 
@@ -97,6 +283,12 @@ int get_student(int fd, int id, student_t *s)
  *  way is to use something like memcmp() to ensure that the location for this
  *  student contains all zero byes indicating the space is empty.
  *
+ *  The check and the write are done holding an exclusive lock on the
+ *  record, and the header update holding one on the header, so concurrent
+ *  sdbsc processes cannot both add the same id (see sdb_lock.c).  The
+ *  record lock is taken with lock_current(), so the add lands in the file
+ *  a concurrent rewrite or restore left behind.
+ *
  *  returns:  NO_ERROR       student added to database
  *            ERR_DB_FILE    database file I/O issue
  *            ERR_DB_OP      database operation logically failed (aka student
@@ -112,9 +304,17 @@ int get_student(int fd, int id, student_t *s)
 int add_student(int fd, int id, char *fname, char *lname, int gpa)
 {
     student_t student = {0};
+    db_header_t hdr;
+    int rc;
+
+    if (lock_current(fd, id) != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
 
     // Check if a student with the given ID already exists in the database
     if (get_student(fd, id, &student) == NO_ERROR) {
+        unlock_record(fd, id);
         printf(M_ERR_DB_ADD_DUP, id);
         return ERR_DB_OP;
     }
@@ -125,11 +325,21 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa)
     strncpy(student.lname, lname, sizeof(student.lname) - 1);
     student.gpa = gpa;
 
-    // Calculate offset for the new student record in the database file
-    off_t offset = id * sizeof(student_t);
+    // Count the student in the header, then store the record and the
+    // header, through the write-ahead log when it is on
+    rc = lock_record(fd, 0, F_WRLCK);
+    if (rc == NO_ERROR)
+        rc = stats_load(fd, &hdr);
+    if (rc == NO_ERROR) {
+        stats_hdr_add(&hdr, &student);
+        rc = wal_apply(fd, id, &student, &hdr);
+    }
+    if (rc == NO_ERROR)
+        sidecars_note_add(&student);
+    unlock_record(fd, 0);
+    unlock_record(fd, id);
 
-    // Seek to the calculated offset and write the new student record
-    if (lseek(fd, offset, SEEK_SET) == -1 || write(fd, &student, sizeof(student_t)) != sizeof(student_t)) {
+    if (rc != NO_ERROR) {
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
@@ -149,6 +359,12 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa)
  *  write an empty student record - see EMPTY_STUDENT_RECORD from db.h at
  *  that location.
  *
+ *  When the --punch option is in effect (see set_punch_on_delete()) the
+ *  filesystem block holding the record is also released if every record
+ *  in it is now empty, instead of waiting for the next compress.  Locking
+ *  is as for add_student(), the punch locks the block on its own after the
+ *  record lock is released.
+ *
  *  returns:  NO_ERROR       student deleted from database
  *            ERR_DB_FILE    database file I/O issue
  *            ERR_DB_OP      database operation logically failed (aka student
@@ -164,29 +380,130 @@ int add_student(int fd, int id, char *fname, char *lname, int gpa)
 int del_student(int fd, int id)
 {
     student_t student;
-    
+    db_header_t hdr;
+    int rc;
+
+    if (lock_current(fd, id) != NO_ERROR) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
     // Check if the student exists in the database
     if (get_student(fd, id, &student) == SRCH_NOT_FOUND) {
+        unlock_record(fd, id);
         printf(M_STD_NOT_FND_MSG, id);
         return ERR_DB_OP;
     }
-    
-    // Calculate the correct offset in the file
-    off_t offset = id * sizeof(student_t);
-    
-    // Seek to the correct position
-    if (lseek(fd, offset, SEEK_SET) == -1) {
+
+    // Take the student out of the header, then write the empty student
+    // record over the student's slot and store the header
+    rc = lock_record(fd, 0, F_WRLCK);
+    if (rc == NO_ERROR)
+        rc = stats_load(fd, &hdr);
+    if (rc == NO_ERROR) {
+        stats_hdr_del(&hdr, student.gpa);
+        rc = wal_apply(fd, id, &EMPTY_STUDENT_RECORD, &hdr);
+    }
+    if (rc == NO_ERROR)
+        sidecars_note_del(&student);
+    unlock_record(fd, 0);
+    unlock_record(fd, id);
+
+    if (rc != NO_ERROR ||
+        (punch_on_delete() && punch_record_block(fd, id) != NO_ERROR)) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    printf(M_STD_DEL_MSG, id);
+    return NO_ERROR;
+}
+
+/*
+ *  update_student
+ *      fd:     linux file descriptor
+ *      id:     student id to be updated
+ *      fname:  new first name, or NULL to keep it
+ *      lname:  new last name, or NULL to keep it
+ *      gpa:    new GPA, or -1 to keep it
+ *
+ *  Changes fields of a student in place instead of a delete and an add.
+ *  The record is read once and only the bytes that changed are written
+ *  back (see patch_record()).  The header is only touched when the GPA
+ *  changes, and the indexes see the old record go and the new one come.
+ *  With the write-ahead log on the whole record is logged and written, as
+ *  for add_student().  Locking is as for add_student().
+ *
+ *  returns:  NO_ERROR       student updated
+ *            ERR_DB_FILE    database file I/O issue
+ *            ERR_DB_OP      database operation logically failed (aka student
+ *                           not in database)
+ *
+ *  console:  M_STD_UPDATED      on success
+ *            M_STD_NOT_FND_MSG  student not in database, cant be updated
+ *            M_ERR_DB_READ      error reading or seeking the database file
+ *            M_ERR_DB_WRITE     error writing to db file
+ */
+int update_student(int fd, int id, char *fname, char *lname, int gpa)
+{
+    student_t student, updated;
+    db_header_t hdr;
+    int rc;
+
+    if (lock_current(fd, id) != NO_ERROR) {
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
 
-    // Write the empty student record
-    if (write(fd, &EMPTY_STUDENT_RECORD, sizeof(student_t)) != sizeof(student_t)) {
+    rc = get_student(fd, id, &student);
+    if (rc != NO_ERROR) {
+        unlock_record(fd, id);
+        if (rc == SRCH_NOT_FOUND)
+            printf(M_STD_NOT_FND_MSG, id);
+        return rc == SRCH_NOT_FOUND ? ERR_DB_OP : ERR_DB_FILE;
+    }
+
+    updated = student;
+    if (fname != NULL) {
+        memset(updated.fname, 0, sizeof(updated.fname));
+        strncpy(updated.fname, fname, sizeof(updated.fname) - 1);
+    }
+    if (lname != NULL) {
+        memset(updated.lname, 0, sizeof(updated.lname));
+        strncpy(updated.lname, lname, sizeof(updated.lname) - 1);
+    }
+    if (gpa >= 0)
+        updated.gpa = gpa;
+
+    // the header lock also orders the index updates, as for an add
+    rc = lock_record(fd, 0, F_WRLCK);
+    if (rc == NO_ERROR && (wal_active() || updated.gpa != student.gpa)) {
+        rc = stats_load(fd, &hdr);
+        if (rc == NO_ERROR) {
+            stats_hdr_del(&hdr, student.gpa);
+            stats_hdr_add(&hdr, &updated);
+            if (wal_active())
+                rc = wal_apply(fd, id, &updated, &hdr);
+            else if (patch_record(fd, &student, &updated) != NO_ERROR ||
+                     stats_save(fd, &hdr) != NO_ERROR)
+                rc = ERR_DB_FILE;
+        }
+    } else if (rc == NO_ERROR) {
+        rc = patch_record(fd, &student, &updated);
+    }
+    if (rc == NO_ERROR) {
+        sidecars_note_del(&student);
+        sidecars_note_add(&updated);
+    }
+    unlock_record(fd, 0);
+    unlock_record(fd, id);
+
+    if (rc != NO_ERROR) {
         printf(M_ERR_DB_WRITE);
         return ERR_DB_FILE;
     }
 
-    printf(M_STD_DEL_MSG, id);
+    printf(M_STD_UPDATED, id);
     return NO_ERROR;
 }
 
@@ -194,13 +511,10 @@ int del_student(int fd, int id)
  *  count_db_records
  *      fd:     linux file descriptor
  *
- *  Counts the number of records in the database.  Start by reading the
- *  database at the beginning, and continue reading individual records
- *  until you it EOF.  EOF is when the read() syscall returns 0. Check
- *  if a slot is empty or previously deleted by investigating if all of
- *  the bytes in the record read are zeros - I would suggest using memory
- *  compare memcmp() for this. Create a counter variable and initialize it
- *  to zero, every time a non-zero record is read increment the counter.
+ *  Counts the number of records in the database.  The count is kept up to
+ *  date in the database header by add_student() and del_student(), so this
+ *  is a single read of slot 0 rather than a scan of the whole file.  If the
+ *  header is suspected to be stale use --rebuild-stats to recount.
  *
  *  returns:  <number>       returns the number of records in db on success
  *            ERR_DB_FILE    database file I/O issue
@@ -216,22 +530,14 @@ int del_student(int fd, int id)
  */
 int count_db_records(int fd)
 {
-    student_t student;
-    int count = 0;
+    db_header_t hdr;
 
-    // Move file pointer to the beginning of the database file
-    if (lseek(fd, 0, SEEK_SET) == -1) {
+    // The live record count is maintained in the header
+    if (stats_load(fd, &hdr) != NO_ERROR) {
         printf(M_ERR_DB_READ);
         return ERR_DB_FILE;
     }
-
-    // Read through the entire file and count valid (non-empty) student records
-    while (read(fd, &student, sizeof(student_t)) == sizeof(student_t)) {
-        // Check if the record is not an empty (deleted) record
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, sizeof(student_t)) != 0) {
-            count++;
-        }
-    }
+    int count = hdr.count;
 
     // Print the appropriate message based on the number of records found
     if (count == 0) {
@@ -243,16 +549,51 @@ int count_db_records(int fd)
     return count; // Return the total number of valid student records
 }
 
+/*
+ *  count_db_where
+ *      fd:  linux file descriptor
+ *      q:   a compiled query (see sdb_query.c)
+ *
+ *  Counts the students matching q.  Unlike count_db_records() this is a
+ *  scan, limited to the ids q can match, that tests each binary record and
+ *  formats none of them.
+ *
+ *  returns:  <number>       the number of matching students
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_DB_QUERY_CNT   on success
+ *            M_ERR_DB_READ    error reading or seeking the database file
+ */
+int count_db_where(int fd, const sdb_query_t *q)
+{
+    student_t student;
+    db_scan_t sc;
+    int count = 0;
+
+    scan_open(&sc, fd);
+    scan_limit(&sc, q->id_lo, q->id_hi);
+    while (scan_next(&sc, &student)) {
+        if (query_match(q, &student))
+            count++;
+    }
+    if (sc.failed) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
+    }
+
+    printf(M_DB_QUERY_CNT, count);
+    return count;
+}
+
 /*
  *  print_db
  *      fd:     linux file descriptor
  *
- *  Prints all records in the database.  Start by reading the
- *  database at the beginning, and continue reading individual records
- *  until you it EOF.  EOF is when the read() syscall returns 0. Check
- *  if a slot is empty or previously deleted by investigating if all of
- *  the bytes in the record read are zeros - I would suggest using memory
- *  compare memcmp() for this. Be careful as the database might be empty.
+ *  Prints all records in the database.  The records are walked in id order
+ *  with the scan iterator (see sdb_scan.c), which only reads the parts of
+ *  the sparse file that hold data and skips empty or deleted slots. Be
+ *  careful as the database might be empty.  The rows are produced by
+ *  print_db_fmt() below, with integer formatting into an output buffer.
  *  on the first real row encountered print the header for the required output:
  *
  *     printf(STUDENT_PRINT_HDR_STRING, "ID",
@@ -277,34 +618,91 @@ int count_db_records(int fd)
  *
  */
 int print_db(int fd)
+{
+    return print_db_fmt(fd, FMT_TABLE);
+}
+
+/*
+ *  print_db_fmt
+ *      fd:   linux file descriptor
+ *      fmt:  FMT_TABLE for the print_db() table, or FMT_CSV, FMT_TSV or
+ *            FMT_JSONL to export the records (see sdb_format.c)
+ *
+ *  The rows are rendered by fmt_row() into a large buffer that is written
+ *  to stdout with write() as it fills, rather than a printf() per row.  An
+ *  empty database prints M_DB_EMPTY as a table and just the header line,
+ *  if the format has one, as an export.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  the table or export, or M_DB_EMPTY
+ *            M_ERR_DB_READ    error reading or seeking the database file
+ */
+int print_db_fmt(int fd, int fmt)
+{
+    return print_db_where(fd, fmt, NULL);
+}
+
+/*
+ *  print_db_where
+ *      fd:   linux file descriptor
+ *      fmt:  FMT_TABLE, FMT_CSV, FMT_TSV or FMT_JSONL
+ *      q:    a compiled query (see sdb_query.c), or NULL for every record
+ *
+ *  print_db_fmt() of the students matching q.  The scan only reads the ids
+ *  q can match, and each record is tested as it is read, so only the rows
+ *  printed are formatted.  A table that nothing matches prints
+ *  M_QUERY_NOT_FND, so it is not mistaken for an empty database.
+ *
+ *  returns:  NO_ERROR       on success
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  the table or export, or M_DB_EMPTY, M_QUERY_NOT_FND when q
+ *            matched nothing
+ *            M_ERR_DB_READ    error reading or seeking the database file
+ */
+int print_db_where(int fd, int fmt, const sdb_query_t *q)
 {
     student_t student;
     bool first_record = true; // Flag to track if we printed the header
+    char hdr[FMT_ROW_MAX];
+    out_buf_t out;
+    db_scan_t sc;
 
-    // Move file pointer to the beginning of the database file
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
-        return ERR_DB_FILE;
-    }
+    out_begin(&out);
 
-    // Read through the entire file and print valid (non-empty) student records
-    while (read(fd, &student, sizeof(student_t)) == sizeof(student_t)) {
-        // Check if the record is not an empty (deleted) record
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, sizeof(student_t)) != 0) {
-            // Print header only before the first valid record
-            if (first_record) {
-                printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
-                first_record = false;
-            }
+    // an export has its header even when there are no rows
+    if (fmt != FMT_TABLE) {
+        out_bytes(&out, hdr, fmt_header(hdr, fmt));
+        first_record = false;
+    }
 
-            // Print the student record with formatted output
-            printf(STUDENT_PRINT_FMT_STRING, student.id, student.fname, student.lname, student.gpa / 100.0);
+    // Walk every valid (non-empty) student record
+    scan_open(&sc, fd);
+    if (q != NULL)
+        scan_limit(&sc, q->id_lo, q->id_hi);
+    while (scan_next(&sc, &student)) {
+        if (q != NULL && !query_match(q, &student))
+            continue;
+        // Print header only before the first valid record
+        if (first_record) {
+            out_bytes(&out, hdr, fmt_header(hdr, fmt));
+            first_record = false;
         }
+        out_row(&out, &student, fmt);
+    }
+    out_flush(&out);
+
+    if (sc.failed) {
+        printf(M_ERR_DB_READ);
+        return ERR_DB_FILE;
     }
 
     // If no valid records were found, print that the database is empty
+    // or that none matched
     if (first_record) {
-        printf(M_DB_EMPTY);
+        printf(q != NULL ? M_QUERY_NOT_FND : M_DB_EMPTY);
     }
 
     return NO_ERROR;
@@ -351,8 +749,10 @@ void print_student(student_t *s)
     // Print the table header for the student record
     printf(STUDENT_PRINT_HDR_STRING, "ID", "FIRST NAME", "LAST_NAME", "GPA");
 
-    // Print the student's details with formatted output
-    printf(STUDENT_PRINT_FMT_STRING, s->id, s->fname, s->lname, s->gpa / 100.0);
+    // Print the student's details, fmt_row() renders the same columns as
+    // STUDENT_PRINT_FMT_STRING without floating point
+    char row[FMT_ROW_MAX];
+    fwrite(row, 1, fmt_row(row, s, FMT_TABLE), stdout);
 }
 
 
@@ -368,31 +768,24 @@ void print_student(student_t *s)
  *  deleted storage is used to write a blank - see EMPTY_STUDENT_RECORD from
  *  db.h - record.
  *
- *  Since Linux provides no way to delete data in the middle of a file, and
- *  deleted records take up physical storage, this function will compress the
- *  database by rewriting a new database file that only includes valid student
- *  records. There are a number of ways to do this, but since this is extra credit
- *  you need to figure this out on your own.
- *
- *  At a high level create a temporary database file then copy all valid students from
- *  the active database (passed in via fd) to the temporary file. When this is done
- *  rename the temporary database file to the name of the real database file. See
- *  the constants in db.h for required file names:
- *
- *         #define DB_FILE     "student.db"        //name of database file
- *         #define TMP_DB_FILE ".tmp_student.db"   //for extra credit
+ *  The database is compressed in place: compact_in_place() punches holes
+ *  where whole blocks hold only deleted records and truncates deleted
+ *  records off the end of the file.  Only on a filesystem that cannot punch
+ *  holes is a new file written instead, by rewrite_db() below.  Either way
+ *  the disk space released is reported.
  *
- *  Note that you are passed in the fd of the database file to be compressed,
- *  it is very likely you will need to close it to overwrite it with the
- *  compressed version of the file.  To ensure the caller can work with the
- *  compressed file after you create it, it is a good design to return the fd
- *  of the new compressed file from this function
+ *  The fd of the compressed database is returned, which is the fd passed
+ *  in unless the file had to be rewritten.  The whole file is locked while
+ *  it is compressed, and with the write-ahead log on it is checkpointed
+ *  first.  With the log backend, detaching it merges its segments into the
+ *  file, so the log is compacted before the file is.
  *
  *  returns:  <number>       returns the fd of the compressed database file
  *            ERR_DB_FILE    database file I/O issue
  *
  *
- *  console:  M_DB_COMPRESSED_OK  on success, the db was successfully compressed.
+ *  console:  M_DB_COMPRESSED_OK  on success, the db was successfully compressed,
+ *                                followed by M_DB_RECLAIMED
  *            M_ERR_DB_OPEN    error when opening/creating temporary database file.
  *                             this error should also be returned after you
  *                             compressed the database file and if you are unable
@@ -406,51 +799,213 @@ void print_student(student_t *s)
  */
 int compress_db(int fd)
 {
-    int temp_fd = open(TMP_DB_FILE, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-    if (temp_fd == -1) {
+    long long before = db_disk_usage(fd);
+
+    int locked_fd = fd;
+
+    // no other process may touch the file while it is compacted, and
+    // logged changes go into the file first
+    if (lock_db(fd, F_WRLCK) != NO_ERROR || wal_checkpoint(fd) != NO_ERROR) {
+        unlock_db(locked_fd);
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    // the compaction works on the file, so the storage backend and the
+    // buffer pool (if any) are dropped and re-established on the result
+    bool remap = backend_attached(fd);
+    bool recache = bufpool_attached(fd);
+
+    int rc = backend_detach();
+    if (rc == NO_ERROR)
+        rc = bufpool_detach();
+    if (rc == NO_ERROR)
+        rc = compact_in_place(fd);
+    if (rc == ERR_DB_OP)        // closes the locked fd, releasing the lock
+        fd = rewrite_db(fd, paged_db(fd) ? DB_HDR_VERSION_PAGED : DB_HDR_VERSION);
+    unlock_db(locked_fd);       // nothing left to undo if rewrite_db() closed it
+
+    if (fd < 0)
+        return fd;
+    if (rc != NO_ERROR && rc != ERR_DB_OP) {
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    if ((remap && backend_attach(fd) != NO_ERROR) ||
+        (recache && bufpool_attach(fd) != NO_ERROR)) {
         printf(M_ERR_DB_OPEN);
         return ERR_DB_FILE;
     }
 
-    student_t student;
+    long long after = db_disk_usage(fd);
+    printf(M_DB_COMPRESSED_OK);
+    printf(M_DB_RECLAIMED, (before > after) ? before - after : 0);
+    return fd;
+}
 
-    // Seek to the start of the original file
-    if (lseek(fd, 0, SEEK_SET) == -1) {
-        printf(M_ERR_DB_READ);
-        close(temp_fd);
+/*
+ *  convert_db
+ *      fd:       linux file descriptor
+ *      version:  DB_HDR_VERSION for the direct format or
+ *                DB_HDR_VERSION_PAGED for the paged one (see sdb_paged.c)
+ *
+ *  Rewrites the database in the given format with rewrite_db(), under a
+ *  lock on the whole file and after a checkpoint of the write-ahead log,
+ *  like compress_db().  Converting to the direct format fails, leaving the
+ *  database as it was, if a student id is above MAX_STD_ID.  The indexes
+ *  and the GPA column stay valid, the students do not change.
+ *
+ *  returns:  <number>       the fd of the converted database file
+ *            ERR_DB_OP      a student does not fit the direct format, fd
+ *                           is still open
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_DB_CONVERTED   on success
+ *            M_ERR_CONVERT_ID a student does not fit the direct format
+ *            M_ERR_DB_OPEN, M_ERR_DB_CREATE, M_ERR_DB_READ or
+ *            M_ERR_DB_WRITE as for compress_db()
+ */
+int convert_db(int fd, int version)
+{
+    int locked_fd = fd;
+
+    if (lock_db(fd, F_WRLCK) != NO_ERROR || wal_checkpoint(fd) != NO_ERROR) {
+        unlock_db(locked_fd);
+        printf(M_ERR_DB_WRITE);
+        return ERR_DB_FILE;
+    }
+
+    bool remap = backend_attached(fd);
+    bool recache = bufpool_attached(fd);
+
+    int rc = backend_detach();
+    if (rc == NO_ERROR)
+        rc = bufpool_detach();
+    if (rc != NO_ERROR)
+        printf(M_ERR_DB_WRITE);
+    else
+        rc = rewrite_db(fd, version);   // closes the locked fd on success
+    bool kept = (rc == ERR_DB_OP);
+    unlock_db(locked_fd);       // nothing left to undo if rewrite_db() closed it
+
+    if (kept)
+        rc = fd;
+    if (rc < 0)
+        return rc;
+    if ((remap && backend_attach(rc) != NO_ERROR) ||
+        (recache && bufpool_attach(rc) != NO_ERROR)) {
+        printf(M_ERR_DB_OPEN);
+        return ERR_DB_FILE;
+    }
+    if (kept)
+        return ERR_DB_OP;
+
+    fd = rc;
+    printf(M_DB_CONVERTED, version == DB_HDR_VERSION_PAGED ? "paged" : "direct");
+    return fd;
+}
+
+/*
+ *  rewrite_db
+ *      fd:       linux file descriptor, not attached to the mmap backend
+ *      version:  DB_HDR_VERSION or DB_HDR_VERSION_PAGED, the format of the
+ *                file written
+ *
+ *  The fallback for compress_db() on filesystems without hole punching,
+ *  and the conversion between the formats.  Creates a temporary database
+ *  file, copies all valid students from the active database to it and
+ *  renames it over the real database file.  See the constants in db.h for
+ *  the file names:
+ *
+ *         #define DB_FILE     "student.db"        //name of database file
+ *         #define TMP_DB_FILE ".tmp_student.db"   //for extra credit
+ *
+ *  fd is closed and the fd of the new file returned, already attached if
+ *  it is paged.  The whole file lock held on fd is forgotten before the
+ *  close (see unlock_db_closing()), the new file may get the same number.
+ *
+ *  returns:  <number>       returns the fd of the compressed database file
+ *            ERR_DB_OP      a student does not fit the direct format, fd
+ *                           is left open and unchanged
+ *            ERR_DB_FILE    database file I/O issue
+ *
+ *  console:  M_ERR_DB_OPEN, M_ERR_DB_CREATE, M_ERR_DB_READ or M_ERR_DB_WRITE
+ *            as for compress_db(), M_ERR_CONVERT_ID, nothing on success
+ */
+static int rewrite_db(int fd, int version)
+{
+    int temp_fd = open(TMP_DB_FILE, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (temp_fd == -1) {
+        printf(M_ERR_DB_OPEN);
         return ERR_DB_FILE;
     }
 
+    student_t student;
+    db_scan_t sc;
     off_t offset = 0;
+    int rc = NO_ERROR;
+
+    // The compressed file gets a header recomputed from the records copied
+    db_header_t hdr;
+    stats_hdr_init(&hdr);
+
+    // A paged file is laid out by the builder, it needs the ids in order
+    paged_build_t *build = NULL;
+    if (version == DB_HDR_VERSION_PAGED && (build = paged_build_begin(temp_fd)) == NULL)
+        rc = ERR_DB_FILE;
+
+    // The scan only returns valid student records (non-empty), copy each
+    // to the same position in the new file
+    scan_open(&sc, fd);
+    while (rc == NO_ERROR && scan_next(&sc, &student)) {
+        stats_hdr_add(&hdr, &student);
+
+        if (build != NULL) {
+            rc = paged_build_add(build, &student);
+            continue;
+        }
+        if (student.id > MAX_STD_ID) {
+            printf(M_ERR_CONVERT_ID, student.id);
+            rc = ERR_DB_OP;
+            break;
+        }
 
-    while (read(fd, &student, sizeof(student_t)) == sizeof(student_t)) {
         // Calculate the position where this student was originally stored
         offset = student.id * sizeof(student_t);
 
-        // Copy only valid student records (non-empty) to the same position in the new file
-        if (memcmp(&student, &EMPTY_STUDENT_RECORD, sizeof(student_t)) != 0) {
-            if (lseek(temp_fd, offset, SEEK_SET) == -1) {
-                printf(M_ERR_DB_WRITE);
-                close(temp_fd);
-                return ERR_DB_FILE;
-            }
-            if (write(temp_fd, &student, sizeof(student_t)) != sizeof(student_t)) {
-                printf(M_ERR_DB_WRITE);
-                close(temp_fd);
-                return ERR_DB_FILE;
-            }
-        }
+        if (lseek(temp_fd, offset, SEEK_SET) == -1 ||
+            write(temp_fd, &student, sizeof(student_t)) != sizeof(student_t))
+            rc = ERR_DB_FILE;
     }
 
-    // Close the original database
-    close(fd);
+    if (build != NULL && paged_build_end(build, &hdr) != NO_ERROR && rc == NO_ERROR)
+        rc = ERR_DB_FILE;
+    else if (build == NULL && rc == NO_ERROR &&
+             pwrite(temp_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+        rc = ERR_DB_FILE;
+
+    if (rc == NO_ERROR && sc.failed) {
+        printf(M_ERR_DB_READ);
+        rc = ERR_DB_FILE;
+    } else if (rc == ERR_DB_FILE) {
+        printf(M_ERR_DB_WRITE);
+    }
     close(temp_fd);
+    if (rc != NO_ERROR) {
+        unlink(TMP_DB_FILE);
+        return rc;
+    }
 
-    // Replace the original database file with the compressed version
+    // Replace the original database file with the compressed version, the
+    // original is closed (and unlocked) once it has been replaced
+    unlock_db_closing(fd);
     if (rename(TMP_DB_FILE, DB_FILE) == -1) {
+        close(fd);
         printf(M_ERR_DB_CREATE);
         return ERR_DB_FILE;
     }
+    close(fd);
 
     // Reopen the compressed file
     int new_fd = open(DB_FILE, O_RDWR);
@@ -458,8 +1013,12 @@ int compress_db(int fd)
         printf(M_ERR_DB_OPEN);
         return ERR_DB_FILE;
     }
+    if (paged_attach(new_fd) != NO_ERROR) {
+        printf(M_ERR_DB_READ);
+        close(new_fd);
+        return ERR_DB_FILE;
+    }
 
-    printf(M_DB_COMPRESSED_OK);
     return new_fd;
 }
 
@@ -470,7 +1029,8 @@ int compress_db(int fd)
  *
  *  This function validates that the id and gpa are in the allowable ranges
  *  as per the specifications.  It checks if the values are within the
- *  inclusive range using constents in db.h
+ *  inclusive range using constents in db.h, ids go up to MAX_STD_ID or, in
+ *  a paged database, up to MAX_PAGED_STD_ID
  *
  *  returns:    NO_ERROR       on success, both ID and GPA are in range
  *              EXIT_FAIL_ARGS if either ID or GPA is out of range
@@ -481,7 +1041,7 @@ int compress_db(int fd)
 int validate_range(int id, int gpa)
 {
 
-    if ((id < MIN_STD_ID) || (id > MAX_STD_ID))
+    if ((id < MIN_STD_ID) || (id > db_max_std_id()))
         return EXIT_FAIL_ARGS;
 
     if ((gpa < MIN_STD_GPA) || (gpa > MAX_STD_GPA))
@@ -503,60 +1063,258 @@ int validate_range(int id, int gpa)
  */
 void usage(char *exename)
 {
-    printf("usage: %s -[h|a|c|d|f|p|z] options.  Where:\n", exename);
+    printf("usage: %s -[h|a|c|d|f|p|u|z] options.  Where:\n", exename);
     printf("\t-h:  prints help\n");
-    printf("\t-a id first_name last_name gpa(as 3 digit int):  adds a student\n");
+    printf("\t-a id first_name last_name gpa(as 3 digit int):  adds a student,\n");
+    printf("\t             ids go up to %d, or %d in a paged database\n",
+           MAX_STD_ID, MAX_PAGED_STD_ID);
+    printf("\t-A avg|min|max|hist:  GPA aggregate over all students\n");
     printf("\t-c:  counts the records in the database\n");
-    printf("\t-d id:  deletes a student\n");
-    printf("\t-f id:  finds and prints a student in the database\n");
-    printf("\t-p:  prints all records in the student database\n");
-    printf("\t-x:  compress the database file [EXTRA CREDIT]\n");
+    printf("\t-d id [--punch]:  deletes a student, --punch releases its\n");
+    printf("\t             disk block at once if the block is now empty\n");
+    printf("\t-f id [id ...]|-:  finds and prints students in the database,\n");
+    printf("\t             many ids (or - for ids on stdin) are read in one batch\n");
+    printf("\t-g lo hi:  finds students with lo <= gpa <= hi (as 3 digit ints)\n");
+    printf("\t-L file|-:  bulk loads id,fname,lname,gpa rows from a file or stdin\n");
+    printf("\t-n lname [fname]:  finds students by name, lname alone is a prefix,\n");
+    printf("\t             with fname lname must match and fname is a prefix\n");
+    printf("\t-p [--threads N] [--format table|csv|tsv|jsonl]:  prints all records\n");
+    printf("\t             in the student database, with N threads reading and\n");
+    printf("\t             formatting id ranges, as a table or an export\n");
+    printf("\t-p --sort lname|fname|gpa[:desc]:  prints the records sorted by last\n");
+    printf("\t             name, first name or GPA, spilling sorted runs to\n");
+    printf("\t             temporary files past $%s bytes\n", SDB_SORT_MEM_ENV);
+    printf("\t-q expr [--count] [--format F] [--sort K]:  prints (or counts) the\n");
+    printf("\t             students matching expr, tests of id, gpa, fname or\n");
+    printf("\t             lname joined by and, or, not and ( ), for example\n");
+    printf("\t             \"gpa>=3.50 and lname^=Sm\" or \"id=100..199\"\n");
+    printf("\t-s:  prints the record count and GPA statistics\n");
+    printf("\t-t K:  prints the K students with the highest GPA\n");
+    printf("\t-u id [--fname X] [--lname Y] [--gpa N]:  changes fields of a\n");
+    printf("\t             student in place, writing only the changed bytes\n");
+    printf("\t-u file|-:  updates id,fname,lname,gpa rows from a file or stdin\n");
+    printf("\t             in one pass, empty fields are left as they are\n");
+    printf("\t-x:  compress the database file in place\n");
     printf("\t-z:  zero db file (remove all records)\n");
+    printf("\t--backend fd|mmap|mem|log:  reach the records with a syscall each,\n");
+    printf("\t             through a memory mapping, in process memory written\n");
+    printf("\t             back at exit, or append changes to log segments\n");
+    printf("\t             merged into the file at exit, mem and log lock the\n");
+    printf("\t             database while they run\n");
+    printf("\t             (default: $%s if set, else fd)\n", SDB_BACKEND_ENV);
+    printf("\t--mmap:  the same as --backend mmap\n");
+    printf("\t--cache:  keep record pages in a buffer pool in the process, the\n");
+    printf("\t             database is locked while the command (or a busy\n");
+    printf("\t             server) runs\n");
+    printf("\t--wal none|batched|per-op:  log changes ahead of writing them, the\n");
+    printf("\t             log is synced never, once per command or server round,\n");
+    printf("\t             or per change (default: $%s if set)\n", SDB_WAL_ENV);
+    printf("\t--convert direct|paged:  rewrite the database in the direct format\n");
+    printf("\t             (id at id * 64) or the paged one (any 32 bit id)\n");
+    printf("\t--snapshot file|-:  copy the database, holes and all, to a file or\n");
+    printf("\t             as a stream to stdout\n");
+    printf("\t--restore file|-:  replace the database with a snapshot from a file\n");
+    printf("\t             or a stream on stdin\n");
+    printf("\t--rebuild-stats:  recompute the header statistics from the records\n");
+    printf("\t--rebuild-index:  rebuild the indexes and GPA column from the records\n");
+    printf("\t--stats:  print syscall counts, bytes and time per storage primitive\n");
+    printf("\t             to stderr at exit (or as json with $%s=json)\n", SDB_STATS_ENV);
+    printf("\t--serve path:  serve operations for clients on a unix socket\n");
+    printf("\t--connect path:  run the operation on the server at path\n");
+    printf("\t             (default: $%s if set)\n", SDB_SOCKET_ENV);
 }
 
-// Welcome to main()
-int main(int argc, char *argv[])
-{
+/*
+ *  take_flag
+ *      *argc:  pointer to the argument count, decremented if flag is found
+ *      argv:   the argument vector
+ *      flag:   long option to look for, for example "--mmap"
+ *
+ *  Long options modify how an operation runs rather than select one, so
+ *  they may appear anywhere on the command line.  This removes the flag
+ *  from argv so the positional checks in main() are unaffected by it.
+ *
+ *  returns:  true if the flag was present
+ */
+bool take_flag(int *argc, char *argv[], const char *flag)
+{
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], flag) == 0) {
+            // shift the rest down, including the NULL at argv[argc]
+            memmove(&argv[i], &argv[i + 1], (*argc - i) * sizeof(char *));
+            (*argc)--;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ *  find_many
+ *      fd:     linux file descriptor
+ *      n:      number of words
+ *      words:  the ids of -f, or "-" alone to read them from stdin
+ *
+ *  The batched form of -f, see find_students().
+ *
+ *  returns:  the exit code for the shell, EXIT_FAIL_DB if any id was not
+ *            found, EXIT_FAIL_ARGS if a word is not an id
+ */
+static int find_many(int fd, int n, char *words[])
+{
+    int *ids;
+    bool from_stdin = (n == 1 && strcmp(words[0], "-") == 0);
+
+    n = read_id_list(words, n, from_stdin ? stdin : NULL, &ids);
+    if (n == ERR_DB_OP)
+        return EXIT_FAIL_ARGS;
+    if (n < 0) {
+        printf(M_ERR_DB_READ);
+        return EXIT_FAIL_DB;
+    }
+
+    int found = find_students(fd, ids, n, MULTI_IO_AUTO);
+    free(ids);
+    return (found == n) ? EXIT_OK : EXIT_FAIL_DB;
+}
+
+/*
+ *  run_op
+ *      *pfd:  file descriptor of the open database, updated when the
+ *             operation reopens the file (-x and -z)
+ *      argc:  argument count, long options already removed
+ *      argv:  argument vector, argv[1] selects the operation
+ *
+ *  Runs a single database operation described by a command line.  This is
+ *  everything main() does after opening the database, split out so that
+ *  the server mode in sdb_server.c can run client requests against the
+ *  database it keeps open.
+ *
+ *  returns:  the exit code for the shell, see EXIT_* in sdbsc.h
+ *
+ *  console:  whatever the selected operation prints
+ */
+int run_op(int *pfd, int argc, char *argv[])
+{
     char opt;      // user selected option
-    int fd;        // file descriptor of database files
+    int fd = *pfd; // file descriptor of database files
     int rc;        // return code from various operations
     int exit_code; // exit code to shell
     int id;        // userid from argv[2]
     int gpa;       // gpa from argv[5]
+    int lo, hi;    // gpa range from argv[2] and argv[3] for -g
+    int nthreads;  // worker threads for -p --threads
+    int fmt;       // output format for -p --format
+    int old_fd;    // the database -z replaces
+    bool remap;    // -z with a storage backend attached
+    bool paged;    // -z of a paged database
+    bool cached;   // -z with the buffer pool attached
 
     // space for a student structure which we will get back from
     // some of the functions we will be writing such as get_student(),
     // and print_student().
     student_t student = {0};
 
+    // --punch applies to this operation only (a server runs many)
+    set_punch_on_delete(take_flag(&argc, argv, "--punch"));
+    char *threads = take_opt(&argc, argv, "--threads");
+    char *format = take_opt(&argc, argv, "--format");
+    char *sort_spec = take_opt(&argc, argv, "--sort");
+    bool query_count = take_flag(&argc, argv, "--count");
+    char *convert = take_opt(&argc, argv, "--convert");
+    char *snapshot = take_opt(&argc, argv, "--snapshot");
+    char *restore = take_opt(&argc, argv, "--restore");
+    char *upd_fname = take_opt(&argc, argv, "--fname");
+    char *upd_lname = take_opt(&argc, argv, "--lname");
+    char *upd_gpa = take_opt(&argc, argv, "--gpa");
+
+    // --restore replaces the database before anything else runs on it
+    if (restore != NULL)
+    {
+        rc = restore_db(fd, restore);
+        if (rc == ERR_DB_OP)
+            return EXIT_FAIL_DB;
+        if (rc < 0)
+        {
+            *pfd = -1;
+            return EXIT_FAIL_DB;
+        }
+        *pfd = fd = rc;
+        if (argc < 2 && convert == NULL && snapshot == NULL)
+            return EXIT_OK;
+    }
+
+    // --convert may be given alone or ahead of another operation
+    if (convert != NULL)
+    {
+        if (strcmp(convert, "direct") != 0 && strcmp(convert, "paged") != 0)
+        {
+            printf(M_ERR_CONVERT_FMT, convert);
+            return EXIT_FAIL_ARGS;
+        }
+        rc = convert_db(fd, strcmp(convert, "paged") == 0 ?
+                            DB_HDR_VERSION_PAGED : DB_HDR_VERSION);
+        if (rc == ERR_DB_OP)
+            return EXIT_FAIL_DB;
+        if (rc < 0)
+        {
+            *pfd = -1;
+            return EXIT_FAIL_DB;
+        }
+        *pfd = fd = rc;
+        if (argc < 2 && snapshot == NULL)
+            return EXIT_OK;
+    }
+
+    // --snapshot copies the database as it is after the two above
+    if (snapshot != NULL)
+    {
+        if (snapshot_db(fd, snapshot) != NO_ERROR)
+            return EXIT_FAIL_DB;
+        if (argc < 2)
+            return EXIT_OK;
+    }
+
+    // --rebuild-stats may be given alone or ahead of another operation
+    if (take_flag(&argc, argv, "--rebuild-stats"))
+    {
+        rc = rebuild_stats(fd);
+        if (rc < 0)
+        {
+            printf(M_ERR_DB_READ);
+            return EXIT_FAIL_DB;
+        }
+        printf(M_DB_STATS_REBUILT, rc);
+        if (argc < 2)
+            return EXIT_OK;
+    }
+
+    // and so may --rebuild-index, which rebuilds every index and column
+    if (take_flag(&argc, argv, "--rebuild-index"))
+    {
+        rc = sidecars_rebuild(fd);
+        if (rc < 0)
+        {
+            printf(M_ERR_DB_WRITE);
+            return EXIT_FAIL_DB;
+        }
+        printf(M_NAME_IDX_REBUILT, rc);
+        if (argc < 2)
+            return EXIT_OK;
+    }
+
     // This function must have at least one arg, and the arg must start
     // with a dash
     if ((argc < 2) || (*argv[1] != '-'))
     {
         usage(argv[0]);
-        exit(1);
+        return 1;
     }
 
     // The option is the first character after the dash for example
     //-h -a -c -d -f -p -x -z
     opt = (char)*(argv[1] + 1); // get the option flag
 
-    // handle the help flag and then exit normally
-    if (opt == 'h')
-    {
-        usage(argv[0]);
-        exit(EXIT_OK);
-    }
-
-    // now lets open the file and continue if there is no error
-    // note we are not truncating the file using the second
-    // parameter
-    fd = open_db(DB_FILE, false);
-    if (fd < 0)
-    {
-        exit(EXIT_FAIL_DB);
-    }
-
     // set rc to the return code of the operation to ensure the program
     // use that to determine the proper exit_code.  Look at the header
     // sdbsc.h for expected values.
@@ -564,6 +1322,28 @@ int main(int argc, char *argv[])
     exit_code = EXIT_OK;
     switch (opt)
     {
+    case 'h':
+        usage(argv[0]);
+        break;
+
+    case 'A':
+        //   arv[0] arv[1]             arv[2]
+        // prog_name     -A  avg|min|max|hist
+        //-----------------------------------
+        // example:  prog_name -A avg
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = print_aggregate(fd, argv[2]);
+        if (rc == ERR_DB_OP)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
     case 'a':
         //   arv[0] arv[1]  arv[2]      arv[3]    arv[4]  arv[5]
         // prog_name     -a      id  first_name last_name     gpa
@@ -627,14 +1407,24 @@ int main(int argc, char *argv[])
         // prog_name     -f      id
         //-------------------------
         // example:  prog_name -f 100
-        if (argc != 3)
+        //           prog_name -f 100 101 205
+        //           prog_name -f - < ids.txt
+        if (argc < 3)
         {
             usage(argv[0]);
             exit_code = EXIT_FAIL_ARGS;
             break;
         }
+        if (argc > 3 || strcmp(argv[2], "-") == 0)
+        {
+            exit_code = find_many(fd, argc - 2, &argv[2]);
+            break;
+        }
         id = atoi(argv[2]);
-        rc = get_student(fd, id, &student);
+        rc = lock_record(fd, id, F_RDLCK);
+        if (rc == NO_ERROR)
+            rc = get_student(fd, id, &student);
+        unlock_record(fd, id);
 
         switch (rc)
         {
@@ -652,12 +1442,239 @@ int main(int argc, char *argv[])
         }
         break;
 
+    case 'g':
+        //   arv[0] arv[1] arv[2] arv[3]
+        // prog_name     -g     lo     hi
+        //-------------------------------
+        // example:  prog_name -g 350 400
+        if (argc != 4)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        lo = atoi(argv[2]);
+        hi = atoi(argv[3]);
+        if (lo < MIN_STD_GPA || hi > MAX_STD_GPA || lo > hi)
+        {
+            printf(M_ERR_GPA_RNG);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = find_by_gpa_range(fd, lo, hi);
+        if (rc <= 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'L':
+        //   arv[0] arv[1]  arv[2]
+        // prog_name     -L  file|-
+        //-------------------------
+        // example:  prog_name -L students.csv
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = bulk_load(fd, argv[2]);
+        if (rc == ERR_DB_OP)
+            exit_code = EXIT_FAIL_ARGS;
+        else if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'u':
+        //   arv[0] arv[1] arv[2]
+        // prog_name     -u     id [--fname X] [--lname Y] [--gpa N]
+        // prog_name     -u file|-
+        //-------------------------------------------------------------
+        // example:  prog_name -u 100 --gpa 372
+        //           prog_name -u - < gpas.csv
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        if (upd_fname == NULL && upd_lname == NULL && upd_gpa == NULL)
+        {
+            if (argv[2][strspn(argv[2], "0123456789")] == '\0')
+            {
+                printf(M_ERR_UPD_NONE);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = bulk_update(fd, argv[2]);
+            if (rc == ERR_DB_OP)
+                exit_code = EXIT_FAIL_ARGS;
+            else if (rc < 0)
+                exit_code = EXIT_FAIL_DB;
+            break;
+        }
+        id = atoi(argv[2]);
+        gpa = upd_gpa != NULL ? atoi(upd_gpa) : -1;
+        if (upd_gpa != NULL && (gpa < MIN_STD_GPA || gpa > MAX_STD_GPA))
+        {
+            printf(M_ERR_UPD_GPA);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = update_student(fd, id, upd_fname, upd_lname, gpa);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'n':
+        //   arv[0] arv[1] arv[2]  arv[3]
+        // prog_name     -n  lname [fname]
+        //--------------------------------
+        // example:  prog_name -n Doe J
+        if (argc != 3 && argc != 4)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = find_by_name(fd, argv[2], argc == 4 ? argv[3] : NULL);
+        if (rc <= 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
     case 'p':
         //    arv[0] arv[1]
         // prog_name     -p
         //-----------------
-        // example:  prog_name -p
-        rc = print_db(fd);
+        // example:  prog_name -p --threads 4 --format csv
+        //           prog_name -p --sort gpa:desc
+        fmt = (format == NULL) ? FMT_TABLE : fmt_parse(format);
+        if (fmt < 0)
+        {
+            printf(M_ERR_FORMAT, format);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        if (sort_spec != NULL)
+        {
+            int sort = sort_parse(sort_spec);
+            if (sort < 0)
+            {
+                printf(M_ERR_SORT, sort_spec);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            if (threads != NULL)
+            {
+                printf(M_ERR_SORT_THREADS);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = print_db_sorted(fd, fmt, sort, NULL);
+        }
+        else if (threads == NULL)
+        {
+            rc = print_db_fmt(fd, fmt);
+        }
+        else
+        {
+            nthreads = atoi(threads);
+            if (nthreads < 1 || nthreads > PAR_MAX_THREADS)
+            {
+                printf(M_ERR_THREADS, PAR_MAX_THREADS);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = print_db_parallel(fd, nthreads, fmt);
+        }
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 'q':
+        //   arv[0] arv[1]  arv[2]
+        // prog_name     -q    expr
+        //-------------------------
+        // example:  prog_name -q "gpa>=350 and lname^=Sm" --format csv
+        //           prog_name -q "id=1000..1999" --count
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        fmt = (format == NULL) ? FMT_TABLE : fmt_parse(format);
+        if (fmt < 0)
+        {
+            printf(M_ERR_FORMAT, format);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        sdb_query_t query;
+        const char *err_at;
+        if (query_compile(argv[2], &query, &err_at) != NO_ERROR)
+        {
+            printf(M_ERR_QUERY, *err_at ? err_at : "the end");
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        if (query_count && (format != NULL || sort_spec != NULL))
+        {
+            printf(M_ERR_QUERY_ARGS);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        if (query_count)
+        {
+            rc = count_db_where(fd, &query);
+        }
+        else if (sort_spec != NULL)
+        {
+            int sort = sort_parse(sort_spec);
+            if (sort < 0)
+            {
+                printf(M_ERR_SORT, sort_spec);
+                exit_code = EXIT_FAIL_ARGS;
+                break;
+            }
+            rc = print_db_sorted(fd, fmt, sort, &query);
+        }
+        else
+        {
+            rc = print_db_where(fd, fmt, &query);
+        }
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 's':
+        //    arv[0] arv[1]
+        // prog_name     -s
+        //-----------------
+        // example:  prog_name -s
+        rc = print_stats(fd);
+        if (rc < 0)
+            exit_code = EXIT_FAIL_DB;
+        break;
+
+    case 't':
+        //   arv[0] arv[1] arv[2]
+        // prog_name     -t      K
+        //-------------------------
+        // example:  prog_name -t 100
+        if (argc != 3)
+        {
+            usage(argv[0]);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        id = atoi(argv[2]);     // K, the number of students
+        if (id < 1)
+        {
+            printf(M_ERR_TOP_CNT);
+            exit_code = EXIT_FAIL_ARGS;
+            break;
+        }
+        rc = find_top_gpa(fd, id);
         if (rc < 0)
             exit_code = EXIT_FAIL_DB;
         break;
@@ -682,9 +1699,30 @@ int main(int argc, char *argv[])
         // example:  prog_name -x
         // HINT:  close the db file, we already have fd
         //       and reopen db indicating truncate=true
-        close(fd);
+        // the old fd keeps the whole file locked until it is emptied, a
+        // paged database stays paged
+        remap = backend_attached(fd);
+        paged = paged_db(fd);
+        cached = bufpool_attached(fd);
+        if (lock_db(fd, F_WRLCK) != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            exit_code = EXIT_FAIL_DB;
+            break;
+        }
+        backend_detach();
+        bufpool_detach();       // its records are about to go anyway
+        sidecars_drop();
+        old_fd = fd;
         fd = open_db(DB_FILE, true);
-        if (fd < 0)
+        if (fd >= 0 && paged && paged_format(fd) != NO_ERROR) {
+            printf(M_ERR_DB_WRITE);
+            close(fd);
+            fd = -1;
+        }
+        unlock_db(old_fd);
+        close(old_fd);
+        if (fd < 0 || (remap && backend_attach(fd) != NO_ERROR) ||
+            (cached && bufpool_attach(fd) != NO_ERROR))
         {
             exit_code = EXIT_FAIL_DB;
             break;
@@ -697,8 +1735,169 @@ int main(int argc, char *argv[])
         exit_code = EXIT_FAIL_ARGS;
     }
 
+    *pfd = fd;
+    return exit_code;
+}
+
+/*
+ *  take_opt
+ *      *argc:  pointer to the argument count, reduced if the option is found
+ *      argv:   the argument vector
+ *      flag:   long option to look for, for example "--serve"
+ *
+ *  Like take_flag() for a long option that is followed by a value.  Both
+ *  words are removed from argv.  A flag without a value is left in place
+ *  so that main() rejects the command line with a usage message.
+ *
+ *  returns:  the option's value, or NULL if the option is not present
+ */
+char *take_opt(int *argc, char *argv[], const char *flag)
+{
+    for (int i = 1; i + 1 < *argc; i++) {
+        if (strcmp(argv[i], flag) == 0) {
+            char *value = argv[i + 1];
+            memmove(&argv[i], &argv[i + 2], (*argc - i - 1) * sizeof(char *));
+            *argc -= 2;
+            return value;
+        }
+    }
+    return NULL;
+}
+
+// Welcome to main(), benchmarks build without it to call the functions above
+#ifndef SDBSC_NO_MAIN
+int main(int argc, char *argv[])
+{
+    int fd;        // file descriptor of database files
+    int exit_code; // exit code to shell
+
+    // pull out the long options before looking at the operation
+    bool use_mmap = take_flag(&argc, argv, "--mmap");
+    char *backend_name = take_opt(&argc, argv, "--backend");
+    bool use_cache = take_flag(&argc, argv, "--cache");
+    bool use_stats = take_flag(&argc, argv, "--stats");
+    char *wal_name = take_opt(&argc, argv, "--wal");
+    char *serve_path = take_opt(&argc, argv, "--serve");
+    char *connect_path = take_opt(&argc, argv, "--connect");
+
+    if (connect_path == NULL)
+        connect_path = getenv(SDB_SOCKET_ENV);
+    if (wal_name == NULL)
+        wal_name = getenv(SDB_WAL_ENV);
+    if (backend_name == NULL)
+        backend_name = use_mmap ? "mmap" : getenv(SDB_BACKEND_ENV);
+
+    // --stats alone gives the table, the variable may ask for json
+    char *stats_name = getenv(SDB_STATS_ENV);
+    if (stats_name != NULL && *stats_name != '\0')
+    {
+        int mode = instr_parse(stats_name);
+        if (mode < 0)
+        {
+            printf(M_ERR_INSTR_MODE, stats_name);
+            exit(EXIT_FAIL_ARGS);
+        }
+        instr_start(mode);
+    }
+    else if (use_stats)
+    {
+        instr_start(INSTR_TABLE);
+    }
+
+    int wal_level = -1;    // no write-ahead log
+    if (wal_name != NULL && (wal_level = wal_parse_level(wal_name)) < 0)
+    {
+        printf(M_ERR_WAL_LEVEL, wal_name);
+        exit(EXIT_FAIL_ARGS);
+    }
+
+    // --mmap is the same as --backend mmap
+    if (backend_name != NULL && *backend_name != '\0' &&
+        backend_select(backend_name) != NO_ERROR)
+    {
+        printf(M_ERR_BACKEND, backend_name);
+        exit(EXIT_FAIL_ARGS);
+    }
+
+    // server mode keeps the database open and runs operations for clients
+    if (serve_path != NULL)
+        exit(serve_db(serve_path, use_cache, wal_level));
+
+    // This function must have at least one arg, and the arg must start
+    // with a dash
+    if ((argc < 2) || (*argv[1] != '-'))
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    // handle the help flag and then exit normally
+    if (argv[1][1] == 'h')
+    {
+        usage(argv[0]);
+        exit(EXIT_OK);
+    }
+
+    // client mode forwards the operation to a running server
+    if (connect_path != NULL)
+        exit(client_run(connect_path, argc, argv));
+
+    // now lets open the file and continue if there is no error
+    // note we are not truncating the file using the second
+    // parameter
+    fd = open_db(DB_FILE, false);
+    if (fd < 0)
+    {
+        exit(EXIT_FAIL_DB);
+    }
+
+    if (backend_attach(fd) != NO_ERROR)
+    {
+        printf(M_ERR_DB_OPEN);
+        close(fd);
+        exit(EXIT_FAIL_DB);
+    }
+
+    if (use_cache && bufpool_attach(fd) != NO_ERROR)
+    {
+        printf(M_ERR_DB_OPEN);
+        backend_detach();
+        close(fd);
+        exit(EXIT_FAIL_DB);
+    }
+
+    if (wal_level >= 0 && wal_open(wal_level) != NO_ERROR)
+    {
+        printf(M_ERR_WAL_OPEN);
+        bufpool_detach();
+        backend_detach();
+        close(fd);
+        exit(EXIT_FAIL_DB);
+    }
+
+    INSTR_START(t_op);
+    exit_code = run_op(&fd, argc, argv);
+    INSTR_STOP(INSTR_OP, t_op, 0);
+
+    // a batched log is synced once, here, for the whole command
+    if (wal_close(fd) != NO_ERROR)
+    {
+        printf(M_ERR_WAL_SYNC);
+        exit_code = EXIT_FAIL_DB;
+    }
+
+    // and the buffer pool or the backend writes back what it still holds,
+    // the two are never attached together
+    if (bufpool_detach() != NO_ERROR || backend_detach() != NO_ERROR)
+    {
+        printf(M_ERR_DB_WRITE);
+        exit_code = EXIT_FAIL_DB;
+    }
+
     // dont forget to close the file before exiting, and setting the
     // proper exit code - see the header file for expected values
     close(fd);
+    instr_report();
     exit(exit_code);
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
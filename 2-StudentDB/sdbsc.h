@@ -1,28 +1,404 @@
 #ifndef __SDB_H__
+    #define __SDB_H__
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include "db.h" //get student record type
 
 //prototypes for functions go below for this assignment
 int open_db(char *dbFile, bool should_truncate);
+bool db_replaced(int fd);
+int lock_current(int fd, int id);
 int add_student(int fd, int id, char *fname, char *lname, int gpa);
 int get_student(int fd, int id, student_t *s);
 int del_student(int fd, int id);
+int update_student(int fd, int id, char *fname, char *lname, int gpa);
 int compress_db(int fd);
+int convert_db(int fd, int version);
 void print_student(student_t *s);
 int validate_range(int id, int gpa);
 int count_db_records(int fd);
 int print_db(int fd);
 void usage(char *);
 
+//record access helpers shared by the functions above and the modules below
+int read_record(int fd, int id, student_t *s);
+int write_record(int fd, int id, const student_t *s);
+int patch_record(int fd, const student_t *old, const student_t *upd);
+
+//prototypes for the paged file format in sdb_paged.c
+#define PG_SIZE         4096                            //bytes in a page
+#define PG_RECS         (PG_SIZE / (int)sizeof(student_t))  //records in a data page
+#define PG_DIR_ENTRIES  (PG_SIZE / (int)sizeof(uint32_t))   //entries in a directory page
+#define PG_CHUNK_PAGES  (SCAN_BUFF_RECS / PG_RECS)      //data pages in a scan chunk
+
+//where a walk over the chunks of a paged database is, see paged_next_chunk()
+typedef struct paged_cursor {
+    int ri;                         //root entry whose directory is in dir, or -1
+    uint32_t dir[PG_DIR_ENTRIES];
+} paged_cursor_t;
+
+typedef struct paged_build paged_build_t;
+
+int paged_attach(int fd);
+void paged_detach(void);
+bool paged_db(int fd);
+int db_max_std_id(void);
+off_t paged_slot_offset(int fd, int id, bool alloc);
+void paged_cursor_init(int fd, paged_cursor_t *cur);
+int paged_next_chunk(int fd, paged_cursor_t *cur, int chunk);
+int paged_read_chunk(int fd, int chunk, student_t *recs);
+int paged_compact(int fd);
+paged_build_t *paged_build_begin(int fd);
+int paged_build_add(paged_build_t *b, const student_t *s);
+int paged_build_end(paged_build_t *b, const db_header_t *h);
+int paged_format(int fd);
+
+//scan iterator in sdb_scan.c, it returns the students in id order reading
+//only the data extents of the sparse database file, or only the allocated
+//pages of a paged one
+#define SCAN_BUFF_RECS  1024        //records read per pread()
+
+typedef struct db_scan {
+    int fd;
+    bool failed;                    //set if the scan stopped on an I/O error
+    off_t pos;                      //file offset of the next unread slot
+    off_t data_end;                 //end of the data extent being read
+    off_t file_end;                 //end of the last whole record
+    bool paged;                     //reading a paged database by chunks
+    int chunk;                      //paged: the next chunk to look at
+    paged_cursor_t cursor;          //paged: finds the allocated chunks
+    int lo_slot;                    //first slot that may be returned
+    int hi_slot;                    //last slot that may be returned
+    int first_slot;                 //slot number of recs[0]
+    int n;                          //slots available in recs
+    int i;                          //next slot in recs to look at
+    const student_t *recs;          //buff, or the mapping with --mmap
+    uint64_t live[SCAN_BUFF_RECS / 64];     //bit i set if recs[i] is a student
+    student_t buff[SCAN_BUFF_RECS];
+} db_scan_t;
+
+void scan_open(db_scan_t *sc, int fd);
+bool scan_next(db_scan_t *sc, student_t *s);
+void scan_limit(db_scan_t *sc, int lo, int hi);
+
+//prototypes for the database header and statistics in sdb_stats.c
+void stats_hdr_init(db_header_t *h);
+void stats_hdr_add(db_header_t *h, const student_t *s);
+void stats_hdr_del(db_header_t *h, int gpa);
+int stats_load(int fd, db_header_t *h);
+int stats_save(int fd, const db_header_t *h);
+int stats_init(int fd);
+int stats_scan(int fd, db_header_t *h);
+int rebuild_stats(int fd);
+int print_stats(int fd);
+
+//prototypes for in-place compaction in sdb_compact.c
+int compact_in_place(int fd);
+int punch_hole(int fd, off_t off, off_t len);
+int punch_record_block(int fd, int id);
+long long db_disk_usage(int fd);
+void set_punch_on_delete(bool val);
+bool punch_on_delete(void);
+
+//prototypes for the name index in sdb_nameidx.c
+int rebuild_name_idx(int fd);
+int find_by_name(int fd, char *lname, char *fname);
+void name_idx_note_add(const student_t *s);
+void name_idx_note_del(const student_t *s);
+void drop_name_idx(void);
+
+//header of the mmap'd sidecar files, see sdb_sidecar.c
+typedef struct sidecar_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t unused;
+    uint32_t count;                 //students covered, must match the db
+    uint32_t unused2;
+} sidecar_hdr_t;
+
+void *sidecar_map(const char *path, size_t size, uint32_t magic,
+                  uint16_t version, bool create);
+void sidecar_unmap(void *h, size_t size);
+void *sidecar_open_current(int fd, const char *path, size_t size,
+                           uint32_t magic, uint16_t version,
+                           int (*rebuild)(int fd));
+void sidecars_note_add(const student_t *s);
+void sidecars_note_del(const student_t *s);
+int sidecars_rebuild(int fd);
+bool sidecars_cover_ids(int fd);
+void sidecars_drop(void);
+
+//prototypes for the GPA index in sdb_gpaidx.c
+int rebuild_gpa_idx(int fd);
+int find_by_gpa_range(int fd, int lo, int hi);
+int find_top_gpa(int fd, int k);
+void gpa_idx_note_add(const student_t *s);
+void gpa_idx_note_del(const student_t *s);
+void drop_gpa_idx(void);
+
+//prototypes for the GPA column in sdb_colgpa.c
+int rebuild_colgpa(int fd);
+int print_aggregate(int fd, const char *what);
+void colgpa_note_add(const student_t *s);
+void colgpa_note_del(const student_t *s);
+void drop_colgpa(void);
+
+//SIMD kernels in sdb_simd.c, the GPA kernels take a gpa column and live
+//bitmap of nwords * 64 slots, live_slots() builds such a bitmap from records
+#define SDB_SIMD_ENV    "SDBSC_SIMD"    //forces scalar, sse2 or avx2
+
+typedef struct simd_kernels {
+    const char *name;
+    int64_t (*gpa_sum)(const int32_t *gpa, const uint64_t *live, size_t nwords);
+    int (*gpa_min)(const int32_t *gpa, const uint64_t *live, size_t nwords);
+    int (*gpa_max)(const int32_t *gpa, const uint64_t *live, size_t nwords);
+    void (*gpa_hist)(const int32_t *gpa, const uint64_t *live, size_t nwords,
+                     uint32_t *hist);
+    //sets bit i of bits if recs[i] is not an empty record, n <= SCAN_BUFF_RECS
+    void (*live_slots)(const student_t *recs, int n, uint64_t *bits);
+} simd_kernels_t;
+
+const simd_kernels_t *simd_kernels(void);
+const simd_kernels_t *simd_kernels_named(const char *name);
+int simd_live_count(const uint64_t *live, size_t nwords);
+
+//storage backends, read_record() and write_record() reach the records
+//through the one attached to the database (see sdb_backend.c)
+#define SDB_BACKEND_ENV "SDBSC_BACKEND" //backend when --backend is absent
+
+typedef struct sdb_backend {
+    const char *name;
+    bool exclusive;                         //holds the whole file lock while attached
+    int (*open)(int fd);                    //attach to an open database
+    int (*close)(void);                     //write back and detach
+    bool (*attached)(int fd);
+    int (*read_rec)(int fd, int id, student_t *s);
+    int (*write_rec)(int fd, int id, const student_t *s);
+    student_t *(*scan)(size_t *nslots);     //the slots if held in memory, or NULL
+    int (*sync)(int fd);                    //write changes held in memory to the file
+} sdb_backend_t;
+
+extern const sdb_backend_t fd_backend;
+extern const sdb_backend_t mmap_backend;
+extern const sdb_backend_t mem_backend;
+extern const sdb_backend_t log_backend;
+
+int backend_select(const char *name);
+bool backend_exclusive(void);
+const sdb_backend_t *backend_of(int fd);
+int backend_attach(int fd);
+int backend_detach(void);
+bool backend_attached(int fd);
+student_t *backend_slots(int fd, size_t *nslots);
+int backend_sync(int fd);
+
+//prototypes for the log-structured backend in sdb_logdb.c
+int logdb_recover(int fd);
+void logdb_discard(void);
+
+//prototypes for the optional mmap storage backend in sdb_mmap.c
+int mmap_db_attach(int fd);
+int mmap_db_detach(void);
+bool mmap_db_attached(int fd);
+student_t *mmap_db_slot(int id, bool grow);
+
+//prototypes for the buffer pool in sdb_bufpool.c
+#define BUFPOOL_PAGE_RECS   64      //records in a pool page, 4 KB
+#define BUFPOOL_FRAMES      256     //pages held, 1 MB
+#define BUFPOOL_HOLD_ROUNDS 64      //server rounds the pool may hold the file
+int bufpool_attach(int fd);
+int bufpool_detach(void);
+bool bufpool_attached(int fd);
+int bufpool_flush(int fd);
+int bufpool_read(int id, student_t *s);
+int bufpool_write(int id, const student_t *s);
+
+//row formatting and buffered output in sdb_format.c
+#define FMT_TABLE       0           //the STUDENT_PRINT_FMT_STRING table
+#define FMT_CSV         1
+#define FMT_TSV         2
+#define FMT_JSONL       3
+#define FMT_ROW_MAX     512         //bound on one formatted row
+#define OUT_BUFF_SZ     (256 * 1024)
+
+typedef struct out_buf {
+    char *buff;
+    size_t len;
+    bool failed;                    //a write() failed, output is dropped
+} out_buf_t;
+
+int fmt_parse(const char *name);
+size_t fmt_header(char *dst, int fmt);
+size_t fmt_row(char *dst, const student_t *s, int fmt);
+void out_begin(out_buf_t *o);
+void out_bytes(out_buf_t *o, const char *p, size_t len);
+void out_row(out_buf_t *o, const student_t *s, int fmt);
+int out_flush(out_buf_t *o);
+
+//prototypes for the printers that take an output format
+#define PAR_MAX_THREADS 64
+int print_db_fmt(int fd, int fmt);
+int print_db_parallel(int fd, int nthreads, int fmt);
+
+//prototypes for the query predicates in sdb_query.c
+#define QUERY_MAX_OPS   64          //instructions in a compiled query
+
+typedef struct query_op {
+    uint8_t code;                   //test, and, or, not
+    uint8_t field;                  //the field a test looks at
+    bool neg;                       //the test is negated
+    bool prefix;                    //a name test matches a prefix
+    int32_t lo;                     //a number test: lo <= field <= hi
+    int32_t hi;
+    uint32_t len;                   //a name test: the length of str
+    char str[32];
+} query_op_t;
+
+typedef struct sdb_query {
+    int n;                          //instructions in ops
+    query_op_t ops[QUERY_MAX_OPS];  //postfix, run on a stack of results
+    int id_lo;                      //the ids the query can match, the
+    int id_hi;                      //scan is limited to them
+} sdb_query_t;
+
+int query_compile(const char *text, sdb_query_t *q, const char **err_at);
+bool query_match(const sdb_query_t *q, const student_t *s);
+
+//the print and the count of the students matching a query, in sdbsc.c
+int print_db_where(int fd, int fmt, const sdb_query_t *q);
+int count_db_where(int fd, const sdb_query_t *q);
+
+//prototypes for the sorted print in sdb_sort.c
+#define SDB_SORT_MEM_ENV "SDBSC_SORT_MEM"   //bytes sorted in memory before spilling
+#define SORT_LNAME      0           //last name, then first name
+#define SORT_FNAME      1           //first name, then last name
+#define SORT_GPA        2
+#define SORT_DESC       0x100       //or'ed in for :desc
+int sort_parse(const char *spec);
+int print_db_sorted(int fd, int fmt, int sort, const sdb_query_t *q);
+
+//prototypes for the fcntl() record locks in sdb_lock.c
+int lock_range(int fd, off_t start, off_t len, short type);
+int trylock_range(int fd, off_t start, off_t len, short type);
+int lock_record(int fd, int id, short type);
+void unlock_record(int fd, int id);
+int lock_db(int fd, short type);
+void unlock_db(int fd);
+void unlock_db_closing(int fd);
+
+//prototypes for the write-ahead log in sdb_wal.c
+#define SDB_WAL_ENV     "SDBSC_WAL"     //durability level when --wal is absent
+#define WAL_NONE        0               //logged, never synced
+#define WAL_BATCHED     1               //synced by wal_commit() (group commit)
+#define WAL_PER_OP      2               //synced before every change is applied
+
+int wal_parse_level(const char *name);
+int wal_open(int level);
+int wal_apply(int fd, int id, const student_t *rec, const db_header_t *hdr);
+int wal_commit(void);
+int wal_checkpoint(int fd);
+bool wal_needs_checkpoint(bool idle);
+bool wal_active(void);
+int wal_close(int fd);
+void wal_discard(void);
+int wal_recover(int fd);
+uint32_t sdb_crc32(const void *data, size_t len);
+
+//prototypes for batched lookups in sdb_multiget.c
+#define MULTI_IO_AUTO       0       //io_uring, else a pool of pread() threads
+#define MULTI_IO_URING      1
+#define MULTI_IO_PREAD      2
+#define MULTI_QUEUE_DEPTH   64      //io_uring reads in flight
+#define MULTI_THREADS       8       //pread() threads without io_uring
+int find_students(int fd, const int *ids, int n, int io);
+int read_id_list(char *words[], int n, FILE *in, int **ids);
+
+//instrumentation in sdb_instr.c, the hooks are compiled in with SDBSC_INSTR
+//(make INSTR=1) and count only while --stats or $SDBSC_STATS is in effect
+#define SDB_STATS_ENV   "SDBSC_STATS"   //table or json, the summary format
+#define INSTR_TABLE     0
+#define INSTR_JSON      1
+
+enum {
+    INSTR_OP,           //a whole operation, run_op()
+    INSTR_SEEK,         //lseek() of a record or of a scan
+    INSTR_READ,         //read() or pread() of records
+    INSTR_WRITE,        //write() or pwrite() of records
+    INSTR_LOCK,         //fcntl() record and file locks
+    INSTR_LOG,          //write() to the write-ahead log
+    INSTR_SYNC,         //fdatasync() of the log or the database
+    INSTR_OUT,          //write() of console output
+    INSTR_FORMAT,       //formatting a row, no syscall
+    INSTR_SCANNED,      //slots a scan looked at, counted only
+    INSTR_LIVE,         //students among them
+    INSTR_NEVENTS
+};
+
+#ifdef SDBSC_INSTR
+extern bool instr_enabled;
+long long instr_clock(void);
+void instr_note(int e, long long t0, long long bytes);
+void instr_count(int e, long long n);
+#define INSTR_START(t)          long long t = instr_enabled ? instr_clock() : 0
+#define INSTR_STOP(e, t, bytes) do { if (instr_enabled) instr_note(e, t, bytes); } while (0)
+#define INSTR_COUNT(e, n)       do { if (instr_enabled) instr_count(e, n); } while (0)
+#else
+#define INSTR_START(t)          do { } while (0)
+#define INSTR_STOP(e, t, bytes) do { } while (0)
+#define INSTR_COUNT(e, n)       do { } while (0)
+#endif
+
+int instr_parse(const char *name);
+void instr_start(int mode);
+void instr_report(void);
+
+//prototypes for snapshots in sdb_snapshot.c
+int snapshot_db(int fd, const char *path);
+int restore_db(int fd, const char *path);
+
+//prototypes for bulk loading and updating in sdb_load.c
+int bulk_load(int fd, char *path);
+int bulk_update(int fd, char *path);
+
+//runs one command line against an open database, used by main() and the
+//server, returns the exit code
+int run_op(int *pfd, int argc, char *argv[]);
+
+//long option helpers, they remove the option from argv when found
+bool take_flag(int *argc, char *argv[], const char *flag);
+char *take_opt(int *argc, char *argv[], const char *flag);
+
+//server and thin client prototypes in sdb_server.c
+int serve_db(char *sock_path, bool use_cache, int wal_level);
+int client_run(char *sock_path, int argc, char *argv[]);
+
+//client/server protocol over a unix domain socket.  Every message starts
+//with a fixed header followed by a payload:
+//
+//  request:   uint32_t len, then len bytes holding the client's argv
+//             strings, each NUL terminated
+//  response:  int32_t exit_code, uint32_t len, then len bytes of console
+//             output produced by the operation
+//
+//a connection may carry any number of requests, each answered in order
+#define SDB_SOCKET_ENV      "SDBSC_SOCKET"  //default socket for clients
+#define SDB_MAX_REQ_SZ      (1024*64)       //largest request payload
+#define SDB_LISTEN_BACKLOG  64
+
 //error codes to be returned from individual functions
 // NO_ERROR is returned if there are no errors
 // ERR_DB_FILE is returned if there is are any issues with the database file itself
 // ERR_DB_OP is returned if an operation did not work aka add or delete a student
 // SRCH_NOT_FOUND is returned if the student is not found (get_student, and del_student)
+// ERR_DB_COMM is returned if the client/server socket connection fails
 #define NO_ERROR        0
 #define ERR_DB_FILE     -1
 #define ERR_DB_OP       -2
 #define SRCH_NOT_FOUND  -3
+#define ERR_DB_COMM     -4
 #define NOT_IMPLEMENTED_YET 0
 
 
@@ -47,12 +423,64 @@ void usage(char *);
 
 #define M_STD_ADDED       "Student %d added to database.\n"
 #define M_STD_DEL_MSG     "Student %d was deleted from database.\n"
+#define M_STD_UPDATED     "Student %d updated in database.\n"
+#define M_ERR_UPD_NONE    "Cant update, give --fname, --lname or --gpa!\n"
+#define M_ERR_UPD_GPA     "Cant update student, GPA out of allowable range!\n"
 #define M_STD_NOT_FND_MSG "Student %d was not found in database.\n"
 #define M_DB_COMPRESSED_OK "Database successfully compressed!\n"
+#define M_NAME_NOT_FND    "No student named %s%s%s was found in database.\n"
+#define M_NAME_IDX_REBUILT "Name index rebuilt, %d student record(s).\n"
+#define M_GPA_NOT_FND     "No student with a GPA from %.2f to %.2f was found in database.\n"
+#define M_ERR_GPA_RNG     "Cant search, GPA range must be low high within 0 and 500!\n"
+#define M_AGG_AVG         "GPA average %.2f over %d student(s)\n"
+#define M_AGG_MIN         "GPA minimum %.2f\n"
+#define M_AGG_MAX         "GPA maximum %.2f\n"
+#define M_ERR_AGG         "Unknown aggregate %s, use avg, min, max or hist\n"
+#define M_ERR_FORMAT      "Unknown format %s, use table, csv, tsv or jsonl\n"
+#define M_ERR_SORT        "Unknown sort key %s, use lname, fname or gpa, with :desc to reverse\n"
+#define M_ERR_SORT_THREADS "Cant print, --sort and --threads can not be combined!\n"
+#define M_ERR_QUERY       "Cant run query, it does not make sense from: %s\n"
+#define M_ERR_QUERY_ARGS  "Cant run query, --count does not print rows!\n"
+#define M_DB_QUERY_CNT    "%d student record(s) match.\n"
+#define M_QUERY_NOT_FND   "No student records match the query.\n"
+#define M_ERR_THREADS     "Cant print, the number of threads must be from 1 to %d!\n"
+#define M_ERR_TOP_CNT     "Cant search, the number of students must be at least 1!\n"
+#define M_ERR_FIND_ID     "Cant search, %s is not a student id!\n"
+#define M_DB_RECLAIMED    "Reclaimed %lld bytes of disk space.\n"
 #define M_DB_ZERO_OK      "All database records removed!\n"
 #define M_DB_EMPTY        "Database contains no student records.\n"
 #define M_DB_RECORD_CNT   "Database contains %d student record(s).\n"
 #define M_NOT_IMPL        "The requested operation is not implemented yet!\n"
+#define M_ERR_DB_FORMAT   "Unsupported DB file format, exiting!\n"
+#define M_DB_GPA_STATS    "GPA average %.2f, minimum %.2f, maximum %.2f\n"
+#define M_DB_GPA_HIST     "  %.2f - %.2f  %u\n"
+#define M_DB_STATS_REBUILT "Database statistics rebuilt, %d student record(s).\n"
+#define M_DB_CONVERTED    "Database converted to the %s format.\n"
+#define M_ERR_CONVERT_FMT "Unknown DB file format %s, use direct or paged\n"
+#define M_ERR_CONVERT_ID  "Cant convert, student %d does not fit the direct format!\n"
+#define M_DB_SNAPSHOT     "Database snapshot written to %s as a %s.\n"
+#define M_DB_RESTORED     "Database restored from %s, %d student record(s).\n"
+#define M_ERR_SNAP_OPEN   "Cant open snapshot %s\n"
+#define M_ERR_SNAP_BAD    "Cant restore, %s is not a complete database snapshot!\n"
+
+#define M_ERR_BULK_INPUT  "Cant open bulk load input %s\n"
+#define M_BULK_SUMMARY    "Loaded %d student(s), rejected %d row(s) in %.3f sec (%.0f rows/sec).\n"
+#define M_BULK_REJECT     "Rejected line %ld (%s): %s\n"
+#define M_UPD_SUMMARY     "Updated %d student(s), rejected %d row(s) in %.3f sec (%.0f rows/sec).\n"
+
+#define M_ERR_WAL_LEVEL   "Unknown WAL durability %s, use none, batched or per-op\n"
+#define M_ERR_BACKEND     "Unknown backend %s, use fd, mmap, mem or log\n"
+#define M_ERR_WAL_OPEN    "Error opening the write-ahead log, exiting!\n"
+#define M_ERR_WAL_SYNC    "Error syncing the write-ahead log!\n"
+#define M_ERR_INSTR_MODE  "Unknown stats format %s, use table or json\n"
+#define M_ERR_INSTR_OFF   "Instrumentation is not built in, rebuild with make INSTR=1\n"
+
+#define M_SRV_START       "Serving %s on %s\n"
+#define M_SRV_STOP        "Server stopped.\n"
+#define M_ERR_SRV_SOCKET  "Error creating server socket %s, exiting!\n"
+#define M_ERR_CLI_CONNECT "Error connecting to server socket %s, exiting!\n"
+#define M_ERR_CLI_COMM    "Error communicating with server, exiting!\n"
+#define M_ERR_CLI_STDIN   "Reading from stdin or writing to stdout is not supported through a server.\n"
 
 //useful format strings for print students
 //For example to print the header in the required output:
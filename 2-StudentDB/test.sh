@@ -8,6 +8,11 @@ setup_file() {
     fi
 }
 
+# --stats only counts in a build with instrumentation (make INSTR=1)
+instr_built() {
+    ! ./sdbsc --stats -c 2>&1 >/dev/null | grep -q "^Instrumentation is not built in"
+}
+
 @test "Check if database is empty to start" {
     run ./sdbsc -p
     [ "$status" -eq 0 ]
@@ -194,4 +199,778 @@ setup_file() {
         echo "Failed Output:  $output"
         return 1
     }
-}
\ No newline at end of file
+}
+
+@test "mmap backend sees the same records" {
+    run ./sdbsc -f 3 --mmap
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')
+    [ "$normalized_output" = "3 jane doe 3.90" ] || {
+        echo "Failed Output:  $normalized_output"
+        return 1
+    }
+}
+
+@test "mmap backend grows the file like the fd backend" {
+    run ./sdbsc --mmap -a 200 mm apped 250
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Student 200 added to database." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run stat --format="%s" ./student.db
+    [ "${lines[0]}" = "12864" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -d 200
+    [ "$status" -eq 0 ]
+}
+
+@test "Bulk load students from stdin" {
+    run bash -c 'printf "10,bulk,one,300\n11,bulk,two,310\n3,dup,student,300\n12,bad,gpa,900\n" | ./sdbsc -L -'
+    [ "$status" -eq 0 ]
+    [[ "${lines[0]}" == "Loaded 2 student(s), rejected 2 row(s) in "* ]] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "${lines[1]}" = "Rejected line 3 (duplicate id): 3,dup,student,300" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "${lines[2]}" = "Rejected line 4 (id or gpa out of range): 12,bad,gpa,900" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Server mode serves client operations" {
+    ./sdbsc --serve ./test.sock > ./test.sock.log 3>&- &
+    server=$!
+    # the server announces itself once it is listening
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        grep -q "^Serving" ./test.sock.log && break
+        sleep 0.1
+    done
+
+    run ./sdbsc --connect ./test.sock -f 3
+    found_status=$status
+    normalized_output=$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')
+
+    run ./sdbsc --connect ./test.sock -f 4
+    missing_status=$status
+    missing_output=$output
+
+    kill $server
+    wait $server
+    rm -f ./test.sock.log
+
+    [ "$found_status" -eq 0 ]
+    [ "$normalized_output" = "3 jane doe 3.90" ] || {
+        echo "Failed Output:  $normalized_output"
+        return 1
+    }
+    [ "$missing_status" -eq 1 ]
+    [ "$missing_output" = "Student 4 was not found in database." ] || {
+        echo "Failed Output:  $missing_output"
+        return 1
+    }
+}
+
+@test "Stats come from the header and can be rebuilt" {
+    run ./sdbsc -s
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "${lines[1]}" = "GPA average 3.26, minimum 2.85, maximum 3.90" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc --rebuild-stats -c
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database statistics rebuilt, 5 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "${lines[1]}" = "Database contains 5 student record(s)." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+}
+
+@test "Delete with --punch releases the block and compress reports space" {
+    run ./sdbsc -a 64 punch me 300
+    [ "$status" -eq 0 ]
+    run ./sdbsc -a 65 punch me 300
+    [ "$status" -eq 0 ]
+    blocks_before=$(stat -c %b student.db)
+
+    run ./sdbsc -d 64
+    [ "$status" -eq 0 ]
+    run ./sdbsc -d 65 --punch
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Student 65 was deleted from database." ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    blocks_after=$(stat -c %b student.db)
+    [ "$blocks_after" -lt "$blocks_before" ] || {
+        echo "Blocks before $blocks_before after $blocks_after"
+        return 1
+    }
+
+    run ./sdbsc -x
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database successfully compressed!" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [[ "${lines[1]}" =~ ^Reclaimed\ [0-9]+\ bytes\ of\ disk\ space\.$ ]] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+    [ "$(stat -c %s student.db)" -eq 4096 ]
+
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ]
+}
+
+@test "Find students by name through the name index" {
+    run ./sdbsc -n do
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST NAME LAST_NAME GPA 3 jane doe 3.90 63 jim doe 2.85 1 john doe 3.45"
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        return 1
+    }
+
+    # the index follows deletes and adds
+    ./sdbsc -d 63
+    ./sdbsc -a 70 jill doe 300
+    run ./sdbsc -n doe ji
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    [ "$normalized_output" = "ID FIRST NAME LAST_NAME GPA 70 jill doe 3.00" ] || {
+        echo "Failed Output: $normalized_output"
+        return 1
+    }
+
+    run ./sdbsc -n smith
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "No student named smith was found in database." ]
+}
+
+@test "GPA range and top-K queries" {
+    run ./sdbsc -g 300 310
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    expected_output="ID FIRST NAME LAST_NAME GPA 10 bulk one 3.00 70 jill doe 3.00 11 bulk two 3.10"
+    [ "$normalized_output" = "$expected_output" ] || {
+        echo "Failed Output: $normalized_output"
+        return 1
+    }
+
+    run ./sdbsc -t 2
+    [ "$status" -eq 0 ]
+    normalized_output=$(echo -n "$output" | tr -s '[:space:]' ' ')
+    [ "$normalized_output" = "ID FIRST NAME LAST_NAME GPA 3 jane doe 3.90 1 john doe 3.45" ] || {
+        echo "Failed Output: $normalized_output"
+        return 1
+    }
+
+    run ./sdbsc -g 400 300
+    [ "$status" -eq 2 ]
+}
+
+@test "GPA aggregates from the column agree across SIMD kernels" {
+    run ./sdbsc -A avg
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "GPA average 3.29 over 5 student(s)" ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    expected=$(./sdbsc -s | tail -n +3)
+    for k in scalar sse2 avx2; do
+        run env SDBSC_SIMD=$k ./sdbsc -A hist
+        [ "$status" -eq 0 ]
+        [ "$output" = "$expected" ] || {
+            echo "Failed Output ($k):  $output"
+            return 1
+        }
+        run env SDBSC_SIMD=$k ./sdbsc -A min
+        [ "${lines[0]}" = "GPA minimum 3.00" ]
+        run env SDBSC_SIMD=$k ./sdbsc -A max
+        [ "${lines[0]}" = "GPA maximum 3.90" ]
+    done
+}
+
+@test "Parallel print matches the plain print" {
+    expected=$(./sdbsc -p)
+    for n in 1 2 7; do
+        run ./sdbsc -p --threads $n
+        [ "$status" -eq 0 ]
+        [ "$output" = "$expected" ] || {
+            echo "Failed Output (--threads $n):  $output"
+            return 1
+        }
+    done
+
+    run ./sdbsc --mmap -p --threads 3
+    [ "$output" = "$expected" ]
+
+    run ./sdbsc -p --threads 0
+    [ "$status" -eq 2 ]
+}
+
+@test "Print exports csv, tsv and jsonl" {
+    ./sdbsc -a 80 'o"neil,jr' 'back\slash' 250
+
+    run ./sdbsc -p --format csv
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "id,fname,lname,gpa" ]
+    [ "${lines[1]}" = "1,john,doe,3.45" ]
+    [ "${lines[6]}" = '80,"o""neil,jr",back\slash,2.50' ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    run ./sdbsc -p --format tsv --threads 2
+    [ "$status" -eq 0 ]
+    [ "${lines[2]}" = "$(printf '3\tjane\tdoe\t3.90')" ]
+    [ "${lines[6]}" = "$(printf '80\to"neil,jr\tback\\\\slash\t2.50')" ]
+
+    run ./sdbsc -p --format jsonl
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = '{"id":1,"fname":"john","lname":"doe","gpa":3.45}' ]
+    [ "${lines[5]}" = '{"id":80,"fname":"o\"neil,jr","lname":"back\\slash","gpa":2.50}' ] || {
+        echo "Failed Output:  $output"
+        return 1
+    }
+
+    ./sdbsc -d 80
+    run ./sdbsc -p --format xml
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Unknown format xml, use table, csv, tsv or jsonl" ]
+}
+
+@test "Write-ahead log replays changes lost from the database file" {
+    # a process that exits checkpoints its log, one killed leaves it
+    ./sdbsc --wal per-op --serve ./test.sock > ./test.sock.log 3>&- &
+    server=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        grep -q "^Serving" ./test.sock.log && break
+        sleep 0.1
+    done
+    run ./sdbsc --connect ./test.sock -a 90 wal test 200
+    kill -9 $server
+    wait $server || true
+    rm -f ./test.sock.log
+    [ "$status" -eq 0 ]
+    [ -s student.db.wal ]
+
+    # lose the in place write, as a crash before writeback would
+    dd if=/dev/zero of=student.db bs=64 seek=90 count=1 conv=notrunc 2>/dev/null
+    run ./sdbsc -f 90
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "90     wal                      test                             2.00" ]
+    [ ! -s student.db.wal ]
+
+    run env SDBSC_WAL=batched ./sdbsc -d 90
+    [ "$status" -eq 0 ]
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ]
+
+    # a log a running server holds is live, another server that opened
+    # the database before it was written changes it without the log, and
+    # later processes must not replay the log over that change
+    ./sdbsc --wal batched --serve ./test.sock > ./test.sock.log 3>&- &
+    server=$!
+    ./sdbsc --serve ./test2.sock > ./test2.sock.log 3>&- &
+    server2=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        grep -q "^Serving" ./test.sock.log && grep -q "^Serving" ./test2.sock.log && break
+        sleep 0.1
+    done
+    ./sdbsc --connect ./test.sock -a 91 wal live 210
+    ./sdbsc --connect ./test2.sock -d 91
+    run ./sdbsc -f 91
+    live_status=$status
+    kill $server $server2
+    wait $server $server2
+    rm -f ./test.sock.log ./test2.sock.log
+    [ "$live_status" -eq 1 ]
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ]
+    [ ! -s student.db.wal ]
+
+    # a short --wal command leaves no log behind for a later process to
+    # replay over what a server that opened the database earlier changed
+    ./sdbsc --serve ./test.sock > ./test.sock.log 3>&- &
+    server=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        grep -q "^Serving" ./test.sock.log && break
+        sleep 0.1
+    done
+    ./sdbsc --wal batched -a 5 joe smith 350
+    [ ! -s student.db.wal ]
+    ./sdbsc --connect ./test.sock -d 5
+    run ./sdbsc --connect ./test.sock -f 5
+    served_status=$status
+    kill $server
+    wait $server
+    rm -f ./test.sock.log
+    [ "$served_status" -eq 1 ]
+    run ./sdbsc -f 5
+    [ "$status" -eq 1 ]
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ]
+
+    run ./sdbsc --wal sometimes -c
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Unknown WAL durability sometimes, use none, batched or per-op" ]
+}
+
+@test "Concurrent adds of the same id store it once" {
+    for i in 1 2 3 4 5 6 7 8; do
+        ./sdbsc -a 95 race "run$i" 100 > race.$i.out &
+    done
+    wait
+
+    run cat race.1.out race.2.out race.3.out race.4.out race.5.out race.6.out race.7.out race.8.out
+    rm -f race.*.out
+    [ "$(echo "$output" | grep -c "added to database")" -eq 1 ]
+
+    ./sdbsc -d 95
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ]
+    run ./sdbsc --rebuild-stats -c
+    [ "${lines[0]}" = "Database statistics rebuilt, 5 student record(s)." ]
+}
+
+@test "Writers waiting behind a convert land in the new file" {
+    for i in $(seq 1000 1199); do
+        ./sdbsc -a $i wait convert 300 > /dev/null &
+    done
+    for r in 1 2 3; do
+        ./sdbsc --convert paged > /dev/null
+        ./sdbsc --convert direct > /dev/null
+    done
+    wait
+
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 205 student record(s)." ]
+
+    for i in $(seq 1000 1199); do
+        ./sdbsc -d $i > /dev/null &
+    done
+    for r in 1 2 3; do
+        ./sdbsc --convert paged > /dev/null
+        ./sdbsc --convert direct > /dev/null
+    done
+    wait
+
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ]
+    run ./sdbsc --rebuild-stats -c
+    [ "${lines[0]}" = "Database statistics rebuilt, 5 student record(s)." ]
+}
+
+@test "Paged format holds ids beyond 100000" {
+    ./sdbsc -p > direct.out
+
+    run ./sdbsc --convert paged
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database converted to the paged format." ]
+
+    run ./sdbsc -a 2000000000 wide id 377
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Student 2000000000 added to database." ]
+
+    run ./sdbsc -f 2000000000
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "2000000000 wide                     id                               3.77" ]
+
+    run ./sdbsc -p --threads 2
+    [ "$status" -eq 0 ]
+    [ "${lines[6]}" = "2000000000 wide                     id                               3.77" ]
+
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 6 student record(s)." ]
+    run ./sdbsc -t 1
+    [ "${lines[1]}" = "3      jane                     doe                              3.90" ]
+    run ./sdbsc -g 370 380
+    [ "${lines[1]}" = "2000000000 wide                     id                               3.77" ]
+    run ./sdbsc -A max
+    [ "${lines[0]}" = "GPA maximum 3.90" ]
+
+    # a direct file would need 128 GB for that id
+    [ "$(stat -c %s student.db)" -lt 1048576 ]
+
+    run ./sdbsc --convert direct
+    [ "$status" -eq 1 ]
+    [ "${lines[0]}" = "Cant convert, student 2000000000 does not fit the direct format!" ]
+
+    ./sdbsc -d 2000000000
+    run ./sdbsc --convert direct
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database converted to the direct format." ]
+
+    run ./sdbsc -p
+    [ "$output" = "$(cat direct.out)" ]
+    rm -f direct.out
+}
+
+@test "Buffer pool writes its changes back for other processes" {
+    ./sdbsc --serve ./test.sock --cache > ./test.sock.log 3>&- &
+    server=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        grep -q "^Serving" ./test.sock.log && break
+        sleep 0.1
+    done
+
+    ./sdbsc --connect ./test.sock -a 96 pool one 310
+    ./sdbsc --connect ./test.sock -a 97 pool two 320
+    ./sdbsc --connect ./test.sock -d 97
+
+    # a process of its own waits for the server to let go of the file
+    run ./sdbsc -f 96
+    direct_status=$status
+    direct_row=$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')
+    run ./sdbsc -f 97
+    deleted_status=$status
+
+    kill $server
+    wait $server
+    rm -f ./test.sock.log
+
+    [ "$direct_status" -eq 0 ]
+    [ "$direct_row" = "96 pool one 3.10" ]
+    [ "$deleted_status" -eq 1 ]
+
+    run ./sdbsc --cache -d 96
+    [ "$status" -eq 0 ]
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 5 student record(s)." ]
+}
+
+@test "Find many ids in one batch" {
+    ./sdbsc -a 31 many one 301
+    ./sdbsc -a 2000 many two 302
+    ./sdbsc -a 33 many three 303
+
+    run ./sdbsc -f 2000 32 31
+    [ "$status" -eq 1 ]
+    [ "$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')" = "2000 many two 3.02" ]
+    [ "$(echo -n "${lines[2]}" | tr -s '[:space:]' ' ')" = "31 many one 3.01" ]
+    [ "${lines[3]}" = "Student 32 was not found in database." ]
+
+    run bash -c "echo '33 31' | ./sdbsc -f -"
+    [ "$status" -eq 0 ]
+    [ "$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')" = "33 many three 3.03" ]
+    [ "$(echo -n "${lines[2]}" | tr -s '[:space:]' ' ')" = "31 many one 3.01" ]
+
+    run ./sdbsc -f 31 abc
+    [ "$status" -eq 2 ]
+
+    # a few hundred ids, on the command line or from stdin, go through a
+    # server as they run locally
+    ./sdbsc --serve ./test.sock > ./test.sock.log 3>&- &
+    server=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        grep -q "^Serving" ./test.sock.log && break
+        sleep 0.1
+    done
+    run ./sdbsc --connect ./test.sock -f $(seq 1 400)
+    served_status=$status
+    served_output=$output
+    run bash -c "seq 1 400 | ./sdbsc --connect ./test.sock -f -"
+    piped_status=$status
+    piped_output=$output
+    kill $server
+    wait $server
+    rm -f ./test.sock.log
+
+    run ./sdbsc -f $(seq 1 400)
+    [ "$status" -eq 1 ]
+    [ "${#lines[@]}" -gt 400 ]
+    [ "$served_status" -eq "$status" ]
+    [ "$served_output" = "$output" ]
+    [ "$piped_status" -eq "$status" ]
+    [ "$piped_output" = "$output" ]
+}
+
+@test "Snapshot and restore the database" {
+    rm -f ./test.snap ./test.stream
+    ./sdbsc -z
+    ./sdbsc -a 41 snap one 341
+    ./sdbsc -a 99000 snap two 342
+
+    run ./sdbsc --snapshot ./test.snap
+    [ "$status" -eq 0 ]
+    [ "$(stat -c %s ./test.snap)" = "$(stat -c %s student.db)" ]
+    ./sdbsc --snapshot - > ./test.stream
+
+    ./sdbsc -d 41
+    ./sdbsc -a 42 snap three 343
+    run ./sdbsc --restore ./test.snap
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database restored from ./test.snap, 2 student record(s)." ]
+    run ./sdbsc -f 41 99000
+    [ "$status" -eq 0 ]
+    run ./sdbsc -f 42
+    [ "$status" -eq 1 ]
+    run ./sdbsc -n t
+    [ "${#lines[@]}" -eq 2 ]
+
+    # a running server moves over to a database restored under it
+    ./sdbsc --serve ./test.sock > ./test.sock.log 3>&- &
+    server=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        grep -q "^Serving" ./test.sock.log && break
+        sleep 0.1
+    done
+    ./sdbsc --connect ./test.sock -c
+    ./sdbsc --restore ./test.snap
+    ./sdbsc --connect ./test.sock -a 43 snap four 344
+    run ./sdbsc -f 43
+    found_status=$status
+    kill $server
+    wait $server
+    rm -f ./test.sock.log
+    [ "$found_status" -eq 0 ]
+
+    ./sdbsc -z
+    run bash -c "cat ./test.stream | ./sdbsc --restore - -c"
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "Database contains 2 student record(s)." ]
+
+    head -c 100 ./test.stream > ./test.snap
+    run ./sdbsc --restore ./test.snap
+    [ "$status" -eq 1 ]
+    run ./sdbsc -c
+    [ "${lines[0]}" = "Database contains 2 student record(s)." ]
+    rm -f ./test.snap ./test.stream
+}
+
+@test "Instrumentation summary with --stats" {
+    ./sdbsc -a 51 stats one 351
+
+    if ! instr_built; then
+        run bash -c "./sdbsc --stats -f 51 2>&1 >/dev/null"
+        [ "$status" -eq 0 ]
+        [ "$output" = "Instrumentation is not built in, rebuild with make INSTR=1" ]
+        skip "built with make INSTR=0"
+    fi
+
+    run bash -c "./sdbsc --stats -f 51 2>&1 >/dev/null"
+    [ "$status" -eq 0 ]
+    [ "${lines[0]%% *}" = "stats" ]
+    [[ "$output" == *"syscalls"* ]]
+    [[ "$output" == *"read"* ]]
+
+    # the summary stays off stdout
+    run bash -c "./sdbsc --stats -f 51 2>/dev/null"
+    [ "$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')" = "51 stats one 3.51" ]
+    [ "${#lines[@]}" -eq 2 ]
+
+    run bash -c "SDBSC_STATS=json ./sdbsc -p 2>&1 >/dev/null"
+    [[ "$output" == "{\"syscalls\": "* ]]
+    [[ "$output" == *"\"live\": "* ]]
+
+    run bash -c "SDBSC_STATS=xml ./sdbsc -c"
+    [ "$status" -eq 2 ]
+}
+
+@test "Update students in place with -u" {
+    ./sdbsc -z
+    ./sdbsc -a 61 upd one 300
+    ./sdbsc -a 62 upd two 310
+
+    run ./sdbsc -u 61 --gpa 395 --lname uno
+    [ "$status" -eq 0 ]
+    [ "$output" = "Student 61 updated in database." ]
+    run ./sdbsc -f 61
+    [ "$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')" = "61 upd uno 3.95" ]
+
+    # a GPA change alone writes only the GPA field and the header
+    if instr_built; then
+        run bash -c "./sdbsc --backend fd --stats -u 62 --gpa 320 2>&1 >/dev/null | grep '^write'"
+        [ "$(echo "$output" | tr -s ' ' | cut -d' ' -f2)" -eq 2 ]
+    else
+        ./sdbsc -u 62 --gpa 320
+    fi
+
+    run ./sdbsc -u 63 --gpa 100
+    [ "$status" -eq 1 ]
+    run ./sdbsc -u 61 --gpa 501
+    [ "$status" -eq 2 ]
+    run ./sdbsc -u 61
+    [ "$status" -eq 2 ]
+
+    run bash -c "printf '61,,,200\n62,Two,,\n64,,,100\n' | ./sdbsc -u -"
+    [ "$status" -eq 0 ]
+    [[ "${lines[0]}" == "Updated 2 student(s), rejected 1 row(s)"* ]]
+    [ "${lines[1]}" = "Rejected line 3 (student not in database): 64,,,100" ]
+    run ./sdbsc -f 62
+    [ "$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')" = "62 Two two 3.20" ]
+    run ./sdbsc -s
+    [ "${lines[1]}" = "GPA average 2.60, minimum 2.00, maximum 3.20" ]
+}
+
+@test "Storage backends selected with --backend" {
+    ./sdbsc -z
+    run ./sdbsc --backend mem -a 71 in memory 371
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Student 71 added to database." ]
+
+    # the mem backend writes its changes back when it detaches
+    run ./sdbsc --backend fd -f 71
+    [ "$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')" = "71 in memory 3.71" ]
+    run ./sdbsc --backend mmap -u 71 --gpa 300
+    [ "$status" -eq 0 ]
+    run bash -c "SDBSC_BACKEND=mem ./sdbsc -p --format csv"
+    [ "${lines[1]}" = "71,in,memory,3.00" ]
+
+    # slots never written stay holes
+    run stat --format="%s" ./student.db
+    [ "${lines[0]}" = "4608" ]
+
+    run ./sdbsc --backend disk -c
+    [ "$status" -eq 2 ]
+}
+
+@test "Log backend appends changes and merges them into the file" {
+    ./sdbsc -z
+    run ./sdbsc --backend log -a 81 log one 381
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Student 81 added to database." ]
+    ./sdbsc --backend log -a 82 log two 382
+    run ./sdbsc --backend log -d 81
+    [ "${lines[0]}" = "Student 81 was deleted from database." ]
+
+    # the segments are merged into the file and removed when it detaches
+    run bash -c "ls student.db.seg.* 2>/dev/null"
+    [ "$output" = "" ]
+    run ./sdbsc --backend fd -f 82
+    [ "$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')" = "82 log two 3.82" ]
+    run ./sdbsc --backend fd -f 81
+    [ "${lines[0]}" = "Student 81 was not found in database." ]
+
+    run ./sdbsc --backend log -x
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "Database successfully compressed!" ]
+    run ./sdbsc --backend log -c
+    [ "${lines[0]}" = "Database contains 1 student record(s)." ]
+}
+
+@test "Print sorted with --sort, spilling runs past the memory budget" {
+    ./sdbsc -z
+    ./sdbsc -a 91 Cara Smith 310
+    ./sdbsc -a 92 Abe Jones 390
+    ./sdbsc -a 93 Bea Smith 310
+    ./sdbsc -a 94 Dan Adams 250
+
+    run ./sdbsc -p --sort lname --format csv
+    [ "$status" -eq 0 ]
+    [ "${lines[1]}" = "94,Dan,Adams,2.50" ]
+    [ "${lines[2]}" = "92,Abe,Jones,3.90" ]
+    [ "${lines[3]}" = "93,Bea,Smith,3.10" ]
+    [ "${lines[4]}" = "91,Cara,Smith,3.10" ]
+
+    # equal GPAs stay in id order when reversed
+    run ./sdbsc -p --sort gpa:desc --format csv
+    [ "${lines[1]}" = "92,Abe,Jones,3.90" ]
+    [ "${lines[2]}" = "91,Cara,Smith,3.10" ]
+    [ "${lines[3]}" = "93,Bea,Smith,3.10" ]
+
+    # a tiny budget sorts in runs on disk and merges them to the same order
+    expected=$(./sdbsc -p --sort fname)
+    run bash -c "SDBSC_SORT_MEM=1 ./sdbsc -p --sort fname"
+    [ "$output" = "$expected" ]
+    [ "$(echo -n "${lines[1]}" | tr -s '[:space:]' ' ')" = "92 Abe Jones 3.90" ]
+
+    run ./sdbsc -p --sort age
+    [ "$status" -eq 2 ]
+}
+
+@test "Query students with -q predicates" {
+    ./sdbsc -z
+    ./sdbsc -a 101 Sam Smith 360
+    ./sdbsc -a 102 Sal Smythe 340
+    ./sdbsc -a 103 Ann Jones 390
+    ./sdbsc -a 204 Bo Smith 355
+
+    run ./sdbsc -q "gpa>=350 and lname^=Sm" --format csv
+    [ "$status" -eq 0 ]
+    [ "${#lines[@]}" -eq 3 ]
+    [ "${lines[1]}" = "101,Sam,Smith,3.60" ]
+    [ "${lines[2]}" = "204,Bo,Smith,3.55" ]
+
+    run ./sdbsc -q "id=101..199 and not lname=Jones" --count
+    [ "${lines[0]}" = "2 student record(s) match." ]
+    run ./sdbsc -q "gpa=3.55..3.90 or fname=Sal" --sort gpa:desc --format csv
+    [ "${lines[1]}" = "103,Ann,Jones,3.90" ]
+    [ "${lines[4]}" = "102,Sal,Smythe,3.40" ]
+
+    # a query for ids past the last student matches nothing
+    run ./sdbsc -q "id>=300"
+    [ "$status" -eq 0 ]
+    [ "${lines[0]}" = "No student records match the query." ]
+    run ./sdbsc -q "id>=300" --sort gpa
+    [ "${lines[0]}" = "No student records match the query." ]
+
+    run ./sdbsc -q "gpa^=3"
+    [ "$status" -eq 2 ]
+    [ "${lines[0]}" = "Cant run query, it does not make sense from: ^=3" ]
+}
+
+@test "Live slots are found the same by every SIMD kernel" {
+    ./sdbsc -z
+    # students and holes on both sides of the 64 slot words, 10 left
+    # in 131 slots, neither a multiple of 4
+    for id in 1 2 3 62 63 64 65 66 67 126 127 128 129 130; do
+        ./sdbsc -a $id s$id edge 300
+    done
+    for id in 2 64 127 129; do
+        ./sdbsc -d $id
+    done
+    cp student.db student.db.simd
+
+    expected=$(SDBSC_SIMD=scalar ./sdbsc -p)
+    [ "$(echo "$expected" | wc -l)" -eq 11 ]
+    expected_x=$(SDBSC_SIMD=scalar ./sdbsc -x)
+    expected_size=$(stat --format="%s" ./student.db)
+
+    for k in scalar sse2 avx2; do
+        cp student.db.simd student.db
+        run env SDBSC_SIMD=$k ./sdbsc -p
+        [ "$status" -eq 0 ]
+        [ "$output" = "$expected" ] || {
+            echo "Failed Output ($k):  $output"
+            return 1
+        }
+        run env SDBSC_SIMD=$k ./sdbsc -p --threads 2
+        [ "$output" = "$expected" ]
+
+        run env SDBSC_SIMD=$k ./sdbsc -x
+        [ "$status" -eq 0 ]
+        [ "$output" = "$expected_x" ]
+        [ "$(stat --format="%s" ./student.db)" = "$expected_size" ]
+        run ./sdbsc -p
+        [ "$output" = "$expected" ]
+    done
+    rm -f student.db.simd
+}